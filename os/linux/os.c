@@ -4,6 +4,9 @@
 #include <grp.h>
 #include <pwd.h>
 #include <time.h>
+#ifdef __x86_64__
+#include <cpuid.h>
+#endif
 #include "os.h"
 #include "../../src/scopestdlib.h"
 #include "../../src/dbg.h"
@@ -298,95 +301,113 @@ osGetProcUidGid(pid_t pid, uid_t *uid, gid_t *gid)
     return -1;
 }
 
-int
-osGetProcMemory(pid_t pid)
+// Fields of /proc/<pid>/stat, counted from the one after the command
+#define PROC_STAT_NUM_THREADS  17   // field 20
+#define PROC_STAT_VSIZE        20   // field 23, in bytes
+#define PROC_STAT_RSS_PAGES    21   // field 24, in pages
+
+/*
+ * proc.mem, proc.rss, proc.thread and proc.child all come from
+ * /proc/<pid>/stat; the periodic thread reads it once for all of them.
+ */
+bool
+osGetProcStat(pid_t pid, proc_stat_t *stat)
 {
-    int fd;
-    long result;
-    char *start, *entry, *last;
-    const char delim[] = ":";
-    char buf[2048];
+    int fd, i;
+    ssize_t len;
+    char *entry, *last;
+    char buf[1024];
 
-    scope_snprintf(buf, sizeof(buf), "/proc/%d/status", pid);
+    if (!stat) return FALSE;
+
+    scope_snprintf(buf, sizeof(buf), "/proc/%d/stat", pid);
     if ((fd = scope_open(buf, O_RDONLY)) == -1) {
         DBG(NULL);
-        return -1;
+        return FALSE;
     }
 
-    if (scope_read(fd, buf, sizeof(buf)) == -1) {
+    len = scope_read(fd, buf, sizeof(buf) - 1);
+    scope_close(fd);
+    if (len <= 0) {
         DBG(NULL);
-        scope_close(fd);
-        return -1;
+        return FALSE;
     }
+    buf[len] = '\0';
 
-    if ((start = scope_strstr(buf, "VmSize")) == NULL) {
+    // The command is in parens, and can have spaces (or parens) of its own
+    if ((entry = scope_strrchr(buf, ')')) == NULL) {
         DBG(NULL);
-        scope_close(fd);
-        return -1;        
+        return FALSE;
     }
-    
-    entry = scope_strtok_r(start, delim, &last);
-    entry = scope_strtok_r(NULL, delim, &last);
-    if (entry == NULL) {
-        DBG(NULL);
-        scope_close(fd);
-        return -1;        
+
+    long threads = 0, vsize = 0, rss = 0;
+    entry = scope_strtok_r(entry + 1, " ", &last);
+    for (i = 0; entry && (i <= PROC_STAT_RSS_PAGES); i++) {
+        if (i == PROC_STAT_NUM_THREADS) threads = scope_strtol(entry, NULL, 10);
+        if (i == PROC_STAT_VSIZE) vsize = scope_strtol(entry, NULL, 10);
+        if (i == PROC_STAT_RSS_PAGES) rss = scope_strtol(entry, NULL, 10);
+        entry = scope_strtok_r(NULL, " ", &last);
     }
-    
-    if ((result = scope_strtol(entry, NULL, 0)) == (long)0) {
+    if (!threads || !vsize) {
         DBG(NULL);
-        scope_close(fd);
-        return -1;
+        return FALSE;
     }
-    
-    scope_close(fd);
-    return (int)result;
+
+    stat->threads = threads;
+    stat->vsize = vsize / 1024;
+    stat->rss = rss * (scope_getpagesize() / 1024);
+    return TRUE;
 }
 
+// VmSize, in KiB
 int
-osGetNumThreads(pid_t pid)
+osGetProcMemory(pid_t pid)
 {
-    int fd, i;
-    long result;
-    char *entry, *last;
-    const char delim[] = " ";
-    char buf[1024];
+    proc_stat_t stat;
+    if (!osGetProcStat(pid, &stat)) return -1;
 
-    // Get the size of the file with stat, malloc buf then scope_free
-    scope_snprintf(buf, sizeof(buf), "/proc/%d/stat", pid);
-    if ((fd = scope_open(buf, O_RDONLY)) == -1) {
-        DBG(NULL);
-        return -1;
-    }
+    return (int)stat.vsize;
+}
 
-    if (scope_read(fd, buf, sizeof(buf)) == -1) {
-        DBG(NULL);
-        scope_close(fd);
-        return -1;
-    }
+// Resident set size, in KiB
+int
+osGetProcRss(pid_t pid)
+{
+    proc_stat_t stat;
+    if (!osGetProcStat(pid, &stat)) return -1;
 
-    entry = scope_strtok_r(buf, delim, &last);
-    for (i = 1; i < 20; i++) {
-        entry = scope_strtok_r(NULL, delim, &last);
-    }
-    scope_close(fd);
+    return (int)stat.rss;
+}
 
-    if ((result = scope_strtol(entry, NULL, 0)) == (long)0) {
-        DBG(NULL);
-        return -1;
-    }
-    return (int)result;
+int
+osGetNumThreads(pid_t pid)
+{
+    proc_stat_t stat;
+    if (!osGetProcStat(pid, &stat)) return -1;
+
+    return (int)stat.threads;
 }
 
+/*
+ * Since Linux 6.2, the size of /proc/<pid>/fd is the number of open
+ * descriptors; the kernel counts them without listing them. A process
+ * with many of them isn't charged for a directory read every period.
+ */
 int
 osGetNumFds(pid_t pid)
 {
     int nfile = 0;
     DIR *dirp;
     struct dirent *entry;
+    struct stat sb;
     char buf[1024];
 
     scope_snprintf(buf, sizeof(buf), "/proc/%d/fd", pid);
+    if ((scope_stat(buf, &sb) == 0) && (sb.st_size > 0)) {
+        return (int)sb.st_size;
+    }
+
+    // An older kernel; count them
     if ((dirp = scope_opendir(buf)) == NULL) {
         DBG(NULL);
         return -1;
@@ -402,36 +423,233 @@ osGetNumFds(pid_t pid)
     return nfile - 1; // we opened one fd to read /fd :)
 }
 
+// What counting the entries in /proc/<pid>/task, but for this one, gives
 int
 osGetNumChildProcs(pid_t pid)
 {
-    int nchild = 0;
-    DIR *dirp;
-    struct dirent * entry;
-    char buf[1024];
+    proc_stat_t stat;
+    if (!osGetProcStat(pid, &stat)) return -1;
 
-    scope_snprintf(buf, sizeof(buf), "/proc/%d/task", pid);
-    if ((dirp = scope_opendir(buf)) == NULL) {
+    return (int)stat.threads - 1;
+}
+
+/*
+ * The files the rest of the proc metrics come from are opened, read and
+ * closed every period. Keeping them open would have them counted in
+ * proc.fd, and an application can close descriptors it didn't open
+ * (daemons often close all of them); the number can then go to one of
+ * its own files, which we'd never be able to tell apart.
+ *
+ * Returns the length read into buf, which is terminated, or -1
+ */
+static ssize_t
+procFileRead(const char *path, char *buf, size_t len)
+{
+    int fd = scope_open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    ssize_t rc = scope_read(fd, buf, len - 1);
+    scope_close(fd);
+    if (rc < 0) return -1;
+
+    buf[rc] = '\0';
+    return rc;
+}
+
+// Bytes read from and written to storage; what the page cache served isn't.
+// Children the process has waited for are counted too.
+bool
+osGetProcIo(pid_t pid, long long *readBytes, long long *writeBytes)
+{
+    char path[64];
+    char buf[512];
+    char *rd, *wr;
+
+    scope_snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    if (procFileRead(path, buf, sizeof(buf)) <= 0) return FALSE;
+
+    if (((rd = scope_strstr(buf, "\nread_bytes: ")) == NULL) ||
+        ((wr = scope_strstr(buf, "\nwrite_bytes: ")) == NULL)) {
         DBG(NULL);
+        return FALSE;
+    }
+
+    *readBytes = scope_strtoll(rd + C_STRLEN("\nread_bytes: "), NULL, 10);
+    *writeBytes = scope_strtoll(wr + C_STRLEN("\nwrite_bytes: "), NULL, 10);
+    return TRUE;
+}
+
+// The files of a cgroup v2 we read, in g_cgroupdir for the cgroup g_cgroup
+static const char *const g_cgroupname[] = {
+    "cpu.pressure", "memory.pressure", "io.pressure", "cpu.stat",
+};
+static char g_cgroup[PATH_MAX];
+static char g_cgroupdir[PATH_MAX];
+
+// The "some" total of a pressure file: how long at least one task stalled
+static long long
+pressureTotal(const char *buf)
+{
+    const char *total;
+
+    if (scope_strncmp(buf, "some ", C_STRLEN("some ")) ||
+        ((total = scope_strstr(buf, "total=")) == NULL)) {
         return -1;
     }
-    
-    while ((entry = scope_readdir(dirp)) != NULL) {
-            nchild++;
+    return scope_strtoll(total + C_STRLEN("total="), NULL, 10);
+}
+
+/*
+ * Pressure (PSI) and throttling of the cgroup the process is in. The
+ * cgroup comes from /proc/<pid>/cgroup each time, so that the files of
+ * the new one are read when the process is moved. The v2 hierarchy is
+ * mounted on /sys/fs/cgroup, or on /sys/fs/cgroup/unified alongside v1.
+ */
+bool
+osGetCgroupStats(pid_t pid, cgroup_stats_t *stats)
+{
+    char path[PATH_MAX];
+    char buf[MAX_PROC];
+    char *cgroup, *end;
+    int i;
+
+    scope_snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    if (procFileRead(path, buf, sizeof(buf)) <= 0) return FALSE;
+
+    if (!scope_strncmp(buf, "0::", C_STRLEN("0::"))) {
+        cgroup = buf + C_STRLEN("0::");
+    } else if ((cgroup = scope_strstr(buf, "\n0::")) != NULL) {
+        cgroup += C_STRLEN("\n0::");
+    } else {
+        return FALSE;   // v1 only
     }
+    if ((end = scope_strchr(cgroup, '\n')) != NULL) *end = '\0';
 
-    scope_closedir(dirp);
-    return nchild - 3; // Not including the parent proc itself and ., ..
+    stats->moved = FALSE;
+    if (scope_strcmp(cgroup, g_cgroup)) {
+        stats->moved = (g_cgroup[0] != '\0');
+        scope_strncpy(g_cgroup, cgroup, sizeof(g_cgroup) - 1);
+
+        const char *root = "/sys/fs/cgroup";
+        if (osIsFilePresent("/sys/fs/cgroup/cgroup.controllers") == -1) {
+            root = "/sys/fs/cgroup/unified";
+        }
+        scope_snprintf(g_cgroupdir, sizeof(g_cgroupdir), "%s%s", root, cgroup);
+    }
+
+    long long value[ARRAY_SIZE(g_cgroupname)];
+    bool found = FALSE;
+    for (i = 0; i < ARRAY_SIZE(g_cgroupname); i++) {
+        value[i] = -1;
+        scope_snprintf(path, sizeof(path), "%s/%s", g_cgroupdir, g_cgroupname[i]);
+        if (procFileRead(path, buf, sizeof(buf)) <= 0) continue;
+
+        if (i < ARRAY_SIZE(g_cgroupname) - 1) {
+            value[i] = pressureTotal(buf);
+        } else if ((end = scope_strstr(buf, "\nthrottled_usec ")) != NULL) {
+            // Only there when the cpu controller is enabled for the cgroup
+            value[i] = scope_strtoll(end + C_STRLEN("\nthrottled_usec "), NULL, 10);
+        }
+        if (value[i] != -1) found = TRUE;
+    }
+
+    stats->cpuPressure = value[0];
+    stats->memPressure = value[1];
+    stats->ioPressure = value[2];
+    stats->cpuThrottled = value[3];
+    return found;
+}
+
+// How long to count h/w timer ticks against CLOCK_MONOTONIC
+#define TIMER_CALIBRATE_NS 1000000ULL
+
+// Anything outside of this is a bad reading, not a real counter
+#define TIMER_MIN_HZ 1000000ULL
+#define TIMER_MAX_HZ 20000000000ULL
+
+static uint64_t
+monotonicNs(void)
+{
+    struct timespec ts;
+
+    scope_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Converting ticks to ns is a multiply and a shift; see getDurationNow().
+ * A shift of 32 leaves the multiplier with plenty of precision for any
+ * counter in the accepted range.
+ */
+static void
+setTimerScale(platform_time_t *cfg, uint64_t hz)
+{
+    cfg->freq = hz / 1000000;
+    cfg->shift = 32;
+    cfg->mult = (uint64_t)((((unsigned __int128)1000000000ULL) << 32) / hz);
+}
+
+#ifdef __x86_64__
+/*
+ * The kernel runs a watchdog on the TSC and moves to another clocksource
+ * when it finds the TSC unstable. Don't trust it if the kernel doesn't.
+ */
+static bool
+tscMarkedUnstable(void)
+{
+    char src[32] = {0};
+    int fd;
+
+    if ((fd = scope_open("/sys/devices/system/clocksource/clocksource0/current_clocksource", O_RDONLY)) == -1) {
+        return FALSE;
+    }
+
+    int rc = scope_read(fd, src, sizeof(src) - 1);
+    scope_close(fd);
+    if (rc <= 0) return FALSE;
+
+    return (scope_strncmp(src, "hpet", 4) == 0) ||
+           (scope_strncmp(src, "acpi_pm", 7) == 0);
 }
 
+static uint64_t
+tscHz(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    // Newer CPUs report the TSC frequency as a ratio of the crystal clock
+    if (__get_cpuid_max(0, NULL) >= 0x15) {
+        __cpuid(0x15, eax, ebx, ecx, edx);
+        if (eax && ebx && ecx) return ((uint64_t)ecx * ebx) / eax;
+    }
+
+    // Otherwise count ticks over a short interval
+    uint64_t t0 = monotonicNs();
+    uint64_t c0 = getCounter();
+    uint64_t t1, c1;
+    do {
+        t1 = monotonicNs();
+        c1 = getCounter();
+    } while ((t1 - t0) < TIMER_CALIBRATE_NS);
+
+    return ((c1 - c0) * 1000000000ULL) / (t1 - t0);
+}
+#endif
+
 int
 osInitTimer(platform_time_t *cfg)
 {
     int fd;
     uint64_t val;
+    uint64_t hz = 0;
     char *buf;
     const char path[] = "/proc/cpuinfo";
 
+    // Until we know better, getTime() returns ns from CLOCK_MONOTONIC
+    cfg->gptimer_avail = FALSE;
+    cfg->mult = 1;
+    cfg->shift = 0;
+
     if ((fd = scope_open(path, O_RDONLY)) == -1) {
         DBG(NULL);
         return -1;
@@ -447,7 +665,7 @@ osInitTimer(platform_time_t *cfg)
         return -1;
     }
     
-    if (scope_read(fd, buf, MAX_PROC) == -1) {
+    if (scope_read(fd, buf, MAX_PROC - 1) == -1) {
         DBG(NULL);
         scope_close(fd);
         scope_free(buf);
@@ -460,49 +678,43 @@ osInitTimer(platform_time_t *cfg)
         cfg->tsc_rdtscp = TRUE;
     }
     
-    if (scope_strstr(buf, "tsc_reliable") == NULL) {
-        cfg->tsc_invariant = FALSE;
-    } else {
+    /*
+     * An invariant TSC runs at a constant rate in all P, C and T states.
+     * A hypervisor that can't provide one should not claim these flags.
+     */
+    if ((scope_strstr(buf, "tsc_reliable") != NULL) ||
+        ((scope_strstr(buf, "constant_tsc") != NULL) &&
+         (scope_strstr(buf, "nonstop_tsc") != NULL))) {
         cfg->tsc_invariant = TRUE;
+    } else {
+        cfg->tsc_invariant = FALSE;
     }
 
     if ((cfg->freq = getProcVal(buf, "cpu MHz")) == -1) {
         cfg->freq = -1;
     }
 
-    if (((val = getProcVal(buf, "CPU architecture")) != -1) &&
-        (val >= 8)) {
-        cfg->gptimer_avail = TRUE;
-    } else {
-        cfg->gptimer_avail = FALSE;
-    }
-
 #ifdef __aarch64__
     /*
      * This uses the General Purpose Timer definition in an aarch64 instance.
      * The frequency is the lower 32 bits of the CNTFRQ_EL0 register and
-     * is defined as HZ. The configured freq is defined in Mhz.
+     * is defined as HZ.
      */
-    if (cfg->gptimer_avail == TRUE) {
+    if (((val = getProcVal(buf, "CPU architecture")) != -1) &&
+        (val >= 8)) {
         uint64_t freq;
 
         __asm__ volatile (
-            "mrs x1, CNTFRQ_EL0 \n"
-            "mov %0, x1  \n"
+            "mrs %0, CNTFRQ_EL0 \n"
             : "=r" (freq)                // output
-            :                            // inputs
-            :                            // clobbered register
             );
 
-        freq &= 0x0000000ffffffff;
-        freq /= 1000000;
-        cfg->freq = freq;
+        hz = freq & 0x0000000ffffffff;
     }
 #elif defined(__x86_64__)
-    if ((cfg->tsc_invariant == TRUE) && (cfg->freq != -1)) {
-        cfg->gptimer_avail = TRUE;
-    } else {
-        cfg->gptimer_avail = FALSE;
+    (void)val;
+    if ((cfg->tsc_invariant == TRUE) && !tscMarkedUnstable()) {
+        hz = tscHz();
     }
 #else
 #error No architecture defined
@@ -510,9 +722,10 @@ osInitTimer(platform_time_t *cfg)
 
     scope_close(fd);
     scope_free(buf);
-    if (cfg->freq == (uint64_t)-1) {
-        DBG(NULL);
-        return -1;
+
+    if ((hz >= TIMER_MIN_HZ) && (hz <= TIMER_MAX_HZ)) {
+        setTimerScale(cfg, hz);
+        cfg->gptimer_avail = TRUE;
     }
     return 0;
 }
@@ -757,61 +970,143 @@ osInitJavaAgent(void)
 }
 
 
+/*
+ * While GOT entries are being patched, /proc/self/maps is read once into
+ * a table and osGetPageProt() looks addresses up there. The table belongs
+ * to the thread that loaded it; nothing else can map or unmap memory we
+ * look up while that thread is patching, and it only changes protections
+ * that it puts back.
+ */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    int prot;
+} os_map_t;
+
+static __thread os_map_t *t_maps = NULL;
+static __thread size_t t_maps_count = 0;
+static __thread int t_maps_depth = 0;
+
 /*
  * Example from /proc/self/maps:
  * 7f1b23bd4000-7f1b23bd7000 rw-p 001e3000 08:01 402063 /usr/lib/x86_64-linux-gnu/libc-2.29.so
+ *
+ * Returns FALSE at the end of the file or at a line we can't parse.
  */
+static bool
+readMapsEntry(FILE *fstream, char **buf, size_t *len, os_map_t *map)
+{
+    if (scope_getline(buf, len, fstream) == -1) return FALSE;
+
+    char *end = NULL;
+    map->start = scope_strtoull(*buf, &end, 0x10);
+    if ((map->start == 0) || (map->start == ULLONG_MAX)) return FALSE;
+
+    map->end = scope_strtoull(end + 1, &end, 0x10);
+    if ((map->end == 0) || (map->end == ULLONG_MAX)) return FALSE;
+
+    char *perms = end + 1;
+    map->prot = 0;
+    map->prot |= perms[0] == 'r' ? PROT_READ : 0;
+    map->prot |= perms[1] == 'w' ? PROT_WRITE : 0;
+    map->prot |= perms[2] == 'x' ? PROT_EXEC : 0;
+    return TRUE;
+}
+
+/*
+ * Calls nest; the table is read by the first and freed by the last
+ * osMapsRelease(). Returns FALSE if it couldn't be read, in which case
+ * osGetPageProt() reads the file as usual.
+ */
+bool
+osMapsLoad(void)
+{
+    if (t_maps_depth++) return (t_maps != NULL);
+
+    FILE *fstream = scope_fopen("/proc/self/maps", "r");
+    if (fstream == NULL) return FALSE;
+
+    char *buf = NULL;
+    size_t len = 0, alloc = 0;
+    os_map_t map;
+    while (readMapsEntry(fstream, &buf, &len, &map)) {
+        if (t_maps_count == alloc) {
+            alloc = (alloc) ? alloc * 2 : 256;
+            os_map_t *temp = scope_realloc(t_maps, alloc * sizeof(os_map_t));
+            if (!temp) {
+                DBG(NULL);
+                scope_free(t_maps);
+                t_maps = NULL;
+                t_maps_count = 0;
+                break;
+            }
+            t_maps = temp;
+        }
+        t_maps[t_maps_count++] = map;
+    }
+
+    if (buf) scope_free(buf);
+    scope_fclose(fstream);
+    scopeLog(CFG_LOG_DEBUG, "%s: %zu mappings", __FUNCTION__, t_maps_count);
+    return (t_maps != NULL);
+}
+
+void
+osMapsRelease(void)
+{
+    if (!t_maps_depth || --t_maps_depth) return;
+
+    if (t_maps) scope_free(t_maps);
+    t_maps = NULL;
+    t_maps_count = 0;
+}
+
+// The kernel lists mappings in address order
+static int
+findMapsEntry(uint64_t addr)
+{
+    size_t lo = 0, hi = t_maps_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (addr < t_maps[mid].start) {
+            hi = mid;
+        } else if (addr >= t_maps[mid].end) {
+            lo = mid + 1;
+        } else {
+            return t_maps[mid].prot;
+        }
+    }
+    return -1;
+}
+
 int
 osGetPageProt(uint64_t addr)
 {
     int prot = -1;
     size_t len = 0;
     char *buf = NULL;
+    os_map_t map;
 
     if (addr == 0) {
         return -1;
     }
 
+    if (t_maps) return findMapsEntry(addr);
+
     FILE *fstream = scope_fopen("/proc/self/maps", "r");
     if (fstream == NULL) return -1;
 
-    while (scope_getline(&buf, &len, fstream) != -1) {
-        char *end = NULL;
-        uint64_t addr1 = scope_strtoull(buf, &end, 0x10);
-        if ((addr1 == 0) || (addr1 == ULLONG_MAX)) {
-            if (buf) scope_free(buf);
-            scope_fclose(fstream);
-            return -1;
-        }
+    while (readMapsEntry(fstream, &buf, &len, &map)) {
+        scopeLog(CFG_LOG_TRACE, "addr 0x%lux addr1 0x%lux addr2 0x%lux\n", addr, map.start, map.end);
 
-        uint64_t addr2 = scope_strtoull(end + 1, &end, 0x10);
-        if ((addr2 == 0) || (addr2 == ULLONG_MAX)) {
-            if (buf) scope_free(buf);
-            scope_fclose(fstream);
-            return -1;
-        }
-
-        scopeLog(CFG_LOG_TRACE, "addr 0x%lux addr1 0x%lux addr2 0x%lux\n", addr, addr1, addr2);
-
-        if ((addr >= addr1) && (addr < addr2)) {
-            char *perms = end + 1;
-            scopeLog(CFG_LOG_DEBUG, "matched 0x%lx to 0x%lx-0x%lx\n\t%c%c%c", addr, addr1, addr2, perms[0], perms[1], perms[2]);
-            prot = 0;
-            prot |= perms[0] == 'r' ? PROT_READ : 0;
-            prot |= perms[1] == 'w' ? PROT_WRITE : 0;
-            prot |= perms[2] == 'x' ? PROT_EXEC : 0;
-            if (buf) scope_free(buf);
+        if ((addr >= map.start) && (addr < map.end)) {
+            scopeLog(CFG_LOG_DEBUG, "matched 0x%lx to 0x%lx-0x%lx\n\tprot %d", addr, map.start, map.end, map.prot);
+            prot = map.prot;
             break;
         }
-
-        if (buf) {
-            scope_free(buf);
-            buf = NULL;
-        }
-
-        len = 0;
     }
 
+    if (buf) scope_free(buf);
     scope_fclose(fstream);
     return prot;
 }
@@ -945,6 +1240,22 @@ osGetProcCPU(void) {
         ((long long)ruse.ru_utime.tv_usec + (long long)ruse.ru_stime.tv_usec);
 }
 
+bool
+osGetProcRusage(int who, proc_rusage_t *usage)
+{
+    struct rusage ruse;
+
+    if (scope_getrusage(who, &ruse) != 0) {
+        return FALSE;
+    }
+
+    usage->volCtxSwitch = ruse.ru_nvcsw;
+    usage->involCtxSwitch = ruse.ru_nivcsw;
+    usage->majorFaults = ruse.ru_majflt;
+    usage->minorFaults = ruse.ru_minflt;
+    return TRUE;
+}
+
 uint64_t
 osFindLibrary(const char *library, pid_t pid, bool matchLibraryExactly)
 {
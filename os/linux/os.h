@@ -45,6 +45,30 @@
 
 extern char *program_invocation_short_name;
 
+// From /proc/<pid>/stat
+typedef struct {
+    long threads;
+    long vsize;                 // KiB
+    long rss;                   // KiB
+} proc_stat_t;
+
+// Counted since the process (RUSAGE_SELF) or thread (RUSAGE_THREAD) started
+typedef struct {
+    long long volCtxSwitch;     // gave up the cpu; to wait for something
+    long long involCtxSwitch;   // had the cpu taken away
+    long long majorFaults;      // a page had to be read in
+    long long minorFaults;      // a page was already in memory
+} proc_rusage_t;
+
+// Microseconds, counted since the cgroup was created; -1 when unknown
+typedef struct {
+    long long cpuPressure;      // some of the cgroup's tasks waited for a cpu
+    long long memPressure;      // ... for memory
+    long long ioPressure;       // ... for io
+    long long cpuThrottled;     // all of them were held back by cpu.max
+    bool moved;                 // the process is in another cgroup than last time
+} cgroup_stats_t;
+
 extern int osGetProcname(char *, int);
 extern int osGetProcUidGid(pid_t, uid_t *, gid_t *);
 extern int osGetNumThreads(pid_t);
@@ -52,12 +76,19 @@ extern int osGetNumFds(pid_t);
 extern int osGetNumChildProcs(pid_t);
 extern int osInitTimer(platform_time_t *);
 extern int osGetProcMemory(pid_t);
+extern int osGetProcRss(pid_t);
+extern bool osGetProcStat(pid_t, proc_stat_t *);
+extern bool osGetProcRusage(int, proc_rusage_t *);
+extern bool osGetProcIo(pid_t, long long *, long long *);
+extern bool osGetCgroupStats(pid_t, cgroup_stats_t *);
 extern int osIsFilePresent(const char *);
 extern int osGetCmdline(pid_t, char **);
 extern bool osThreadInit(void(*handler)(int, siginfo_t *, void *), unsigned);
 extern int osUnixSockPeer(ino_t);
 extern void osInitJavaAgent(void);
 extern int osGetPageProt(unsigned long);
+extern bool osMapsLoad(void);
+extern void osMapsRelease(void);
 extern int osGetExePath(pid_t, char **);
 extern bool osTimerStop(void);
 extern bool osIsScopeHandlerActive(void);
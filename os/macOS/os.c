@@ -153,6 +153,18 @@ osGetPageProt(uint64_t addr)
     return -1;
 }
 
+bool
+osMapsLoad(void)
+{
+    return FALSE;
+}
+
+void
+osMapsRelease(void)
+{
+    return;
+}
+
 bool
 osTimerStop(void)
 {
@@ -0,0 +1,37 @@
+#ifndef __AGGMETRIC_H__
+#define __AGGMETRIC_H__
+#include <stdint.h>
+#include "com.h"
+#include "dbg.h"
+
+// The most fields an aggregation can give a metric to say what it's of
+#define AGG_KEYS_MAX ( 4 )
+
+// Sends a metric of one of the aggregations (fsagg.c, netagg.c). keys
+// are the fields that say what it's of, ended by FIELDEND; the fields
+// every summary metric has follow them. numops is left out when it's 0.
+static inline int
+aggSendMetric(mtc_t *mtc, const char *name, uint64_t value, data_type_t type,
+              const event_field_t *keys, uint64_t numops, const char *unit)
+{
+    event_field_t fields[AGG_KEYS_MAX + 7];
+    size_t n;
+
+    for (n = 0; keys && (keys[n].value_type != FMT_END) && (n < AGG_KEYS_MAX); n++) {
+        fields[n] = keys[n];
+    }
+    fields[n++] = (event_field_t)STRFIELD("proc",    g_proc.procname, 4, TRUE);
+    fields[n++] = (event_field_t)NUMFIELD("pid",     g_proc.pid,      4, TRUE);
+    fields[n++] = (event_field_t)STRFIELD("host",    g_proc.hostname, 4, TRUE);
+    if (numops) {
+        fields[n++] = (event_field_t)NUMFIELD("numops", numops,       8, TRUE);
+    }
+    fields[n++] = (event_field_t)STRFIELD("unit",    unit,            4, TRUE);
+    fields[n++] = (event_field_t)STRFIELD("summary", "true",          1, TRUE);
+    fields[n] = (event_field_t)FIELDEND;
+
+    event_t metric = INT_EVENT(name, value, type, fields);
+    return cmdSendMetric(mtc, &metric);
+}
+
+#endif // __AGGMETRIC_H__
@@ -0,0 +1,339 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include "arena.h"
+#include "atomic.h"
+#include "dbg.h"
+#include "scopestdlib.h"
+
+#define ARENA_MAGIC       0x5c09a7e1    // in use
+#define ARENA_FREE_MAGIC  0x5c09f7ee    // in a cache or the depot
+#define ARENA_NEW_MAGIC   0x5c09e3e3    // from the heap, never handed out
+#define ARENA_LARGE       0xffffffff    // class of objects from the heap
+
+// Threads are given one of this many caches, in turn. A cache can't be
+// thread local; whatever a thread had cached would be lost when it
+// exits, and some applications start a thread for every request.
+#define ARENA_SLOTS       64
+
+// Objects move between a cache and the depot this many at a time. A
+// cache holds up to two batches per class so that alternating allocs
+// and frees at a batch boundary don't bounce a batch back and forth.
+#define ARENA_BATCH       32
+#define ARENA_CACHE_MAX   (2 * ARENA_BATCH)
+
+// Past this many bytes in the depot, of all classes together, freed
+// batches go back to the heap. A burst that backs up the event queue
+// would otherwise leave the arena holding everything it took for good.
+#define ARENA_DEPOT_BYTES (4 * 1024 * 1024)
+
+// Buffers whose size depends on the data (log data, frames, headers)
+// bigger than this come from the heap. A few big ones would otherwise
+// fill the caches and depot of the biggest classes.
+#define ARENA_BUFFER_MAX  2048
+
+// Sizes include the header. The steps are small enough that the big
+// event copies (net_info, fs_info) don't waste much of a class.
+static const uint32_t g_class_size[] = {
+    64, 96, 128, 192, 256, 384, 512, 768,
+    1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584,
+    4096, 4608, 5120, 6144, 7168, 8192,
+};
+#define ARENA_CLASSES (sizeof(g_class_size) / sizeof(g_class_size[0]))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t cls;
+    uint64_t pad;               // keeps what follows 16 byte aligned
+} arena_hdr_t;
+
+typedef struct _arena_free_t {
+    arena_hdr_t hdr;
+    struct _arena_free_t *next;         // in a cache or a batch
+    struct _arena_free_t *nextBatch;    // first of a batch in the depot
+} arena_free_t;
+
+typedef struct {
+    arena_free_t *head;
+    unsigned count;
+} arena_cache_t;
+
+typedef struct {
+    int lock;
+    arena_cache_t cache[ARENA_CLASSES];
+    uint64_t hits;              // only ever counted up, under the lock
+    uint64_t misses;
+} __attribute__((aligned(64))) arena_slot_t;
+
+typedef struct {
+    int lock;
+    arena_free_t *batches;      // each one ARENA_BATCH long
+} arena_depot_t;
+
+static arena_slot_t g_slot[ARENA_SLOTS];
+static arena_depot_t g_depot[ARENA_CLASSES];
+static int g_next_slot = 0;
+static __thread int t_slot = -1;
+
+static uint64_t g_heap_bytes = 0;
+static uint64_t g_depot_bytes = 0;
+static uint64_t g_refills = 0;
+static uint64_t g_large_allocs = 0;
+static uint64_t g_last_hits = 0;
+static uint64_t g_last_misses = 0;
+
+/*
+ * The lock on a thread's own slot is almost never taken; two threads
+ * share a slot only when there are more than ARENA_SLOTS of them. If it
+ * is taken (by a thread sharing the slot, or by this one when a signal
+ * handler interrupted it here) the other slots are tried before waiting.
+ */
+static arena_slot_t *
+slotLock(void)
+{
+    if (t_slot == -1) {
+        t_slot = (unsigned)(__sync_fetch_and_add(&g_next_slot, 1)) % ARENA_SLOTS;
+    }
+
+    int i;
+    for (i = 0; i < ARENA_SLOTS; i++) {
+        arena_slot_t *slot = &g_slot[(t_slot + i) % ARENA_SLOTS];
+        if (atomicCas32(&slot->lock, 0, 1)) return slot;
+    }
+
+    arena_slot_t *slot = &g_slot[t_slot];
+    while (!atomicCas32(&slot->lock, 0, 1)) atomicPause();
+    return slot;
+}
+
+static void
+slotUnlock(arena_slot_t *slot)
+{
+    atomicCas32(&slot->lock, 1, 0);
+}
+
+static void
+depotLock(arena_depot_t *depot)
+{
+    while (!atomicCas32(&depot->lock, 0, 1)) atomicPause();
+}
+
+static void
+depotUnlock(arena_depot_t *depot)
+{
+    atomicCas32(&depot->lock, 1, 0);
+}
+
+static int
+classOf(size_t size)
+{
+    int cls;
+    for (cls = 0; cls < ARENA_CLASSES; cls++) {
+        if (size <= g_class_size[cls]) return cls;
+    }
+    return -1;
+}
+
+// Fill an empty cache with a batch from the depot, or a new one
+static bool
+cacheRefill(arena_cache_t *cache, int cls)
+{
+    arena_depot_t *depot = &g_depot[cls];
+    size_t size = g_class_size[cls];
+
+    depotLock(depot);
+    arena_free_t *batch = depot->batches;
+    if (batch) depot->batches = batch->nextBatch;
+    depotUnlock(depot);
+
+    unsigned count = ARENA_BATCH;
+    if (batch) {
+        atomicSubU64(&g_depot_bytes, ARENA_BATCH * size);
+    } else {
+        // Each object is its own heap allocation so that any of them
+        // can be given back on its own
+        for (count = 0; count < ARENA_BATCH; count++) {
+            arena_free_t *blk = scope_malloc(size);
+            if (!blk) break;
+            blk->hdr.magic = ARENA_NEW_MAGIC;
+            blk->hdr.cls = cls;
+            blk->next = batch;
+            batch = blk;
+        }
+        if (!count) {
+            DBG(NULL);
+            return FALSE;
+        }
+        atomicAddU64(&g_heap_bytes, count * size);
+    }
+
+    cache->head = batch;
+    cache->count = count;
+    atomicAddU64(&g_refills, 1);
+    return TRUE;
+}
+
+// Hand a batch of a full cache to the depot. The most recently freed
+// objects are kept; they're the likeliest to still be in the cpu cache.
+static void
+cacheFlush(arena_cache_t *cache, int cls)
+{
+    arena_depot_t *depot = &g_depot[cls];
+    arena_free_t *last = cache->head;
+    int i;
+    for (i = 1; i < cache->count - ARENA_BATCH; i++) last = last->next;
+    arena_free_t *batch = last->next;
+    last->next = NULL;
+    cache->count -= ARENA_BATCH;
+
+    // The bytes are claimed before the batch goes in, so that threads
+    // flushing at once can't take the depot past its limit together
+    uint64_t bytes = ARENA_BATCH * g_class_size[cls];
+    if (atomicAddFetchU64(&g_depot_bytes, bytes) <= ARENA_DEPOT_BYTES) {
+        depotLock(depot);
+        batch->nextBatch = depot->batches;
+        depot->batches = batch;
+        depotUnlock(depot);
+        return;
+    }
+    atomicSubU64(&g_depot_bytes, bytes);
+
+    while (batch) {
+        arena_free_t *next = batch->next;
+        batch->hdr.magic = 0;
+        scope_free(batch);
+        batch = next;
+    }
+    atomicSubU64(&g_heap_bytes, bytes);
+}
+
+static void *
+largeMalloc(size_t size)
+{
+    arena_hdr_t *hdr = scope_malloc(sizeof(arena_hdr_t) + size);
+    if (!hdr) return NULL;
+    hdr->magic = ARENA_MAGIC;
+    hdr->cls = ARENA_LARGE;
+    atomicAddU64(&g_large_allocs, 1);
+    return hdr + 1;
+}
+
+void *
+arenaMalloc(size_t size)
+{
+    int cls = classOf(size + sizeof(arena_hdr_t));
+    if (cls == -1) return largeMalloc(size);
+
+    arena_slot_t *slot = slotLock();
+    arena_cache_t *cache = &slot->cache[cls];
+    if (!cache->head && !cacheRefill(cache, cls)) {
+        slotUnlock(slot);
+        return NULL;
+    }
+
+    arena_free_t *blk = cache->head;
+    cache->head = blk->next;
+    cache->count--;
+    if (blk->hdr.magic == ARENA_NEW_MAGIC) {
+        slot->misses++;
+    } else {
+        slot->hits++;
+    }
+    slotUnlock(slot);
+
+    blk->hdr.magic = ARENA_MAGIC;
+    return &blk->hdr + 1;
+}
+
+void *
+arenaMallocBuffer(size_t size)
+{
+    if (size > ARENA_BUFFER_MAX) return largeMalloc(size);
+    return arenaMalloc(size);
+}
+
+void *
+arenaCalloc(size_t nmemb, size_t size)
+{
+    if (size && (nmemb > SIZE_MAX / size)) return NULL;
+
+    void *ptr = arenaMalloc(nmemb * size);
+    if (ptr) scope_memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+void
+arenaFree(void *ptr)
+{
+    if (!ptr) return;
+
+    arena_hdr_t *hdr = (arena_hdr_t *)ptr - 1;
+    if (hdr->magic != ARENA_MAGIC) {
+        // Freed twice, or not ours. Leaking it is safer than guessing.
+        DBG("%p", ptr);
+        return;
+    }
+
+    if (hdr->cls == ARENA_LARGE) {
+        hdr->magic = 0;
+        scope_free(hdr);
+        return;
+    }
+
+    int cls = hdr->cls;
+    arena_free_t *blk = (arena_free_t *)hdr;
+    blk->hdr.magic = ARENA_FREE_MAGIC;
+
+    arena_slot_t *slot = slotLock();
+    arena_cache_t *cache = &slot->cache[cls];
+    blk->next = cache->head;
+    cache->head = blk;
+    if (++cache->count >= ARENA_CACHE_MAX) cacheFlush(cache, cls);
+    slotUnlock(slot);
+}
+
+/*
+ * refills, largeAllocs, hits and misses are counted since the last call;
+ * the others are current values. An allocation is a miss the first time
+ * an object from the heap is handed out; large allocations always are.
+ *
+ * The per slot counters are summed without taking the slot locks. A sum
+ * can miss an increment in flight; the next call picks it up.
+ */
+void
+arenaGetStats(arena_stats_t *stats)
+{
+    if (!stats) return;
+
+    uint64_t hits = 0, misses = 0;
+    int i;
+    for (i = 0; i < ARENA_SLOTS; i++) {
+        hits += g_slot[i].hits;
+        misses += g_slot[i].misses;
+    }
+
+    stats->heapBytes = g_heap_bytes;
+    stats->depotBytes = g_depot_bytes;
+    stats->refills = atomicSwapU64(&g_refills, 0);
+    stats->largeAllocs = atomicSwapU64(&g_large_allocs, 0);
+    stats->hits = hits - g_last_hits;
+    stats->misses = misses - g_last_misses + stats->largeAllocs;
+    g_last_hits = hits;
+    g_last_misses = misses;
+}
+
+/*
+ * In the child of a fork, only the thread that called fork remains. A
+ * slot or depot could have been locked by any of the others; nobody is
+ * left to unlock it.
+ */
+void
+arenaAtFork(void)
+{
+    int i;
+    for (i = 0; i < ARENA_SLOTS; i++) {
+        g_slot[i].lock = 0;
+    }
+    for (i = 0; i < ARENA_CLASSES; i++) {
+        g_depot[i].lock = 0;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
+
+// The arena allocates the objects the datapath (application threads)
+// posts to our reporting thread; event copies, protocol objects and the
+// headers and frames they carry, log events and their data, payloads.
+// Nearly all of them are allocated on one thread and freed on another,
+// which the heap behind scope_malloc() handles with a lock every
+// application thread contends for.
+//
+// Objects are rounded up to one of a few size classes. Each thread is
+// given a small cache of free objects per class, which it only shares
+// with other threads once there are more threads than caches. A cache
+// that fills up (the reporting thread's, freeing what everyone else
+// allocated) hands a batch to a shared depot; a cache that's empty
+// takes a batch from the depot, or a new one from the heap. Only so
+// much is kept in the depot; past that, batches go back to the heap.
+//
+// Anything bigger than the largest class comes straight from the heap,
+// as do buffers from arenaMallocBuffer() past a smaller limit; their
+// size follows the data, and a few big ones would crowd out the rest.
+//
+// Memory from arenaMalloc()/arenaCalloc() must be freed with arenaFree()
+// and never with scope_free(), and vice versa.
+
+typedef struct {
+    uint64_t heapBytes;     // held by the size classes; in use or free
+    uint64_t depotBytes;    // free, waiting in the depot for a thread
+    uint64_t refills;       // batches taken from the depot or the heap
+    uint64_t largeAllocs;   // too big for a class or the buffer limit
+    uint64_t hits;          // allocs given an object used before
+    uint64_t misses;        // allocs given new memory from the heap
+} arena_stats_t;
+
+void *arenaMalloc(size_t);
+void *arenaMallocBuffer(size_t);
+void *arenaCalloc(size_t, size_t);
+void  arenaFree(void *);
+
+void  arenaGetStats(arena_stats_t *);
+void  arenaAtFork(void);
+
+#endif // __ARENA_H__
@@ -27,6 +27,11 @@ atomicAddU64(uint64_t *ptr, uint64_t val) {
     } while (!atomicCasU64(ptr, oldval, newval));
 }
 
+static inline uint64_t
+atomicAddFetchU64(uint64_t *ptr, uint64_t val) {
+    return __sync_add_and_fetch(ptr, val);
+}
+
 static inline void
 atomicSubU64(uint64_t* ptr, uint64_t val) {
     // Ensure that we don't "subtract past zero"...
@@ -49,6 +54,18 @@ atomicSwapU64(uint64_t *ptr, uint64_t val) {
 
 
 
+// For the body of a spin wait; tells the cpu it's spinning so it can
+// back off the memory bus and give way to a hyperthread sibling
+static inline void
+atomicPause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
 static inline bool
 atomicCas32(int *ptr, int oldval, int newval)
 {
@@ -41,9 +41,13 @@ struct _config_t
             char* prefix;
             unsigned maxlen;
             unsigned enable;
+            unsigned maxseries;
         } statsd;
         unsigned period;
         unsigned verbosity;
+        unsigned top[CFG_MTC_STATSD + 1];
+        size_t numFsPaths;
+        char **fspaths;
     } mtc;
 
     struct {
@@ -186,6 +190,7 @@ cfgCreateDefault(void)
     c->mtc.statsd.prefix = (DEFAULT_STATSD_PREFIX) ? scope_strdup(DEFAULT_STATSD_PREFIX) : NULL;
     c->mtc.statsd.maxlen = DEFAULT_STATSD_MAX_LEN;
     c->mtc.statsd.enable = DEFAULT_MTC_STATSD_ENABLE;
+    c->mtc.statsd.maxseries = DEFAULT_STATSD_MAX_SERIES;
     c->mtc.period = DEFAULT_SUMMARY_PERIOD;
     c->mtc.verbosity = DEFAULT_MTC_VERBOSITY;
     SCOPE_BIT_SET_VAR(c->mtc.categories, CFG_MTC_FS, DEFAULT_MTC_FS_ENABLE);
@@ -193,6 +198,12 @@ cfgCreateDefault(void)
     SCOPE_BIT_SET_VAR(c->mtc.categories, CFG_MTC_HTTP, DEFAULT_MTC_HTTP_ENABLE);
     SCOPE_BIT_SET_VAR(c->mtc.categories, CFG_MTC_DNS, DEFAULT_MTC_DNS_ENABLE);
     SCOPE_BIT_SET_VAR(c->mtc.categories, CFG_MTC_PROC, DEFAULT_MTC_PROC_ENABLE);
+    metric_watch_t category;
+    for (category = CFG_MTC_FS; category <= CFG_MTC_STATSD; category++) {
+        c->mtc.top[category] = DEFAULT_MTC_WATCH_TOP;
+    }
+    c->mtc.numFsPaths = 0;
+    c->mtc.fspaths = NULL;
     c->evt.enable = DEFAULT_EVT_ENABLE;
     c->evt.format = DEFAULT_CTL_FORMAT;
     c->evt.ratelimit = DEFAULT_MAXEVENTSPERSEC;
@@ -263,6 +274,8 @@ cfgDestroy(config_t **cfg)
         if (c->evt.namefilter[src]) scope_free(c->evt.namefilter[src]);
     }
 
+    cfgMtcFsPathsClear(c);
+
     int i;
     for (i = 0; i < c->evt.numHeaders; i++) {
         if (c->evt.hextract && c->evt.hextract[i]) {
@@ -330,6 +343,33 @@ cfgMtcWatchEnable(config_t* cfg, metric_watch_t category) {
     }
 }
 
+unsigned
+cfgMtcWatchTop(config_t *cfg, metric_watch_t category)
+{
+    if ((category >= CFG_MTC_FS) && (category <= CFG_MTC_STATSD)) {
+        return (cfg) ? cfg->mtc.top[category] : DEFAULT_MTC_WATCH_TOP;
+    }
+
+    DBG("%d", category);
+    return DEFAULT_MTC_WATCH_TOP;
+}
+
+size_t
+cfgMtcFsNumPaths(config_t *cfg)
+{
+    return (cfg) ? cfg->mtc.numFsPaths : 0;
+}
+
+const char *
+cfgMtcFsPath(config_t *cfg, int num)
+{
+    if (cfg && (num >= 0) && (num < cfg->mtc.numFsPaths)) {
+        return cfg->mtc.fspaths[num];
+    }
+
+    return NULL;
+}
+
 cfg_mtc_format_t
 cfgMtcFormat(config_t* cfg)
 {
@@ -348,6 +388,12 @@ cfgMtcStatsDMaxLen(config_t* cfg)
     return (cfg) ? cfg->mtc.statsd.maxlen : DEFAULT_STATSD_MAX_LEN;
 }
 
+unsigned
+cfgMtcStatsDMaxSeries(config_t *cfg)
+{
+    return (cfg) ? cfg->mtc.statsd.maxseries : DEFAULT_STATSD_MAX_SERIES;
+}
+
 unsigned
 cfgMtcPeriod(config_t* cfg)
 {
@@ -697,6 +743,14 @@ cfgMtcStatsDMaxLenSet(config_t* cfg, unsigned len)
     cfg->mtc.statsd.maxlen = len;
 }
 
+void
+cfgMtcStatsDMaxSeriesSet(config_t *cfg, unsigned val)
+{
+    if (!cfg || !val) return;
+    if (val > CFG_MAX_STATSD_MAX_SERIES) val = CFG_MAX_STATSD_MAX_SERIES;
+    cfg->mtc.statsd.maxseries = val;
+}
+
 void
 cfgMtcPeriodSet(config_t* cfg, unsigned val)
 {
@@ -726,6 +780,58 @@ cfgMtcWatchEnableSet(config_t *cfg, unsigned val, metric_watch_t type)
     }
 }
 
+// Only the fs and net watches can be reported by their heaviest keys
+void
+cfgMtcWatchTopSet(config_t *cfg, unsigned val, metric_watch_t type)
+{
+    if (!cfg) return;
+
+    switch (type) {
+        case CFG_MTC_FS:
+        case CFG_MTC_NET:
+            if (val > CFG_MAX_WATCH_TOP) val = CFG_MAX_WATCH_TOP;
+            cfg->mtc.top[type] = val;
+            break;
+        default:
+            DBG("%d", type);
+            break;
+    }
+}
+
+void
+cfgMtcFsPathsClear(config_t *cfg)
+{
+    if (!cfg) return;
+
+    int i;
+    for (i = 0; i < cfg->mtc.numFsPaths; i++) {
+        if (cfg->mtc.fspaths[i]) scope_free(cfg->mtc.fspaths[i]);
+    }
+    if (cfg->mtc.fspaths) scope_free(cfg->mtc.fspaths);
+    cfg->mtc.fspaths = NULL;
+    cfg->mtc.numFsPaths = 0;
+}
+
+void
+cfgMtcFsPathSet(config_t *cfg, const char *pattern)
+{
+    if (!cfg || !pattern || (pattern[0] == '\0')) return;
+
+    char **temp = scope_realloc(cfg->mtc.fspaths, (cfg->mtc.numFsPaths + 1) * sizeof(char *));
+    if (!temp) {
+        DBG(NULL);
+        return;
+    }
+    cfg->mtc.fspaths = temp;
+
+    char *copy = scope_strdup(pattern);
+    if (!copy) {
+        DBG(NULL);
+        return;
+    }
+    cfg->mtc.fspaths[cfg->mtc.numFsPaths++] = copy;
+}
+
 void
 cfgCmdDirSet(config_t* cfg, const char* path)
 {
@@ -20,8 +20,12 @@ unsigned            cfgMtcEnable(config_t*);
 cfg_mtc_format_t    cfgMtcFormat(config_t*);
 const char*         cfgMtcStatsDPrefix(config_t*);
 unsigned            cfgMtcStatsDMaxLen(config_t*);
+unsigned            cfgMtcStatsDMaxSeries(config_t *);
 unsigned            cfgMtcPeriod(config_t*);
 unsigned            cfgMtcWatchEnable(config_t *, metric_watch_t);
+unsigned            cfgMtcWatchTop(config_t *, metric_watch_t);
+size_t              cfgMtcFsNumPaths(config_t *);
+const char *        cfgMtcFsPath(config_t *, int);
 const char*         cfgCmdDir(config_t*);
 unsigned            cfgSendProcessStartMsg(config_t*);
 unsigned            cfgMtcVerbosity(config_t*);
@@ -61,8 +65,12 @@ void                cfgMtcEnableSet(config_t*, unsigned);
 void                cfgMtcFormatSet(config_t*, cfg_mtc_format_t);
 void                cfgMtcStatsDPrefixSet(config_t*, const char*);
 void                cfgMtcStatsDMaxLenSet(config_t*, unsigned);
+void                cfgMtcStatsDMaxSeriesSet(config_t *, unsigned);
 void                cfgMtcPeriodSet(config_t*, unsigned);
 void                cfgMtcWatchEnableSet(config_t *, unsigned, metric_watch_t);
+void                cfgMtcWatchTopSet(config_t *, unsigned, metric_watch_t);
+void                cfgMtcFsPathsClear(config_t *);
+void                cfgMtcFsPathSet(config_t *, const char *);
 void                cfgCmdDirSet(config_t*, const char*);
 void                cfgSendProcessStartMsgSet(config_t*, unsigned);
 void                cfgMtcVerbositySet(config_t*, unsigned);
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/auxv.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -21,6 +22,7 @@
 #include "fn.h"
 #include "state.h"
 #include "scopestdlib.h"
+#include "rulesidx.h"
 
 #ifndef NO_YAML
 #include "yaml.h"
@@ -35,6 +37,9 @@
 #define VERBOSITY_NODE               "verbosity"
 #define WATCH_NODE               "watch"
 #define TYPE_NODE                    "type"
+#define TOP_NODE                     "top"
+#define PATHS_NODE                   "paths"
+#define MAXSERIES_NODE               "maxseries"
 #define TRANSPORT_NODE           "transport"
 #define TYPE_NODE                    "type"
 #define HOST_NODE                    "host"
@@ -174,6 +179,9 @@ void cfgMtcStatsDPrefixSetFromStr(config_t*, const char*);
 void cfgMtcStatsDMaxLenSetFromStr(config_t*, const char*);
 void cfgMtcPeriodSetFromStr(config_t*, const char*);
 void cfgMtcWatchEnableSetFromStr(config_t*, const char*, metric_watch_t);
+void cfgMtcWatchTopSetFromStr(config_t*, const char*, metric_watch_t);
+void cfgMtcFsPathSetFromStr(config_t*, const char*);
+void cfgMtcStatsDMaxSeriesSetFromStr(config_t*, const char*);
 void cfgCmdDirSetFromStr(config_t*, const char*);
 void cfgConfigEventSetFromStr(config_t*, const char*);
 void cfgEvtEnableSetFromStr(config_t*, const char*);
@@ -202,11 +210,13 @@ void cfgSnapshotBacktraceEnableSetFomStr(config_t *, const char *);
 static void cfgSetFromFile(config_t *, const char *);
 
 static void processRoot(config_t *, yaml_document_t *, yaml_node_t *);
+static int isWatchType(yaml_document_t *, yaml_node_pair_t *);
 
 // These global variables limits us to only reading one config file at a time...
 // which seems fine for now, I guess.
 static which_transport_t transport_context;
 static watch_t watch_context;
+static int mtc_watch_context;        // a metric_watch_t, or -1
 static protocol_def_t *protocol_context = NULL;
 static regex_t* g_regex = NULL;
 static char g_logmsg[1024] = {};
@@ -494,10 +504,18 @@ processEnvStyleInput(config_t *cfg, const char *env_line)
         cfgMtcPeriodSetFromStr(cfg, value);
     } else if (!scope_strcmp(env_name, "SCOPE_METRIC_STATSD")) {
         cfgMtcWatchEnableSetFromStr(cfg, value, CFG_MTC_STATSD);
+    } else if (!scope_strcmp(env_name, "SCOPE_METRIC_STATSD_MAXSERIES")) {
+        cfgMtcStatsDMaxSeriesSetFromStr(cfg, value);
     } else if (!scope_strcmp(env_name, "SCOPE_METRIC_FS")) {
         cfgMtcWatchEnableSetFromStr(cfg, value, CFG_MTC_FS);
+    } else if (!scope_strcmp(env_name, "SCOPE_METRIC_FS_TOP")) {
+        cfgMtcWatchTopSetFromStr(cfg, value, CFG_MTC_FS);
+    } else if (!scope_strcmp(env_name, "SCOPE_METRIC_FS_PATHS")) {
+        cfgMtcFsPathSetFromStr(cfg, value);
     } else if (!scope_strcmp(env_name, "SCOPE_METRIC_NET")) {
         cfgMtcWatchEnableSetFromStr(cfg, value, CFG_MTC_NET);
+    } else if (!scope_strcmp(env_name, "SCOPE_METRIC_NET_TOP")) {
+        cfgMtcWatchTopSetFromStr(cfg, value, CFG_MTC_NET);
     } else if (!scope_strcmp(env_name, "SCOPE_METRIC_HTTP")) {
         cfgMtcWatchEnableSetFromStr(cfg, value, CFG_MTC_HTTP);
     } else if (!scope_strcmp(env_name, "SCOPE_METRIC_DNS")) {
@@ -746,6 +764,51 @@ cfgMtcWatchEnableSetFromStr(config_t *cfg, const char *value, metric_watch_t typ
     cfgMtcWatchEnableSet(cfg, strToVal(boolMap, value), type);
 }
 
+void
+cfgMtcWatchTopSetFromStr(config_t *cfg, const char *value, metric_watch_t type)
+{
+    if (!cfg || !value) return;
+    scope_errno = 0;
+    char *endptr = NULL;
+    unsigned long x = scope_strtoul(value, &endptr, 10);
+    if (scope_errno || *endptr) return;
+
+    cfgMtcWatchTopSet(cfg, x, type);
+}
+
+void
+cfgMtcStatsDMaxSeriesSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    scope_errno = 0;
+    char *endptr = NULL;
+    unsigned long x = scope_strtoul(value, &endptr, 10);
+    if (scope_errno || *endptr) return;
+
+    cfgMtcStatsDMaxSeriesSet(cfg, x);
+}
+
+// Patterns are separated by colons, like $PATH. They replace any there
+// were; an empty value leaves none.
+void
+cfgMtcFsPathSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+
+    cfgMtcFsPathsClear(cfg);
+
+    char *copy = scope_strdup(value);
+    if (!copy) return;
+
+    char *last = NULL;
+    char *pattern = scope_strtok_r(copy, ":", &last);
+    while (pattern) {
+        cfgMtcFsPathSet(cfg, pattern);
+        pattern = scope_strtok_r(NULL, ":", &last);
+    }
+    scope_free(copy);
+}
+
 void
 cfgCmdDirSetFromStr(config_t* cfg, const char* value)
 {
@@ -1333,12 +1396,56 @@ processMtcWatchType(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     for(category = CFG_MTC_FS; category <= CFG_MTC_STATSD; ++category) {
         if (!scope_strcmp(value, mtcWatchTypeMap[category].str)) {
             cfgMtcWatchEnableSet(config, TRUE, category);
+            mtc_watch_context = category;
         }
     }
 
     if (value) scope_free(value);
 }
 
+static void
+processMtcWatchTop(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    if (node->type != YAML_SCALAR_NODE) return;
+    if (mtc_watch_context == -1) return;
+
+    char* value = stringVal(node);
+    cfgMtcWatchTopSetFromStr(config, value, mtc_watch_context);
+    if (value) scope_free(value);
+}
+
+static void
+processMtcWatchMaxSeries(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    if (node->type != YAML_SCALAR_NODE) return;
+
+    // watch maxseries is only valid for statsd
+    if (mtc_watch_context != CFG_MTC_STATSD) return;
+
+    char* value = stringVal(node);
+    cfgMtcStatsDMaxSeriesSetFromStr(config, value);
+    if (value) scope_free(value);
+}
+
+static void
+processMtcWatchPaths(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    if (node->type != YAML_SEQUENCE_NODE) return;
+
+    // watch paths is only valid for fs
+    if (mtc_watch_context != CFG_MTC_FS) return;
+
+    cfgMtcFsPathsClear(config);
+
+    yaml_node_item_t *item;
+    foreach(item, node->data.sequence.items) {
+        yaml_node_t *node = yaml_document_get_node(doc, *item);
+        char *value = stringVal(node);
+        cfgMtcFsPathSet(config, value);
+        if (value) scope_free(value);
+    }
+}
+
 static void
 processMtcSource(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 {
@@ -1346,11 +1453,24 @@ processMtcSource(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 
     parse_table_t t[] = {
         {YAML_SCALAR_NODE,    TYPE_NODE,            processMtcWatchType},
+        {YAML_SCALAR_NODE,    TOP_NODE,             processMtcWatchTop},
+        {YAML_SEQUENCE_NODE,  PATHS_NODE,           processMtcWatchPaths},
+        {YAML_SCALAR_NODE,    MAXSERIES_NODE,       processMtcWatchMaxSeries},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
 
+    mtc_watch_context = -1;
+
     yaml_node_pair_t* pair;
+    // process type first
+    foreach(pair, node->data.mapping.pairs) {
+        if (!isWatchType(doc, pair)) continue;
+        processKeyValuePair(t, pair, config, doc);
+        break;
+    }
+    // Then process everything else
     foreach(pair, node->data.mapping.pairs) {
+        if (isWatchType(doc, pair)) continue;
         processKeyValuePair(t, pair, config, doc);
     }
 }
@@ -1802,10 +1922,8 @@ processProtocolEntry(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     // init the regex
     int errornumber;
     PCRE2_SIZE erroroffset;
-    protocol_context->re = pcre2_compile(
-            (PCRE2_SPTR)protocol_context->regex,
-            PCRE2_ZERO_TERMINATED, 0,
-            &errornumber, &erroroffset, NULL);
+    protocol_context->re = regexCompile(protocol_context->regex,
+            &errornumber, &erroroffset);
     if (!protocol_context->re) {
         scopeLogWarn("WARN: invalid regex for \"%s\" protocol entry; %s\n",
                  protocol_context->protname, protocol_context->regex);
@@ -2380,13 +2498,35 @@ err:
 }
 
 static cJSON*
-createMetricWatchObjectJson(config_t *cfg, const char* name)
+createMetricWatchObjectJson(config_t *cfg, metric_watch_t category)
 {
     cJSON *root = NULL;
 
     if (!(root = cJSON_CreateObject())) goto err;
 
-    if (!cJSON_AddStringToObjLN(root, TYPE_NODE, name)) goto err;
+    if (!cJSON_AddStringToObjLN(root, TYPE_NODE,
+                                  mtcWatchTypeMap[category].str)) goto err;
+
+    unsigned top = cfgMtcWatchTop(cfg, category);
+    if (top && !cJSON_AddNumberToObjLN(root, TOP_NODE, top)) goto err;
+
+    if ((category == CFG_MTC_STATSD) &&
+        (cfgMtcStatsDMaxSeries(cfg) != DEFAULT_STATSD_MAX_SERIES) &&
+        !cJSON_AddNumberToObjLN(root, MAXSERIES_NODE,
+                                cfgMtcStatsDMaxSeries(cfg))) goto err;
+
+    if ((category == CFG_MTC_FS) && cfgMtcFsNumPaths(cfg)) {
+        cJSON *paths = cJSON_CreateArray();
+        if (!paths) goto err;
+        cJSON_AddItemToObject(root, PATHS_NODE, paths);
+
+        int i;
+        for (i = 0; i < cfgMtcFsNumPaths(cfg); i++) {
+            cJSON *path = cJSON_CreateString(cfgMtcFsPath(cfg, i));
+            if (!path) goto err;
+            cJSON_AddItemToArray(paths, path);
+        }
+    }
 
     return root;
 err:
@@ -2405,7 +2545,7 @@ createMetricWatchArrayJson(config_t* cfg)
     for(category = CFG_MTC_FS; category <= CFG_MTC_STATSD; ++category) {
         cJSON* item;
         if (!cfgMtcWatchEnable(cfg, category)) continue;
-        if (!(item = createMetricWatchObjectJson(cfg, mtcWatchTypeMap[category].str))) goto err;
+        if (!(item = createMetricWatchObjectJson(cfg, category))) goto err;
         cJSON_AddItemToArray(root, item);
     }
 
@@ -3460,6 +3600,222 @@ processRulesSourceSection(yaml_document_t *doc, char **unixPath) {
     }
 }
 
+/*
+ * Compiled rules
+ *
+ * Every process libscope is loaded into checks the rules file to decide if
+ * it should be scoped. With ld.so.preload that's every process on the host,
+ * and most of them are denied. Parsing the rules file for each of them (to
+ * validate it and again to match it) is most of what our constructor costs
+ * a process we end up not scoping.
+ *
+ * So the loader compiles the rules file, when it installs it, to an index
+ * in <rules file>.idx (see rulesidx.h). Processes map the index and match
+ * against it without parsing anything. libscope never writes the index;
+ * when there isn't one that's current, the rules file is used as it always
+ * was.
+ */
+typedef struct {
+    rules_idx_hdr_t *hdr;   // and everything after it
+    size_t size;
+} rules_idx_t;
+
+// Everything is checked once, so that matching doesn't have to
+static bool
+rulesIdxIsSound(const rules_idx_hdr_t *hdr, size_t size)
+{
+    if ((size < sizeof(rules_idx_hdr_t)) ||
+        (hdr->magic != RULES_IDX_MAGIC) ||
+        (hdr->version != RULES_IDX_VERSION) ||
+        (hdr->size != size)) return FALSE;
+
+    if ((hdr->allowOff > size) ||
+        (hdr->allowCount > (size - hdr->allowOff) / sizeof(rules_op_t)) ||
+        (hdr->denyOff > size) ||
+        (hdr->denySlots > (size - hdr->denyOff) / sizeof(rules_slot_t)) ||
+        (hdr->denySlots & (hdr->denySlots - 1)) ||
+        (hdr->argOff > size) ||
+        (hdr->argCount > (size - hdr->argOff) / sizeof(uint32_t)) ||
+        (hdr->strOff > size) ||
+        (hdr->strSize > size - hdr->strOff) ||
+        !hdr->strSize) return FALSE;
+
+    const char *str = (const char *)hdr + hdr->strOff;
+    if (str[hdr->strSize - 1] || (hdr->unixPath >= hdr->strSize)) return FALSE;
+
+    const rules_op_t *op = (const rules_op_t *)((const char *)hdr + hdr->allowOff);
+    uint32_t i;
+    for (i = 0; i < hdr->allowCount; i++) {
+        if ((op[i].str >= hdr->strSize) || (op[i].len >= hdr->strSize - op[i].str)) return FALSE;
+    }
+    const rules_slot_t *slot = (const rules_slot_t *)((const char *)hdr + hdr->denyOff);
+    for (i = 0; i < hdr->denySlots; i++) {
+        if (slot[i].str >= hdr->strSize) return FALSE;
+    }
+    const uint32_t *arg = (const uint32_t *)((const char *)hdr + hdr->argOff);
+    for (i = 0; i < hdr->argCount; i++) {
+        if (arg[i] >= hdr->strSize) return FALSE;
+    }
+    return TRUE;
+}
+
+// TRUE if the index was compiled from the rules file as it is now
+static bool
+rulesIdxIsFor(const rules_idx_hdr_t *hdr, const struct stat *rules)
+{
+    return (hdr->dev == rules->st_dev) &&
+           (hdr->ino == rules->st_ino) &&
+           (hdr->fileSize == rules->st_size) &&
+           (hdr->mtimeSec == rules->st_mtim.tv_sec) &&
+           (hdr->mtimeNsec == rules->st_mtim.tv_nsec);
+}
+
+/*
+ * An index that anyone else could have written isn't used; it would let
+ * them decide what's scoped, and with what config.
+ */
+static bool
+rulesIdxMap(const char *idxPath, const struct stat *rules, rules_idx_t *idx)
+{
+    struct stat sbuf;
+
+    int fd = scope_open(idxPath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return FALSE;
+
+    if ((scope_fstat(fd, &sbuf) == -1) ||
+        !S_ISREG(sbuf.st_mode) ||
+        (sbuf.st_mode & (S_IWGRP | S_IWOTH)) ||
+        ((sbuf.st_uid != 0) && (sbuf.st_uid != scope_geteuid()) &&
+         (sbuf.st_uid != rules->st_uid)) ||
+        (sbuf.st_size < sizeof(rules_idx_hdr_t)) ||
+        (sbuf.st_size > RULES_IDX_MAX_SIZE)) {
+        scope_close(fd);
+        return FALSE;
+    }
+
+    void *mem = scope_mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    scope_close(fd);
+    if (mem == MAP_FAILED) return FALSE;
+
+    rules_idx_hdr_t *hdr = mem;
+    if (!rulesIdxIsSound(hdr, sbuf.st_size) || !rulesIdxIsFor(hdr, rules)) {
+        // stale, or not an index
+        scope_munmap(mem, sbuf.st_size);
+        return FALSE;
+    }
+
+    idx->hdr = hdr;
+    idx->size = sbuf.st_size;
+    return TRUE;
+}
+
+static bool
+rulesIdxLoad(const char *rulesPath, rules_idx_t *idx)
+{
+    struct stat sbuf;
+    char idxPath[PATH_MAX];
+
+    if (!rulesPath || (scope_stat(rulesPath, &sbuf) == -1)) return FALSE;
+    if (scope_snprintf(idxPath, sizeof(idxPath), "%s%s", rulesPath, RULES_IDX_EXT) >= sizeof(idxPath)) {
+        return FALSE;
+    }
+
+    return rulesIdxMap(idxPath, &sbuf, idx);
+}
+
+static void
+rulesIdxRelease(rules_idx_t *idx)
+{
+    if (!idx->hdr) return;
+    scope_munmap(idx->hdr, idx->size);
+    idx->hdr = NULL;
+}
+
+static const char *
+rulesIdxStr(const rules_idx_t *idx, uint32_t str)
+{
+    return (const char *)idx->hdr + idx->hdr->strOff + str;
+}
+
+static void
+rulesApplyConfig(config_t *cfg, const char *yaml, size_t len)
+{
+    yaml_parser_t parser;
+    yaml_document_t doc;
+
+    if (!yaml_parser_initialize(&parser)) return;
+    yaml_parser_set_input_string(&parser, (const unsigned char *)yaml, len);
+    if (yaml_parser_load(&parser, &doc)) {
+        yaml_node_t *node = yaml_document_get_root_node(&doc);
+        if (node && (node->type == YAML_MAPPING_NODE)) processRoot(cfg, &doc, node);
+        yaml_document_delete(&doc);
+    }
+    yaml_parser_delete(&parser);
+}
+
+/*
+ * Same result as processRulesRootNode(); the allow rules are evaluated in
+ * order, since the config of a rule that matched is applied as it's found.
+ */
+static proc_status
+rulesIdxMatch(const rules_idx_t *idx, const char *procName, const char *procCmdLine, config_t *cfg)
+{
+    const rules_idx_hdr_t *hdr = idx->hdr;
+    const rules_op_t *op = (const rules_op_t *)((const char *)hdr + hdr->allowOff);
+    uint32_t hash = rulesHash(procName);
+    proc_status status = PROC_NOT_FOUND;
+    bool rulesMatch = FALSE;
+    uint32_t i;
+
+    for (i = 0; i < hdr->allowCount; i++, op++) {
+        switch (op->type) {
+            case RULES_OP_PROCNAME:
+                if ((op->hash != hash) || scope_strcmp(rulesIdxStr(idx, op->str), procName)) break;
+                // fall through
+            case RULES_OP_PROCNAME_ALL:
+                status = PROC_ALLOWED;
+                rulesMatch = TRUE;
+                break;
+            case RULES_OP_ARG:
+                rulesMatch = (scope_strstr(procCmdLine, rulesIdxStr(idx, op->str)) != NULL);
+                status = rulesMatch ? PROC_ALLOWED : PROC_DENIED;
+                break;
+            case RULES_OP_ARG_ALL:
+                status = PROC_ALLOWED;
+                rulesMatch = TRUE;
+                break;
+            case RULES_OP_CONFIG:
+                if (rulesMatch) {
+                    rulesApplyConfig(cfg, rulesIdxStr(idx, op->str), op->len);
+                    rulesMatch = FALSE;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (hdr->flags & RULES_IDX_DENY_ALL) return PROC_DENIED;
+
+    if (hdr->denySlots) {
+        const rules_slot_t *slot = (const rules_slot_t *)((const char *)hdr + hdr->denyOff);
+        uint32_t mask = hdr->denySlots - 1;
+        uint32_t s = hash & mask;
+        for (i = 0; (i < hdr->denySlots) && slot[s].str; i++, s = (s + 1) & mask) {
+            if ((slot[s].hash == hash) && !scope_strcmp(rulesIdxStr(idx, slot[s].str), procName)) {
+                return PROC_DENIED;
+            }
+        }
+    }
+
+    const uint32_t *arg = (const uint32_t *)((const char *)hdr + hdr->argOff);
+    for (i = 0; i < hdr->argCount; i++) {
+        if (scope_strstr(procCmdLine, rulesIdxStr(idx, arg[i]))) return PROC_DENIED;
+    }
+
+    return status;
+}
+
 /*
  * Parse scope rules file
  *
@@ -3526,8 +3882,13 @@ cfgRulesStatus(const char *procName, const char *procCmdLine, const char *rulesP
                          .status = PROC_NOT_FOUND,
                          .rulesMatch = FALSE,
                          .cfg = cfg};
-    bool res = rulesParseFile(rulesPath, &fCfg);
-    if (res == FALSE) {
+    rules_idx_t idx = {0};
+    if (rulesIdxLoad(rulesPath, &idx)) {
+        bool parsed = ((idx.hdr->flags & RULES_IDX_PARSED) != 0);
+        if (parsed) fCfg.status = rulesIdxMatch(&idx, procName, procCmdLine, cfg);
+        rulesIdxRelease(&idx);
+        if (!parsed) return RULES_ERROR;
+    } else if (rulesParseFile(rulesPath, &fCfg) == FALSE) {
         return RULES_ERROR;
     }
 
@@ -3547,7 +3908,8 @@ const char *
 cfgRulesFilePath(void)
 {
     char *rulesFilePath = NULL;
-    char *envRulesVal = getenv("SCOPE_RULES");
+    // A setuid/setgid process doesn't get its rules from whoever started it
+    char *envRulesVal = getauxval(AT_SECURE) ? NULL : getenv("SCOPE_RULES");
 //    const char *criblHome = getenv("CRIBL_HOME");
 //    char criblRulesPath[PATH_MAX];
 
@@ -3601,6 +3963,18 @@ cfgRulesUnixPath(void) {
         return unixPath;
     }
 
+    rules_idx_t idx = {0};
+    if (rulesIdxLoad(rulesPath, &idx)) {
+        if (idx.hdr->unixPath) {
+            unixPath = scope_strdup(rulesIdxStr(&idx, idx.hdr->unixPath));
+        }
+        rulesIdxRelease(&idx);
+        if (unixPath) {
+            unixPath = scope_dirname(unixPath);
+        }
+        return unixPath;
+    }
+
     FILE *fp = scope_fopen(rulesPath, "rb");
     if (!fp) {
         return unixPath;
@@ -3666,6 +4040,13 @@ cfgRulesFileIsValid(const char *rulesPath) {
     bool status = FALSE;
     bool res;
 
+    rules_idx_t idx = {0};
+    if (rulesIdxLoad(rulesPath, &idx)) {
+        status = ((idx.hdr->flags & RULES_IDX_VALID) != 0);
+        rulesIdxRelease(&idx);
+        return status;
+    }
+
     if ((fs = scope_fopen(rulesPath, "rb")) == NULL) {
         return status;
     }
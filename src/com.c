@@ -293,6 +293,10 @@ msgEventGet(ctl_t *ctl)
 // To address this, have a lazily-allocated pool of stacks.
 // Once allocated, never free stacks in this pool, instead just
 // keep track of whether each stack is available for reuse.
+//
+// Each pool entry also carries the match data, match context and
+// JIT stack used by regexMatch(), so a thread borrowing an entry
+// borrows everything it needs to run a match without allocating.
 
 // Why 48? Primarily to support 48 concurrent threads,
 // but also to provide some slop. Slop for the unlikely case
@@ -304,10 +308,18 @@ msgEventGet(ctl_t *ctl)
 typedef struct {
     uint64_t used;
     char *addr;
+    pcre2_match_data *match_data;
+    pcre2_match_context *mcontext;
+    pcre2_jit_stack *jit_stack;
 } pool_t;
 
 static pool_t g_stack_pool[POOL_MAX] = {0};
 
+// Threads created by libscope (the periodic thread) run on a stack we
+// know has plenty of headroom.  They can call pcre2 without switching
+// to a pool stack first.
+static __thread bool g_regex_stack_headroom = FALSE;
+
 static bool
 grab_unused(pool_t *entry)
 {
@@ -316,8 +328,17 @@ grab_unused(pool_t *entry)
     return atomicCasU64(&entry->used, (uint64_t)FALSE, (uint64_t)TRUE);
 }
 
-static char *
-get_stack(void)
+static void
+put_entry(pool_t *entry)
+{
+    if (!atomicCasU64(&entry->used, (uint64_t)TRUE, (uint64_t)FALSE)) {
+         scopeLogError("put_entry failed to set used to FALSE");
+    }
+}
+
+// Returns a pool entry with a stack, or NULL if the pool is exhausted
+static pool_t *
+get_entry(void)
 {
     int i;
     for (i=0; i<POOL_MAX; i++) {
@@ -326,21 +347,28 @@ get_stack(void)
         if (!entry->used && grab_unused(entry)) {
 
             // Sweet!  Our thread grabbed an allocated spot!
-            if (entry->addr) return entry->addr;
+            if (entry->addr) return entry;
 
             // We have a spot, but we need to allocate a stack here.
             entry->addr = scope_malloc(PCRE_STACK_SIZE);
-            if (entry->addr) return entry->addr;
+            if (entry->addr) return entry;
 
             // We got a spot, but our malloc failed. Put the spot back
             // into the unused pool. Stop looping if this happens.
-            if (!atomicCasU64(&entry->used, (uint64_t)TRUE, (uint64_t)FALSE)) {
-                 scopeLogError("get_stack failed to set used to FALSE");
-            }
+            put_entry(entry);
             break;
         }
     }
 
+    return NULL;
+}
+
+static char *
+get_stack(void)
+{
+    pool_t *entry = get_entry();
+    if (entry) return entry->addr;
+
     // Our attempt to use the pool failed.
     // All pool entries were probably in use.
     // As a fall-back, do an allocation that's not from the pool
@@ -358,9 +386,7 @@ free_stack(char *addr)
 
             // Addr is in the pool. Don't free addr, but set used to false
             // to allow reuse.
-            if (!atomicCasU64(&entry->used, (uint64_t)TRUE, (uint64_t)FALSE)) {
-                 scopeLogError("free_stack failed to set used to FALSE");
-            }
+            put_entry(entry);
             return;
         }
     }
@@ -370,18 +396,13 @@ free_stack(char *addr)
     scope_free(addr);
 }
 
-
-int
-pcre2_match_wrapper(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
-                    PCRE2_SIZE startoffset, uint32_t options,
-                    pcre2_match_data *match_data, pcre2_match_context *mcontext)
+static int
+pcre2_match_on_stack(char *pcre_stack, pcre2_code *re, PCRE2_SPTR data,
+                     PCRE2_SIZE size, PCRE2_SIZE startoffset, uint32_t options,
+                     pcre2_match_data *match_data, pcre2_match_context *mcontext)
 {
     int rc;
-    char *pcre_stack = NULL, *tstack = NULL, *gstack = NULL;
-    if ((pcre_stack = get_stack()) == NULL) {
-        scopeLogError("ERROR; pcre2_match_wrapper: get_stack");
-        return -1;
-    }
+    char *tstack = NULL, *gstack = NULL;
 
     tstack = pcre_stack + PCRE_STACK_SIZE;
 
@@ -434,6 +455,29 @@ pcre2_match_wrapper(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
    #error Bad arch defined
 #endif
 
+    return rc;
+}
+
+int
+pcre2_match_wrapper(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
+                    PCRE2_SIZE startoffset, uint32_t options,
+                    pcre2_match_data *match_data, pcre2_match_context *mcontext)
+{
+    int rc;
+    char *pcre_stack = NULL;
+
+    if (g_regex_stack_headroom) {
+        return pcre2_match(re, data, size, startoffset, options, match_data, mcontext);
+    }
+
+    if ((pcre_stack = get_stack()) == NULL) {
+        scopeLogError("ERROR; pcre2_match_wrapper: get_stack");
+        return -1;
+    }
+
+    rc = pcre2_match_on_stack(pcre_stack, re, data, size, startoffset,
+                              options, match_data, mcontext);
+
     if (pcre_stack) free_stack(pcre_stack);
     return rc;
 }
@@ -445,6 +489,10 @@ regexec_wrapper(const regex_t *preg, const char *string, size_t nmatch,
     int rc;
     char *pcre_stack = NULL, *tstack = NULL, *gstack = NULL;
 
+    if (g_regex_stack_headroom) {
+        return regexec(preg, string, nmatch, pmatch, eflags);
+    }
+
      if ((pcre_stack = get_stack()) == NULL) {
         scopeLogError("ERROR; regexec_wrapper: get_stack");
         return -1;
@@ -502,6 +550,153 @@ regexec_wrapper(const regex_t *preg, const char *string, size_t nmatch,
     return rc;
 }
 
+void
+regexSetStackHeadroom(bool headroom)
+{
+    g_regex_stack_headroom = headroom;
+}
+
+pcre2_code *
+regexCompile(const char *pattern, int *errNum, PCRE2_SIZE *errPos)
+{
+    int num;
+    PCRE2_SIZE pos;
+    pcre2_code *re = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, 0,
+                                   errNum ? errNum : &num,
+                                   errPos ? errPos : &pos, NULL);
+    if (!re) return NULL;
+
+    // If the JIT isn't available (unsupported arch, or executable memory
+    // is denied us) pcre2_match() just keeps using the interpreter.
+    if (pcre2_jit_compile(re, PCRE2_JIT_COMPLETE)) {
+        scopeLogDebug("DEBUG: regex %s will not be JIT compiled", pattern);
+    }
+
+    return re;
+}
+
+// The match context points the JIT at a stack on the heap.  Left to
+// its own devices the JIT puts 32KB on the machine stack, which is
+// all the room a pool stack has.
+static bool
+regexResourcesCreate(pcre2_match_data **match_data, pcre2_match_context **mcontext,
+                     pcre2_jit_stack **jit_stack, uint32_t ovecsize)
+{
+    *match_data = pcre2_match_data_create(ovecsize, NULL);
+    *mcontext = pcre2_match_context_create(NULL);
+    *jit_stack = pcre2_jit_stack_create(REGEX_JIT_STACK_MIN, REGEX_JIT_STACK_MAX, NULL);
+    if (*match_data && *mcontext && *jit_stack) {
+        pcre2_jit_stack_assign(*mcontext, NULL, *jit_stack);
+        return TRUE;
+    }
+
+    if (*match_data) pcre2_match_data_free(*match_data);
+    if (*mcontext) pcre2_match_context_free(*mcontext);
+    if (*jit_stack) pcre2_jit_stack_free(*jit_stack);
+    *match_data = NULL;
+    *mcontext = NULL;
+    *jit_stack = NULL;
+    return FALSE;
+}
+
+// For when the pool is exhausted, or the pattern has too many captures
+// for the pooled match data.  Everything is allocated for this match alone.
+static int
+regexMatchUnpooled(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
+                   uint32_t captures, pcre2_match_data **results)
+{
+    int rc;
+    char *pcre_stack = NULL;
+    pcre2_match_data *match_data;
+    pcre2_match_context *mcontext;
+    pcre2_jit_stack *jit_stack;
+
+    if (!regexResourcesCreate(&match_data, &mcontext, &jit_stack, captures + 1)) {
+        return PCRE2_ERROR_NOMEMORY;
+    }
+
+    if (g_regex_stack_headroom) {
+        rc = pcre2_match(re, data, size, 0, 0, match_data, mcontext);
+    } else if ((pcre_stack = scope_malloc(PCRE_STACK_SIZE))) {
+        rc = pcre2_match_on_stack(pcre_stack, re, data, size, 0, 0, match_data, mcontext);
+        scope_free(pcre_stack);
+    } else {
+        rc = PCRE2_ERROR_NOMEMORY;
+    }
+
+    pcre2_match_context_free(mcontext);
+    pcre2_jit_stack_free(jit_stack);
+
+    if (results && (rc >= 0)) {
+        *results = match_data;
+    } else {
+        pcre2_match_data_free(match_data);
+    }
+    return rc;
+}
+
+int
+regexMatch(pcre2_code *re, PCRE2_SPTR data, PCRE2_SIZE size,
+           pcre2_match_data **results)
+{
+    int rc;
+    uint32_t captures = 0;
+    pool_t *entry;
+
+    if (results) *results = NULL;
+    if (!re || !data) return PCRE2_ERROR_NULL;
+
+    if (pcre2_pattern_info(re, PCRE2_INFO_CAPTURECOUNT, &captures) ||
+        (captures >= REGEX_OVEC_MAX) ||
+        !(entry = get_entry())) {
+        return regexMatchUnpooled(re, data, size, captures, results);
+    }
+
+    // The match resources are created the first time an entry is used
+    // and stay with the entry from then on.
+    if (!entry->match_data &&
+        !regexResourcesCreate(&entry->match_data, &entry->mcontext,
+                              &entry->jit_stack, REGEX_OVEC_MAX)) {
+        put_entry(entry);
+        return regexMatchUnpooled(re, data, size, captures, results);
+    }
+
+    if (g_regex_stack_headroom) {
+        rc = pcre2_match(re, data, size, 0, 0, entry->match_data, entry->mcontext);
+    } else {
+        rc = pcre2_match_on_stack(entry->addr, re, data, size, 0, 0,
+                                  entry->match_data, entry->mcontext);
+    }
+
+    // Hold on to the entry while the caller looks at the results
+    if (results && (rc >= 0)) {
+        *results = entry->match_data;
+    } else {
+        put_entry(entry);
+    }
+    return rc;
+}
+
+void
+regexMatchRelease(pcre2_match_data *results)
+{
+    int i;
+
+    if (!results) return;
+
+    for (i=0; i<POOL_MAX; i++) {
+        pool_t *entry = &g_stack_pool[i];
+
+        if (entry->match_data == results) {
+            put_entry(entry);
+            return;
+        }
+    }
+
+    // Not from the pool; regexMatchUnpooled() allocated it.
+    pcre2_match_data_free(results);
+}
+
 bool
 cmdCbufEmpty(ctl_t *ctl)
 {
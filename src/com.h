@@ -17,6 +17,9 @@
 #include "pcre2.h"
 
 #define PCRE_STACK_SIZE (32 * 1024)
+#define REGEX_OVEC_MAX 16
+#define REGEX_JIT_STACK_MIN (32 * 1024)
+#define REGEX_JIT_STACK_MAX (256 * 1024)
 
 extern unsigned g_sendprocessstart;
 extern bool g_exitdone;
@@ -57,6 +60,16 @@ int pcre2_match_wrapper(pcre2_code *, PCRE2_SPTR, PCRE2_SIZE, PCRE2_SIZE,
                         uint32_t, pcre2_match_data *, pcre2_match_context *);
 int regexec_wrapper(const regex_t *, const char *, size_t, regmatch_t *, int);
 
+// regex
+// Patterns from regexCompile are JIT compiled when the JIT is available.
+// regexMatch borrows pooled match data; when *results is set on return,
+// the caller is done with it after calling regexMatchRelease.
+pcre2_code *regexCompile(const char *, int *, PCRE2_SIZE *);
+int regexMatch(pcre2_code *, PCRE2_SPTR, PCRE2_SIZE, pcre2_match_data **);
+void regexMatchRelease(pcre2_match_data *);
+// Called from threads that run on a stack with known headroom
+void regexSetStackHeadroom(bool);
+
 bool cmdCbufEmpty(ctl_t *);
 
 // payloads
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <sys/time.h>
 
+#include "arena.h"
 #include "circbuf.h"
 #include "cfgutils.h"
 #include "com.h"
@@ -825,19 +826,23 @@ ctlPostEvent(ctl_t *ctl, char *event)
 static log_event_t *
 createInternalLogEvent(int fd, const char *path, const void *buf, size_t count, uint64_t uid, proc_id_t *proc, watch_t logType, regex_t *valfilter)
 {
-    log_event_t *event = scope_calloc(1, sizeof(*event));
-    char *data = scope_malloc(count);
-    char *src = scope_strdup(path);
+    if (!path) return NULL;
 
-    if (!event || !data || !path) {
+    size_t pathlen = scope_strlen(path) + 1;
+    log_event_t *event = arenaCalloc(1, sizeof(*event));
+    char *data = arenaMallocBuffer(count);
+    char *src = arenaMallocBuffer(pathlen);
+
+    if (!event || !data || !src) {
         DBG("event = %p, data = %p, src = %p", event, data, src);
-        if (event) scope_free(event);
-        if (data) scope_free(data);
-        if (src) scope_free(src);
+        if (event) arenaFree(event);
+        if (data) arenaFree(data);
+        if (src) arenaFree(src);
         return NULL;
     }
 
     scope_memcpy(data, buf, count);
+    scope_memcpy(src, path, pathlen);
 
     struct timeval tv;
     scope_gettimeofday(&tv, NULL);
@@ -860,9 +865,9 @@ destroyInternalLogEvent(log_event_t **eventptr)
     if (!eventptr || !*eventptr) return;
 
     log_event_t *event = *eventptr;
-    if (event->id.path) scope_free(event->id.path);
-    if (event->data)    scope_free(event->data);
-    if (event)          scope_free(event);
+    if (event->id.path) arenaFree(event->id.path);
+    if (event->data)    arenaFree(event->data);
+    if (event)          arenaFree(event);
     *eventptr = NULL;
 }
 
@@ -899,12 +904,7 @@ ctlSendLog(ctl_t *ctl, int fd, const char *path, const void *buf, size_t count,
         return 0;
     }
 
-    // We can't run the value filter on what might be raw binary data.
-    // Grab the correct one for our logType, and send a pointer of
-    // it to be used later, after we've created a string from the data.
-    filter = evtFormatValueFilter(ctl->evt, logType);
-
-    log_event_t *logevent = NULL;
+    bool binary = FALSE;
     if (!ctl->allow_binary_console && (logType == CFG_SRC_CONSOLE)) {
 
         // Grab previous data_content, then compute and save new data_content
@@ -914,16 +914,28 @@ ctlSendLog(ctl_t *ctl, int fd, const char *path, const void *buf, size_t count,
 
         // Report only first event of binary data, drop and ignore rest
         if (cur_data_content == FS_CONTENT_BINARY) {
-            if (prev_data_content != FS_CONTENT_BINARY) {
-                logevent = createInternalLogEvent(fd, path, BINARY_DATA_MSG, C_STRLEN(BINARY_DATA_MSG), uid, proc, logType, filter);
-            } else {
-                return -1;
-            }
+            if (prev_data_content == FS_CONTENT_BINARY) return -1;
+            binary = TRUE;
         }
     }
 
-    // This will be true for CFG_SRC_FILE, or if CFG_SRC_CONSOLE is TEXT.
-    if (!logevent) {
+    // Don't bother copying data we'd drop when formatting it; it's
+    // dropped on purpose, so it isn't an error
+    if (evtFormatRateLimited(ctl->evt, logType)) {
+        evtFormatRateLimitDrop(ctl->evt, logType);
+        return 0;
+    }
+
+    // We can't run the value filter on what might be raw binary data.
+    // Grab the correct one for our logType, and send a pointer of
+    // it to be used later, after we've created a string from the data.
+    filter = evtFormatValueFilter(ctl->evt, logType);
+
+    log_event_t *logevent = NULL;
+    if (binary) {
+        logevent = createInternalLogEvent(fd, path, BINARY_DATA_MSG, C_STRLEN(BINARY_DATA_MSG), uid, proc, logType, filter);
+    } else {
+        // This will be true for CFG_SRC_FILE, or if CFG_SRC_CONSOLE is TEXT.
         logevent = createInternalLogEvent(fd, path, buf, count, uid, proc, logType, filter);
     }
 
@@ -966,7 +978,7 @@ createLogEventJson(ctl_t *ctl, streambuf_t *stmbuf)
         }
     }
 
-    if (!(root = fmtEventJson(ctl->evt, &event))) goto out;
+    if (!(root = evtFormatLog(ctl->evt, &event))) goto out;
 
     successful = TRUE;
 out:
@@ -975,7 +987,7 @@ out:
         root = NULL;
     }
     scope_free(stmbuf->buf);
-    scope_free(stmbuf->id.path);
+    arenaFree(stmbuf->id.path);
 
     return root;
 }
@@ -1284,6 +1296,29 @@ ctlEvtSourceEnabled(ctl_t *ctl, watch_t src)
     return srcEnabledDefault[CFG_SRC_FILE];
 }
 
+/*
+ * Every event posted from the datapath is formatted as a metric event
+ * in addition to any event of its own source.  Returns TRUE when all of
+ * the enabled sources a post would feed are over their rate limit for
+ * the current second; the caller is expected to drop the post.
+ */
+bool
+ctlEvtRateLimited(ctl_t *ctl, watch_t src)
+{
+    if (!ctl || !ctl->evt || src >= CFG_SRC_MAX) return FALSE;
+
+    bool metric = evtFormatSourceEnabled(ctl->evt, CFG_SRC_METRIC);
+    bool other = (src != CFG_SRC_METRIC) && evtFormatSourceEnabled(ctl->evt, src);
+    if (!metric && !other) return FALSE;
+
+    if (metric && !evtFormatRateLimited(ctl->evt, CFG_SRC_METRIC)) return FALSE;
+    if (other && !evtFormatRateLimited(ctl->evt, src)) return FALSE;
+
+    if (metric) evtFormatRateLimitDrop(ctl->evt, CFG_SRC_METRIC);
+    if (other) evtFormatRateLimitDrop(ctl->evt, src);
+    return TRUE;
+}
+
 unsigned
 ctlEnhanceFs(ctl_t *ctl)
 {
@@ -138,6 +138,7 @@ transport_status_t  ctlConnectionStatus(ctl_t *, which_transport_t);
 
 // Accessor for performance
 bool            ctlEvtSourceEnabled(ctl_t *, watch_t);
+bool            ctlEvtRateLimited(ctl_t *, watch_t);
 
 unsigned         ctlEnhanceFs(ctl_t *);
 void             ctlEnhanceFsSet(ctl_t *, unsigned);
@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "dbg.h"
+#include "dnsanswer.h"
+#include "scopestdlib.h"
+
+#define DNS_HEADER_LEN 12
+#define DNS_RR_FIXED_LEN 10     // type, class, ttl, rdlength
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+
+// A name can't be longer than 255 bytes, so more jumps than this
+// means a compression loop
+#define DNS_MAX_NAME_JUMPS 64
+
+typedef struct {
+    uint64_t key;
+    time_t expires;
+    unsigned repeats;
+    dns_answer_t answer;        // the last one reported, to flush repeats
+} dns_cache_entry_t;
+
+struct _dns_cache_t {
+    size_t mask;
+    dns_cache_entry_t *entries;
+    dns_repeats_fn flush;
+};
+
+static inline uint16_t
+get16(const unsigned char *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t
+get32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/*
+ * Read the name at off. Returns the offset just past the name as it
+ * appears at off (a compression pointer is two bytes), or -1 if the
+ * name is malformed. When out is not NULL, the dotted name is written
+ * there; characters that aren't printable are replaced with '?'.
+ */
+static int
+readName(const unsigned char *pkt, size_t len, size_t off, char *out, size_t outlen)
+{
+    int next = -1;
+    int jumps = 0;
+    size_t used = 0;
+
+    while (off < len) {
+        unsigned char label = pkt[off];
+
+        if (label == 0) {
+            if (next == -1) next = off + 1;
+            if (out && outlen) out[(used) ? used - 1 : 0] = '\0';
+            return next;
+        }
+
+        if ((label & 0xc0) == 0xc0) {
+            if ((off + 1 >= len) || (++jumps > DNS_MAX_NAME_JUMPS)) return -1;
+            if (next == -1) next = off + 2;
+            off = ((label & 0x3f) << 8) | pkt[off + 1];
+            continue;
+        }
+
+        // 0x40 and 0x80 are reserved label types
+        if (label & 0xc0) return -1;
+        if (off + 1 + label > len) return -1;
+
+        if (out) {
+            if (used + label + 1 >= outlen) return -1;
+            for (size_t i = 0; i < label; i++) {
+                unsigned char c = pkt[off + 1 + i];
+                out[used++] = ((c > 0x20) && (c < 0x7f)) ? c : '?';
+            }
+            out[used++] = '.';
+        }
+        off += 1 + label;
+    }
+
+    return -1;
+}
+
+/*
+ * Decode the response in pkt into ans, which should start zeroed.
+ * Set tcp when pkt starts with the two byte length used over TCP.
+ * Returns TRUE if pkt is a response with at least one answer record.
+ */
+bool
+dnsAnswerParse(const unsigned char *pkt, size_t len, bool tcp, dns_answer_t *ans)
+{
+    if (!pkt || !ans) return FALSE;
+
+    if (tcp) {
+        if (len < 2) return FALSE;
+        size_t msglen = get16(pkt);
+        pkt += 2;
+        len -= 2;
+        if (msglen < len) len = msglen;
+    }
+
+    if (len < DNS_HEADER_LEN) return FALSE;
+
+    // Must be a response (QR set)
+    if (!(pkt[2] & 0x80)) return FALSE;
+
+    uint16_t qdcount = get16(&pkt[4]);
+    uint16_t ancount = get16(&pkt[6]);
+    if (ancount == 0) return FALSE;
+
+    int off = DNS_HEADER_LEN;
+    for (int i = 0; i < qdcount; i++) {
+        if ((off = readName(pkt, len, off, NULL, 0)) == -1) return FALSE;
+        off += 4;   // qtype, qclass
+        if (off > len) return FALSE;
+    }
+
+    for (int i = 0; i < ancount; i++) {
+        char *domain = (ans->domain[0]) ? NULL : ans->domain;
+        if ((off = readName(pkt, len, off, domain, sizeof(ans->domain))) == -1) {
+            // keep what we have from earlier records
+            if (domain) domain[0] = '\0';
+            return (i > 0);
+        }
+        if (off + DNS_RR_FIXED_LEN > len) return (i > 0);
+
+        uint16_t type = get16(&pkt[off]);
+        uint16_t class = get16(&pkt[off + 2]);
+        uint32_t ttl = get32(&pkt[off + 4]);
+        uint16_t rdlen = get16(&pkt[off + 8]);
+        off += DNS_RR_FIXED_LEN;
+        if (off + rdlen > len) return (i > 0);
+
+        int family = 0;
+        if ((type == DNS_TYPE_A) && (class == DNS_CLASS_IN) && (rdlen == 4)) {
+            family = AF_INET;
+        } else if ((type == DNS_TYPE_AAAA) && (class == DNS_CLASS_IN) && (rdlen == 16)) {
+            family = AF_INET6;
+        }
+
+        if (family && (ans->numAddrs < DNS_ANSWER_MAX_ADDRS)) {
+            dns_addr_t *addr = &ans->addrs[ans->numAddrs];
+            addr->family = family;
+            scope_memset(addr->addr, 0, sizeof(addr->addr));
+            scope_memmove(addr->addr, &pkt[off], rdlen);
+            if ((ans->numAddrs == 0) || (ttl < ans->ttl)) ans->ttl = ttl;
+            ans->numAddrs++;
+        }
+
+        off += rdlen;
+    }
+
+    return TRUE;
+}
+
+dns_cache_t *
+dnsCacheCreate(size_t entries, dns_repeats_fn flush)
+{
+    size_t size = 1;
+
+    // Round up to a power of two so a key maps to an entry with a mask
+    while (size < entries) size <<= 1;
+
+    dns_cache_t *cache = scope_calloc(1, sizeof(*cache));
+    if (!cache) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    cache->entries = scope_calloc(size, sizeof(dns_cache_entry_t));
+    if (!cache->entries) {
+        DBG(NULL);
+        scope_free(cache);
+        return NULL;
+    }
+    cache->mask = size - 1;
+    cache->flush = flush;
+
+    return cache;
+}
+
+void
+dnsCacheDestroy(dns_cache_t **cache)
+{
+    if (!cache || !*cache) return;
+
+    scope_free((*cache)->entries);
+    scope_free(*cache);
+    *cache = NULL;
+}
+
+static uint64_t
+fnv1a(uint64_t hash, const unsigned char *p, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Servers rotate the order of records, so the addresses are combined
+// in a way that doesn't depend on their order
+static uint64_t
+answerKey(const dns_answer_t *ans)
+{
+    const uint64_t basis = 0xcbf29ce484222325ULL;
+    uint64_t key = fnv1a(basis, (const unsigned char *)ans->domain,
+                         scope_strnlen(ans->domain, sizeof(ans->domain)));
+
+    for (int i = 0; i < ans->numAddrs; i++) {
+        const dns_addr_t *addr = &ans->addrs[i];
+        size_t alen = (addr->family == AF_INET) ? 4 : 16;
+        key += fnv1a(basis, addr->addr, alen);
+    }
+
+    return key ? key : 1;
+}
+
+static void
+flushEntry(dns_cache_t *cache, dns_cache_entry_t *entry)
+{
+    if (!entry->repeats) return;
+    if (cache->flush) cache->flush(&entry->answer, entry->repeats);
+    entry->repeats = 0;
+}
+
+/*
+ * Returns TRUE if ans should be reported. *repeats is then the number of
+ * identical answers that weren't reported since the last one that was.
+ * Returns FALSE if an identical answer was reported less than its TTL
+ * ago; the answer is counted as a repeat.
+ */
+bool
+dnsCacheReport(dns_cache_t *cache, const dns_answer_t *ans, time_t now, unsigned *repeats)
+{
+    if (repeats) *repeats = 0;
+    if (!cache || !ans) return TRUE;
+
+    uint64_t key = answerKey(ans);
+    dns_cache_entry_t *entry = &cache->entries[key & cache->mask];
+
+    if (entry->key == key) {
+        if (now < entry->expires) {
+            entry->repeats++;
+            return FALSE;
+        }
+        if (repeats) *repeats = entry->repeats;
+        entry->repeats = 0;
+    } else {
+        // A different answer takes the entry over; the repeats counted
+        // for the old one go out now or they'd be lost
+        flushEntry(cache, entry);
+    }
+
+    entry->key = key;
+    entry->expires = now + ans->ttl;
+    entry->answer = *ans;
+    return TRUE;
+}
+
+/*
+ * Hand every count of repeats held in the cache to the flush function
+ * and start the counts over. Entries are kept, so repeats within the
+ * TTL are still only counted.
+ */
+void
+dnsCacheFlush(dns_cache_t *cache)
+{
+    if (!cache) return;
+
+    for (size_t i = 0; i <= cache->mask; i++) {
+        flushEntry(cache, &cache->entries[i]);
+    }
+}
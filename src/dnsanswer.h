@@ -0,0 +1,51 @@
+#ifndef __DNSANSWER_H__
+#define __DNSANSWER_H__
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "scopetypes.h"
+
+// This decodes DNS responses into a fixed struct, without allocating,
+// so that it can run on the application thread. Building anything from
+// the result (JSON for the dns event) is left to the reporting thread.
+//
+// Handles compressed names, CNAME chains (addresses are collected from
+// every A and AAAA record in the answer section, whatever its owner),
+// EDNS (the OPT record lives in the additional section, which isn't
+// read) and the two byte length prefix of DNS over TCP.
+//
+// The answer cache lets the reporting thread summarize repeated,
+// identical answers. An answer is identical if it has the same domain
+// and the same set of addresses, in any order. Repeats seen within the
+// TTL of the last reported answer are counted rather than reported.
+// The count is handed back with the next identical answer that is
+// reported, or to the flush function when the entry is taken over by
+// a different answer or when dnsCacheFlush is called each period.
+
+#define DNS_ANSWER_MAX_ADDRS 8
+#define DEFAULT_DNS_CACHE_ENTRIES 256
+
+typedef struct {
+    int family;                 // AF_INET or AF_INET6
+    unsigned char addr[16];
+} dns_addr_t;
+
+typedef struct {
+    char domain[MAX_HOSTNAME];  // owner name of the first answer record
+    uint64_t duration;          // ms from query to response
+    uint32_t ttl;               // lowest TTL of the address records
+    int numAddrs;
+    dns_addr_t addrs[DNS_ANSWER_MAX_ADDRS];
+} dns_answer_t;
+
+typedef struct _dns_cache_t dns_cache_t;
+typedef void (*dns_repeats_fn)(const dns_answer_t *, unsigned);
+
+bool dnsAnswerParse(const unsigned char *, size_t, bool, dns_answer_t *);
+
+dns_cache_t *dnsCacheCreate(size_t, dns_repeats_fn);
+void dnsCacheDestroy(dns_cache_t **);
+bool dnsCacheReport(dns_cache_t *, const dns_answer_t *, time_t, unsigned *);
+void dnsCacheFlush(dns_cache_t *);
+
+#endif // __DNSANSWER_H__
@@ -5,6 +5,7 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "atomic.h"
 #include "dbg.h"
 #include "evtformat.h"
 #include "strset.h"
@@ -71,11 +72,42 @@ valToStr(enum_map_t map[], unsigned val)
     return NULL;
 }
 
+// Metric and field names come from a small, mostly static set.  So the
+// outcome of running a name or field filter is cached by the string it
+// was run against; the cache is thrown away whenever the filter changes.
+// Values are not; value filters are JIT compiled instead (when the
+// pcre2 lib supports it).
+#define FILTER_CACHE_SIZE 512                      // must be a power of 2
+#define FILTER_CACHE_MAX (FILTER_CACHE_SIZE / 2)   // bounds probe lengths
+
+typedef struct {
+    char *str;
+    uint32_t hash;
+    bool match;
+} filter_decision_t;
+
 typedef struct {
     int valid;
     regex_t re;
+
+    // Only used from the reporting thread (see filterMatches())
+    filter_decision_t *cache;
+    unsigned cached;
+
+    // Only set for value filters (see filterValueMatches())
+    pcre2_code *jit;
 } local_re_t;
 
+// Per-source, per-second event budget.  These are updated without locks
+// from the reporting thread (which formats events) and read from the
+// datapath (which uses them to drop events before allocating them).
+typedef struct {
+    uint64_t time;      // the second the current budget applies to
+    uint64_t evtCount;  // events counted against the current second
+    uint64_t dropped;   // events dropped, since creation
+    int notified;       // notice sent for the current second
+} ratelimit_t;
+
 struct _evt_fmt_t
 {
     local_re_t value_re[CFG_SRC_MAX];
@@ -85,9 +117,7 @@ struct _evt_fmt_t
 
     struct {
         // runtime params
-        time_t time;
-        unsigned long evtCount;
-        int notified;
+        ratelimit_t src[CFG_SRC_MAX];
         // configured param
         unsigned long maxEvtPerSec;
     } ratelimit;
@@ -141,27 +171,140 @@ static unsigned srcEnabledDefault[] = {
 
 
 static void
-filterSet(local_re_t *re, const char *str, const char *default_val)
+filterCacheClear(local_re_t *re)
+{
+    if (!re->cache) return;
+
+    int i;
+    for (i=0; i<FILTER_CACHE_SIZE; i++) {
+        if (re->cache[i].str) scope_free(re->cache[i].str);
+    }
+    scope_free(re->cache);
+    re->cache = NULL;
+    re->cached = 0;
+}
+
+static void
+filterJitClear(local_re_t *re)
+{
+    if (re->jit) pcre2_code_free(re->jit);
+    re->jit = NULL;
+}
+
+static void
+filterFree(local_re_t *re)
+{
+    if (re->valid) regfree(&re->re);
+    re->valid = FALSE;
+    filterCacheClear(re);
+    filterJitClear(re);
+}
+
+// Compiles the pattern a second time with the native pcre2 api, so it
+// can be JIT compiled.  If anything fails, we fall back to re->re.
+static void
+filterJitSet(local_re_t *re, const char *pattern)
+{
+    filterJitClear(re);
+    re->jit = regexCompile(pattern, NULL, NULL);
+}
+
+static void
+filterSet(local_re_t *re, const char *str, const char *default_val, bool jit)
 {
     if (!re) return;
 
-    local_re_t temp;
+    const char *pattern = str;
+    local_re_t temp = {0};
     temp.valid = str && !regcomp(&temp.re, str, REG_EXTENDED | REG_NOSUB);
     if (!temp.valid && default_val) {
         // regcomp failed on str.  Try the default.
+        pattern = default_val;
         temp.valid = !regcomp(&temp.re, default_val, REG_EXTENDED | REG_NOSUB);
     }
 
     if (temp.valid) {
         // Out with the old
-        if (re->valid) regfree(&re->re);
+        filterFree(re);
         // In with the new
         *re = temp;
+        if (jit) filterJitSet(re, pattern);
     } else {
         if (default_val) DBG("%s", str);
     }
 }
 
+static uint32_t
+filterHash(const char *str)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    const unsigned char *c;
+    for (c = (const unsigned char *)str; *c; c++) {
+        hash ^= *c;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/*
+ * Returns TRUE if str matches the filter, remembering the outcome.
+ * Not thread safe; this is for the reporting thread only.
+ */
+static bool
+filterMatches(local_re_t *re, const char *str)
+{
+    if (!re || !re->valid) return FALSE;
+    if (!str) str = "";
+
+    if (!re->cache) {
+        re->cache = scope_calloc(FILTER_CACHE_SIZE, sizeof(filter_decision_t));
+    }
+    if (!re->cache) {
+        return !regexec_wrapper(&re->re, str, 0, NULL, 0);
+    }
+
+    uint32_t hash = filterHash(str);
+    unsigned i = hash & (FILTER_CACHE_SIZE - 1);
+    filter_decision_t *entry;
+    for (entry = &re->cache[i]; entry->str;
+         i = (i + 1) & (FILTER_CACHE_SIZE - 1), entry = &re->cache[i]) {
+        if (entry->hash == hash && !scope_strcmp(entry->str, str)) {
+            return entry->match;
+        }
+    }
+
+    bool match = !regexec_wrapper(&re->re, str, 0, NULL, 0);
+
+    // entry is the empty slot that ended our probe.  Use it if we can.
+    if ((re->cached < FILTER_CACHE_MAX) && (entry->str = scope_strdup(str))) {
+        entry->hash = hash;
+        entry->match = match;
+        re->cached++;
+    }
+
+    return match;
+}
+
+/*
+ * Like filterMatches(), but for the value filter.  Values have too many
+ * distinct values to cache, but we can run them against the JIT.
+ */
+static bool
+filterValueMatches(local_re_t *re, const char *str)
+{
+    if (!re || !re->valid) return FALSE;
+
+    if (re->jit) {
+        int rc = regexMatch(re->jit, (PCRE2_SPTR)str, PCRE2_ZERO_TERMINATED, NULL);
+        if (rc >= 0) return TRUE;
+        if (rc == PCRE2_ERROR_NOMATCH) return FALSE;
+        // Some other error; let the posix interface have a go at it.
+    }
+
+    return !regexec_wrapper(&re->re, str, 0, NULL, 0);
+}
+
 evt_fmt_t *
 evtFormatCreate(void)
 {
@@ -173,9 +316,9 @@ evtFormatCreate(void)
 
     watch_t src;
     for (src=CFG_SRC_FILE;  src<CFG_SRC_MAX; src++) {
-        filterSet(&evt->value_re[src], NULL, valueFilterDefault[src]);
-        filterSet(&evt->field_re[src], NULL, fieldFilterDefault[src]);
-        filterSet(&evt->name_re[src], NULL, nameFilterDefault[src]);
+        filterSet(&evt->value_re[src], NULL, valueFilterDefault[src], TRUE);
+        filterSet(&evt->field_re[src], NULL, fieldFilterDefault[src], FALSE);
+        filterSet(&evt->name_re[src], NULL, nameFilterDefault[src], FALSE);
         evt->enabled[src] = srcEnabledDefault[src];
     }
 
@@ -211,9 +354,9 @@ evtFormatDestroy(evt_fmt_t **evt)
 
     watch_t src;
     for (src=CFG_SRC_FILE; src<CFG_SRC_MAX; src++) {
-        if (edestroy->value_re[src].valid) regfree(&edestroy->value_re[src].re);
-        if (edestroy->field_re[src].valid) regfree(&edestroy->field_re[src].re);
-        if (edestroy->name_re[src].valid) regfree(&edestroy->name_re[src].re);
+        filterFree(&edestroy->value_re[src]);
+        filterFree(&edestroy->field_re[src]);
+        filterFree(&edestroy->name_re[src]);
     }
 
     evtFormatDestroyTags(&edestroy->tags);
@@ -229,7 +372,7 @@ evtFormatValueFilter(evt_fmt_t *evt, watch_t src)
         if (evt && evt->value_re[src].valid) return &evt->value_re[src].re;
         static local_re_t default_re[CFG_SRC_MAX];
         if (!default_re[src].valid) {
-            filterSet(&default_re[src], NULL, valueFilterDefault[src]);
+            filterSet(&default_re[src], NULL, valueFilterDefault[src], FALSE);
         }
         if (default_re[src].valid) return &default_re[src].re;
     }
@@ -244,7 +387,7 @@ evtFormatFieldFilter(evt_fmt_t *evt, watch_t src)
         if (evt && evt->field_re[src].valid) return &evt->field_re[src].re;
         static local_re_t default_re[CFG_SRC_MAX];
         if (!default_re[src].valid) {
-            filterSet(&default_re[src], NULL, fieldFilterDefault[src]);
+            filterSet(&default_re[src], NULL, fieldFilterDefault[src], FALSE);
         }
         if (default_re[src].valid) return &default_re[src].re;
     }
@@ -259,7 +402,7 @@ evtFormatNameFilter(evt_fmt_t *evt, watch_t src)
         if (evt && evt->name_re[src].valid) return &evt->name_re[src].re;
         static local_re_t default_re[CFG_SRC_MAX];
         if (!default_re[src].valid) {
-            filterSet(&default_re[src], NULL, nameFilterDefault[src]);
+            filterSet(&default_re[src], NULL, nameFilterDefault[src], FALSE);
         }
         if (default_re[src].valid) return &default_re[src].re;
     }
@@ -286,6 +429,43 @@ evtFormatRateLimit(evt_fmt_t *evt)
     return (evt) ? evt->ratelimit.maxEvtPerSec : DEFAULT_MAXEVENTSPERSEC;
 }
 
+/*
+ * Returns TRUE when the budget of src for the current second has
+ * already been exhausted; that is, the formatter has already counted
+ * an event over it.  The rate limit notice is sent by the formatter,
+ * for the first event over budget; whether it was isn't looked at here.
+ * This is intended to be called from the datapath, so that events
+ * which will be dropped anyway are never allocated or queued.
+ */
+bool
+evtFormatRateLimited(evt_fmt_t *evt, watch_t src)
+{
+    if (!evt || src >= CFG_SRC_MAX) return FALSE;
+
+    unsigned long maxEvtPerSec = evt->ratelimit.maxEvtPerSec;
+    if (maxEvtPerSec == 0) return FALSE;
+
+    struct timeval tv;
+    scope_gettimeofday(&tv, NULL);
+
+    ratelimit_t *rl = &evt->ratelimit.src[src];
+    return (rl->time == tv.tv_sec) && (rl->evtCount > maxEvtPerSec);
+}
+
+void
+evtFormatRateLimitDrop(evt_fmt_t *evt, watch_t src)
+{
+    if (!evt || src >= CFG_SRC_MAX) return;
+    atomicAddU64(&evt->ratelimit.src[src].dropped, 1);
+}
+
+unsigned long long
+evtFormatRateLimitDropped(evt_fmt_t *evt, watch_t src)
+{
+    if (!evt || src >= CFG_SRC_MAX) return 0ULL;
+    return evt->ratelimit.src[src].dropped;
+}
+
 custom_tag_t**
 evtFormatCustomTags(evt_fmt_t* fmt)
 {
@@ -296,21 +476,21 @@ void
 evtFormatValueFilterSet(evt_fmt_t *evt, watch_t src, const char *str)
 {
     if (!evt || src >= CFG_SRC_MAX) return;
-    filterSet(&evt->value_re[src], str, valueFilterDefault[src]);
+    filterSet(&evt->value_re[src], str, valueFilterDefault[src], TRUE);
 }
 
 void
 evtFormatFieldFilterSet(evt_fmt_t *evt, watch_t src, const char *str)
 {
     if (!evt || src >= CFG_SRC_MAX) return;
-    filterSet(&evt->field_re[src], str, fieldFilterDefault[src]);
+    filterSet(&evt->field_re[src], str, fieldFilterDefault[src], FALSE);
 }
 
 void
 evtFormatNameFilterSet(evt_fmt_t *evt, watch_t src, const char *str)
 {
     if (!evt || src >= CFG_SRC_MAX) return;
-    filterSet(&evt->name_re[src], str, nameFilterDefault[src]);
+    filterSet(&evt->name_re[src], str, nameFilterDefault[src], FALSE);
 }
 
 void
@@ -369,7 +549,7 @@ evtFormatCustomTagsSet(evt_fmt_t* fmt, custom_tag_t** tags)
 #define NO_MATCH_FOUND 0
 
 static int
-anyValueFieldMatches(regex_t *filter, event_t *metric)
+anyValueFieldMatches(local_re_t *filter, event_t *metric)
 {
     if (!filter || !metric) return MATCH_FOUND;
 
@@ -387,7 +567,7 @@ anyValueFieldMatches(regex_t *filter, event_t *metric)
             DBG(NULL);
     }
     if (valbuf[0]) {
-        if (!regexec_wrapper(filter, valbuf, 0, NULL, 0)) return MATCH_FOUND;
+        if (filterValueMatches(filter, valbuf)) return MATCH_FOUND;
     }
 
     // Handle the case where there are no fields...
@@ -405,7 +585,7 @@ anyValueFieldMatches(regex_t *filter, event_t *metric)
             }
         }
 
-        if (str && !regexec_wrapper(filter, str, 0, NULL, 0)) return MATCH_FOUND;
+        if (str && filterValueMatches(filter, str)) return MATCH_FOUND;
     }
 
     return NO_MATCH_FOUND;
@@ -482,6 +662,62 @@ rateLimitMessage(proc_id_t *proc, watch_t src, unsigned maxEvtPerSec)
     return json;
 }
 
+/*
+ * Counts one event against the budget of src for the second now.
+ * Returns TRUE if the event fits in the budget.  The first caller
+ * to see a new second resets the count; a few events racing that
+ * reset may be attributed to either second, which is fine for our
+ * purposes and keeps this free of locks.
+ */
+static bool
+rateLimitAdmit(evt_fmt_t *evt, watch_t src, time_t now)
+{
+    unsigned long maxEvtPerSec = evt->ratelimit.maxEvtPerSec;
+    if (maxEvtPerSec == 0) return TRUE; // no rate limiting.
+
+    ratelimit_t *rl = &evt->ratelimit.src[src];
+    uint64_t then = rl->time;
+    if ((then != (uint64_t)now) && atomicCasU64(&rl->time, then, now)) {
+        atomicSwapU64(&rl->evtCount, 0);
+        atomicSwap32(&rl->notified, 0);
+    }
+
+    if (atomicAddFetchU64(&rl->evtCount, 1) <= maxEvtPerSec) return TRUE;
+
+    atomicAddU64(&rl->dropped, 1);
+    return FALSE;
+}
+
+// one notice per truncate
+static cJSON *
+rateLimitNotice(evt_fmt_t *evt, proc_id_t *proc, watch_t src)
+{
+    ratelimit_t *rl = &evt->ratelimit.src[src];
+    if (!atomicCas32(&rl->notified, 0, 1)) return NULL;
+
+    cJSON *notice = rateLimitMessage(proc, src, evt->ratelimit.maxEvtPerSec);
+    if (!notice) atomicSwap32(&rl->notified, 0);
+    return notice;
+}
+
+cJSON *
+evtFormatLog(evt_fmt_t *evt, event_format_t *sev)
+{
+    if (!evt || !sev || (sev->sourcetype >= CFG_SRC_MAX)) {
+        return fmtEventJson(evt, sev);
+    }
+
+    struct timeval tv;
+    scope_gettimeofday(&tv, NULL);
+
+    if (!rateLimitAdmit(evt, sev->sourcetype, tv.tv_sec)) {
+        if (sev->data) cJSON_Delete(sev->data);
+        return rateLimitNotice(evt, sev->proc, sev->sourcetype);
+    }
+
+    return fmtEventJson(evt, sev);
+}
+
 static const char *
 metricTypeStr(data_type_t type)
 {
@@ -502,7 +738,7 @@ metricTypeStr(data_type_t type)
 }
 
 static int
-addJsonFields(event_field_t *fields, regex_t *fieldFilter, cJSON *json, strset_t *addedFields)
+addJsonFields(event_field_t *fields, regex_t *fieldFilter, local_re_t *cachedFilter, cJSON *json, strset_t *addedFields)
 {
     if (!fields) return TRUE;
 
@@ -512,6 +748,7 @@ addJsonFields(event_field_t *fields, regex_t *fieldFilter, cJSON *json, strset_t
     for (fld = fields; fld->value_type != FMT_END; fld++) {
 
         // skip outputting anything that doesn't match fieldFilter
+        if (cachedFilter && !filterMatches(cachedFilter, fld->name)) continue;
         if (fieldFilter && regexec_wrapper(fieldFilter, fld->name, 0, NULL, 0)) continue;
 
         // skip if this field is not used in events
@@ -532,8 +769,8 @@ addJsonFields(event_field_t *fields, regex_t *fieldFilter, cJSON *json, strset_t
     return TRUE;
 }
 
-cJSON *
-fmtMetricJson(event_t *metric, regex_t *fieldFilter, watch_t src, custom_tag_t **tags)
+static cJSON *
+fmtMetricJsonHelper(event_t *metric, regex_t *fieldFilter, local_re_t *cachedFilter, watch_t src, custom_tag_t **tags)
 {
     const char *metric_type = NULL;
     strset_t *addedFields = NULL;
@@ -566,9 +803,9 @@ fmtMetricJson(event_t *metric, regex_t *fieldFilter, watch_t src, custom_tag_t *
     // is given to capturedFields then custom fields then remaining fields.
     addedFields = strSetCreate(DEFAULT_SET_SIZE);
     if (addedFields) {
-        if (!addJsonFields(metric->capturedFields, fieldFilter, json, addedFields)) goto err;
+        if (!addJsonFields(metric->capturedFields, fieldFilter, cachedFilter, json, addedFields)) goto err;
         addCustomJsonFields(tags, json, addedFields);
-        if (!addJsonFields(metric->fields, fieldFilter, json, addedFields)) goto err;
+        if (!addJsonFields(metric->fields, fieldFilter, cachedFilter, json, addedFields)) goto err;
         strSetDestroy(&addedFields);
     }
 
@@ -583,6 +820,12 @@ err:
     return NULL;
 }
 
+cJSON *
+fmtMetricJson(event_t *metric, regex_t *fieldFilter, watch_t src, custom_tag_t **tags)
+{
+    return fmtMetricJsonHelper(metric, fieldFilter, NULL, src, tags);
+}
+
 static cJSON *
 evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc, watch_t src)
 {
@@ -591,37 +834,24 @@ evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
     struct timeval tv;
     scope_gettimeofday(&tv, NULL);
     
-    regex_t *filter;
-
-    if (!evt || !metric || !proc) return NULL;
+    if (!evt || !metric || !proc || src >= CFG_SRC_MAX) return NULL;
 
     // Test for a name field match.  No match, no metric output
     if (!evtFormatSourceEnabled(evt, src) ||
-        !(filter = evtFormatNameFilter(evt, src)) ||
-        (regexec_wrapper(filter, metric->name, 0, NULL, 0))) {
+        !filterMatches(&evt->name_re[src], metric->name)) {
         return NULL;
     }
 
     // rate limited to maxEvtPerSec
-    if (evt->ratelimit.maxEvtPerSec == 0) {
-        ; // no rate limiting.
-    } else if (tv.tv_sec != evt->ratelimit.time) {
-        evt->ratelimit.time = tv.tv_sec;
-        evt->ratelimit.evtCount = evt->ratelimit.notified = 0;
-    } else if (++evt->ratelimit.evtCount >= evt->ratelimit.maxEvtPerSec) {
-        // one notice per truncate
-        if (evt->ratelimit.notified == 0) {
-            cJSON *notice = rateLimitMessage(proc, src, evt->ratelimit.maxEvtPerSec);
-            evt->ratelimit.notified = (notice)?1:0;
-            return notice;
-        }
+    if (!rateLimitAdmit(evt, src, tv.tv_sec)) {
+        return rateLimitNotice(evt, proc, src);
     }
 
     /*
      * Loop through all metric fields for at least one matching field value
      * No match, no metric output
      */
-    if (!anyValueFieldMatches(evtFormatValueFilter(evt, src), metric)) {
+    if (!anyValueFieldMatches(&evt->value_re[src], metric)) {
         return NULL;
     }
 
@@ -633,7 +863,7 @@ evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
 
     // Format the metric string using the configured metric format type
     if (!metric->data) {
-        event.data = fmtMetricJson(metric, evtFormatFieldFilter(evt, src), src, NULL);
+        event.data = fmtMetricJsonHelper(metric, NULL, &evt->field_re[src], src, NULL);
     } else {
         event.data = metric->data;
     }
@@ -17,11 +17,14 @@ regex_t *           evtFormatFieldFilter(evt_fmt_t *, watch_t);
 regex_t *           evtFormatNameFilter(evt_fmt_t *, watch_t);
 unsigned            evtFormatSourceEnabled(evt_fmt_t *, watch_t);
 unsigned            evtFormatRateLimit(evt_fmt_t *);
+bool                evtFormatRateLimited(evt_fmt_t *, watch_t);
+unsigned long long  evtFormatRateLimitDropped(evt_fmt_t *, watch_t);
 custom_tag_t **     evtFormatCustomTags(evt_fmt_t *);
 
 // These are the exposed functions that are expected to be used externally
 cJSON *             evtFormatMetric(evt_fmt_t *, event_t *, uint64_t, proc_id_t *);
 cJSON *             evtFormatHttp(evt_fmt_t *, event_t *, uint64_t, proc_id_t *);
+cJSON *             evtFormatLog(evt_fmt_t *, event_format_t *);
 
 // Could be static; these are lower level funcs only exposed for testing
 cJSON *             fmtMetricJson(event_t *, regex_t *, watch_t, custom_tag_t **);
@@ -33,6 +36,7 @@ void                evtFormatFieldFilterSet(evt_fmt_t *, watch_t, const char *);
 void                evtFormatNameFilterSet(evt_fmt_t *, watch_t, const char *);
 void                evtFormatSourceEnabledSet(evt_fmt_t *, watch_t, unsigned);
 void                evtFormatRateLimitSet(evt_fmt_t *, unsigned);
+void                evtFormatRateLimitDrop(evt_fmt_t *, watch_t);
 void                evtFormatCustomTagsSet(evt_fmt_t *, custom_tag_t **);
 
 #endif // __EVT_FORMAT_H__
@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 
+#include "arena.h"
 #include "dbg.h"
 #include "evtutils.h"
 #include "report.h"
@@ -10,11 +11,11 @@
 static protocol_info *
 evtProtoAllocHttpBase(void)
 {
-    protocol_info *proto = scope_calloc(1, sizeof(protocol_info));
-    http_post *post = scope_calloc(1, sizeof(http_post));
+    protocol_info *proto = arenaCalloc(1, sizeof(protocol_info));
+    http_post *post = arenaCalloc(1, sizeof(http_post));
     if (!proto || !post) {
-        if (post) scope_free(post);
-        if (proto) scope_free(proto);
+        if (post) arenaFree(post);
+        if (proto) arenaFree(proto);
         return NULL;
     }
 
@@ -42,11 +43,11 @@ protocol_info *
 evtProtoAllocHttp2Frame(uint32_t frameLen)
 {
     protocol_info *proto = evtProtoAllocHttpBase();
-    char *frame = scope_malloc(frameLen);
+    char *frame = arenaMallocBuffer(frameLen);
     if (!proto || !frame) {
         DBG(NULL);
         if (proto) evtProtoFree(proto);
-        if (frame) scope_free(frame);
+        if (frame) arenaFree(frame);
         return NULL;
     }
 
@@ -62,14 +63,16 @@ evtProtoAllocDetect(const char * const protocolName)
 {
     if (!protocolName) return NULL;
 
-    protocol_info *proto = scope_calloc(1, sizeof(protocol_info));
-    char *protname = scope_strdup(protocolName);
+    size_t len = scope_strlen(protocolName) + 1;
+    protocol_info *proto = arenaCalloc(1, sizeof(protocol_info));
+    char *protname = arenaMalloc(len);
     if (!proto || !protname) {
         DBG(NULL);
-        if (protname) scope_free(protname);
-        if (proto) scope_free(proto);
+        if (protname) arenaFree(protname);
+        if (proto) arenaFree(proto);
         return NULL;
     }
+    scope_memcpy(protname, protocolName, len);
 
     proto->evtype = EVT_PROTO;
     proto->ptype = EVT_DETECT;
@@ -86,14 +89,14 @@ evtProtoFree(protocol_info *proto)
     if ((proto->ptype == EVT_HREQ) || (proto->ptype == EVT_HRES) || (proto->ptype == EVT_H2FRAME)) {
         http_post *post = (http_post *)proto->data;
         if (post) {
-            if (post->hdr) scope_free(post->hdr);
-            scope_free(post);
+            if (post->hdr) arenaFree(post->hdr);
+            arenaFree(post);
         }
     } else if (proto->ptype == EVT_DETECT) {
-        // proto->data is a pointer to a strdup'd string
-        if (proto->data) scope_free(proto->data);
+        // proto->data is a copy of the protocol name
+        if (proto->data) arenaFree(proto->data);
     }
-    scope_free(proto);
+    arenaFree(proto);
     return TRUE;
 }
 
@@ -107,35 +110,35 @@ evtFree(evt_type *event)
         {
             // Alloc'd in postNetState. There are no nested allocations.
             // net_info *net = (net_info *)event;
-            scope_free(event);
+            arenaFree(event);
             break;
         }
         case EVT_FS:
         {
             // Alloc'd in postFSState. There are no nested allocations.
             // fs_info *fs = (fs_info *)event;
-            scope_free(event);
+            arenaFree(event);
             break;
         }
         case EVT_ERR:
         {
             // Alloc'd in postStatErrState. There are no nested allocations.
             // stat_err_info *staterr = (stat_err_info *)event;
-            scope_free(event);
+            arenaFree(event);
             break;
         }
         case EVT_STAT:
         {
             // Alloc'd in postStatErrState. There are no nested allocations.
             // stat_err_info *staterr = (stat_err_info *)event;
-            scope_free(event);
+            arenaFree(event);
             break;
         }
         case EVT_DNS:
         {
             // Alloc'd in postDNSState. There are no nested allocations.
-            // net_info *net = (net_info *)event;
-            scope_free(event);
+            // dns_info *dns = (dns_info *)event;
+            arenaFree(event);
             break;
         }
         case EVT_PROTO:
@@ -148,7 +151,7 @@ evtFree(evt_type *event)
         }
         default:
             DBG(NULL);
-            scope_free(event);
+            arenaFree(event);
     }
     return TRUE;
 }
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include "aggmetric.h"
+#include "dbg.h"
+#include "fsagg.h"
+#include "topn.h"
+#include "scopestdlib.h"
+
+
+// The table keeps this many entries for each path reported, and at least
+// MIN_ENTRIES. The more it keeps, the less a path that is only sometimes
+// busy loses when it's taken over.
+#define ENTRIES_PER_PATH ( 4 )
+#define MIN_ENTRIES ( 64 )
+
+struct _fs_agg_t {
+    topn_t *paths;
+    unsigned top;
+    char **pattern;
+    size_t numPatterns;
+    topn_entry_t *entry;          // room for top of them, for SendReport
+};
+
+
+fs_agg_t *
+fsAggCreate(unsigned top)
+{
+    if (!top) return NULL;
+
+    size_t entries = (size_t)top * ENTRIES_PER_PATH;
+    if (entries < MIN_ENTRIES) entries = MIN_ENTRIES;
+
+    fs_agg_t *agg = scope_calloc(1, sizeof(*agg));
+    topn_t *paths = topnCreate(entries, sizeof(fs_agg_counts_t));
+    topn_entry_t *entry = scope_calloc(top, sizeof(*entry));
+    if (!agg || !paths || !entry) {
+        if (agg) scope_free(agg);
+        topnDestroy(&paths);
+        if (entry) scope_free(entry);
+        DBG("agg = %p, paths = %p, entry = %p", agg, paths, entry);
+        return NULL;
+    }
+
+    agg->paths = paths;
+    agg->top = top;
+    agg->entry = entry;
+
+    return agg;
+}
+
+void
+fsAggDestroy(fs_agg_t **fs_agg_ptr)
+{
+    if (!fs_agg_ptr || !*fs_agg_ptr) return;
+
+    fs_agg_t *fs_agg = *fs_agg_ptr;
+    topnDestroy(&fs_agg->paths);
+
+    int i;
+    for (i = 0; i < fs_agg->numPatterns; i++) {
+        scope_free(fs_agg->pattern[i]);
+    }
+    if (fs_agg->pattern) scope_free(fs_agg->pattern);
+    scope_free(fs_agg->entry);
+    scope_free(fs_agg);
+
+    *fs_agg_ptr = NULL;
+}
+
+bool
+fsAggPatternAdd(fs_agg_t *fs_agg, const char *pattern)
+{
+    if (!fs_agg || !pattern || !pattern[0]) return FALSE;
+
+    char **temp = scope_realloc(fs_agg->pattern, (fs_agg->numPatterns + 1) * sizeof(char *));
+    if (!temp) {
+        DBG(NULL);
+        return FALSE;
+    }
+    fs_agg->pattern = temp;
+
+    char *copy = scope_strdup(pattern);
+    if (!copy) {
+        DBG(NULL);
+        return FALSE;
+    }
+    fs_agg->pattern[fs_agg->numPatterns++] = copy;
+    return TRUE;
+}
+
+// The key a path is counted under; the first pattern it matches, or itself
+const char *
+fsAggKey(fs_agg_t *fs_agg, const char *path)
+{
+    if (!fs_agg || !path) return path;
+
+    int i;
+    for (i = 0; i < fs_agg->numPatterns; i++) {
+        if (!scope_fnmatch(fs_agg->pattern[i], path, FNM_PATHNAME | FNM_LEADING_DIR)) {
+            return fs_agg->pattern[i];
+        }
+    }
+    return path;
+}
+
+void
+fsAggAddCounts(fs_agg_t *fs_agg, const char *path, const fs_agg_counts_t *counts)
+{
+    if (!fs_agg || !path || !path[0] || !counts) return;
+
+    uint64_t ops = counts->opens + counts->reads + counts->writes + counts->seeks;
+    if (!ops) return;
+
+    fs_agg_counts_t *total = topnAdd(fs_agg->paths, fsAggKey(fs_agg, path), ops);
+    if (!total) return;
+
+    total->opens += counts->opens;
+    total->reads += counts->reads;
+    total->readBytes += counts->readBytes;
+    total->writes += counts->writes;
+    total->writeBytes += counts->writeBytes;
+    total->seeks += counts->seeks;
+    total->durations += counts->durations;
+    total->durationTotal += counts->durationTotal;
+}
+
+// numops is only sent for reads, writes and durations
+static void
+send_path_metric(mtc_t *mtc, const char *name, const char *path, uint64_t value,
+                 data_type_t type, uint64_t numops, const char *unit)
+{
+    event_field_t keys[] = {
+        STRFIELD("file",         path,            4, TRUE),
+        FIELDEND
+    };
+    aggSendMetric(mtc, name, value, type, keys, numops, unit);
+}
+
+static void
+report_path(mtc_t *mtc, const char *path, fs_agg_counts_t *counts)
+{
+    // Don't report zeros; a read of 0 bytes is still a read
+    if (counts->opens) {
+        send_path_metric(mtc, "fs.path.open", path, counts->opens, DELTA, 0, "operation");
+    }
+    if (counts->reads) {
+        send_path_metric(mtc, "fs.path.read", path, counts->readBytes, DELTA, counts->reads, "byte");
+    }
+    if (counts->writes) {
+        send_path_metric(mtc, "fs.path.write", path, counts->writeBytes, DELTA, counts->writes, "byte");
+    }
+    if (counts->seeks) {
+        send_path_metric(mtc, "fs.path.seek", path, counts->seeks, DELTA, 0, "operation");
+    }
+    if (counts->durations) {
+        // factor of 1000 converts ns to us; as fs.duration, at least 1
+        uint64_t dur = counts->durationTotal / (1000 * counts->durations);
+        if (!dur) dur = 1;
+        send_path_metric(mtc, "fs.path.duration", path, dur, HISTOGRAM, counts->durations, "microsecond");
+    }
+}
+
+void
+fsAggSendReport(fs_agg_t *fs_agg, mtc_t *mtc)
+{
+    if (!fs_agg || !mtc) return;
+
+    size_t count = topnGet(fs_agg->paths, fs_agg->entry, fs_agg->top);
+    size_t i;
+    for (i = 0; i < count; i++) {
+        report_path(mtc, fs_agg->entry[i].key, fs_agg->entry[i].value);
+    }
+}
+
+void
+fsAggReset(fs_agg_t *fs_agg)
+{
+    if (!fs_agg) return;
+
+    topnReset(fs_agg->paths);
+}
@@ -0,0 +1,50 @@
+#ifndef __FSAGG_H__
+#define __FSAGG_H__
+#include "mtc.h"
+
+// This aggregates file system activity by path for the metrics channel,
+// for processes that open too many files for per descriptor metrics to
+// be of use. What a descriptor did is added under its path, when it's
+// closed and once a period while it's open.
+//
+// Paths can be collapsed. A path that matches a pattern (an fnmatch(3)
+// glob, where * doesn't match /), or that is under a directory that
+// matches it, is counted under the pattern. /var/lib/data/*/part-*
+// counts /var/lib/data/2023/part-00001 and the rest of the parts under
+// the one key; /tmp counts everything under /tmp. The first pattern that
+// matches is used.
+//
+// The table has room for a few times the number of paths reported; see
+// topn.h. Paths are weighed by operations (opens, reads, writes, seeks),
+// and the heaviest are reported each period.
+//
+// A normal lifecycle:
+//   Create
+//   PatternAdd
+//   AddCounts
+//   AddCounts
+//   SendReport (sends the heaviest paths added since Create or Reset)
+//   Reset
+
+typedef struct _fs_agg_t fs_agg_t;
+
+typedef struct {
+    uint64_t opens;
+    uint64_t reads;
+    uint64_t readBytes;
+    uint64_t writes;
+    uint64_t writeBytes;
+    uint64_t seeks;
+    uint64_t durations;           // number of reads and writes timed
+    uint64_t durationTotal;       // ns
+} fs_agg_counts_t;
+
+fs_agg_t *fsAggCreate(unsigned);
+void fsAggDestroy(fs_agg_t **);
+bool fsAggPatternAdd(fs_agg_t *, const char *);
+const char *fsAggKey(fs_agg_t *, const char *);
+void fsAggAddCounts(fs_agg_t *, const char *, const fs_agg_counts_t *);
+void fsAggSendReport(fs_agg_t *, mtc_t *);
+void fsAggReset(fs_agg_t *);
+
+#endif // __FSAGG_H__
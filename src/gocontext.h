@@ -1,5 +1,11 @@
 #ifndef __GOTCONTEXT_H__
 #define __GOTCONTEXT_H__
+
+// Descriptors covered by g_go_fd_filter; larger ones always reach c_syscall.
+// gocontext.S and gocontext_arm.S include this header for it.
+#define GO_FD_FILTER_SIZE 4096
+
+#ifndef __ASSEMBLER__
 #include "scopeelf.h"
 
 #define EXPORTON __attribute__((visibility("default")))
@@ -111,6 +117,7 @@ extern go_schema_t go_17_schema_arm;
 extern go_arg_offsets_t g_go_arg;
 extern go_struct_offsets_t g_go_struct;
 extern tap_t g_go_tap[];
+extern uint8_t g_go_fd_filter[];
 
 extern int arch_prctl(int, unsigned long);
 extern void initGoHook(elf_buf_t*);
@@ -133,4 +140,5 @@ extern void go_hook_exit(void);
 extern void go_hook_die(void);
 extern void go_hook_sighandler(void);
 
+#endif // __ASSEMBLER__
 #endif // __GOTCONTEXT_H__
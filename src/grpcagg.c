@@ -0,0 +1,381 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include "com.h"
+#include "dbg.h"
+#include "grpcagg.h"
+#include "utils.h"
+#include "scopestdlib.h"
+
+
+#define DEFAULT_METHOD_SLOTS ( 64 )
+
+// Method names come from the peer. Past this many in one period, calls
+// are counted under OTHER_METHOD so a misbehaving client can't grow the
+// table without bound.
+#define MAX_METHODS ( 1024 )
+#define OTHER_METHOD "/_other/_other"
+
+// Upper bounds of the duration histogram buckets, in msecs
+static const uint64_t bucketMax[] = {
+    1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, UINT64_MAX
+};
+static const char *bucketName[] = {
+    "1", "2", "5", "10", "25", "50", "100", "250", "500", "1000", "2500", "5000", "10000", "+Inf"
+};
+#define NUM_BUCKETS (sizeof(bucketMax) / sizeof(bucketMax[0]))
+
+typedef enum {
+    ROLE_CLIENT,
+    ROLE_SERVER,
+    ROLE_MAX
+} grpc_role_enum;
+
+typedef struct {
+    uint64_t calls[GRPC_STATUS_MAX + 1];   // calls by grpc-status
+    uint64_t durTotal;                     // msecs, of calls with a duration
+    uint64_t durCount;
+    uint64_t bucket[NUM_BUCKETS];          // calls by duration
+    uint64_t reqMsgs;
+    uint64_t respMsgs;
+} role_agg_t;
+
+typedef struct {
+    char *path;           // the key; /package.Service/Method
+    char *service;        // path split in two for the metric fields
+    char *method;
+    uint64_t hash;
+    role_agg_t role[ROLE_MAX];
+} method_agg_t;
+
+struct _grpc_agg_t {
+    method_agg_t **slot;  // open addressed by hash of path
+    uint64_t count;
+    uint64_t alloc;       // a power of two
+};
+
+
+grpc_agg_t *
+grpcAggCreate(void)
+{
+    grpc_agg_t *agg = scope_calloc(1, sizeof(*agg));
+    method_agg_t **slots = scope_calloc(DEFAULT_METHOD_SLOTS, sizeof(*slots));
+    if (!agg || !slots) {
+        if (agg) scope_free(agg);
+        if (slots) scope_free(slots);
+        DBG("agg = %p, slots = %p", agg, slots);
+        return NULL;
+    }
+
+    agg->slot = slots;
+    agg->count = 0;
+    agg->alloc = DEFAULT_METHOD_SLOTS;
+
+    return agg;
+}
+
+void
+grpcAggDestroy(grpc_agg_t **grpc_agg_ptr)
+{
+    if (!grpc_agg_ptr || !*grpc_agg_ptr) return;
+
+    grpc_agg_t *grpc_agg = *grpc_agg_ptr;
+    grpcAggReset(grpc_agg);
+
+    scope_free(grpc_agg->slot);
+    scope_free(grpc_agg);
+
+    *grpc_agg_ptr = NULL;
+}
+
+static uint64_t
+hashOfPath(const char *path)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *path; path++) {
+        hash ^= (unsigned char)*path;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static method_agg_t **
+find_slot(method_agg_t **slot, uint64_t alloc, const char *path, uint64_t hash)
+{
+    uint64_t i = hash & (alloc - 1);
+    while (slot[i]) {
+        if ((slot[i]->hash == hash) && !scope_strcmp(slot[i]->path, path)) break;
+        i = (i + 1) & (alloc - 1);
+    }
+    return &slot[i];
+}
+
+static bool
+grow_table(grpc_agg_t *grpc_agg)
+{
+    uint64_t new_alloc = grpc_agg->alloc << 1;
+    method_agg_t **new_slot = scope_calloc(new_alloc, sizeof(*new_slot));
+    if (!new_slot) {
+        DBG(NULL);
+        return FALSE;
+    }
+
+    uint64_t i;
+    for (i = 0; i < grpc_agg->alloc; i++) {
+        method_agg_t *entry = grpc_agg->slot[i];
+        if (!entry) continue;
+        *find_slot(new_slot, new_alloc, entry->path, entry->hash) = entry;
+    }
+
+    scope_free(grpc_agg->slot);
+    grpc_agg->slot = new_slot;
+    grpc_agg->alloc = new_alloc;
+    return TRUE;
+}
+
+static method_agg_t *
+create_method_entry(const char *path, uint64_t hash)
+{
+    method_agg_t *entry = scope_calloc(1, sizeof(*entry));
+    char *temp_path = scope_strdup(path);
+
+    // "/package.Service/Method"; anything else is all service
+    const char *sep = (path[0] == '/') ? scope_strrchr(path, '/') : NULL;
+    char *service = NULL;
+    char *method = NULL;
+    if (sep && sep != path) {
+        service = scope_strdup(path + 1);
+        if (service) service[sep - path - 1] = '\0';
+        method = scope_strdup(sep + 1);
+    } else {
+        service = scope_strdup(path);
+        method = scope_strdup("");
+    }
+
+    if (!entry || !temp_path || !service || !method) {
+        if (entry) scope_free(entry);
+        if (temp_path) scope_free(temp_path);
+        if (service) scope_free(service);
+        if (method) scope_free(method);
+        DBG(NULL);
+        return NULL;
+    }
+
+    entry->path = temp_path;
+    entry->service = service;
+    entry->method = method;
+    entry->hash = hash;
+    return entry;
+}
+
+static method_agg_t *
+get_method_entry(grpc_agg_t *grpc_agg, const char *path)
+{
+    // The path never has a query string in gRPC, so unlike http_target
+    // it's used as is.
+    uint64_t hash = hashOfPath(path);
+    method_agg_t **slot = find_slot(grpc_agg->slot, grpc_agg->alloc, path, hash);
+    if (*slot) return *slot;
+
+    if (grpc_agg->count >= MAX_METHODS && scope_strcmp(path, OTHER_METHOD)) {
+        return get_method_entry(grpc_agg, OTHER_METHOD);
+    }
+
+    // keep the table no more than half full
+    if ((grpc_agg->count + 1) * 2 > grpc_agg->alloc) {
+        if (!grow_table(grpc_agg)) return NULL;
+        slot = find_slot(grpc_agg->slot, grpc_agg->alloc, path, hash);
+    }
+
+    method_agg_t *entry = create_method_entry(path, hash);
+    if (!entry) return NULL;
+
+    *slot = entry;
+    grpc_agg->count++;
+    return entry;
+}
+
+void
+grpcAggAddCall(grpc_agg_t *grpc_agg, grpc_call_t *call)
+{
+    if (!grpc_agg || !call || !call->method || !call->method[0]) return;
+
+    method_agg_t *entry = get_method_entry(grpc_agg, call->method);
+    if (!entry) return;
+
+    role_agg_t *role = &entry->role[call->isServer ? ROLE_SERVER : ROLE_CLIENT];
+
+    int status = call->status;
+    if (status < 0 || status > GRPC_STATUS_MAX) {
+        DBG("%d", status);
+        status = 2; // UNKNOWN
+    }
+    role->calls[status]++;
+
+    if (call->hasDuration) {
+        role->durTotal += call->duration;
+        role->durCount++;
+
+        int i;
+        for (i = 0; call->duration > bucketMax[i]; i++);
+        role->bucket[i]++;
+    }
+
+    role->reqMsgs += call->reqMsgs;
+    role->respMsgs += call->respMsgs;
+}
+
+static void
+report_role(mtc_t *mtc, method_agg_t *entry, grpc_role_enum r)
+{
+    role_agg_t *role = &entry->role[r];
+    const char *role_str = (r == ROLE_SERVER) ? "server" : "client";
+
+    uint64_t calls = 0;
+    int i;
+    for (i = 0; i <= GRPC_STATUS_MAX; i++) {
+        if (!role->calls[i]) continue;
+        calls += role->calls[i];
+
+        event_field_t fields[] = {
+            STRFIELD("grpc_service", entry->service, 4, TRUE),
+            STRFIELD("grpc_method",  entry->method,  4, TRUE),
+            NUMFIELD("grpc_status",  i,              1, TRUE),
+            STRFIELD("grpc_role",    role_str,       4, TRUE),
+            STRFIELD("proc",         g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",          g_proc.pid,      4, TRUE),
+            STRFIELD("host",         g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",         "request", 4, TRUE),
+            STRFIELD("summary",      "true",    1, TRUE),
+            FIELDEND
+        };
+        event_t metric = INT_EVENT("grpc.req", role->calls[i], DELTA, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+    if (!calls) return;
+
+    if (role->durCount) {
+        event_field_t fields[] = {
+            STRFIELD("grpc_service", entry->service, 4, TRUE),
+            STRFIELD("grpc_method",  entry->method,  4, TRUE),
+            NUMFIELD("numops",       role->durCount, 8, TRUE),
+            STRFIELD("proc",         g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",          g_proc.pid,      4, TRUE),
+            STRFIELD("host",         g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",         "millisecond", 4, TRUE),
+            STRFIELD("summary",      "true",    1, TRUE),
+            FIELDEND
+        };
+        event_t metric = INT_EVENT((r == ROLE_SERVER) ?
+                                   "grpc.duration.server" : "grpc.duration.client",
+                                   role->durTotal, DELTA_MS, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+
+    // The histogram is cumulative; each bucket counts the calls that took
+    // at most its "le" msecs, so "+Inf" counts them all. Buckets below the
+    // fastest call are empty and aren't sent.
+    uint64_t cumulative = 0;
+    for (i = 0; i < NUM_BUCKETS; i++) {
+        cumulative += role->bucket[i];
+        if (!cumulative) continue;
+
+        event_field_t fields[] = {
+            STRFIELD("grpc_service", entry->service, 4, TRUE),
+            STRFIELD("grpc_method",  entry->method,  4, TRUE),
+            STRFIELD("le",           bucketName[i],  4, TRUE),
+            STRFIELD("proc",         g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",          g_proc.pid,      4, TRUE),
+            STRFIELD("host",         g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",         "request", 4, TRUE),
+            STRFIELD("summary",      "true",    1, TRUE),
+            FIELDEND
+        };
+        event_t metric = INT_EVENT((r == ROLE_SERVER) ?
+                                   "grpc.duration.server.bucket" : "grpc.duration.client.bucket",
+                                   cumulative, DELTA, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+
+    struct {
+        const char *name;
+        uint64_t value;
+    } msgs[] = {
+        {"grpc.req.messages",  role->reqMsgs},
+        {"grpc.resp.messages", role->respMsgs},
+    };
+    for (i = 0; i < sizeof(msgs) / sizeof(msgs[0]); i++) {
+        if (!msgs[i].value) continue;
+
+        event_field_t fields[] = {
+            STRFIELD("grpc_service", entry->service, 4, TRUE),
+            STRFIELD("grpc_method",  entry->method,  4, TRUE),
+            STRFIELD("grpc_role",    role_str,       4, TRUE),
+            STRFIELD("proc",         g_proc.procname, 4, TRUE),
+            NUMFIELD("pid",          g_proc.pid,      4, TRUE),
+            STRFIELD("host",         g_proc.hostname, 4, TRUE),
+            STRFIELD("unit",         "message", 4, TRUE),
+            STRFIELD("summary",      "true",    1, TRUE),
+            FIELDEND
+        };
+        event_t metric = INT_EVENT(msgs[i].name, msgs[i].value, DELTA, fields);
+        cmdSendMetric(mtc, &metric);
+    }
+}
+
+void
+grpcAggSendReport(grpc_agg_t *grpc_agg, mtc_t *mtc)
+{
+    if (!grpc_agg || !mtc) return;
+
+    uint64_t i;
+    for (i = 0; i < grpc_agg->alloc; i++) {
+        method_agg_t *entry = grpc_agg->slot[i];
+        if (!entry) continue;
+        report_role(mtc, entry, ROLE_CLIENT);
+        report_role(mtc, entry, ROLE_SERVER);
+    }
+}
+
+void
+grpcAggReset(grpc_agg_t *grpc_agg)
+{
+    if (!grpc_agg) return;
+
+    uint64_t i;
+    for (i = 0; i < grpc_agg->alloc; i++) {
+        method_agg_t *entry = grpc_agg->slot[i];
+        if (entry) {
+            scope_free(entry->path);
+            scope_free(entry->service);
+            scope_free(entry->method);
+            scope_free(entry);
+        }
+        grpc_agg->slot[i] = NULL;
+    }
+    grpc_agg->count = 0;
+}
+
+// The gRPC status for a call that ended without a grpc-status, from the
+// HTTP status; see "HTTP to gRPC Status Code Mapping" in the gRPC docs.
+int
+grpcStatusFromHttp(int httpStatus)
+{
+    switch (httpStatus) {
+        case 400:
+            return 13; // INTERNAL
+        case 401:
+            return 16; // UNAUTHENTICATED
+        case 403:
+            return 7;  // PERMISSION_DENIED
+        case 404:
+            return 12; // UNIMPLEMENTED
+        case 429:
+        case 502:
+        case 503:
+        case 504:
+            return 14; // UNAVAILABLE
+        default:
+            return 2;  // UNKNOWN
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef __GRPCAGG_H__
+#define __GRPCAGG_H__
+#include "mtc.h"
+
+// This aggregates gRPC calls seen over HTTP/2 for the metrics channel,
+// the same way httpagg does for HTTP requests. Calls are keyed by method
+// (the :path, /package.Service/Method) and each completed call is
+// counted here instead of being sent as its own event.
+//
+// A normal lifecycle:
+//   Create
+//   AddCall
+//   AddCall
+//   SendReport (sends a summary of all calls received before it)
+//   Reset (returns to a state similar to Create)
+
+#define GRPC_STATUS_MAX 16        // UNAUTHENTICATED; the highest code
+
+typedef struct _grpc_agg_t grpc_agg_t;
+
+typedef struct {
+    const char *method;           // :path of the request
+    bool isServer;
+    int status;                   // grpc-status, 0..GRPC_STATUS_MAX
+    bool hasDuration;
+    uint64_t duration;            // msecs from request to end of call
+    uint64_t reqMsgs;             // messages sent by the client
+    uint64_t respMsgs;            // messages sent by the server
+} grpc_call_t;
+
+grpc_agg_t *grpcAggCreate(void);
+void grpcAggDestroy(grpc_agg_t **);
+void grpcAggAddCall(grpc_agg_t *, grpc_call_t *);
+void grpcAggSendReport(grpc_agg_t *, mtc_t *);
+void grpcAggReset(grpc_agg_t *);
+
+int grpcStatusFromHttp(int);
+
+#endif // __GRPCAGG_H__
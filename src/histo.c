@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#include "atomic.h"
+#include "dbg.h"
+#include "histo.h"
+#include "scopestdlib.h"
+
+// Threads are given one of this many shards, in turn
+#define HISTO_SHARDS 16
+
+typedef struct {
+    uint64_t bucket[HISTO_CLASSES][HISTO_BUCKETS];
+} __attribute__((aligned(64))) histo_shard_t;
+
+static histo_shard_t g_shard[HISTO_SHARDS];
+static uint64_t g_last[HISTO_CLASSES][HISTO_BUCKETS];
+static int g_next_shard = 0;
+static __thread int t_shard = -1;
+
+// duration is in ns
+void
+histoRecord(histo_class_t cls, uint64_t duration)
+{
+    if (cls >= HISTO_CLASSES) {
+        DBG("%d", cls);
+        return;
+    }
+
+    if (t_shard == -1) {
+        t_shard = (unsigned)(__sync_fetch_and_add(&g_next_shard, 1)) % HISTO_SHARDS;
+    }
+
+    uint64_t us = duration / 1000;
+    unsigned b = us ? 64 - __builtin_clzll(us) : 0;
+    if (b >= HISTO_BUCKETS) b = HISTO_BUCKETS - 1;
+
+    atomicAddFetchU64(&g_shard[t_shard].bucket[cls][b], 1);
+}
+
+/*
+ * Counted since the last call. The shards are summed without stopping
+ * anyone from recording; an increment in flight is picked up next time.
+ * Only the periodic thread asks.
+ */
+void
+histoGet(histo_class_t cls, histo_t *histo)
+{
+    if (!histo || (cls >= HISTO_CLASSES)) {
+        DBG("%d", cls);
+        return;
+    }
+
+    histo->count = 0;
+    int b, i;
+    for (b = 0; b < HISTO_BUCKETS; b++) {
+        uint64_t sum = 0;
+        for (i = 0; i < HISTO_SHARDS; i++) {
+            sum += g_shard[i].bucket[cls][b];
+        }
+        histo->bucket[b] = sum - g_last[cls][b];
+        histo->count += histo->bucket[b];
+        g_last[cls][b] = sum;
+    }
+}
+
+// In the child of a fork; what the parent recorded is the parent's to report
+void
+histoReset(void)
+{
+    scope_memset(g_shard, 0, sizeof(g_shard));
+    scope_memset(g_last, 0, sizeof(g_last));
+}
@@ -0,0 +1,37 @@
+#ifndef __HISTO_H__
+#define __HISTO_H__
+
+#include <stdint.h>
+#include "scopetypes.h"
+
+// Latency histograms of the operations the datapath times. Recording a
+// duration is one atomic increment of a bucket; the buckets are split
+// into shards that threads are spread across, so that threads doing the
+// same operation don't all increment the same counters.
+//
+// Buckets are powers of two of microseconds. Bucket 0 counts what took
+// less than 1 us, bucket b what took less than 2^b us, and the last one
+// everything longer than the one before it.
+
+typedef enum {
+    HISTO_READ,
+    HISTO_WRITE,
+    HISTO_OPEN,
+    HISTO_STAT,
+    HISTO_CONNECT,
+    HISTO_DNS,
+    HISTO_CLASSES,
+} histo_class_t;
+
+#define HISTO_BUCKETS 26
+
+typedef struct {
+    uint64_t count;
+    uint64_t bucket[HISTO_BUCKETS];
+} histo_t;
+
+void histoRecord(histo_class_t, uint64_t);
+void histoGet(histo_class_t, histo_t *);
+void histoReset(void);
+
+#endif // __HISTO_H__
@@ -380,4 +380,272 @@ channelExpire(channelstore_t *chanStore, uint64_t circBufCount, bool circBufWasE
     return storeExpire((store_t *)chanStore, circBufCount, circBufWasEmptied);
 }
 
+//////////////////////
+
+#define STREAM_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t id;
+    void *data;
+    uint32_t older;               // index of the node added before this one
+    uint32_t newer;               // index of the node added after this one
+    size_t bytes;                 // as last charged
+} streamNode_t;
+
+typedef struct _streamtable_t {
+    streamNode_t *nodes;          // max nodes; unused ones are on the free list
+    uint32_t *slots;              // node index + 1, or 0 for an empty slot
+    size_t max;
+    size_t mask;
+    size_t count;
+    uint32_t oldest;
+    uint32_t newest;
+    uint32_t free;
+    freeStream_fn freeStream;
+    uint64_t evicted;
+    size_t bytes;                 // charged to all nodes
+    size_t maxBytes;              // 0 - no budget
+} streamtable_t;
+
+static inline size_t
+streamSlotOfId(streamtable_t *table, uint32_t id)
+{
+    // Client streams are odd and server streams even, both counting up,
+    // so mix the bits before masking
+    return (id * 0x9E3779B1U) & table->mask;
+}
+
+streamtable_t *
+streamTableCreate(size_t max, size_t maxBytes, freeStream_fn freeStream)
+{
+    if (!max || max >= STREAM_NONE || !freeStream) return NULL;
+
+    // Keep the table no more than half full so probes stay short
+    size_t numSlots = 1;
+    while (numSlots < max * 2) numSlots <<= 1;
+
+    streamtable_t *table = scope_calloc(1, sizeof(streamtable_t));
+    if (!table) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    table->nodes = scope_calloc(max, sizeof(streamNode_t));
+    table->slots = scope_calloc(numSlots, sizeof(uint32_t));
+    if (!table->nodes || !table->slots) {
+        DBG(NULL);
+        if (table->nodes) scope_free(table->nodes);
+        if (table->slots) scope_free(table->slots);
+        scope_free(table);
+        return NULL;
+    }
+
+    size_t i;
+    for (i = 0; i < max; i++) {
+        table->nodes[i].newer = (i + 1 < max) ? i + 1 : STREAM_NONE;
+    }
+    table->max = max;
+    table->maxBytes = maxBytes;
+    table->mask = numSlots - 1;
+    table->oldest = STREAM_NONE;
+    table->newest = STREAM_NONE;
+    table->free = 0;
+    table->freeStream = freeStream;
+
+    return table;
+}
+
+void
+streamTableDestroy(streamtable_t **tableptr)
+{
+    if (!tableptr || !*tableptr) return;
+    streamtable_t *table = *tableptr;
+
+    uint32_t i;
+    for (i = table->oldest; i != STREAM_NONE; i = table->nodes[i].newer) {
+        table->freeStream(table->nodes[i].data);
+    }
+
+    scope_free(table->nodes);
+    scope_free(table->slots);
+    scope_free(table);
+    *tableptr = NULL;
+}
+
+static size_t
+streamSlotFind(streamtable_t *table, uint32_t id, bool *found)
+{
+    size_t slot = streamSlotOfId(table, id);
+    while (table->slots[slot]) {
+        if (table->nodes[table->slots[slot] - 1].id == id) {
+            *found = TRUE;
+            return slot;
+        }
+        slot = (slot + 1) & table->mask;
+    }
+    *found = FALSE;
+    return slot;
+}
+
+static void
+streamSlotClear(streamtable_t *table, size_t slot)
+{
+    // Linear probing; move later entries of the run back into the hole
+    // so lookups never need tombstones
+    size_t next = slot;
+    table->slots[slot] = 0;
+    for (;;) {
+        next = (next + 1) & table->mask;
+        if (!table->slots[next]) break;
+
+        size_t home = streamSlotOfId(table, table->nodes[table->slots[next] - 1].id);
+        // move it if its home is not in the (slot, next] range
+        if ((slot <= next) ? (home <= slot || home > next)
+                           : (home <= slot && home > next)) {
+            table->slots[slot] = table->slots[next];
+            table->slots[next] = 0;
+            slot = next;
+        }
+    }
+}
+
+static void
+streamRemove(streamtable_t *table, size_t slot)
+{
+    uint32_t n = table->slots[slot] - 1;
+    streamNode_t *node = &table->nodes[n];
+
+    streamSlotClear(table, slot);
+
+    if (node->older != STREAM_NONE) {
+        table->nodes[node->older].newer = node->newer;
+    } else {
+        table->oldest = node->newer;
+    }
+    if (node->newer != STREAM_NONE) {
+        table->nodes[node->newer].older = node->older;
+    } else {
+        table->newest = node->older;
+    }
+
+    table->freeStream(node->data);
+    node->data = NULL;
+    table->bytes -= node->bytes;
+    node->bytes = 0;
+    node->newer = table->free;
+    table->free = n;
+    table->count--;
+}
+
+// Returns the id of the stream it evicted
+static uint32_t
+streamEvictOldest(streamtable_t *table)
+{
+    bool found;
+    uint32_t id = table->nodes[table->oldest].id;
+    size_t slot = streamSlotFind(table, id, &found);
+    streamRemove(table, slot);
+    table->evicted++;
+    return id;
+}
+
+bool
+streamTableAdd(streamtable_t *table, uint32_t id, void *data)
+{
+    if (!table || !data) return FALSE;
+
+    bool found;
+    size_t slot = streamSlotFind(table, id, &found);
+    if (found) return FALSE;
+
+    if (table->count == table->max) {
+        streamEvictOldest(table);
+        // the hole may have moved entries; find where this id goes again
+        slot = streamSlotFind(table, id, &found);
+    }
+
+    uint32_t n = table->free;
+    streamNode_t *node = &table->nodes[n];
+    table->free = node->newer;
+
+    node->id = id;
+    node->data = data;
+    node->older = table->newest;
+    node->newer = STREAM_NONE;
+    if (table->newest != STREAM_NONE) {
+        table->nodes[table->newest].newer = n;
+    } else {
+        table->oldest = n;
+    }
+    table->newest = n;
+
+    table->slots[slot] = n + 1;
+    table->count++;
+    return TRUE;
+}
+
+void *
+streamTableGet(streamtable_t *table, uint32_t id)
+{
+    if (!table) return NULL;
+
+    bool found;
+    size_t slot = streamSlotFind(table, id, &found);
+    return found ? table->nodes[table->slots[slot] - 1].data : NULL;
+}
 
+bool
+streamTableDelete(streamtable_t *table, uint32_t id)
+{
+    if (!table) return FALSE;
+
+    bool found;
+    size_t slot = streamSlotFind(table, id, &found);
+    if (!found) return FALSE;
+
+    streamRemove(table, slot);
+    return TRUE;
+}
+
+/*
+ * Sets the bytes a stream holds, then evicts the oldest streams while the
+ * table is over its budget. Returns FALSE if the stream isn't in the table
+ * afterwards; when it's too big on its own, it goes too.
+ */
+bool
+streamTableCharge(streamtable_t *table, uint32_t id, size_t bytes)
+{
+    if (!table) return FALSE;
+
+    bool found;
+    size_t slot = streamSlotFind(table, id, &found);
+    if (!found) return FALSE;
+
+    streamNode_t *node = &table->nodes[table->slots[slot] - 1];
+    table->bytes = table->bytes - node->bytes + bytes;
+    node->bytes = bytes;
+
+    bool kept = TRUE;
+    while (table->maxBytes && (table->bytes > table->maxBytes)) {
+        if (streamEvictOldest(table) == id) kept = FALSE;
+    }
+    return kept;
+}
+
+size_t
+streamTableCount(streamtable_t *table)
+{
+    return table ? table->count : 0;
+}
+
+size_t
+streamTableBytes(streamtable_t *table)
+{
+    return table ? table->bytes : 0;
+}
+
+uint64_t
+streamTableEvicted(streamtable_t *table)
+{
+    return table ? table->evicted : 0;
+}
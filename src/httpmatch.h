@@ -67,5 +67,33 @@ bool            channelDelete(channelstore_t *, uint64_t);
 bool            channelExpire(channelstore_t *, uint64_t, bool);
 
 
+// Within a channel, the state for each stream is kept in a stream table.
+// It's sized when it's created and never grows; lookups by stream ID are
+// a hash probe.  Streams are normally deleted when their response ends
+// but with thousands multiplexed on one channel and events being dropped,
+// that can't be relied on.  When the table is full, adding a stream
+// evicts the oldest one still in the table and counts the eviction.
+//
+// The table also has a byte budget (0 for none).  Each stream is charged
+// what its owner says it holds; while the total is over the budget, the
+// oldest streams are evicted, and counted, the same way.
+//
+
+typedef struct _streamtable_t streamtable_t;
+
+typedef void (*freeStream_fn)(void *);
+
+streamtable_t  *streamTableCreate(size_t, size_t, freeStream_fn);
+void            streamTableDestroy(streamtable_t **);
+
+bool            streamTableAdd(streamtable_t *, uint32_t, void *);
+void           *streamTableGet(streamtable_t *, uint32_t);
+bool            streamTableDelete(streamtable_t *, uint32_t);
+bool            streamTableCharge(streamtable_t *, uint32_t, size_t);
+size_t          streamTableCount(streamtable_t *);
+size_t          streamTableBytes(streamtable_t *);
+uint64_t        streamTableEvicted(streamtable_t *);
+
+
 
 #endif // __HTTPMATCH_H__
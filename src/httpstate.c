@@ -3,6 +3,7 @@
 #include <string.h>
 //#include <lshpack.h>
 
+#include "arena.h"
 #include "com.h"
 #include "dbg.h"
 #include "evtutils.h"
@@ -18,6 +19,16 @@
 #define HTTP2_MAGIC "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
 #define HTTP2_MAGIC_LEN 24
 
+// Partial HTTP/2 frames are stashed in buffers taken from a small shared
+// pool instead of one realloc'd for each socket. A buffer is only held
+// while a frame is incomplete. Frames bigger than the default
+// SETTINGS_MAX_FRAME_SIZE, or any stashed while the pool is empty, get a
+// buffer of their own.
+#define HTTP2_STASH_POOL 32
+#define HTTP2_STASH_SIZE (16 * 1024 + 9)
+static int g_http2_stash_used[HTTP2_STASH_POOL];
+static uint8_t *g_http2_stash_pool[HTTP2_STASH_POOL];
+
 #define HTTP_START "HTTP/"
 #define HTTP_END "\r\n"
 static search_t* g_http_start = NULL;
@@ -31,6 +42,7 @@ static pcre2_code *g_http_upgrade = NULL;
 static pcre2_code *g_http_connect = NULL;
 
 static void setHttpState(http_state_t *httpstate, http_enum_t toState);
+static void http2StashRelease(http_buf_t *stash);
 static void appendHeader(http_state_t *httpstate, char* buf, size_t len);
 static size_t getContentLength(char *header, size_t len);
 static size_t bytesToSkipForContentLength(http_state_t *httpstate, size_t len);
@@ -48,14 +60,13 @@ setHttpState(http_state_t *httpstate, http_enum_t toState)
     switch (toState) {
         case HTTP_NONE:
             // cleanup the stash for the RX and TX sides
-            if (httpstate->http2Buf.buf) {
-                scope_free(httpstate->http2Buf.buf);
-                httpstate->http2Buf.buf = NULL;
-            }
-            httpstate->http2Buf.len = 0;
-            httpstate->http2Buf.size = 0;
+            http2StashRelease(&httpstate->http2Buf);
+            httpstate->http2Buf.skip = 0;
+            scope_memset(httpstate->grpcMsg, 0, sizeof(httpstate->grpcMsg));
+            httpstate->dataMsg = NULL;
+            httpstate->dataMsgs = 0;
             if (httpstate->hdr) {
-                scope_free(httpstate->hdr);
+                arenaFree(httpstate->hdr);
                 httpstate->hdr = NULL;
             }
 
@@ -94,15 +105,20 @@ appendHeader(http_state_t *httpstate, char* buf, size_t len)
         }
     }
 
-    // If we need more space, scope_realloc
+    // If we need more space, grow it. The header is posted to the
+    // reporting thread which frees it, so it comes from the arena.
     if (alloc_size != httpstate->hdralloc) {
-        char* temp = scope_realloc(httpstate->hdr, alloc_size);
+        char* temp = arenaMallocBuffer(alloc_size);
         if (!temp) {
             DBG(NULL);
             // Don't return partial headers...  All or nothing.
             setHttpState(httpstate, HTTP_NONE);
             return;
         }
+        if (httpstate->hdr) {
+            scope_memcpy(temp, httpstate->hdr, httpstate->hdrlen);
+            arenaFree(httpstate->hdr);
+        }
         httpstate->hdr = temp;
         httpstate->hdralloc = alloc_size;
     }
@@ -119,28 +135,29 @@ getContentLength(char *header, size_t len)
 {
     if (!g_http_clength) return -1;
 
-    pcre2_match_data *matches = pcre2_match_data_create_from_pattern(g_http_clength, NULL);
-    if (!matches) return -1;
-
-    int rc = pcre2_match_wrapper(g_http_clength,
-            (PCRE2_SPTR)header, (PCRE2_SIZE)len,
-            0, 0, matches, NULL);
+    pcre2_match_data *matches = NULL;
+    int rc = regexMatch(g_http_clength,
+            (PCRE2_SPTR)header, (PCRE2_SIZE)len, &matches);
     if (rc != 2) {
-        pcre2_match_data_free(matches);
+        regexMatchRelease(matches);
         return -1;
     }
 
-    PCRE2_UCHAR *cLen; PCRE2_SIZE cLenLen;
-    pcre2_substring_get_bynumber(matches, 1, &cLen, &cLenLen);
-
-    size_t ret = scope_strtoull((const char *)cLen, NULL, 0);
+    // The digits aren't null terminated; copy them out rather than
+    // allocating a substring.
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(matches);
+    char cLen[24];
+    size_t cLenLen = ovector[3] - ovector[2];
+    if (cLenLen >= sizeof(cLen)) cLenLen = sizeof(cLen) - 1;
+    scope_memcpy(cLen, &header[ovector[2]], cLenLen);
+    cLen[cLenLen] = '\0';
+    regexMatchRelease(matches);
+
+    size_t ret = scope_strtoull(cLen, NULL, 0);
     if ((ret == 0) || (ret == ULLONG_MAX)) {
         ret = -1;
     }
 
-    pcre2_match_data_free(matches);
-    pcre2_substring_free(cLen);
-
     return ret;
 }
 
@@ -150,14 +167,8 @@ hasUpgrade(const char *header, size_t len)
 {
     if (!g_http_upgrade) return FALSE;
 
-    pcre2_match_data *matches = pcre2_match_data_create_from_pattern(g_http_upgrade, NULL);
-    if (!matches) return FALSE;
-
-    int rc = pcre2_match_wrapper(g_http_upgrade,
-            (PCRE2_SPTR)header, (PCRE2_SIZE)len,
-            0, 0, matches, NULL);
-
-    pcre2_match_data_free(matches);
+    int rc = regexMatch(g_http_upgrade,
+            (PCRE2_SPTR)header, (PCRE2_SIZE)len, NULL);
 
     return rc == 1;
 }
@@ -168,14 +179,8 @@ hasConnectionUpgrade(const char *header, size_t len)
 {
     if (!g_http_connect) return FALSE;
 
-    pcre2_match_data *matches = pcre2_match_data_create_from_pattern(g_http_connect, NULL);
-    if (!matches) return FALSE;
-
-    int rc = pcre2_match_wrapper(g_http_connect,
-            (PCRE2_SPTR)header, (PCRE2_SIZE)len,
-            0, 0, matches, NULL);
-
-    pcre2_match_data_free(matches);
+    int rc = regexMatch(g_http_connect,
+            (PCRE2_SPTR)header, (PCRE2_SIZE)len, NULL);
 
     return rc == 1;
 }
@@ -275,39 +280,21 @@ reportHttp1(http_state_t *httpstate)
     return 0;
 }
 
-static bool
-reportHttp2(http_state_t *state, net_info *net, http_buf_t *stash,
-        const uint8_t *buf, uint32_t frameLen, httpId_t *httpId)
+static void
+setHttp2Proto(http_state_t *state, net_info *net, httpId_t *httpId,
+        protocol_info *proto, uint32_t frameLen)
 {
-    if (!state || !stash || !buf || !frameLen || !httpId) {
-        scopeLogError("ERROR: NULL reportHttp2() parameter");
-        DBG(NULL);
-        return FALSE;
-    }
-
-    protocol_info *proto = evtProtoAllocHttp2Frame(frameLen);
-    if (!proto) {
-        scopeLogError("ERROR: failed to allocate protocol object");
-        DBG(NULL);
-        return FALSE;
-    }
-
     http_post *post = (http_post *)proto->data;
     post->ssl            = state->id.isSsl;
     post->start_duration = getTime();
-    post->id             = state->id;
-    if (stash->len) {
-        scope_memcpy(post->hdr, stash->buf, stash->len);
-        scope_memcpy(post->hdr + stash->len, buf, frameLen - stash->len);
-    } else {
-        scope_memcpy(post->hdr, buf, frameLen);
-    }
+    // state->id is only set by the HTTP/1 parser
+    post->id             = *httpId;
 
     // Unlike in the HTTP/1 case, we're sending TRUE here if the frame was
     // sent, not if we're the server. We haven't parsed the frame to know if
     // it's a request or response yet so we're sending half of the isServer
     // answer here and will finish the logic on the reporting side.
-    proto->isServer = (state->id.src == NETTX) || (state->id.src == TLSTX);
+    proto->isServer = (httpId->src == NETTX) || (httpId->src == TLSTX);
     proto->len      = frameLen;
     proto->fd       = httpId->sockfd;
     proto->uid      = httpId->uid;
@@ -328,6 +315,33 @@ reportHttp2(http_state_t *state, net_info *net, http_buf_t *stash,
         proto->localConn.ss_family  = -1;
         proto->remoteConn.ss_family = -1;
     }
+}
+
+static bool
+reportHttp2(http_state_t *state, net_info *net, http_buf_t *stash,
+        const uint8_t *buf, uint32_t frameLen, httpId_t *httpId)
+{
+    if (!state || !stash || !buf || !frameLen || !httpId) {
+        scopeLogError("ERROR: NULL reportHttp2() parameter");
+        DBG(NULL);
+        return FALSE;
+    }
+
+    protocol_info *proto = evtProtoAllocHttp2Frame(frameLen);
+    if (!proto) {
+        scopeLogError("ERROR: failed to allocate protocol object");
+        DBG(NULL);
+        return FALSE;
+    }
+
+    http_post *post = (http_post *)proto->data;
+    if (stash->len) {
+        scope_memcpy(post->hdr, stash->buf, stash->len);
+        scope_memcpy(post->hdr + stash->len, buf, frameLen - stash->len);
+    } else {
+        scope_memcpy(post->hdr, buf, frameLen);
+    }
+    setHttp2Proto(state, net, httpId, proto, frameLen);
 
     bool ret = (uint8_t)(post->hdr[4]) & 0x04; // TRUE if END_HEADERS flag set
 
@@ -337,6 +351,36 @@ reportHttp2(http_state_t *state, net_info *net, http_buf_t *stash,
     return ret;
 }
 
+// The frame is summarized as a DATA frame header with a 4 byte payload;
+// the number of gRPC messages that started in it.
+static void
+reportHttp2Data(http_state_t *state, net_info *net, httpId_t *httpId,
+        uint32_t stream, uint32_t msgs)
+{
+    protocol_info *proto = evtProtoAllocHttp2Frame(9 + 4);
+    if (!proto) {
+        scopeLogError("ERROR: failed to allocate protocol object");
+        DBG(NULL);
+        return;
+    }
+
+    http_post *post = (http_post *)proto->data;
+    uint8_t *frame = (uint8_t *)post->hdr;
+    scope_memset(frame, 0, 9);
+    frame[2] = 4;    // length; type (DATA) and flags are 0
+    frame[5] = (stream >> 24) & 0x7f;
+    frame[6] = (stream >> 16) & 0xff;
+    frame[7] = (stream >>  8) & 0xff;
+    frame[8] = (stream      ) & 0xff;
+    frame[9]  = (msgs >> 24) & 0xff;
+    frame[10] = (msgs >> 16) & 0xff;
+    frame[11] = (msgs >>  8) & 0xff;
+    frame[12] = (msgs      ) & 0xff;
+    setHttp2Proto(state, net, httpId, proto, 9 + 4);
+
+    cmdPostEvent(g_ctl, (char *)proto);
+}
+
 /*
  * If we have an fd check for TCP
  * If we don't have a socket it can mean we are
@@ -451,18 +495,15 @@ initHttpState(void)
     int        errNum;
     PCRE2_SIZE errPos;
 
-    if (!(g_http_clength = pcre2_compile((PCRE2_SPTR)HTTP_CLENGTH,
-            PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
+    if (!(g_http_clength = regexCompile(HTTP_CLENGTH, &errNum, &errPos))) {
         scopeLogError("ERROR: HTTP/1 content-length regex failed; err=%d, pos=%ld",
                 errNum, errPos);
     }
-    if (!(g_http_upgrade = pcre2_compile((PCRE2_SPTR)HTTP_UPGRADE,
-            PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
+    if (!(g_http_upgrade = regexCompile(HTTP_UPGRADE, &errNum, &errPos))) {
         scopeLogError("ERROR: HTTP/1 upgrade regex failed; err=%d, pos=%ld",
                 errNum, errPos);
     }
-    if (!(g_http_connect = pcre2_compile((PCRE2_SPTR)HTTP_CONNECT,
-            PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
+    if (!(g_http_connect = regexCompile(HTTP_CONNECT, &errNum, &errPos))) {
         scopeLogError("ERROR: HTTP/1 connection regex failed; err=%d, pos=%ld",
                 errNum, errPos);
     }
@@ -475,6 +516,57 @@ destroyHttpState(void) {
     pcre2_code_free(g_http_clength);
     searchFree(&g_http_end);
     searchFree(&g_http_start);
+
+    int i;
+    for (i = 0; i < HTTP2_STASH_POOL; i++) {
+        if (g_http2_stash_pool[i] && atomicCas32(&g_http2_stash_used[i], 0, 1)) {
+            scope_free(g_http2_stash_pool[i]);
+            g_http2_stash_pool[i] = NULL;
+            g_http2_stash_used[i] = 0;
+        }
+    }
+}
+
+static uint8_t *
+http2StashPoolGet(void)
+{
+    int i;
+    for (i = 0; i < HTTP2_STASH_POOL; i++) {
+        if (!atomicCas32(&g_http2_stash_used[i], 0, 1)) continue;
+
+        // the slot is ours now so it's safe to fill it in the first time
+        if (!g_http2_stash_pool[i]) {
+            g_http2_stash_pool[i] = scope_malloc(HTTP2_STASH_SIZE);
+            if (!g_http2_stash_pool[i]) {
+                atomicCas32(&g_http2_stash_used[i], 1, 0);
+                return NULL;
+            }
+        }
+        return g_http2_stash_pool[i];
+    }
+
+    return NULL;
+}
+
+static void
+http2StashRelease(http_buf_t *stash)
+{
+    if (!stash) return;
+
+    if (stash->buf) {
+        int i;
+        for (i = 0; i < HTTP2_STASH_POOL; i++) {
+            if (g_http2_stash_pool[i] == stash->buf) {
+                atomicCas32(&g_http2_stash_used[i], 1, 0);
+                break;
+            }
+        }
+        if (i == HTTP2_STASH_POOL) scope_free(stash->buf);
+    }
+
+    stash->buf = NULL;
+    stash->len = 0;
+    stash->size = 0;
 }
 
 static void
@@ -489,16 +581,28 @@ http2StashFrame(http_buf_t *stash, const uint8_t *buf, size_t len)
     // need to store the `len` we're given plus whatever's already stashed
     size_t need = len + stash->len;
     if (need > stash->size) {
-        // round up to the next 1k boundary and scope_realloc
-        need = ((need + 1023) / 1024) * 1024;
-        uint8_t *newBuf = scope_realloc(stash->buf, need);
+        uint8_t *newBuf = NULL;
+        size_t newSize = HTTP2_STASH_SIZE;
+        if (!stash->buf && need <= HTTP2_STASH_SIZE) {
+            newBuf = http2StashPoolGet();
+        }
+        if (!newBuf) {
+            // round up to the next 1k boundary
+            newSize = ((need + 1023) / 1024) * 1024;
+            newBuf = scope_malloc(newSize);
+        }
         if (!newBuf) {
             scopeLogError("ERROR: failed to (re)allocate frame buffer");
             DBG(NULL);
             return;
         }
+
+        size_t stashed = stash->len;
+        if (stashed) scope_memcpy(newBuf, stash->buf, stashed);
+        http2StashRelease(stash);
         stash->buf = newBuf;
-        stash->size = need;
+        stash->len = stashed;
+        stash->size = newSize;
     }
 
     // append what we're given to the stash
@@ -566,7 +670,6 @@ http2GetFrameType(http_buf_t *stash, const uint8_t *buf, size_t len)
     return ret;
 }
 
-#if 0
 static uint8_t
 http2GetFrameFlags(http_buf_t *stash, const uint8_t *buf, size_t len)
 {
@@ -634,9 +737,57 @@ http2GetFrameStream(http_buf_t *stash, const uint8_t *buf, size_t len)
 
     return ret;
 }
-#endif
 
 
+// The framing state kept for a stream's DATA frames. Only a few streams
+// are tracked per socket; a stream that lost its slot starts over as if
+// a message starts at the beginning of its next DATA frame.
+static grpc_msg_t *
+grpcMsgForStream(http_state_t *state, uint32_t stream)
+{
+    // stream IDs from one side are all odd or all even
+    grpc_msg_t *msg = &state->grpcMsg[(stream >> 1) & (GRPC_MSG_STREAMS - 1)];
+    if (msg->stream != stream) {
+        scope_memset(msg, 0, sizeof(*msg));
+        msg->stream = stream;
+    }
+    return msg;
+}
+
+// Returns the number of gRPC messages whose prefix ends in buf
+static uint32_t
+grpcCountMessages(grpc_msg_t *msg, const uint8_t *buf, size_t len)
+{
+    uint32_t count = 0;
+    size_t pos = 0;
+
+    while (pos < len && !msg->notGrpc) {
+        if (msg->left) {
+            size_t take = (msg->left < len - pos) ? msg->left : len - pos;
+            msg->left -= take;
+            pos += take;
+            continue;
+        }
+
+        uint8_t c = buf[pos++];
+        if (msg->have == 0) {
+            // the compressed flag is 0 or 1; anything else isn't gRPC
+            if (c > 1) msg->notGrpc = 1;
+            msg->len = 0;
+        } else {
+            msg->len = (msg->len << 8) | c;
+        }
+
+        if (++msg->have == 5) {
+            msg->have = 0;
+            msg->left = msg->len;
+            count++;
+        }
+    }
+
+    return count;
+}
+
 static bool
 parseHttp2(http_state_t* state, net_info *net, int isTx,
         const uint8_t *buf, size_t len, httpId_t *httpId)
@@ -654,57 +805,79 @@ parseHttp2(http_state_t* state, net_info *net, int isTx,
     http_buf_t    *stash  = &state->http2Buf;       // stash for partial frames
     while (bufLen > 0) {
         // skip over MAGIC
-        if (bufLen >= HTTP2_MAGIC_LEN && !scope_strncmp((char*)buf, HTTP2_MAGIC, HTTP2_MAGIC_LEN)) {
+        if (bufLen >= HTTP2_MAGIC_LEN && !scope_strncmp((char*)bufPos, HTTP2_MAGIC, HTTP2_MAGIC_LEN)) {
             bufPos += HTTP2_MAGIC_LEN;
             bufLen -= HTTP2_MAGIC_LEN;
-            if (!bufLen) return FALSE;
+            if (!bufLen) return ret;
+        }
+
+        // skip the rest of a frame we're not interested in
+        if (stash->skip) {
+            size_t skip = (stash->skip < bufLen) ? stash->skip : bufLen;
+            if (state->dataMsg) {
+                state->dataMsgs += grpcCountMessages(state->dataMsg, bufPos, skip);
+            }
+            bufPos += skip;
+            bufLen -= skip;
+            stash->skip -= skip;
+
+            if (!stash->skip && state->dataMsg) {
+                if (state->dataMsgs) {
+                    reportHttp2Data(state, net, httpId, state->dataMsg->stream, state->dataMsgs);
+                }
+                state->dataMsg = NULL;
+                state->dataMsgs = 0;
+            }
+            continue;
         }
 
         // stash the buffer if we don't have enough for a frame header
         if (stash->len + bufLen < 9) {
             http2StashFrame(stash, bufPos, bufLen);
-            return FALSE;
+            return ret;
         }
 
         // get the header values
         uint32_t fLen    = http2GetFrameLength(stash, bufPos, bufLen);
         uint8_t  fType   = http2GetFrameType(stash, bufPos, bufLen);
-        //uint8_t  fFlags  = http2GetFrameFlags(stash, bufPos, bufLen);
-        //uint32_t fStream = http2GetFrameStream(stash, bufPos, bufLen);
+        uint8_t  fFlags  = http2GetFrameFlags(stash, bufPos, bufLen);
+        uint32_t fStream = http2GetFrameStream(stash, bufPos, bufLen);
+
+        //scopeLogDebug("DEBUG: HTTP/2 %s frame found; type=0x%02x, flags=0x%02x, stream=%d",
+        //        isTx ? "TX" : "RX", fType, fFlags, fStream);
+
+        // Only HEADERS(1), PUSH_PROMISE(5) and CONTINUATION(9) frames are
+        // reported. For the others, the header is all we need to find
+        // where the next frame starts so the payload is skipped, not
+        // stashed; DATA frames are often bigger than everything else.
+        // gRPC messages are counted in the DATA payload on the way past;
+        // padded frames are rare enough that they aren't.
+        if (fType != 0x01 && fType != 0x05 && fType != 0x09) {
+            size_t hdrLeft = 9 - stash->len;
+            bufPos += hdrLeft;
+            bufLen -= hdrLeft;
+            http2StashRelease(stash);
+            stash->skip = fLen;
+            if (fType == 0x00 && fLen && !(fFlags & 0x08)) {
+                state->dataMsg = grpcMsgForStream(state, fStream);
+                state->dataMsgs = 0;
+            }
+            continue;
+        }
 
         // stash the buffer if we don't have enough for the whole frame
         if (stash->len + bufLen < (9 + fLen)) {
             http2StashFrame(stash, bufPos, bufLen);
-            return FALSE;
+            return ret;
         }
 
-        //scopeLogDebug("DEBUG: HTTP/2 %s frame found; type=0x%02x, flags=0x%02x, stream=%d",
-        //        isTx ? "TX" : "RX", fType, fFlags, fStream);
-
-        // process interesting frames
-        switch (fType) {
-            case 0x01:
-                // process HEADERS frames
-                ret |= reportHttp2(state, net, stash, bufPos, fLen+9, httpId);
-                break;
-            case 0x05:
-                // process PUSH_PROMISE frames (unsolicited requests)
-                ret |= reportHttp2(state, net, stash, bufPos, fLen+9, httpId);
-                break;
-            case 0x09:
-                // process CONTINUATION frames (additional HEADERS)
-                ret |= reportHttp2(state, net, stash, bufPos, fLen+9, httpId);
-                break;
-            default:
-                // not interested in other frames
-                break;
-        }
+        ret |= reportHttp2(state, net, stash, bufPos, fLen+9, httpId);
 
-        // skip over what we parsed in the buffer and clear the stash
+        // skip over what we parsed in the buffer and give the stash back
         size_t bytesParsed = fLen + 9 - stash->len;
         bufPos += bytesParsed;
         bufLen -= bytesParsed;
-        stash->len = 0; // the stash was parsed too
+        http2StashRelease(stash); // the stash was parsed too
     }
 
     return ret;
@@ -6,6 +6,7 @@
 #include "cJSON.h"
 #include "dbg.h"
 #include <errno.h>
+#include <limits.h>
 #include <time.h>
 
 /* Inter-process communication module based on the message-queue
@@ -24,10 +25,14 @@
  * See details in: https://man7.org/linux/man-pages/man7/mq_overview.7.html
  */
 
-// IPC message (send/receive) retry count
-#define RETRY_COUNT 500
+// How long to wait on a queue that's full (send) or empty (receive)
+// in the middle of a message
+#define FRAME_TIMEOUT_MS 25
 #define INPUT_MSG_ALLOC_LIMIT (1024*1024) // 1 MB
 
+// Where the mqueue filesystem is normally mounted
+#define MQUEUE_DIR "/dev/mqueue"
+
 /*
  * Translates the internal status of parsing request to the response output status
  */
@@ -62,29 +67,48 @@ typedef enum {
     MSG_RECV_OK,                     // Request was succesfully received
 } ipc_receive_result;
 
+static uint64_t
+nowMs(void)
+{
+    struct timespec ts;
+    scope_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Waits for the queue to have a message (POLLIN) or room for one (POLLOUT).
+ * The deadline is set by the first wait for a frame.
+ * Returns FALSE once the deadline has passed.
+ */
+static bool
+waitForQueue(mqd_t mqDes, short events, uint64_t *deadline)
+{
+    uint64_t now = nowMs();
+    if (!*deadline) *deadline = now + FRAME_TIMEOUT_MS;
+    if (now >= *deadline) return FALSE;
+
+    struct pollfd fds = {.fd = mqDes, .events = events};
+    return (scope_poll(&fds, 1, *deadline - now) != 0);
+}
+
 /*
  * Retrieves IPC frame to specific message queue descriptor
  */
 static ipc_receive_result
 ipcReceiveFrameWithRetry(mqd_t mqDes, char *mqMsgBuf, size_t mqMaxMsgSize, ssize_t *mqMsgLen) {
-    for (int retryCount = 1; retryCount <= RETRY_COUNT; ++retryCount) {
+    uint64_t deadline = 0;
+    while (1) {
         *mqMsgLen = scope_mq_receive(mqDes, mqMsgBuf, mqMaxMsgSize, 0);
         if (*mqMsgLen != -1) {
             return MSG_RECV_OK;
-        } else if(scope_errno == EAGAIN) {
-            /*
-            * Message queue is empty wait 50 us and retry since
-            * the communication here is non-block
-            */
-            scope_nanosleep((const struct timespec[]){{0, 50000L}}, NULL);
-        } else {
-            /*
-            * Other error
-            */
+        } else if (scope_errno != EAGAIN) {
             return MSG_RECV_OTHER;
         }
+        // The queue is non-blocking; wait for the next frame
+        if (!waitForQueue(mqDes, POLLIN, &deadline)) {
+            return MSG_RECV_RETRY_LIMIT;
+        }
     }
-    return MSG_RECV_RETRY_LIMIT;
 }
 
 /*
@@ -92,24 +116,18 @@ ipcReceiveFrameWithRetry(mqd_t mqDes, char *mqMsgBuf, size_t mqMaxMsgSize, ssize
  */
 static ipc_resp_result_t
 ipcSendFrameWithRetry(mqd_t mqDes, void *frame, size_t frameLen) {
-    for (int retryCount = 1; retryCount <= RETRY_COUNT; ++retryCount) {
-        int sendRes = scope_mq_send(mqDes, frame, frameLen, 0);
-        if (sendRes == 0) {
+    uint64_t deadline = 0;
+    while (1) {
+        if (scope_mq_send(mqDes, frame, frameLen, 0) == 0) {
             return RESP_RESULT_OK;
-        } else if(scope_errno == EAGAIN) {
-            /*
-            * Message queue is full wait 50 us and retry since
-            * the communication here is non-block
-            */
-            scope_nanosleep((const struct timespec[]){{0, 50000L}}, NULL);
-        } else {
-            /*
-            * Other error
-            */
+        } else if (scope_errno != EAGAIN) {
             return RESP_SEND_OTHER;
         }
+        // The queue is non-blocking; wait for the CLI to make room
+        if (!waitForQueue(mqDes, POLLOUT, &deadline)) {
+            return RESP_SEND_RETRY_LIMIT;
+        }
     }
-    return RESP_SEND_RETRY_LIMIT;
 }
 
 /*
@@ -150,6 +168,158 @@ ipcIsActive(mqd_t mqdes, size_t *maxMsgSize, long *msgCount) {
     return TRUE;
 }
 
+/*
+ * A watch only works if the mqueue filesystem mounted is the one of our
+ * IPC namespace; a container can have the host's, or none. A queue we
+ * create has to show up in it.
+ */
+static bool
+mqueueDirIsOurs(pid_t pid)
+{
+    char name[64];
+    char path[PATH_MAX];
+    struct stat sb;
+
+    scope_snprintf(name, sizeof(name), "/ScopeIPCProbe.%d", pid);
+    scope_snprintf(path, sizeof(path), "%s%s", MQUEUE_DIR, name);
+    mqd_t probe = scope_mq_open(name, O_RDONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600, NULL);
+    if (probe == (mqd_t)-1) return FALSE;
+
+    bool ours = (scope_stat(path, &sb) == 0);
+    scope_mq_close(probe);
+    scope_mq_unlink(name);
+    return ours;
+}
+
+/*
+ * Starts watching for the request queue of the process pid.
+ * Called again after a fork; what the parent watched is closed, along
+ * with anything added to it. Descriptors of a new watch must be -1.
+ */
+void
+ipcWatchStart(ipc_watch_t *watch, pid_t pid)
+{
+    if (!watch) return;
+
+    if (watch->notifyFd != -1) scope_close(watch->notifyFd);
+    if (watch->reqDesc != (mqd_t)-1) ipcCloseConnection(watch->reqDesc);
+    watch->notifyFd = -1;
+    watch->reqWd = -1;
+    watch->reqDesc = (mqd_t)-1;
+    scope_snprintf(watch->reqName, sizeof(watch->reqName), "/ScopeIPCIn.%d", pid);
+    scope_snprintf(watch->respName, sizeof(watch->respName), "/ScopeIPCOut.%d", pid);
+
+    watch->notifyFd = scope_inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ((watch->notifyFd == -1) || !mqueueDirIsOurs(pid)) return;
+
+    watch->reqWd = scope_inotify_add_watch(watch->notifyFd, MQUEUE_DIR, IN_CREATE | IN_DELETE);
+    if (watch->reqWd == -1) return;
+
+    // The CLI could have created it before we were watching
+    watch->reqDesc = ipcOpenConnection(watch->reqName, O_RDONLY | O_NONBLOCK);
+}
+
+/*
+ * Watches path for the events in mask, with the same inotify instance.
+ * Returns the watch descriptor, or -1.
+ */
+int
+ipcWatchAdd(ipc_watch_t *watch, const char *path, uint32_t mask)
+{
+    if (!watch || !path || (watch->notifyFd == -1)) return -1;
+    return scope_inotify_add_watch(watch->notifyFd, path, mask);
+}
+
+void
+ipcWatchRemove(ipc_watch_t *watch, int wd)
+{
+    if (!watch || (watch->notifyFd == -1) || (wd == -1)) return;
+    scope_inotify_rm_watch(watch->notifyFd, wd);
+}
+
+/*
+ * Handles what the watch has seen; call when notifyFd is readable.
+ * Events of paths added with ipcWatchAdd() are passed to fn.
+ * If notifyFd stops working, we go back to opening the queue by name.
+ */
+void
+ipcWatchUpdate(ipc_watch_t *watch, ipc_notify_fn fn, void *data)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool reopen = FALSE, closed = FALSE;
+
+    if (!watch || (watch->notifyFd == -1)) return;
+
+    while (1) {
+        ssize_t len = scope_read(watch->notifyFd, buf, sizeof(buf));
+        if (len <= 0) {
+            if ((len == -1) && (scope_errno == EAGAIN)) break;
+            DBG("%d", watch->notifyFd);
+            scope_close(watch->notifyFd);
+            watch->notifyFd = -1;
+            watch->reqWd = -1;
+            if (fn) {
+                struct inotify_event gone = {.wd = -1};
+                fn(&gone, data);
+            }
+            break;
+        }
+
+        char *ptr;
+        for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            if (event->mask & IN_Q_OVERFLOW) {
+                reopen = (watch->reqWd != -1);
+                if (fn) fn(event, data);
+            } else if (event->wd != watch->reqWd) {
+                if (fn) fn(event, data);
+            } else if (event->mask & IN_IGNORED) {
+                // The mqueue fs was unmounted
+                watch->reqWd = -1;
+                reopen = FALSE;
+                closed = TRUE;
+            } else if (event->len && !scope_strcmp(event->name, watch->reqName + 1)) {
+                // The last one seen is what's there now
+                reopen = (event->mask & IN_CREATE) != 0;
+                closed = (event->mask & IN_DELETE) != 0;
+            }
+        }
+    }
+
+    if ((reopen || closed) && (watch->reqDesc != (mqd_t)-1)) {
+        ipcCloseConnection(watch->reqDesc);
+        watch->reqDesc = (mqd_t)-1;
+    }
+    if (reopen) {
+        watch->reqDesc = ipcOpenConnection(watch->reqName, O_RDONLY | O_NONBLOCK);
+    }
+}
+
+/*
+ * Returns the request queue if it exists, or -1.
+ * Give it back with ipcWatchRelease().
+ */
+mqd_t
+ipcWatchRequestQueue(ipc_watch_t *watch)
+{
+    if (!watch) return (mqd_t)-1;
+    if (watch->reqWd != -1) return watch->reqDesc;
+
+    // Not watched; what we opened before could have been removed since
+    if (watch->reqDesc != (mqd_t)-1) {
+        ipcCloseConnection(watch->reqDesc);
+        watch->reqDesc = (mqd_t)-1;
+    }
+    return ipcOpenConnection(watch->reqName, O_RDONLY | O_NONBLOCK);
+}
+
+void
+ipcWatchRelease(ipc_watch_t *watch, mqd_t mqDes)
+{
+    if (!watch || (mqDes == (mqd_t)-1)) return;
+    if (mqDes != watch->reqDesc) ipcCloseConnection(mqDes);
+}
+
 
 /*
  * Verify if the buffer contains NUL termination character
@@ -521,20 +691,20 @@ ipcSendSuccessfulResponse(mqd_t mqDes, size_t msgBufSize, const char *scopeDataR
     }
 
     while (scopeDataRemainLen) {
-        // Create basic metadata for response
-        cJSON *metadataJson = createMetaResp(IPC_RESP_OK, uniqReq, scopeDataRemainLen);
-        if (!metadataJson) {
-            goto destroyFrame;
-        }
-
-        char *metadataBytes = cJSON_PrintUnformatted(metadataJson);
-        size_t metadataLen = scope_strlen(metadataBytes) + 1;
+        /*
+        * The metadata is what createMetaResp() would make, written
+        * straight into the frame. The status is 206 while there is
+        * data remaining after this frame; we only know that once we
+        * know how much room the metadata leaves.
+        */
+        char metadata[128];
+        size_t metadataLen = scope_snprintf(metadata, sizeof(metadata),
+            "{\"status\":%d,\"uniq\":%d,\"remain\":%zu}",
+            IPC_RESP_OK, uniqReq, scopeDataRemainLen) + 1;
 
         // There is not sufficient place to use msg buffer 
         if (metadataLen >= msgBufSize) {
             res = RESP_UNSUFFICENT_MSGBUF_ERROR;
-            scope_free(metadataBytes);
-            cJSON_Delete(metadataJson);
             goto destroyFrame;
         }
         // Calculate the scope data offset and length including NUL terminator byte
@@ -545,22 +715,12 @@ ipcSendSuccessfulResponse(mqd_t mqDes, size_t msgBufSize, const char *scopeDataR
         }
         scopeDataRemainLen -= dataSendLen;
 
-        /*
-        * If there is still remaining data we want to change status
-        * from 200 -> 206, but because of how we construct the message
-        * we cannot do this prior
-        */
         if (scopeDataRemainLen != 0) {
-            // Locate the status field
-            char *statusStrs = scope_strstr(metadataBytes, "\"status\":200");
-            // Get the offset for change 200 -> 206 minus 2 escape "\" characters
-            size_t offset = sizeof("\"status\":200") - 2;
-            statusStrs[offset] = '6';
+            // 200 -> 206; the same length
+            metadata[C_STRLEN("{\"status\":20")] = '6';
         }
 
-        scope_memcpy(frame, metadataBytes, metadataLen);
-        scope_free(metadataBytes);
-        cJSON_Delete(metadataJson);
+        scope_memcpy(frame, metadata, metadataLen);
 
         // Copy the scope frame data
         scope_memcpy(frame + metadataLen, scopeRespBytes + scopeDataOffset, dataSendLen);
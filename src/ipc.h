@@ -12,6 +12,38 @@ mqd_t ipcOpenConnection(const char *, int);
 int ipcCloseConnection(mqd_t);
 bool ipcIsActive(mqd_t, size_t *, long *);
 
+/*
+ * Watch for the request queue the CLI creates for a process
+ *
+ * The CLI creates the request queue when it has a request for us and
+ * removes it when it's done. With a watch on the mqueue filesystem the
+ * queue is opened when it's created and closed when it's removed, so
+ * notifyFd and reqDesc can be polled for a request. Where the mqueue
+ * filesystem of our IPC namespace isn't mounted, reqWd is -1 and the
+ * queue has to be opened by name to see if it's there.
+ *
+ * Other paths can be watched with the same inotify instance, with
+ * ipcWatchAdd(); their events are passed to the function given to
+ * ipcWatchUpdate(). An IN_Q_OVERFLOW event is passed to it too, as is
+ * an event with a wd of -1 and no mask when notifyFd stops working.
+ */
+typedef struct {
+    int notifyFd;           // inotify instance, -1 if there isn't one
+    int reqWd;              // its watch on the mqueue fs, -1 if not watched
+    mqd_t reqDesc;          // the request queue while it exists, or -1
+    char reqName[64];       // "/ScopeIPCIn.<pid>"
+    char respName[64];      // "/ScopeIPCOut.<pid>"
+} ipc_watch_t;
+
+typedef void (*ipc_notify_fn)(const struct inotify_event *, void *);
+
+void ipcWatchStart(ipc_watch_t *, pid_t);
+int ipcWatchAdd(ipc_watch_t *, const char *, uint32_t);
+void ipcWatchRemove(ipc_watch_t *, int);
+void ipcWatchUpdate(ipc_watch_t *, ipc_notify_fn, void *);
+mqd_t ipcWatchRequestQueue(ipc_watch_t *);
+void ipcWatchRelease(ipc_watch_t *, mqd_t);
+
 /*
  * Internal status of sending the response
  */
@@ -5,6 +5,7 @@
 #include "state.h"
 #include "utils.h"
 #include "scopestdlib.h"
+#include "atomic.h"
 
 #include <jni.h>
 #include <jvmti.h>
@@ -12,16 +13,26 @@
 
 #define SSL 1
 
+// Set in a cached channel id so a hashCode() of 0 reads as cached
+#define CHANNEL_ID_CACHED (1ULL << 32)
+
+// Byte array regions up to this size are copied to the stack
+#define JAVA_ARRAY_STACK_LEN (4096)
+
 typedef struct {
     jmethodID mid_Object_hashCode;
-    jmethodID mid_SSLSocketImpl_getSession;
     
     jmethodID mid_AppOutputStream___write;
     jmethodID mid_AppInputStream___read;
     jfieldID  fid_AppOutputStream_socket;
     jfieldID  fid_AppInputStream_socket;
+    jfieldID  fid_AppOutputStream___id;
+    jfieldID  fid_AppInputStream___id;
+    jfieldID  fid_AppOutputStream___fd;
+    jfieldID  fid_AppInputStream___fd;
     
     jmethodID mid_ByteBuffer_array;
+    jmethodID mid_ByteBuffer_arrayOffset;
     jmethodID mid_ByteBuffer_position;
     jmethodID mid_ByteBuffer_limit;
     jmethodID mid_ByteBuffer_hasArray;
@@ -30,7 +41,7 @@ typedef struct {
 #if SSL > 0
     jmethodID mid_SSLEngineImpl___wrap;
     jmethodID mid_SSLEngineImpl___unwrap;
-    jmethodID mid_SSLEngineImpl_getSession;
+    jfieldID  fid_SSLEngineImpl___id;
 #endif
     jmethodID mid_Socket_getInetAddress;
     jmethodID mid_Socket_getPort;
@@ -75,28 +86,47 @@ getFdFromSocket(JNIEnv *jni, jobject socket)
 {
     int fd = -1;
     jobject socketImpl = (*jni)->CallObjectMethod(jni, socket, g_java.mid_Socket_getImp);
+    if (clearJniException(jni) || !socketImpl) return fd;
     jobject fdObj = (*jni)->CallObjectMethod(jni, socketImpl, g_java.mid_SocketImpl_getFileDescriptor);
-    if (fdObj) {
-        fd = (*jni)->GetIntField(jni, fdObj, g_java.fid_FileDescriptor_fd);
-    }
+    (*jni)->DeleteLocalRef(jni, socketImpl);
+    if (clearJniException(jni) || !fdObj) return fd;
+    fd = (*jni)->GetIntField(jni, fdObj, g_java.fid_FileDescriptor_fd);
+    (*jni)->DeleteLocalRef(jni, fdObj);
     return fd;
 }
 
+/*
+ * doProtocol() identifies a TLS channel by the hashCode() of the connection
+ * it's on; the SSLEngineImpl, or the SSLSocketImpl a stream belongs to. It
+ * used to be the session's, but a renegotiation replaces the session and not
+ * the connection, so an id cached from the session would go stale. Rather
+ * than calling hashCode() through JNI for every buffer, the id is computed
+ * once and kept in a field we inject into the engine/stream.
+ */
+static uint64_t
+getCachedChannelId(JNIEnv *jni, jobject obj, jfieldID fid)
+{
+    if (!fid) return 0;
+    return (uint64_t)(*jni)->GetLongField(jni, obj, fid);
+}
+
+static uint64_t
+cacheChannelId(JNIEnv *jni, jobject obj, jfieldID fid, jobject conn)
+{
+    jint hash = (*jni)->CallIntMethod(jni, conn, g_java.mid_Object_hashCode);
+    if (clearJniException(jni)) return 0;
+
+    uint64_t id = (uint64_t)(uint32_t)hash | CHANNEL_ID_CACHED;
+    if (fid) (*jni)->SetLongField(jni, obj, fid, (jlong)id);
+    return id;
+}
+
 static void 
 initJniGlobals(JNIEnv *jni) 
 {
     if (g_java.mid_Object_hashCode != NULL) return;
     jclass objectClass             = (*jni)->FindClass(jni, "java/lang/Object");
     g_java.mid_Object_hashCode     = (*jni)->GetMethodID(jni, objectClass, "hashCode", "()I");
-#if SSL > 0
-    jclass sslSocketImplClass      = (*jni)->FindClass(jni, "sun/security/ssl/SSLSocketImpl");
-    if (sslSocketImplClass == NULL) {
-        // Oracle JDK 6
-        sslSocketImplClass = (*jni)->FindClass(jni, "com/sun/net/ssl/internal/ssl/SSLSocketImpl");
-        clearJniException(jni);
-    }
-    g_java.mid_SSLSocketImpl_getSession = (*jni)->GetMethodID(jni, sslSocketImplClass, "getSession", "()Ljavax/net/ssl/SSLSession;");
-#endif
     jclass socketClass         = (*jni)->FindClass(jni, "java/net/Socket");
     g_java.mid_Socket_getInetAddress = (*jni)->GetMethodID(jni, socketClass, "getInetAddress", "()Ljava/net/InetAddress;");
     g_java.mid_Socket_getPort      = (*jni)->GetMethodID(jni, socketClass, "getPort", "()I");
@@ -155,6 +185,9 @@ initAppOutputStreamGlobals(JNIEnv *jni)
         scopeLog(CFG_LOG_DEBUG, "unable to find an SSLSocket field in AppOutputStream class");
     }
     clearJniException(jni);
+    g_java.fid_AppOutputStream___id = (*jni)->GetFieldID(jni, appOutputStreamClass, "__id", "J");
+    g_java.fid_AppOutputStream___fd = (*jni)->GetFieldID(jni, appOutputStreamClass, "__fd", "I");
+    clearJniException(jni);
 }
 #endif
 static void
@@ -198,6 +231,9 @@ initAppInputStreamGlobals(JNIEnv *jni)
         scopeLog(CFG_LOG_DEBUG, "unable to find an SSLSocket field in AppInputStream class");
     }
     clearJniException(jni);
+    g_java.fid_AppInputStream___id = (*jni)->GetFieldID(jni, appInputStreamClass, "__id", "J");
+    g_java.fid_AppInputStream___fd = (*jni)->GetFieldID(jni, appInputStreamClass, "__fd", "I");
+    clearJniException(jni);
 }
 
 #if SSL > 0
@@ -213,7 +249,8 @@ initSSLEngineImplGlobals(JNIEnv *jni)
     }
     g_java.mid_SSLEngineImpl___unwrap    = (*jni)->GetMethodID(jni, sslEngineImplClass, "__unwrap", "(Ljava/nio/ByteBuffer;[Ljava/nio/ByteBuffer;II)Ljavax/net/ssl/SSLEngineResult;");
     g_java.mid_SSLEngineImpl___wrap      = (*jni)->GetMethodID(jni, sslEngineImplClass, "__wrap", "([Ljava/nio/ByteBuffer;IILjava/nio/ByteBuffer;)Ljavax/net/ssl/SSLEngineResult;");
-    g_java.mid_SSLEngineImpl_getSession  = (*jni)->GetMethodID(jni, sslEngineImplClass, "getSession", "()Ljavax/net/ssl/SSLSession;");
+    g_java.fid_SSLEngineImpl___id        = (*jni)->GetFieldID(jni, sslEngineImplClass, "__id", "J");
+    clearJniException(jni);
     jclass sslEngineResultClass    = (*jni)->FindClass(jni, "javax/net/ssl/SSLEngineResult");
     g_java.mid_SSLEngineResult_bytesConsumed = (*jni)->GetMethodID(jni, sslEngineResultClass, "bytesConsumed", "()I");
     g_java.mid_SSLEngineResult_bytesProduced = (*jni)->GetMethodID(jni, sslEngineResultClass, "bytesProduced", "()I");
@@ -232,6 +269,7 @@ initSSLEngineImplGlobals(JNIEnv *jni)
     jclass byteBufferClass         = (*jni)->FindClass(jni, "java/nio/ByteBuffer");
     jclass bufferClass             = (*jni)->FindClass(jni, "java/nio/Buffer");
     g_java.mid_ByteBuffer_array    = (*jni)->GetMethodID(jni, byteBufferClass, "array", "()[B");
+    g_java.mid_ByteBuffer_arrayOffset = (*jni)->GetMethodID(jni, byteBufferClass, "arrayOffset", "()I");
     g_java.mid_ByteBuffer_hasArray = (*jni)->GetMethodID(jni, byteBufferClass, "hasArray", "()Z");
     g_java.mid_ByteBuffer_isDirect = (*jni)->GetMethodID(jni, byteBufferClass, "isDirect", "()Z");
     g_java.mid_ByteBuffer_position = (*jni)->GetMethodID(jni, bufferClass, "position", "()I");
@@ -240,6 +278,7 @@ initSSLEngineImplGlobals(JNIEnv *jni)
     jclass dbbClass                = (*jni)->FindClass(jni, "java/nio/DirectByteBuffer");
     g_java.fid_ByteBuffer___fd     = (*jni)->GetFieldID(jni, dbbClass, "__fd", "I");
     if (g_java.fid_ByteBuffer___fd == NULL) {
+        clearJniException(jni);
         // Open JDK 9
         dbbClass                   = (*jni)->FindClass(jni, "java/nio/DirectByteBufferR");
         g_java.fid_ByteBuffer___fd = (*jni)->GetFieldID(jni, dbbClass, "__fd", "I");
@@ -248,6 +287,154 @@ initSSLEngineImplGlobals(JNIEnv *jni)
 }
 #endif
 
+/*
+ * The classes we instrument, grouped by the hook they implement. Each hook
+ * has one class name per JDK generation; once any of them has been
+ * instrumented (or has turned out not to be instrumentable) the hook is
+ * done. When every hook is done the ClassFileLoadHook event is disabled.
+ * Until then it stays on, and the targets are instrumented when the app
+ * loads them, if it ever does; nothing is loaded on its behalf.
+ */
+typedef enum {
+    JAVA_HOOK_APP_OUTPUT,
+    JAVA_HOOK_APP_INPUT,
+    JAVA_HOOK_SSL_ENGINE,
+    JAVA_HOOK_SOCKET_CHANNEL,
+    JAVA_HOOK_DIRECT_BUFFER,
+    JAVA_HOOK_COUNT,
+} java_hook_t;
+
+typedef struct {
+    const char *name;
+    size_t len;
+    java_hook_t hook;
+    int minVersion;   // 0 - no lower bound
+    int maxVersion;   // 0 - no upper bound
+} java_target_t;
+
+/*
+ * Target class names are hashed by length alone; every name has a distinct
+ * length modulo the table size. This is checked at compile time: two names
+ * in the same slot are an override-init error.
+ */
+#define JAVA_TARGET_SLOTS 32
+#define JAVA_TARGET(cname, jhook, minv, maxv) \
+    [(sizeof(cname) - 1) % JAVA_TARGET_SLOTS] = { \
+        .name = cname, .len = sizeof(cname) - 1, .hook = jhook, \
+        .minVersion = minv, .maxVersion = maxv }
+
+static const java_target_t g_java_targets[JAVA_TARGET_SLOTS] = {
+    JAVA_TARGET("sun/security/ssl/AppOutputStream",                JAVA_HOOK_APP_OUTPUT,     0, 10),
+    // Oracle JDK 6
+    JAVA_TARGET("com/sun/net/ssl/internal/ssl/AppOutputStream",    JAVA_HOOK_APP_OUTPUT,     0, 6),
+    // JDK 11
+    JAVA_TARGET("sun/security/ssl/SSLSocketImpl$AppOutputStream",  JAVA_HOOK_APP_OUTPUT,     11, 0),
+    JAVA_TARGET("sun/security/ssl/AppInputStream",                 JAVA_HOOK_APP_INPUT,      0, 10),
+    JAVA_TARGET("com/sun/net/ssl/internal/ssl/AppInputStream",     JAVA_HOOK_APP_INPUT,      0, 6),
+    JAVA_TARGET("sun/security/ssl/SSLSocketImpl$AppInputStream",   JAVA_HOOK_APP_INPUT,      11, 0),
+    JAVA_TARGET("sun/security/ssl/SSLEngineImpl",                  JAVA_HOOK_SSL_ENGINE,     0, 0),
+    JAVA_TARGET("com/sun/net/ssl/internal/ssl/SSLEngineImpl",      JAVA_HOOK_SSL_ENGINE,     0, 6),
+    JAVA_TARGET("sun/nio/ch/SocketChannelImpl",                    JAVA_HOOK_SOCKET_CHANNEL, 0, 0),
+    JAVA_TARGET("java/nio/DirectByteBuffer",                       JAVA_HOOK_DIRECT_BUFFER,  0, 0),
+    // DirectByteBufferR extends DirectByteBuffer; either one carries the field
+    JAVA_TARGET("java/nio/DirectByteBufferR",                      JAVA_HOOK_DIRECT_BUFFER,  0, 0),
+};
+
+// A bit per java_hook_t that still needs a class to instrument
+static uint64_t g_java_hooks_pending = (1ULL << JAVA_HOOK_COUNT) - 1;
+// The JDK's java.specification.version; 0 until known
+static int g_java_version = 0;
+
+static const java_target_t *
+findJavaTarget(const char *name)
+{
+    size_t len = scope_strlen(name);
+    const java_target_t *target = &g_java_targets[len % JAVA_TARGET_SLOTS];
+    if ((target->len != len) || scope_strcmp(target->name, name)) return NULL;
+    return target;
+}
+
+static bool
+javaTargetInVersion(const java_target_t *target)
+{
+    if (!g_java_version) return TRUE;
+    if (target->minVersion && (g_java_version < target->minVersion)) return FALSE;
+    if (target->maxVersion && (g_java_version > target->maxVersion)) return FALSE;
+    return TRUE;
+}
+
+// Returns TRUE if this call completed the last pending hook
+static bool
+setJavaHookDone(java_hook_t hook)
+{
+    uint64_t oldval, newval;
+    do {
+        oldval = g_java_hooks_pending;
+        newval = oldval & ~(1ULL << hook);
+    } while (!atomicCasU64(&g_java_hooks_pending, oldval, newval));
+    return (oldval != 0) && (newval == 0);
+}
+
+static void
+disableClassFileLoadHook(jvmtiEnv *jvmti)
+{
+    jvmtiError error = (*jvmti)->SetEventNotificationMode(jvmti, JVMTI_DISABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL);
+    if (error != JVMTI_ERROR_NONE) {
+        logJvmtiError(jvmti, error, "SetEventNotificationMode");
+        return;
+    }
+    scopeLogInfo("Java SSL hooks are installed; class file load hook disabled");
+}
+
+static bool
+copyMethodToNative(java_class_t *classInfo, const char *method, const char *signature, const char *newName, const char *className)
+{
+    int methodIndex = javaFindMethodIndex(classInfo, method, signature);
+    if (methodIndex == -1) {
+        scopeLogError("ERROR: '%s' method not found in %s class\n", method, className);
+        return FALSE;
+    }
+    javaCopyMethod(classInfo, classInfo->methods[methodIndex], newName);
+    javaConvertMethodToNative(classInfo, methodIndex);
+    return TRUE;
+}
+
+static bool
+instrumentJavaClass(java_class_t *classInfo, java_hook_t hook, const char *className)
+{
+    switch (hook) {
+        case JAVA_HOOK_APP_OUTPUT:
+            if (!copyMethodToNative(classInfo, "write", "([BII)V", "__write", className)) return FALSE;
+            // private fields caching the channel id and fd of the underlying socket
+            javaAddField(classInfo, "__id", "J", ACC_PRIVATE);
+            javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+            return TRUE;
+        case JAVA_HOOK_APP_INPUT:
+            if (!copyMethodToNative(classInfo, "read", "([BII)I", "__read", className)) return FALSE;
+            // private fields caching the channel id and fd of the underlying socket
+            javaAddField(classInfo, "__id", "J", ACC_PRIVATE);
+            javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+            return TRUE;
+        case JAVA_HOOK_SSL_ENGINE:
+            if (!copyMethodToNative(classInfo, "wrap", "([Ljava/nio/ByteBuffer;IILjava/nio/ByteBuffer;)Ljavax/net/ssl/SSLEngineResult;", "__wrap", className) ||
+                !copyMethodToNative(classInfo, "unwrap", "(Ljava/nio/ByteBuffer;[Ljava/nio/ByteBuffer;II)Ljavax/net/ssl/SSLEngineResult;", "__unwrap", className)) {
+                return FALSE;
+            }
+            // add a private field which will cache the channel id of the engine's session
+            javaAddField(classInfo, "__id", "J", ACC_PRIVATE);
+            return TRUE;
+        case JAVA_HOOK_SOCKET_CHANNEL:
+            return copyMethodToNative(classInfo, "read", "(Ljava/nio/ByteBuffer;)I", "__read", className) &&
+                   copyMethodToNative(classInfo, "write", "(Ljava/nio/ByteBuffer;)I", "__write", className);
+        case JAVA_HOOK_DIRECT_BUFFER:
+            // add a private field which will hold the fd used to read/write data for that buffer
+            javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
 void JNICALL 
 ClassFileLoadHook(jvmtiEnv *jvmti_env,
     JNIEnv* jni,
@@ -263,178 +450,224 @@ ClassFileLoadHook(jvmtiEnv *jvmti_env,
 #if SSL == 0
     return;
 #endif
-    if (name == NULL) return;
-
-    if (scope_strcmp(name, "sun/security/ssl/AppOutputStream") == 0 || 
-        scope_strcmp(name, "com/sun/net/ssl/internal/ssl/AppOutputStream") == 0 ||
-        scope_strcmp(name, "sun/security/ssl/SSLSocketImpl$AppOutputStream") == 0) {
+    // A redefined class can't gain the fields and methods we'd add
+    if ((name == NULL) || (class_being_redefined != NULL)) return;
 
-        scopeLogInfo("installing Java SSL hooks for AppOutputStream class...");
+    const java_target_t *target = findJavaTarget(name);
+    if (!target || !javaTargetInVersion(target)) return;
+    if (!(g_java_hooks_pending & (1ULL << target->hook))) return;
 
-        java_class_t *classInfo = javaReadClass(class_data);
+    scopeLogInfo("installing Java SSL hooks for %s class...", name);
 
-        int methodIndex = javaFindMethodIndex(classInfo, "write", "([BII)V");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'write' method not found in AppOutputStream class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__write");
-        javaConvertMethodToNative(classInfo, methodIndex);
+    java_class_t *classInfo = javaReadClass(class_data);
 
+    // A class that doesn't look like we expect won't look any different next time
+    if (instrumentJavaClass(classInfo, target->hook, name)) {
         unsigned char *dest;
         (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
         javaWriteClass(dest, classInfo);
 
         *new_class_data_len = classInfo->length;
         *new_class_data = dest;
-        javaDestroy(&classInfo);
     }
+    javaDestroy(&classInfo);
 
-    if (scope_strcmp(name, "sun/security/ssl/AppInputStream") == 0 ||
-        scope_strcmp(name, "com/sun/net/ssl/internal/ssl/AppInputStream") == 0 ||
-        scope_strcmp(name, "sun/security/ssl/SSLSocketImpl$AppInputStream") == 0) {
-
-        scopeLogInfo("installing Java SSL hooks for AppInputStream class...");
-
-        java_class_t *classInfo = javaReadClass(class_data);
-
-        int methodIndex = javaFindMethodIndex(classInfo, "read", "([BII)I");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'read' method not found in AppInputStream class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__read");
-        javaConvertMethodToNative(classInfo, methodIndex);
+    if (setJavaHookDone(target->hook)) disableClassFileLoadHook(jvmti_env);
+}
 
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
+static int
+parseJavaVersion(const char *version)
+{
+    // "1.8" through JDK 8, "9", "11", "17" after that
+    if (!scope_strncmp(version, "1.", 2)) version += 2;
+    return scope_atoi(version);
+}
 
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
+static void
+setJavaVersion(jvmtiEnv *jvmti)
+{
+    char *version = NULL;
+    jvmtiError error = (*jvmti)->GetSystemProperty(jvmti, "java.specification.version", &version);
+    if ((error != JVMTI_ERROR_NONE) || !version) return;
+    g_java_version = parseJavaVersion(version);
+    (*jvmti)->Deallocate(jvmti, (unsigned char *)version);
+
+    // Hooks with no class in this JDK will never be installed
+    bool inVersion[JAVA_HOOK_COUNT] = {FALSE};
+    int i;
+    for (i = 0; i < JAVA_TARGET_SLOTS; i++) {
+        const java_target_t *target = &g_java_targets[i];
+        if (target->name && javaTargetInVersion(target)) inVersion[target->hook] = TRUE;
     }
+    for (i = 0; i < JAVA_HOOK_COUNT; i++) {
+        if (!inVersion[i] && setJavaHookDone(i)) disableClassFileLoadHook(jvmti);
+    }
+}
 
-    if (scope_strcmp(name, "sun/security/ssl/SSLEngineImpl") == 0 || 
-        scope_strcmp(name, "com/sun/net/ssl/internal/ssl/SSLEngineImpl") == 0) {
-        
-        scopeLogInfo("installing Java SSL hooks for SSLEngineImpl class...");
-
-        java_class_t *classInfo = javaReadClass(class_data);
+/*
+ * When the agent is attached to a running JVM, the targets it has already
+ * loaded can't be instrumented; retransforming a class can't add the
+ * fields and native methods the hooks need. Those hooks are done, and the
+ * rest wait for the app to load their classes.
+ */
+static void
+skipLoadedJavaTargets(jvmtiEnv *jvmti)
+{
+    jint count = 0;
+    jclass *classes = NULL;
+    jvmtiError error = (*jvmti)->GetLoadedClasses(jvmti, &count, &classes);
+    if (error != JVMTI_ERROR_NONE) {
+        logJvmtiError(jvmti, error, "GetLoadedClasses");
+        return;
+    }
 
-        int methodIndex = javaFindMethodIndex(classInfo, "wrap", "([Ljava/nio/ByteBuffer;IILjava/nio/ByteBuffer;)Ljavax/net/ssl/SSLEngineResult;");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'wrap' method not found in SSLEngineImpl class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__wrap");
-        javaConvertMethodToNative(classInfo, methodIndex);
-
-        methodIndex = javaFindMethodIndex(classInfo, "unwrap", "(Ljava/nio/ByteBuffer;[Ljava/nio/ByteBuffer;II)Ljavax/net/ssl/SSLEngineResult;");
-         if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'unwrap' method not found in SSLEngineImpl class\n");
-            return;
+    int i;
+    for (i = 0; i < count; i++) {
+        char *sig = NULL;
+        error = (*jvmti)->GetClassSignature(jvmti, classes[i], &sig, NULL);
+        if ((error != JVMTI_ERROR_NONE) || !sig) continue;
+
+        // "Lsun/nio/ch/SocketChannelImpl;" to the name the hook sees
+        char name[128];
+        size_t len = scope_strlen(sig);
+        if ((sig[0] == 'L') && (len > 2) && (len - 2 < sizeof(name))) {
+            scope_memcpy(name, &sig[1], len - 2);
+            name[len - 2] = '\0';
+
+            const java_target_t *target = findJavaTarget(name);
+            if (target && javaTargetInVersion(target) &&
+                (g_java_hooks_pending & (1ULL << target->hook))) {
+                scopeLogInfo("%s was loaded before the Java agent attached; its hook is skipped", name);
+                setJavaHookDone(target->hook);
+            }
         }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__unwrap");
-        javaConvertMethodToNative(classInfo, methodIndex);
-        
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
-
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
+        (*jvmti)->Deallocate(jvmti, (unsigned char *)sig);
     }
+    (*jvmti)->Deallocate(jvmti, (unsigned char *)classes);
+}
 
-    if (scope_strcmp(name, "sun/nio/ch/SocketChannelImpl") == 0) {
-
-        scopeLogInfo("installing Java SSL hooks for SocketChannelImpl class...");
-        java_class_t *classInfo = javaReadClass(class_data);
+void JNICALL
+VMInit(jvmtiEnv *jvmti_env, JNIEnv* jni, jthread thread)
+{
+    setJavaVersion(jvmti_env);
+}
 
-        int methodIndex = javaFindMethodIndex(classInfo, "read", "(Ljava/nio/ByteBuffer;)I");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'read' method not found in SocketChannelImpl class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__read");
-        javaConvertMethodToNative(classInfo, methodIndex);
-
-        methodIndex = javaFindMethodIndex(classInfo, "write", "(Ljava/nio/ByteBuffer;)I");
-        if (methodIndex == -1) {
-            javaDestroy(&classInfo);
-            scopeLogError("ERROR: 'write' method not found in SocketChannelImpl class\n");
-            return;
-        }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__write");
-        javaConvertMethodToNative(classInfo, methodIndex);
+static void
+doJavaProtocolByteArray(JNIEnv *jni, uint64_t id, jbyteArray buf, jint start, jint end, metric_t src, int fd)
+{
+    if (!jni || !id || !buf || (end <= start)) return;
 
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
+    /*
+     * A heap array can't be viewed in place without GetPrimitiveArrayCritical,
+     * which holds off the GC for as long as doProtocol() runs. Copy out just
+     * the region in use instead; small ones don't need an allocation.
+     */
+    jsize len = end - start;
+    jbyte stackBuf[JAVA_ARRAY_STACK_LEN];
+    jbyte *byteBuf = (len <= JAVA_ARRAY_STACK_LEN) ? stackBuf : scope_malloc(len);
+    if (!byteBuf) return;
 
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
+    (*jni)->GetByteArrayRegion(jni, buf, start, len, byteBuf);
+    if (!clearJniException(jni)) {
+        doProtocol(id, fd, byteBuf, (size_t)len, src, BUF);
+        //scopeLogHexError(byteBuf, len, "doJavaProtocolByteArray");
     }
+    if (byteBuf != stackBuf) scope_free(byteBuf);
+}
 
-    if (scope_strcmp(name, "java/nio/DirectByteBuffer") == 0 ||
-        scope_strcmp(name, "java/nio/DirectByteBufferR") == 0) {
-
-        scopeLogInfo("installing Java SSL hooks for java.nio.DirectByteBuffer class...");
-        java_class_t *classInfo = javaReadClass(class_data);
+static void
+doJavaProtocolBufferAddr(uint64_t id, char *buf, jint start, jint end, metric_t src, int fd)
+{
+    if (!id || !buf || (end <= start)) return;
 
-        // add a private field which will hold the fd used to read/write data for that buffer
-        javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+    // A view of the active region; the buffer can't be freed while we hold a ref
+    doProtocol(id, fd, &buf[start], (size_t)(end - start), src, BUF);
+    //scopeLogHexError(&buf[start], (end - start), "doJavaProtocolBufferAddr");
+}
 
-        unsigned char *dest;
-        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
-        javaWriteClass(dest, classInfo);
+/*
+ * Hands doProtocol() the bytes between start and end positions of a
+ * ByteBuffer; the bytes an SSLEngine wrap() consumed or unwrap() produced.
+ */
+static void
+doJavaProtocolByteBuffer(JNIEnv *jni, uint64_t id, jobject bufEl, jint start, jint end, metric_t src, int fd)
+{
+    if (start >= end) return;
 
-        *new_class_data_len = classInfo->length;
-        *new_class_data = dest;
-        javaDestroy(&classInfo);
+    /*
+     * We call hasArray() on the buffer object in order to see if a byte array is
+     * available. Don't call the array() function if a byte array is not available
+     * as it throws an exception and we don't get any data.
+     *
+     * From the less than helpful Java docs:
+     * hasArray tells whether or not this buffer is backed by an accessible byte array.
+     * If this method returns true then the array and arrayOffset methods may safely be invoked.
+     * Returns true if, and only if, this buffer is backed by an array and is not read-only.
+     *
+     * From practice, while the byte array is not available, it is direct. Therefore, we
+     * fall back to a direct buffer address function. The direct buffer address function
+     * allows access the same memory region that is accessible to Java code via the buffer object.
+     * Returns the starting address of the memory region referenced by the buffer.
+     * Returns NULL if the memory region is undefined.
+     * Returns NULL if the given object is not a direct java.nio.Buffer.
+     * Returns NULL if JNI access to direct buffers is not supported by this virtual machine.
+     */
+    if ((*jni)->CallBooleanMethod(jni, bufEl, g_java.mid_ByteBuffer_hasArray) == TRUE) {
+        jbyteArray buf = (*jni)->CallObjectMethod(jni, bufEl, g_java.mid_ByteBuffer_array);
+        if (clearJniException(jni) || !buf) return;
+        jint arrayOffset = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_arrayOffset);
+        if (!clearJniException(jni) && (arrayOffset >= 0)) {
+            doJavaProtocolByteArray(jni, id, buf, arrayOffset + start, arrayOffset + end, src, fd);
+        }
+        (*jni)->DeleteLocalRef(jni, buf);
+    } else if ((*jni)->CallBooleanMethod(jni, bufEl, g_java.mid_ByteBuffer_isDirect) == TRUE) {
+        char *buf = (*jni)->GetDirectBufferAddress(jni, bufEl);
+        if (clearJniException(jni) || !buf) return;
+        doJavaProtocolBufferAddr(id, buf, start, end, src, fd);
     }
+    clearJniException(jni);
 }
 
-static void
-doJavaProtocolByteArray(JNIEnv *jni, jobject session, jbyteArray buf, jint offset, jint len, metric_t src, int fd)
+static uint64_t
+getEngineChannelId(JNIEnv *jni, jobject engine)
 {
-    if (!jni || !session || !buf) return;
+    uint64_t id = getCachedChannelId(jni, engine, g_java.fid_SSLEngineImpl___id);
+    if (id) return id;
 
-    jint  hash      = (*jni)->CallIntMethod(jni, session, g_java.mid_Object_hashCode);
-    jbyte *byteBuf  = (*jni)->GetPrimitiveArrayCritical(jni, buf, 0);
-    if (!byteBuf) return;
-    doProtocol((uint64_t)hash, fd, &byteBuf[offset], (size_t)(len - offset), src, BUF);
-    //scopeLogHexError(&byteBuf[offset], (len - offset), "doJavaProtocolByteArray");
-    (*jni)->ReleasePrimitiveArrayCritical(jni, buf, byteBuf, 0);
+    return cacheChannelId(jni, engine, g_java.fid_SSLEngineImpl___id, engine);
 }
 
-static void
-doJavaProtocolBufferAddr(JNIEnv *jni, jobject session, void *buf, jint offset, jint len, metric_t src, int fd, jlong bufCap)
+/*
+ * AppInputStream and AppOutputStream find their channel through the
+ * SSLSocketImpl they belong to; the id and fd are cached in the stream.
+ */
+static uint64_t
+getStreamChannelId(JNIEnv *jni, jobject stream, jfieldID fid_socket, jfieldID fid_id, jfieldID fid_fd, int *fd)
 {
-    if (!jni || !session || !buf) return;
-
-    jint  hash    = (*jni)->CallIntMethod(jni, session, g_java.mid_Object_hashCode);
-    char *byteBuf = scope_malloc(bufCap);
-    if (!byteBuf) {
-        return;
+    uint64_t id = getCachedChannelId(jni, stream, fid_id);
+    if (id) {
+        jint fdVal = (fid_fd) ? (*jni)->GetIntField(jni, stream, fid_fd) : 0;
+        if (fdVal) *fd = fdVal;
+        return id;
     }
 
-    scope_memcpy(byteBuf, buf, bufCap);
-    doProtocol((uint64_t)hash, fd, &byteBuf[offset], (size_t)(len - offset), src, BUF);
-    //scopeLogHexError(&byteBuf[offset], (len - offset), "doJavaProtocolBufferAddr");
-    scope_free(byteBuf);
+    if (fid_socket == NULL) return cacheChannelId(jni, stream, fid_id, stream);
+
+    jobject socket = (*jni)->GetObjectField(jni, stream, fid_socket);
+    if (clearJniException(jni) || !socket) return 0;
+    *fd = getFdFromSocket(jni, socket);
+    if ((*fd > 0) && fid_fd) (*jni)->SetIntField(jni, stream, fid_fd, *fd);
+    id = cacheChannelId(jni, stream, fid_id, socket);
+    (*jni)->DeleteLocalRef(jni, socket);
+    return id;
 }
 
 static void
 saveSocketChannel(JNIEnv *jni, jobject socketChannel, jobject buf)
 {
+    // No field when DirectByteBuffer was loaded before the agent attached
+    if (!g_java.fid_ByteBuffer___fd) return;
+
     jint fd = (*jni)->CallIntMethod(jni, socketChannel, g_java.mid_SocketChannelImpl_getFDVal);
     //store the file descriptor in the internal byte buffer's field
     (*jni)->SetIntField(jni, buf, g_java.fid_ByteBuffer___fd, fd);
@@ -475,6 +708,43 @@ Java_sun_nio_ch_SocketChannelImpl_write(JNIEnv *jni, jobject obj, jobject buf)
 }
 
 #if SSL > 0
+/*
+ * Record buffer positions before the original method is called. The
+ * original method moves them past the data it produced or consumed.
+ */
+static bool
+getBufferPositions(JNIEnv *jni, jobjectArray bufs, jint offset, jint len, jint *pos)
+{
+    int i;
+    for (i = 0; i < len; i++) {
+        jobject bufEl = (*jni)->GetObjectArrayElement(jni, bufs, offset + i);
+        if (clearJniException(jni) || !bufEl) return FALSE;
+        pos[i] = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_position);
+        (*jni)->DeleteLocalRef(jni, bufEl);
+        if (clearJniException(jni) || (pos[i] < 0)) return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+doJavaProtocolByteBuffers(JNIEnv *jni, jobject engine, jobjectArray bufs, jint offset, jint len, jint *initialpos, metric_t src, int fd)
+{
+    uint64_t id = getEngineChannelId(jni, engine);
+    if (!id) return;
+
+    int i;
+    for (i = 0; i < len; i++) {
+        jobject bufEl = (*jni)->GetObjectArrayElement(jni, bufs, offset + i);
+        if (clearJniException(jni) || !bufEl) return;
+
+        jint pos = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_position);
+        if (!clearJniException(jni) && (pos >= 0)) {
+            doJavaProtocolByteBuffer(jni, id, bufEl, initialpos[i], pos, src, fd);
+        }
+        (*jni)->DeleteLocalRef(jni, bufEl);
+    }
+}
+
 JNIEXPORT jobject JNICALL
 Java_sun_security_ssl_SSLEngineImpl_unwrap(JNIEnv *jni, jobject obj, jobject src, jobjectArray dsts, jint offset, jint len)
 {
@@ -491,65 +761,28 @@ Java_sun_security_ssl_SSLEngineImpl_unwrap(JNIEnv *jni, jobject obj, jobject src
         return res;
     }
 
-    jint fdVal = (uint64_t) (*jni)->GetIntField(jni, src, g_java.fid_ByteBuffer___fd);
+    jint fdVal = (g_java.fid_ByteBuffer___fd) ?
+        (*jni)->GetIntField(jni, src, g_java.fid_ByteBuffer___fd) : 0;
     if (fdVal) {
         fd = fdVal;
     }
 
+    // Don't touch the buffers if nothing would consume the payload
+    bool consume = !preexisting_exception && (len > 0) && protocolConsumerEnabled(fd);
+    jint initialpos[consume ? len : 1];
+    if (consume) consume = getBufferPositions(jni, dsts, offset, len, initialpos);
+
     if (!preexisting_exception) clearJniException(jni);
 
     // call the original method
     // if there was a pre-existing exception, don't proceed?
     jobject res = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl___unwrap, src, dsts, offset, len);
-    if (preexisting_exception || (*jni)->ExceptionCheck(jni) || !res) return res;
+    if (!consume || (*jni)->ExceptionCheck(jni) || !res) return res;
 
     jint bytesProduced = (*jni)->CallIntMethod(jni, res, g_java.mid_SSLEngineResult_bytesProduced);
     if (clearJniException(jni) || !bytesProduced) return res;
 
-    int i;
-    jobject session = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl_getSession);
-    if (clearJniException(jni) || !session) return res;
-
-
-    for (i = offset; i < (len - offset); i++) {
-        void *buf;
-        jobject bufEl  = (*jni)->GetObjectArrayElement(jni, dsts, i);
-        if (clearJniException(jni) || !bufEl) return res;
-
-        jint pos = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_position);
-        if (clearJniException(jni) || (pos < 0)) return res;
-
-        /*
-         * We call hasArray() on the buffer object in order to see if a byte array is
-         * available. Don't call the array() function if a byte array is not available
-         * as it throws an exception and we don't get any data.
-         *
-         * From the less than helpful Java docs:
-         * hasArray tells whether or not this buffer is backed by an accessible byte array.
-         * If this method returns true then the array and arrayOffset methods may safely be invoked.
-         * Returns true if, and only if, this buffer is backed by an array and is not read-only.
-         *
-         * From practice, while the byte array is not available, it is direct. Therefore, we
-         * fall back to a direct buffer address function. The direct buffer address function
-         * allows access the same memory region that is accessible to Java code via the buffer object.
-         * Returns the starting address of the memory region referenced by the buffer.
-         * Returns NULL if the memory region is undefined.
-         * Returns NULL if the given object is not a direct java.nio.Buffer.
-         * Returns NULL if JNI access to direct buffers is not supported by this virtual machine.
-         */
-        if ((*jni)->CallBooleanMethod(jni, bufEl, g_java.mid_ByteBuffer_hasArray) == TRUE) {
-            buf = (*jni)->CallObjectMethod(jni, bufEl, g_java.mid_ByteBuffer_array);
-            if (clearJniException(jni) || !buf) return res;
-            doJavaProtocolByteArray(jni, session, buf, 0, pos, TLSRX, fd);
-        } else if ((*jni)->CallBooleanMethod(jni, bufEl, g_java.mid_ByteBuffer_isDirect) == TRUE) {
-            buf = (*jni)->GetDirectBufferAddress(jni, bufEl);
-            if (clearJniException(jni) || !buf) return res;
-
-            jlong bufCap = (*jni)->GetDirectBufferCapacity(jni, bufEl);
-            doJavaProtocolBufferAddr(jni, session, buf, 0, pos, TLSRX, fd, bufCap);
-        }
-
-    }
+    doJavaProtocolByteBuffers(jni, obj, dsts, offset, len, initialpos, TLSRX, fd);
 
     clearJniException(jni);
     return res;
@@ -577,59 +810,27 @@ Java_sun_security_ssl_SSLEngineImpl_wrap(JNIEnv *jni, jobject obj, jobjectArray
         return res;
     }
 
-    jint fdVal = (uint64_t) (*jni)->GetIntField(jni, dst, g_java.fid_ByteBuffer___fd);
+    jint fdVal = (g_java.fid_ByteBuffer___fd) ?
+        (*jni)->GetIntField(jni, dst, g_java.fid_ByteBuffer___fd) : 0;
     if (fdVal) {
         fd = fdVal;
     }
 
-    // Record the position before the original method is called.
-    // The original method can change it's value.
-    jint initialpos[len];
-    int i;
-    for (i=offset; i < (len - offset); i++) {
-        jobject bufEl  = (*jni)->GetObjectArrayElement(jni, srcs, i);
-        jint pos       = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_position);
-        initialpos[i] = pos;
-    }
-    
+    // Don't touch the buffers if nothing would consume the payload
+    bool consume = !preexisting_exception && (len > 0) && protocolConsumerEnabled(fd);
+    jint initialpos[consume ? len : 1];
+    if (consume) consume = getBufferPositions(jni, srcs, offset, len, initialpos);
+
     if (!preexisting_exception) clearJniException(jni);
 
     //call the original method
     jobject res = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl___wrap, srcs, offset, len, dst);
-    if (preexisting_exception || (*jni)->ExceptionCheck(jni) || !res) return res;
+    if (!consume || (*jni)->ExceptionCheck(jni) || !res) return res;
 
     jint bytesConsumed = (*jni)->CallIntMethod(jni, res, g_java.mid_SSLEngineResult_bytesConsumed);
     if (clearJniException(jni) || !bytesConsumed) return res;
 
-    jobject session = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl_getSession);
-    if (clearJniException(jni) || !session) return res;
-
-    for (i=offset; i < (len - offset); i++) {
-        void *buf;
-        jobject bufEl = (*jni)->GetObjectArrayElement(jni, srcs, i);
-        if (clearJniException(jni) || !bufEl) return res;
-
-        jint pos = initialpos[i]; // initial position was saved above
-
-        jint limit = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_limit);
-        if (clearJniException(jni) || (limit < 0)) return res;
-
-        /*
-         * There is Java weirdness related to getting a buf from an array.
-         * Refer to Java_sun_security_ssl_SSLEngineImpl_unwrap() for an explanation.
-         */
-        if ((*jni)->CallBooleanMethod(jni, bufEl, g_java.mid_ByteBuffer_hasArray) == TRUE) {
-            buf = (*jni)->CallObjectMethod(jni, bufEl, g_java.mid_ByteBuffer_array);
-            if (clearJniException(jni) || !buf) return res;
-            doJavaProtocolByteArray(jni, session, buf, pos, limit, TLSTX, fd);
-        } else if ((*jni)->CallBooleanMethod(jni, bufEl, g_java.mid_ByteBuffer_isDirect) == TRUE) {
-            buf = (*jni)->GetDirectBufferAddress(jni, bufEl);
-            if (clearJniException(jni) || !buf) return res;
-
-            jlong bufCap = (*jni)->GetDirectBufferCapacity(jni, bufEl);
-            doJavaProtocolBufferAddr(jni, session, buf, pos, limit, TLSTX, fd, bufCap);
-        }
-    }
+    doJavaProtocolByteBuffers(jni, obj, srcs, offset, len, initialpos, TLSTX, fd);
 
     clearJniException(jni);
     return res;
@@ -650,29 +851,23 @@ Java_sun_security_ssl_AppOutputStream_write(JNIEnv *jni, jobject obj, jbyteArray
     initJniGlobals(jni);
     initAppOutputStreamGlobals(jni);
 
-    if (g_cfg.funcs_attached == FALSE) {
+    if ((g_cfg.funcs_attached == FALSE) || preexisting_exception ||
+        !protocolConsumerEnabled(-1)) {
         //call the original method
         (*jni)->CallVoidMethod(jni, obj, g_java.mid_AppOutputStream___write, buf, offset, len);
-        clearJniException(jni);
+        if (!preexisting_exception) clearJniException(jni);
         return;
     }
 
-    jobject session;
-    if (g_java.fid_AppOutputStream_socket != NULL) {
-        jobject socket  = (*jni)->GetObjectField(jni, obj, g_java.fid_AppOutputStream_socket);
-        session = (*jni)->CallObjectMethod(jni, socket, g_java.mid_SSLSocketImpl_getSession);
-        fd = getFdFromSocket(jni, socket);
-    } else {
-        session = obj;
-    }
-
-    if (!preexisting_exception) clearJniException(jni);
-    
     //call the original method
     (*jni)->CallVoidMethod(jni, obj, g_java.mid_AppOutputStream___write, buf, offset, len);
-    if (preexisting_exception || (*jni)->ExceptionCheck(jni)) return;
+    if ((*jni)->ExceptionCheck(jni)) return;
 
-    doJavaProtocolByteArray(jni, session, buf, offset, len, TLSTX, fd);
+    uint64_t id = getStreamChannelId(jni, obj, g_java.fid_AppOutputStream_socket,
+                      g_java.fid_AppOutputStream___id, g_java.fid_AppOutputStream___fd, &fd);
+    if (protocolConsumerEnabled(fd)) {
+        doJavaProtocolByteArray(jni, id, buf, offset, offset + len, TLSTX, fd);
+    }
     clearJniException(jni);
 }
 
@@ -700,29 +895,23 @@ Java_sun_security_ssl_AppInputStream_read(JNIEnv *jni, jobject obj, jbyteArray b
     initJniGlobals(jni);
     initAppInputStreamGlobals(jni);
 
-    if (g_cfg.funcs_attached == FALSE) {
+    if ((g_cfg.funcs_attached == FALSE) || preexisting_exception ||
+        !protocolConsumerEnabled(-1)) {
         //call the original method
         jint res = (*jni)->CallIntMethod(jni, obj, g_java.mid_AppInputStream___read, buf, offset, len);
-        clearJniException(jni);
+        if (!preexisting_exception) clearJniException(jni);
         return res;
     }
 
-    jobject session;
-    if (g_java.fid_AppInputStream_socket != NULL) {
-        jobject socket  = (*jni)->GetObjectField(jni, obj, g_java.fid_AppInputStream_socket);
-        session = (*jni)->CallObjectMethod(jni, socket, g_java.mid_SSLSocketImpl_getSession);
-        fd = getFdFromSocket(jni, socket);
-    } else {
-        session = obj;
-    }
-
-    if (!preexisting_exception) clearJniException(jni);
-
     //call the original method
     jint res = (*jni)->CallIntMethod(jni, obj, g_java.mid_AppInputStream___read, buf, offset, len);
-    if (preexisting_exception || (*jni)->ExceptionCheck(jni) || (res < 0)) return res;
+    if ((*jni)->ExceptionCheck(jni) || (res <= 0)) return res;
 
-    doJavaProtocolByteArray(jni, session, buf, offset, res, TLSRX, fd);
+    uint64_t id = getStreamChannelId(jni, obj, g_java.fid_AppInputStream_socket,
+                      g_java.fid_AppInputStream___id, g_java.fid_AppInputStream___fd, &fd);
+    if (protocolConsumerEnabled(fd)) {
+        doJavaProtocolByteArray(jni, id, buf, offset, offset + res, TLSRX, fd);
+    }
     clearJniException(jni);
     return res;
 }
@@ -769,10 +958,17 @@ Agent_OnLoad(JavaVM *jvm, char *options, void *reserved)
         logJvmtiError(env, error, "SetEventNotificationMode");
         return JNI_ERR;
     }
+
+    error = (*env)->SetEventNotificationMode(env, JVMTI_ENABLE, JVMTI_EVENT_VM_INIT, NULL);
+    if (error != JVMTI_ERROR_NONE) {
+        logJvmtiError(env, error, "SetEventNotificationMode");
+        return JNI_ERR;
+    }
    
     jvmtiEventCallbacks callbacks;
     scope_memset(&callbacks, 0, sizeof(callbacks));
     callbacks.ClassFileLoadHook = &ClassFileLoadHook;
+    callbacks.VMInit = &VMInit;
     error = (*env)->SetEventCallbacks(env, &callbacks, sizeof(callbacks));
     if (error != JVMTI_ERROR_NONE) {
         logJvmtiError(env, error, "SetEventCallbacks");
@@ -782,6 +978,61 @@ Agent_OnLoad(JavaVM *jvm, char *options, void *reserved)
     return JNI_OK;
 }
 
+/*
+ * Loaded into a running JVM (e.g. jcmd <pid> JVMTI.agent_load). VMInit has
+ * come and gone, so the version is read here, and the targets already
+ * loaded are skipped; the hook waits for the rest.
+ */
+JNIEXPORT jint JNICALL
+Agent_OnAttach(JavaVM *jvm, char *options, void *reserved)
+{
+    jvmtiError error;
+    jvmtiEnv *env;
+
+    scopeLogInfo("Attaching Java agent");
+
+    jint result = (*jvm)->GetEnv(jvm, (void **) &env, JVMTI_VERSION_1_0);
+    if (result != 0) {
+        scopeLogError("ERROR: GetEnv failed\n");
+        return JNI_ERR;
+    }
+
+    setJavaVersion(env);
+    skipLoadedJavaTargets(env);
+    if (!g_java_hooks_pending) {
+        scopeLogInfo("Java SSL hook targets were all loaded before the agent attached");
+        return JNI_OK;
+    }
+
+    jvmtiCapabilities capabilities;
+    scope_memset(&capabilities,0, sizeof(capabilities));
+
+    capabilities.can_generate_all_class_hook_events = 1;
+    error = (*env)->AddCapabilities(env, &capabilities);
+    if (error != JVMTI_ERROR_NONE) {
+        logJvmtiError(env, error, "AddCapabilities");
+        return JNI_ERR;
+    }
+
+    // The callback has to be in place before the event is, in the live phase
+    jvmtiEventCallbacks callbacks;
+    scope_memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.ClassFileLoadHook = &ClassFileLoadHook;
+    error = (*env)->SetEventCallbacks(env, &callbacks, sizeof(callbacks));
+    if (error != JVMTI_ERROR_NONE) {
+        logJvmtiError(env, error, "SetEventCallbacks");
+        return JNI_ERR;
+    }
+
+    error = (*env)->SetEventNotificationMode(env, JVMTI_ENABLE, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK, NULL);
+    if (error != JVMTI_ERROR_NONE) {
+        logJvmtiError(env, error, "SetEventNotificationMode");
+        return JNI_ERR;
+    }
+
+    return JNI_OK;
+}
+
 // This overrides a weak definition in src/linux/os.c
 void
 initJavaAgent(void) {
@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yaml.h"
+#include "../rulesidx.h"
+#include "rulescompile.h"
+#include "scopetypes.h"
+
+/*
+ * Compiles a rules file to the index libscope maps (see src/rulesidx.h).
+ * What's compiled mirrors how src/cfgutils.c evaluates the rules file;
+ * a change to one needs the same change to the other, and a new
+ * RULES_IDX_VERSION if the layout changes.
+ */
+#define ALLOW_NODE              "allow"
+#define DENY_NODE               "deny"
+#define PROCNAME_NODE           "procname"
+#define ARG_NODE                "arg"
+#define ALLOW_CONFIG_NODE       "config"
+#define SOURCE_NODE             "source"
+#define UNIX_SOCKET_PATH_NODE   "unixSocketPath"
+#define MATCH_ALL_VAL           "_MatchAll_"
+
+#define RULES_CONFIG_DEPTH      64      // of a config copied to the index
+
+#define foreach(pair, pairs) \
+    for (pair = pairs.start; pair != pairs.top; pair++)
+
+typedef struct {
+    rules_op_t *ops;
+    unsigned opCount;
+    unsigned opMax;
+    uint32_t *deny;         // strs of deny procnames
+    unsigned denyCount;
+    unsigned denyMax;
+    uint32_t *args;
+    unsigned argCount;
+    unsigned argMax;
+    char *str;
+    size_t strLen;
+    size_t strMax;
+    uint32_t flags;
+    uint32_t unixPath;
+    bool failed;
+} rules_build_t;
+
+static bool
+rulesGrow(rules_build_t *b, void **arr, unsigned count, unsigned *max, size_t elemSize)
+{
+    if (b->failed) return FALSE;
+    if (count < *max) return TRUE;
+
+    unsigned newMax = *max ? *max * 2 : 16;
+    void *grown = realloc(*arr, newMax * elemSize);
+    if (!grown) {
+        b->failed = TRUE;
+        return FALSE;
+    }
+    *arr = grown;
+    *max = newMax;
+    return TRUE;
+}
+
+static bool
+rulesAppend(rules_build_t *b, const void *data, size_t len)
+{
+    if (b->failed) return FALSE;
+    if (b->strLen + len > RULES_IDX_MAX_SIZE) {
+        b->failed = TRUE;
+        return FALSE;
+    }
+    if (b->strLen + len > b->strMax) {
+        size_t newMax = b->strMax ? b->strMax : 4096;
+        while (newMax < b->strLen + len) newMax *= 2;
+        char *grown = realloc(b->str, newMax);
+        if (!grown) {
+            b->failed = TRUE;
+            return FALSE;
+        }
+        b->str = grown;
+        b->strMax = newMax;
+    }
+    memcpy(b->str + b->strLen, data, len);
+    b->strLen += len;
+    return TRUE;
+}
+
+// Returns the str of a copy of value, or 0
+static uint32_t
+rulesStr(rules_build_t *b, const char *value)
+{
+    uint32_t str = b->strLen;
+    if (!rulesAppend(b, value, strlen(value) + 1)) return 0;
+    return str;
+}
+
+static void
+rulesOp(rules_build_t *b, rules_op_type_t type, const char *value)
+{
+    if (!rulesGrow(b, (void **)&b->ops, b->opCount, &b->opMax, sizeof(rules_op_t))) return;
+    rules_op_t *op = &b->ops[b->opCount];
+    op->type = type;
+    op->hash = 0;
+    op->str = 0;
+    op->len = 0;
+    if ((type == RULES_OP_PROCNAME) || (type == RULES_OP_ARG)) {
+        if (!(op->str = rulesStr(b, value))) return;
+        op->hash = rulesHash(value);
+        op->len = strlen(value);
+    }
+    b->opCount++;
+}
+
+static void
+rulesWriteScalar(rules_build_t *b, const yaml_char_t *value, size_t length)
+{
+    char esc[8];
+    size_t i, run = 0;
+    rulesAppend(b, "\"", 1);
+    for (i = 0; i < length; i++) {
+        unsigned char c = value[i];
+        if ((c != '"') && (c != '\\') && (c >= 0x20) && (c != 0x7f)) continue;
+
+        rulesAppend(b, value + run, i - run);
+        run = i + 1;
+        if ((c == '"') || (c == '\\')) {
+            esc[0] = '\\';
+            esc[1] = c;
+            rulesAppend(b, esc, 2);
+        } else {
+            snprintf(esc, sizeof(esc), "\\x%02x", c);
+            rulesAppend(b, esc, 4);
+        }
+    }
+    rulesAppend(b, value + run, length - run);
+    rulesAppend(b, "\"", 1);
+}
+
+/*
+ * Written in flow style with every scalar double quoted, which parses back
+ * to the same nodes. Aliases are written out as what they refer to.
+ */
+static void
+rulesWriteNode(rules_build_t *b, yaml_document_t *doc, yaml_node_t *node, int depth)
+{
+    if (!node || (depth > RULES_CONFIG_DEPTH)) {
+        b->failed = TRUE;
+        return;
+    }
+
+    switch (node->type) {
+        case YAML_SCALAR_NODE:
+            rulesWriteScalar(b, node->data.scalar.value, node->data.scalar.length);
+            break;
+        case YAML_SEQUENCE_NODE: {
+            yaml_node_item_t *item;
+            rulesAppend(b, "[", 1);
+            foreach(item, node->data.sequence.items) {
+                if (item != node->data.sequence.items.start) rulesAppend(b, ", ", 2);
+                rulesWriteNode(b, doc, yaml_document_get_node(doc, *item), depth + 1);
+            }
+            rulesAppend(b, "]", 1);
+            break;
+        }
+        case YAML_MAPPING_NODE: {
+            yaml_node_pair_t *pair;
+            rulesAppend(b, "{", 1);
+            foreach(pair, node->data.mapping.pairs) {
+                if (pair != node->data.mapping.pairs.start) rulesAppend(b, ", ", 2);
+                rulesWriteNode(b, doc, yaml_document_get_node(doc, pair->key), depth + 1);
+                rulesAppend(b, ": ", 2);
+                rulesWriteNode(b, doc, yaml_document_get_node(doc, pair->value), depth + 1);
+            }
+            rulesAppend(b, "}", 1);
+            break;
+        }
+        default:
+            b->failed = TRUE;
+            break;
+    }
+}
+
+/*
+ * The config of an allow rule is saved as yaml, and parsed only when the
+ * rule matches; there's no point in another format for something that's
+ * only read by a process being scoped.
+ */
+static void
+rulesConfigOp(rules_build_t *b, yaml_document_t *doc, yaml_node_t *node)
+{
+    uint32_t str = b->strLen;
+    rulesWriteNode(b, doc, node, 0);
+    rulesAppend(b, "", 1);
+
+    if (!rulesGrow(b, (void **)&b->ops, b->opCount, &b->opMax, sizeof(rules_op_t))) return;
+    rules_op_t *op = &b->ops[b->opCount++];
+    op->type = RULES_OP_CONFIG;
+    op->hash = 0;
+    op->str = str;
+    op->len = b->strLen - str - 1;
+}
+
+// Mirrors processAllowSeq() and processValidAllowDenySeq()
+static void
+rulesCompileAllowSeq(rules_build_t *b, yaml_document_t *doc, yaml_node_t *node)
+{
+    yaml_node_item_t *seqItem;
+    foreach(seqItem, node->data.sequence.items) {
+        yaml_node_t *nodeMap = yaml_document_get_node(doc, *seqItem);
+
+        if (nodeMap->type != YAML_MAPPING_NODE) return;
+
+        yaml_node_pair_t *pair;
+        foreach(pair, nodeMap->data.mapping.pairs) {
+            yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if ((key->type != YAML_SCALAR_NODE) || (value->type != YAML_SCALAR_NODE)) continue;
+
+            const char *name = (const char *)key->data.scalar.value;
+            const char *val = (const char *)value->data.scalar.value;
+            if (!strcmp(name, PROCNAME_NODE)) {
+                rulesOp(b, strcmp(val, MATCH_ALL_VAL) ?
+                    RULES_OP_PROCNAME : RULES_OP_PROCNAME_ALL, val);
+            } else if (!strcmp(name, ARG_NODE) && (strlen(val) > 0)) {
+                rulesOp(b, strcmp(val, MATCH_ALL_VAL) ?
+                    RULES_OP_ARG : RULES_OP_ARG_ALL, val);
+            } else {
+                continue;
+            }
+            if (strlen(val) > 0) b->flags |= RULES_IDX_VALID;
+        }
+        foreach(pair, nodeMap->data.mapping.pairs) {
+            yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if ((key->type == YAML_SCALAR_NODE) && (value->type == YAML_MAPPING_NODE) &&
+                !strcmp((const char *)key->data.scalar.value, ALLOW_CONFIG_NODE)) {
+                rulesConfigOp(b, doc, value);
+                break;
+            }
+        }
+    }
+}
+
+// Mirrors processDenySeq() and processValidAllowDenySeq()
+static void
+rulesCompileDenySeq(rules_build_t *b, yaml_document_t *doc, yaml_node_t *node)
+{
+    yaml_node_item_t *seqItem;
+    foreach(seqItem, node->data.sequence.items) {
+        yaml_node_t *nodeMap = yaml_document_get_node(doc, *seqItem);
+
+        if (nodeMap->type != YAML_MAPPING_NODE) return;
+
+        yaml_node_pair_t *pair;
+        foreach(pair, nodeMap->data.mapping.pairs) {
+            yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if ((key->type != YAML_SCALAR_NODE) || (value->type != YAML_SCALAR_NODE)) continue;
+
+            const char *name = (const char *)key->data.scalar.value;
+            const char *val = (const char *)value->data.scalar.value;
+            bool isProcname = !strcmp(name, PROCNAME_NODE);
+            if (!isProcname && strcmp(name, ARG_NODE)) continue;
+            if (strlen(val) > 0) b->flags |= RULES_IDX_VALID;
+
+            if (!strcmp(val, MATCH_ALL_VAL)) {
+                b->flags |= RULES_IDX_DENY_ALL;
+            } else if (isProcname) {
+                if (!rulesGrow(b, (void **)&b->deny, b->denyCount, &b->denyMax, sizeof(uint32_t))) return;
+                if ((b->deny[b->denyCount] = rulesStr(b, val))) b->denyCount++;
+            } else if (strlen(val) > 0) {
+                if (!rulesGrow(b, (void **)&b->args, b->argCount, &b->argMax, sizeof(uint32_t))) return;
+                if ((b->args[b->argCount] = rulesStr(b, val))) b->argCount++;
+            }
+        }
+    }
+}
+
+// Mirrors processRulesRootNode() and processRulesSourceSection()
+static void
+rulesCompileDoc(rules_build_t *b, yaml_document_t *doc)
+{
+    yaml_node_t *node = yaml_document_get_root_node(doc);
+    if ((node == NULL) || (node->type != YAML_MAPPING_NODE)) return;
+
+    yaml_node_pair_t *pair;
+    const char *sections[] = {ALLOW_NODE, DENY_NODE};
+    int i;
+    for (i = 0; i < ARRAY_SIZE(sections); i++) {
+        foreach(pair, node->data.mapping.pairs) {
+            yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+            yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+            if ((key->type != YAML_SCALAR_NODE) || (value->type != YAML_SEQUENCE_NODE) ||
+                strcmp((const char *)key->data.scalar.value, sections[i])) continue;
+            if (i == 0) {
+                rulesCompileAllowSeq(b, doc, value);
+            } else {
+                rulesCompileDenySeq(b, doc, value);
+            }
+        }
+    }
+
+    foreach(pair, node->data.mapping.pairs) {
+        yaml_node_t *key = yaml_document_get_node(doc, pair->key);
+        yaml_node_t *value = yaml_document_get_node(doc, pair->value);
+        if ((key->type != YAML_SCALAR_NODE) || (value->type != YAML_MAPPING_NODE) ||
+            strcmp((const char *)key->data.scalar.value, SOURCE_NODE)) continue;
+
+        yaml_node_pair_t *source;
+        foreach(source, value->data.mapping.pairs) {
+            yaml_node_t *skey = yaml_document_get_node(doc, source->key);
+            yaml_node_t *svalue = yaml_document_get_node(doc, source->value);
+            if ((skey->type != YAML_SCALAR_NODE) || (svalue->type != YAML_SCALAR_NODE) ||
+                strcmp((const char *)skey->data.scalar.value, UNIX_SOCKET_PATH_NODE) ||
+                !svalue->data.scalar.length) continue;
+            b->unixPath = rulesStr(b, (const char *)svalue->data.scalar.value);
+        }
+    }
+}
+
+static size_t
+rulesAlign(size_t size)
+{
+    return (size + 7) & ~7;
+}
+
+// Lays out what was built as an index, in memory from malloc()
+static bool
+rulesIdxFromBuild(rules_build_t *b, const struct stat *sbuf, void **idx, size_t *idxSize)
+{
+    uint32_t slots = 0;
+    if (b->denyCount) {
+        for (slots = 4; slots < b->denyCount * 2; slots *= 2);
+    }
+
+    size_t allowOff = rulesAlign(sizeof(rules_idx_hdr_t));
+    size_t denyOff = rulesAlign(allowOff + b->opCount * sizeof(rules_op_t));
+    size_t argOff = rulesAlign(denyOff + slots * sizeof(rules_slot_t));
+    size_t strOff = rulesAlign(argOff + b->argCount * sizeof(uint32_t));
+    size_t size = rulesAlign(strOff + b->strLen);
+    if (size > RULES_IDX_MAX_SIZE) return FALSE;
+
+    char *mem = calloc(1, size);
+    if (!mem) return FALSE;
+
+    rules_idx_hdr_t *hdr = (rules_idx_hdr_t *)mem;
+    hdr->magic = RULES_IDX_MAGIC;
+    hdr->version = RULES_IDX_VERSION;
+    hdr->size = size;
+    hdr->flags = b->flags;
+    hdr->dev = sbuf->st_dev;
+    hdr->ino = sbuf->st_ino;
+    hdr->fileSize = sbuf->st_size;
+    hdr->mtimeSec = sbuf->st_mtim.tv_sec;
+    hdr->mtimeNsec = sbuf->st_mtim.tv_nsec;
+    hdr->allowOff = allowOff;
+    hdr->allowCount = b->opCount;
+    hdr->denyOff = denyOff;
+    hdr->denySlots = slots;
+    hdr->argOff = argOff;
+    hdr->argCount = b->argCount;
+    hdr->unixPath = b->unixPath;
+    hdr->strOff = strOff;
+    hdr->strSize = b->strLen;
+
+    if (b->opCount) memcpy(mem + allowOff, b->ops, b->opCount * sizeof(rules_op_t));
+    if (b->argCount) memcpy(mem + argOff, b->args, b->argCount * sizeof(uint32_t));
+    memcpy(mem + strOff, b->str, b->strLen);
+
+    rules_slot_t *slot = (rules_slot_t *)(mem + denyOff);
+    unsigned i;
+    for (i = 0; i < b->denyCount; i++) {
+        uint32_t hash = rulesHash(b->str + b->deny[i]);
+        uint32_t s = hash & (slots - 1);
+        while (slot[s].str) s = (s + 1) & (slots - 1);
+        slot[s].hash = hash;
+        slot[s].str = b->deny[i];
+    }
+
+    *idx = mem;
+    *idxSize = size;
+    return TRUE;
+}
+
+/*
+ * Compile the rules file content in yaml, len bytes long, to an index for
+ * the rules file described by sbuf. The index is from malloc() and is
+ * idxSize bytes long.
+ *
+ * A rules file that isn't valid yaml is compiled too, to an index that
+ * says so; it would otherwise be parsed by every process until it's fixed.
+ */
+bool
+rulesCompile(const char *yaml, size_t len, const struct stat *sbuf, void **idx, size_t *idxSize)
+{
+    bool status = FALSE;
+    rules_build_t b = {0};
+
+    if (!yaml || !sbuf || !idx || !idxSize || (len > RULES_IDX_MAX_SIZE)) return FALSE;
+
+    // the first byte of the strings isn't one; no str is 0
+    if (!rulesAppend(&b, "", 1)) goto out;
+
+    yaml_parser_t parser;
+    yaml_document_t doc;
+    if (!yaml_parser_initialize(&parser)) goto out;
+    yaml_parser_set_input_string(&parser, (const unsigned char *)yaml, len);
+    if (yaml_parser_load(&parser, &doc)) {
+        b.flags |= RULES_IDX_PARSED;
+        rulesCompileDoc(&b, &doc);
+        yaml_document_delete(&doc);
+    }
+    yaml_parser_delete(&parser);
+
+    if (!b.failed) status = rulesIdxFromBuild(&b, sbuf, idx, idxSize);
+
+out:
+    free(b.ops);
+    free(b.deny);
+    free(b.args);
+    free(b.str);
+    return status;
+}
@@ -0,0 +1,10 @@
+#ifndef __RULESCOMPILE_H__
+#define __RULESCOMPILE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+bool rulesCompile(const char *, size_t, const struct stat *, void **, size_t *);
+
+#endif // __RULESCOMPILE_H__
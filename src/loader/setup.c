@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <sys/mount.h>
 
@@ -14,8 +15,10 @@
 #include "libver.h"
 #include "nsfile.h"
 #include "patch.h"
+#include "rulescompile.h"
 #include "scopetypes.h"
 #include "setup.h"
+#include "../rulesidx.h"
 
 #define BUFSIZE (4096)
 
@@ -803,8 +806,66 @@ setupMount(pid_t pid, const char *mountDest, uid_t nsUid, gid_t nsGid)
     return TRUE;
 }
 
+/*
+ * Compile the rules file at rulesPath, whose content is in rulesFileMem, to
+ * <rulesPath>.idx; libscope maps the index instead of parsing the rules file.
+ * The index is written to a temporary file and renamed, so that no one maps
+ * half of it. When it can't be written, any old index is removed; libscope
+ * ignores an index that's not for the rules file as it is now, but there's
+ * no reason to leave one behind.
+ */
+static bool
+setupRulesIdx(int rulesFd, const char *rulesPath, void *rulesFileMem, size_t rulesSize, uid_t nsUid, gid_t nsGid)
+{
+    struct stat sbuf;
+    char idxPath[PATH_MAX];
+    char tmpPath[PATH_MAX];
+    void *idx = NULL;
+    size_t idxSize = 0;
+    bool status = FALSE;
+
+    if ((snprintf(idxPath, sizeof(idxPath), "%s%s", rulesPath, RULES_IDX_EXT) >= sizeof(idxPath)) ||
+        (snprintf(tmpPath, sizeof(tmpPath), "%s.%d", idxPath, getpid()) >= sizeof(tmpPath))) {
+        return status;
+    }
+
+    if ((fstat(rulesFd, &sbuf) == -1) ||
+        !rulesCompile(rulesFileMem, rulesSize, &sbuf, &idx, &idxSize)) {
+        fprintf(stderr, "error: setupRules: failed to compile the rules file\n");
+        goto out;
+    }
+
+    int idxFd = nsFileOpenWithMode(tmpPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644, nsUid, nsGid, geteuid(), getegid());
+    if (idxFd == -1) {
+        goto out;
+    }
+
+    size_t len = 0;
+    while (len < idxSize) {
+        ssize_t rc = write(idxFd, (char *)idx + len, idxSize - len);
+        if (rc <= 0) break;
+        len += rc;
+    }
+    close(idxFd);
+
+    if ((len != idxSize) || (nsFileRename(tmpPath, idxPath, nsUid, nsGid, geteuid(), getegid()) == -1)) {
+        unlink(tmpPath);
+        goto out;
+    }
+
+    status = TRUE;
+
+out:
+    if (!status) {
+        unlink(idxPath);
+    }
+    free(idx);
+    return status;
+}
+
 // Install a rules file in /usr/lib/appscope/
 // or, if defined, $CRIBL_HOME/appscope
+// with its compiled index next to it
 bool
 setupRules(void *rulesFileMem, size_t rulesSize, uid_t nsUid, gid_t nsGid)
 {
@@ -854,6 +915,9 @@ setupRules(void *rulesFileMem, size_t rulesSize, uid_t nsUid, gid_t nsGid)
 
     munmap(dest, rulesSize);
 
+    // The rules file is installed even when its index can't be
+    setupRulesIdx(rulesFd, rulesPath, rulesFileMem, rulesSize, nsUid, nsGid);
+
     status = TRUE;
 
 cleanupDestFd:
@@ -0,0 +1,100 @@
+#define _GNU_SOURCE
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The libyaml we build (contrib/Makefile) has its libc calls renamed to
+ * scopelibc_*, for the musl libc that's linked into libscope. The loader
+ * is linked with the system libc, so these forward to it; they're what
+ * the rules compiler (rulescompile.c) needs of libyaml.
+ */
+int
+scopelibc_ferror(FILE *stream)
+{
+    return ferror(stream);
+}
+
+size_t
+scopelibc_fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+    return fread(ptr, size, nmemb, stream);
+}
+
+size_t
+scopelibc_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+    return fwrite(ptr, size, nmemb, stream);
+}
+
+void *
+scopelibc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void *
+scopelibc_realloc(void *ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void
+scopelibc_free(void *ptr)
+{
+    free(ptr);
+}
+
+int
+scopelibc_memcmp(const void *s1, const void *s2, size_t n)
+{
+    return memcmp(s1, s2, n);
+}
+
+void *
+scopelibc_memmove(void *dest, const void *src, size_t n)
+{
+    return memmove(dest, src, n);
+}
+
+void *
+scopelibc_memset(void *s, int c, size_t n)
+{
+    return memset(s, c, n);
+}
+
+int
+scopelibc_sprintf(char *str, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int ret = vsprintf(str, format, args);
+    va_end(args);
+    return ret;
+}
+
+int
+scopelibc_strcmp(const char *s1, const char *s2)
+{
+    return strcmp(s1, s2);
+}
+
+int
+scopelibc_strncmp(const char *s1, const char *s2, size_t n)
+{
+    return strncmp(s1, s2, n);
+}
+
+char *
+scopelibc_strdup(const char *s)
+{
+    return strdup(s);
+}
+
+size_t
+scopelibc_strlen(const char *s)
+{
+    return strlen(s);
+}
@@ -7,40 +7,19 @@
 #include "dbg.h"
 #include "utils.h"
 #include "metriccapture.h"
+#include "statsdagg.h"
 #include "scopestdlib.h"
 
-// Consistent with src/sluice/js/input/MetricsIn.ts
-#define STATSD         "^([^:]+):([\\d.]+)\\|(c|g|ms|s|h)$"
-#define STATSD_CAPTURE_GROUPS 4
-#define STATSD_EXT     "^([^:]+):([\\d.]+)\\|(c|g|ms|s|h)\\|(#[^$]+)$"
-#define STATSD_EXT_CAPTURE_GROUPS 5
-#define STATSD_EXT_DIM "((#|,)([^:]+):([^,]+))"
+// Longest value or sample rate we'll convert; anything longer is garbage
+#define STATSD_NUM_MAX 64
 
-static pcre2_code *g_statsd_regex = NULL;
-static pcre2_code *g_statsd_ext_regex = NULL;
 static cbuf_handle_t g_metric_buf = NULL;
+static statsd_agg_t *g_statsd_agg = NULL;
+static unsigned g_statsd_max = DEFAULT_STATSD_MAX_SERIES;
 
 void
 initMetricCapture(void)
 {
-    int        errNum;
-    PCRE2_SIZE errPos;
-
-    if (!g_statsd_regex) {
-        if (!(g_statsd_regex = pcre2_compile((PCRE2_SPTR)STATSD,
-                PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
-            scopeLogError("ERROR: statsd regex failed; err=%d, pos=%ld",
-                    errNum, errPos);
-        }
-    }
-    if (!g_statsd_ext_regex) {
-        if (!(g_statsd_ext_regex = pcre2_compile((PCRE2_SPTR)STATSD_EXT,
-                PCRE2_ZERO_TERMINATED, 0, &errNum, &errPos, NULL))) {
-            scopeLogError("ERROR: statsd extended regex failed; err=%d, pos=%ld",
-                    errNum, errPos);
-        }
-    }
-
     size_t buf_size = DEFAULT_CBUF_SIZE;
     char *qlen_str;
     if ((qlen_str = fullGetEnv("SCOPE_QUEUE_LENGTH")) != NULL) {
@@ -55,65 +34,194 @@ initMetricCapture(void)
     if (!(g_metric_buf = cbufInit(buf_size))) {
         scopeLogError("ERROR: statsd buffer creation failed");
     }
+
+    g_statsd_max = DEFAULT_STATSD_MAX_SERIES;
+    if (!(g_statsd_agg = statsdAggCreate(g_statsd_max))) {
+        scopeLogError("ERROR: statsd aggregator creation failed");
+    }
+}
+
+// Called on the periodic thread; what's held is reported before the
+// aggregator is replaced, so a new limit doesn't lose a period's metrics
+void
+setMetricCaptureMaxSeries(unsigned maxSeries)
+{
+    if (!maxSeries || (maxSeries == g_statsd_max)) return;
+
+    statsd_agg_t *agg = statsdAggCreate(maxSeries);
+    if (!agg) {
+        scopeLogError("ERROR: statsd aggregator creation failed");
+        return;
+    }
+
+    reportAllCapturedMetrics();
+    statsdAggDestroy(&g_statsd_agg);
+    g_statsd_agg = agg;
+    g_statsd_max = maxSeries;
 }
 
 void
 destroyMetricCapture(void) {
     cbufFree(g_metric_buf);
-    pcre2_code_free(g_statsd_ext_regex);
-    g_statsd_ext_regex = NULL;
-    pcre2_code_free(g_statsd_regex);
-    g_statsd_regex = NULL;
+    g_metric_buf = NULL;
+    statsdAggDestroy(&g_statsd_agg);
 }
 
+static const char *
+findChar(const char *str, const char *end, char c)
+{
+    while ((str < end) && (*str != c)) str++;
+    return str;
+}
+
+static bool
+isStatsdType(const char *type, size_t len)
+{
+    // Consistent with src/sluice/js/input/MetricsIn.ts; c|g|ms|s|h
+    if (len == 1) {
+        return (*type == 'c') || (*type == 'g') || (*type == 's') || (*type == 'h');
+    }
+    return (len == 2) && (type[0] == 'm') && (type[1] == 's');
+}
+
+// Converts len bytes at str. Returns FALSE if they aren't a whole number.
+static bool
+statsdNumber(const char *str, size_t len, bool *isint, long long *intval, double *fltval)
+{
+    char num[STATSD_NUM_MAX];
+    char *endptr = NULL;
+
+    if (!len || (len >= sizeof(num))) return FALSE;
+    scope_memcpy(num, str, len);
+    num[len] = '\0';
+
+    scope_errno = 0;
+    if (scope_strchr(num, '.')) {
+        *isint = FALSE;
+        *fltval = scope_strtod(num, &endptr);
+    } else {
+        *isint = TRUE;
+        *intval = scope_strtoll(num, &endptr, 10);
+    }
+    return (endptr == &num[len]) && !scope_errno;
+}
+
+/*
+ * Parses the first line of buf.  Returns the number of bytes consumed,
+ * including the newline, or 0 if there's nothing left to parse.  If the
+ * line isn't valid StatsD, line->name is NULL.  Nothing is copied; line
+ * points into buf.
+ */
+size_t
+statsdParseLine(const char *buf, size_t len, statsd_line_t *line)
+{
+    if (!line) return 0;
+    scope_memset(line, 0, sizeof(*line));
+    line->rate = 1.0;
+    if (!buf || !len) return 0;
+
+    const char *end = findChar(buf, buf + len, '\n');
+    size_t consumed = (end < buf + len) ? (end - buf) + 1 : len;
+    if ((end > buf) && (end[-1] == '\r')) end--;
+
+    // <name>:
+    const char *p = findChar(buf, end, ':');
+    if ((p == buf) || (p == end)) goto invalid;
+    const char *name = buf;
+    size_t namelen = p - buf;
+
+    // <value>|  digits and decimal points only
+    const char *value = ++p;
+    while ((p < end) && (((*p >= '0') && (*p <= '9')) || (*p == '.'))) p++;
+    if ((p == value) || (p == end) || (*p != '|')) goto invalid;
+    if (!statsdNumber(value, p - value, &line->isint, &line->intval, &line->fltval)) {
+        goto invalid;
+    }
+
+    // <type>
+    line->type = ++p;
+    p = findChar(p, end, '|');
+    line->typelen = p - line->type;
+    if (!isStatsdType(line->type, line->typelen)) goto invalid;
+
+    // Any remaining |sections, in any order
+    while (p < end) {
+        const char *section = ++p;
+        p = findChar(p, end, '|');
+        size_t sectionlen = p - section;
+
+        if ((sectionlen > 1) && (section[0] == '@')) {
+            bool isint;
+            long long intval;
+            double rate;
+            if (!statsdNumber(section + 1, sectionlen - 1, &isint, &intval, &rate)) {
+                goto invalid;
+            }
+            if (isint) rate = intval;
+            if ((rate <= 0.0) || (rate > 1.0)) goto invalid;
+            line->rate = rate;
+        } else if ((sectionlen > 1) && (section[0] == '#')) {
+            line->dims = section;
+            line->dimslen = sectionlen;
+        }
+        // Anything else (DogStatsD container ids, timestamps) is ignored
+    }
+
+    line->name = name;
+    line->namelen = namelen;
+    return consumed;
+
+invalid:
+    line->name = NULL;
+    return consumed;
+}
+
+static unsigned char *
+copyView(unsigned char **pos, const char *str, size_t len)
+{
+    unsigned char *copy = *pos;
+    scope_memcpy(copy, str, len);
+    copy[len] = '\0';
+    *pos += len + 1;
+    return copy;
+}
+
+// One allocation per metric; the strings follow the struct
 static captured_metric_t *
-createCapturedMetric(unsigned char *name, unsigned char *value,
-                     unsigned char *type, unsigned char *dims)
+createCapturedMetric(const statsd_line_t *line)
 {
-    captured_metric_t *base = NULL;
-
-    // These are required fields. (dims may be null)
-    if (!name || !value || !type) goto err;
-
-    // Alloc space
-    base = scope_malloc(sizeof(captured_metric_t));
-    if (!base) goto err;
-
-    // Copy in field values
-    base->name = name;
-    base->value = value;
-    base->type = type;
-    base->dims = dims;
-
-    return base;
-
-err:
-    if (name) pcre2_substring_free(name);
-    if (value) pcre2_substring_free(value);
-    if (type) pcre2_substring_free(type);
-    if (dims) pcre2_substring_free(dims);
-    if (base) scope_free(base);
-    return NULL;
+    size_t size = sizeof(captured_metric_t) +
+                  line->namelen + 1 + line->typelen + 1 + line->dimslen + 1;
+    captured_metric_t *metric = scope_malloc(size);
+    if (!metric) return NULL;
+
+    unsigned char *pos = (unsigned char *)(metric + 1);
+    metric->name = copyView(&pos, line->name, line->namelen);
+    metric->type = copyView(&pos, line->type, line->typelen);
+    metric->dims = (line->dims) ? copyView(&pos, line->dims, line->dimslen) : NULL;
+    metric->isint = line->isint;
+    metric->intval = line->intval;
+    metric->fltval = line->fltval;
+    metric->rate = line->rate;
+
+    return metric;
 }
 
 static void
 destroyCapturedMetric(captured_metric_t **metric)
 {
     if (!metric || !*metric) return;
-    captured_metric_t *tmp = *metric;
-    if (tmp->name) pcre2_substring_free(tmp->name);
-    if (tmp->value) pcre2_substring_free(tmp->value);
-    if (tmp->type) pcre2_substring_free(tmp->type);
-    if (tmp->dims) pcre2_substring_free(tmp->dims);
-    scope_free(tmp);
+    scope_free(*metric);
     *metric = NULL;
 }
 
 // defined in report.c
 extern void reportCapturedMetric(const captured_metric_t *metric);
 
+// Moves captured metrics from the datapath into the aggregator.
+// Sets aren't aggregated; they're reported as they come.
 void
-reportAllCapturedMetrics(void)
+collectCapturedMetrics(void)
 {
     if (!g_metric_buf) return;
 
@@ -122,67 +230,53 @@ reportAllCapturedMetrics(void)
         if (!data) continue;
         captured_metric_t *metric = (captured_metric_t *)data;
 
-        reportCapturedMetric(metric);
+        if (!statsdAggAddMetric(g_statsd_agg, metric)) {
+            reportCapturedMetric(metric);
+        }
 
         destroyCapturedMetric(&metric);
     }
 }
 
+// Called once per summary period
+void
+reportAllCapturedMetrics(void)
+{
+    collectCapturedMetrics();
+
+    statsdAggSendReport(g_statsd_agg, reportCapturedMetric);
+    statsdAggReset(g_statsd_agg);
+}
+
 static bool
 doMetricBuffer(int sockfd, net_info *net, char *buf, size_t len, metric_t src)
 {
     bool is_successful = FALSE;
-    pcre2_match_data *matches = NULL;
-    captured_metric_t *metric = NULL;
-
-    if (!g_statsd_regex || !g_statsd_ext_regex || !g_metric_buf) goto out;
-
-    // Try matching "extended statsd" first
-    matches = pcre2_match_data_create_from_pattern(g_statsd_ext_regex, NULL);
-    if (!matches) goto out;
-
-    int rc = pcre2_match_wrapper(g_statsd_ext_regex,
-            (PCRE2_SPTR)buf, (PCRE2_SIZE)len, 0, 0, matches, NULL);
-    if (rc != STATSD_EXT_CAPTURE_GROUPS) {
-        // Didn't get expected matches.  Try "standard statsd" next.
-        pcre2_match_data_free(matches);
-        matches = pcre2_match_data_create_from_pattern(g_statsd_regex, NULL);
-        if (!matches) goto out;
-
-        rc = pcre2_match_wrapper(g_statsd_regex,
-                (PCRE2_SPTR)buf, (PCRE2_SIZE)len, 0, 0, matches, NULL);
-        if (rc != STATSD_CAPTURE_GROUPS) goto out;
-    }
 
-    // Create a metric object to store the matching results
-    {
-        PCRE2_SIZE unused;
-        PCRE2_UCHAR *name = NULL;
-        PCRE2_UCHAR *val = NULL;
-        PCRE2_UCHAR *type = NULL;
-        PCRE2_UCHAR *dims = NULL;
-        pcre2_substring_get_bynumber(matches, 1, &name, &unused);
-        pcre2_substring_get_bynumber(matches, 2, &val, &unused);
-        pcre2_substring_get_bynumber(matches, 3, &type, &unused);
-        // Dimensions are only there for extended statsd
-        if (rc == STATSD_EXT_CAPTURE_GROUPS) {
-            pcre2_substring_get_bynumber(matches, 4, &dims, &unused);
+    if (!g_metric_buf) return FALSE;
+
+    // A packet can carry many newline delimited metrics
+    size_t consumed;
+    statsd_line_t line;
+    while ((consumed = statsdParseLine(buf, len, &line))) {
+        buf += consumed;
+        len -= consumed;
+        if (!line.name) continue;
+
+        captured_metric_t *metric = createCapturedMetric(&line);
+        if (!metric) continue;
+
+        // Put the metric on a circular buffer for later reporting
+        if (cbufPut(g_metric_buf, (uint64_t)metric) == -1) {
+            // Full; drop and ignore
+            DBG(NULL);
+            destroyCapturedMetric(&metric);
+            break;
         }
 
-        if (!(metric = createCapturedMetric(name, val, type, dims))) goto out;
-    }
-
-    // Put the metric on a circular buffer for later reporting
-    if (cbufPut(g_metric_buf, (uint64_t)metric) == -1) {
-        // Full; drop and ignore
-        DBG(NULL);
-        destroyCapturedMetric(&metric);
-        goto out;
+        is_successful = TRUE;
     }
 
-    is_successful = TRUE;
-out:
-    if (matches) pcre2_match_data_free(matches);
     return is_successful;
 }
 
@@ -202,7 +296,7 @@ doMetricCapture(int sockfd, net_info *net, char *buf, size_t len, metric_t src,
         for (i = 0; i < msg->msg_iovlen; i++) {
             iov = &msg->msg_iov[i];
             if (iov && iov->iov_base && (iov->iov_len > 0)) {
-                ret = ret || doMetricBuffer(sockfd, net, iov->iov_base, iov->iov_len, src);
+                ret = doMetricBuffer(sockfd, net, iov->iov_base, iov->iov_len, src) || ret;
             }
         }
     } else if (dtype == IOV) {
@@ -212,7 +306,7 @@ doMetricCapture(int sockfd, net_info *net, char *buf, size_t len, metric_t src,
         struct iovec *iov = (struct iovec *)buf;
         for (i = 0; i < iovcnt; i++) {
             if (iov[i].iov_base && (iov[i].iov_len > 0)) {
-                ret = ret || doMetricBuffer(sockfd, net, iov[i].iov_base, iov[i].iov_len, src);
+                ret = doMetricBuffer(sockfd, net, iov[i].iov_base, iov[i].iov_len, src) || ret;
             }
         }
     } else {
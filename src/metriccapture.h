@@ -6,15 +6,38 @@
 #include "state_private.h"
 
 void initMetricCapture(void);
+void setMetricCaptureMaxSeries(unsigned);
 bool doMetricCapture(int, net_info*, char*, size_t, metric_t, src_data_t);
 void destroyMetricCapture(void);
+void collectCapturedMetrics(void);
 void reportAllCapturedMetrics(void);
 
 typedef struct {
     unsigned char *name;
-    unsigned char *value;
     unsigned char *type;
-    unsigned char *dims;
+    unsigned char *dims;       // "#key:val,key:val" or NULL
+    bool isint;                // which of intval or fltval is the value
+    long long intval;
+    double fltval;
+    double rate;               // sample rate; 1.0 if there wasn't one
 } captured_metric_t;
 
+// One StatsD/DogStatsD line.  The strings are views into the parsed
+// buffer and are not null terminated.
+//   <name>:<value>|<type>[|@<sample rate>][|#<tag>:<val>,...]
+typedef struct {
+    const char *name;          // NULL if the line isn't valid StatsD
+    size_t namelen;
+    const char *type;
+    size_t typelen;
+    const char *dims;          // starts with the '#'; NULL if no tags
+    size_t dimslen;
+    double rate;               // 1.0 when there is no sample rate
+    bool isint;
+    long long intval;
+    double fltval;
+} statsd_line_t;
+
+size_t statsdParseLine(const char *, size_t, statsd_line_t *);
+
 #endif // __METRIC_H__
@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include "aggmetric.h"
+#include "dbg.h"
+#include "netagg.h"
+#include "topn.h"
+#include "scopestdlib.h"
+
+
+// The table keeps this many entries for each endpoint reported, and at
+// least MIN_ENTRIES; as in fsagg.c.
+#define ENTRIES_PER_ENDPOINT ( 4 )
+#define MIN_ENTRIES ( 64 )
+
+// Ports from here up are a client's, not a service's
+#define EPHEMERAL_PORT_MIN ( 32768 )
+
+#define PORT_CLASS_LEN ( 16 )
+#define KEY_LEN ( INET6_ADDRSTRLEN + PORT_CLASS_LEN + 16 )
+
+typedef struct {
+    net_agg_counts_t counts;
+    char remoteIp[INET6_ADDRSTRLEN];
+    char port[PORT_CLASS_LEN];
+    const char *portField;        // "remotep", or "localp"
+    const char *proto;
+    const char *direction;
+} endpoint_t;
+
+struct _net_agg_t {
+    topn_t *endpoints;
+    unsigned top;
+    topn_entry_t *entry;          // room for top of them, for SendReport
+};
+
+
+net_agg_t *
+netAggCreate(unsigned top)
+{
+    if (!top) return NULL;
+
+    size_t entries = (size_t)top * ENTRIES_PER_ENDPOINT;
+    if (entries < MIN_ENTRIES) entries = MIN_ENTRIES;
+
+    net_agg_t *agg = scope_calloc(1, sizeof(*agg));
+    topn_t *endpoints = topnCreate(entries, sizeof(endpoint_t));
+    topn_entry_t *entry = scope_calloc(top, sizeof(*entry));
+    if (!agg || !endpoints || !entry) {
+        if (agg) scope_free(agg);
+        topnDestroy(&endpoints);
+        if (entry) scope_free(entry);
+        DBG("agg = %p, endpoints = %p, entry = %p", agg, endpoints, entry);
+        return NULL;
+    }
+
+    agg->endpoints = endpoints;
+    agg->top = top;
+    agg->entry = entry;
+
+    return agg;
+}
+
+void
+netAggDestroy(net_agg_t **net_agg_ptr)
+{
+    if (!net_agg_ptr || !*net_agg_ptr) return;
+
+    net_agg_t *net_agg = *net_agg_ptr;
+    topnDestroy(&net_agg->endpoints);
+    scope_free(net_agg->entry);
+    scope_free(net_agg);
+
+    *net_agg_ptr = NULL;
+}
+
+static bool
+ipOf(const struct sockaddr_storage *sa, char *ip, size_t iplen)
+{
+    const void *addr;
+
+    if (sa->ss_family == AF_INET) {
+        addr = &((struct sockaddr_in *)sa)->sin_addr;
+    } else if (sa->ss_family == AF_INET6) {
+        addr = &((struct sockaddr_in6 *)sa)->sin6_addr;
+    } else {
+        return FALSE;
+    }
+
+    return scope_inet_ntop(sa->ss_family, addr, ip, iplen) != NULL;
+}
+
+// A listening port is given as it is; others are classed
+static void
+portOf(const struct sockaddr_storage *sa, bool listening, char *port, size_t portlen)
+{
+    in_port_t num;
+
+    if (sa->ss_family == AF_INET) {
+        num = scope_ntohs(((struct sockaddr_in *)sa)->sin_port);
+    } else if (sa->ss_family == AF_INET6) {
+        num = scope_ntohs(((struct sockaddr_in6 *)sa)->sin6_port);
+    } else {
+        scope_strncpy(port, "unknown", portlen);
+        return;
+    }
+
+    if (!listening && (num >= EPHEMERAL_PORT_MIN)) {
+        scope_strncpy(port, "ephemeral", portlen);
+    } else {
+        scope_snprintf(port, portlen, "%d", num);
+    }
+}
+
+void
+netAggAddCounts(net_agg_t *net_agg, const struct sockaddr_storage *local,
+                const struct sockaddr_storage *remote, int type, bool inbound,
+                const net_agg_counts_t *counts)
+{
+    if (!net_agg || !local || !counts) return;
+
+    uint64_t weight = counts->rxBytes + counts->txBytes +
+                      counts->connections + counts->errors;
+    if (!weight && !counts->rx && !counts->tx) return;
+
+    char ip[INET6_ADDRSTRLEN];
+    char port[PORT_CLASS_LEN];
+    const char *portField;
+    const char *direction;
+    if (!remote) {
+        scope_strncpy(ip, "unconnected", sizeof(ip));
+        portOf(local, FALSE, port, sizeof(port));
+        portField = "localp";
+        direction = "none";
+    } else if (inbound) {
+        if (!ipOf(remote, ip, sizeof(ip))) return;
+        portOf(local, TRUE, port, sizeof(port));
+        portField = "localp";
+        direction = "in";
+    } else {
+        if (!ipOf(remote, ip, sizeof(ip))) return;
+        portOf(remote, FALSE, port, sizeof(port));
+        portField = "remotep";
+        direction = "out";
+    }
+
+    const char *proto = (type == SOCK_STREAM) ? "TCP" :
+                        (type == SOCK_DGRAM) ? "UDP" : "OTHER";
+
+    // Which port it is follows from the direction
+    char key[KEY_LEN];
+    scope_snprintf(key, sizeof(key), "%s|%s|%s|%s", ip, port, proto, direction);
+
+    endpoint_t *endpoint = topnAdd(net_agg->endpoints, key, weight);
+    if (!endpoint) return;
+
+    // It's zeroed when the key gets an entry
+    if (!endpoint->proto) {
+        scope_strncpy(endpoint->remoteIp, ip, sizeof(endpoint->remoteIp));
+        scope_strncpy(endpoint->port, port, sizeof(endpoint->port));
+        endpoint->portField = portField;
+        endpoint->proto = proto;
+        endpoint->direction = direction;
+    }
+
+    net_agg_counts_t *total = &endpoint->counts;
+    total->rx += counts->rx;
+    total->rxBytes += counts->rxBytes;
+    total->tx += counts->tx;
+    total->txBytes += counts->txBytes;
+    total->connections += counts->connections;
+    total->connects += counts->connects;
+    total->connectDuration += counts->connectDuration;
+    total->errors += counts->errors;
+}
+
+// numops is only sent for receives, sends and connect durations
+static void
+send_endpoint_metric(mtc_t *mtc, const char *name, endpoint_t *endpoint,
+                     uint64_t value, data_type_t type, uint64_t numops, const char *unit)
+{
+    event_field_t keys[] = {
+        STRFIELD("remoteip",          endpoint->remoteIp,  4, TRUE),
+        STRFIELD(endpoint->portField, endpoint->port,      4, TRUE),
+        STRFIELD("proto",             endpoint->proto,     4, TRUE),
+        STRFIELD("direction",         endpoint->direction, 4, TRUE),
+        FIELDEND
+    };
+    aggSendMetric(mtc, name, value, type, keys, numops, unit);
+}
+
+static void
+report_endpoint(mtc_t *mtc, endpoint_t *endpoint)
+{
+    net_agg_counts_t *counts = &endpoint->counts;
+
+    // Don't report zeros
+    if (counts->connections) {
+        send_endpoint_metric(mtc, "net.remote.conn", endpoint, counts->connections, DELTA, 0, "connection");
+    }
+    if (counts->rx) {
+        send_endpoint_metric(mtc, "net.remote.rx", endpoint, counts->rxBytes, DELTA, counts->rx, "byte");
+    }
+    if (counts->tx) {
+        send_endpoint_metric(mtc, "net.remote.tx", endpoint, counts->txBytes, DELTA, counts->tx, "byte");
+    }
+    if (counts->connects) {
+        // factor of 1000 converts ns to us; at least 1
+        uint64_t dur = counts->connectDuration / (1000 * counts->connects);
+        if (!dur) dur = 1;
+        send_endpoint_metric(mtc, "net.remote.connect.duration", endpoint, dur, HISTOGRAM, counts->connects, "microsecond");
+    }
+    if (counts->errors) {
+        send_endpoint_metric(mtc, "net.remote.error", endpoint, counts->errors, DELTA, 0, "operation");
+    }
+}
+
+void
+netAggSendReport(net_agg_t *net_agg, mtc_t *mtc)
+{
+    if (!net_agg || !mtc) return;
+
+    size_t count = topnGet(net_agg->endpoints, net_agg->entry, net_agg->top);
+    size_t i;
+    for (i = 0; i < count; i++) {
+        report_endpoint(mtc, net_agg->entry[i].value);
+    }
+}
+
+void
+netAggReset(net_agg_t *net_agg)
+{
+    if (!net_agg) return;
+
+    topnReset(net_agg->endpoints);
+}
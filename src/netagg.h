@@ -0,0 +1,55 @@
+#ifndef __NETAGG_H__
+#define __NETAGG_H__
+#include <sys/socket.h>
+#include "mtc.h"
+
+// This aggregates network activity by remote endpoint for the metrics
+// channel, for processes with too many short lived connections for per
+// descriptor metrics to be of use. What a socket did is added under its
+// remote address, a port, protocol and direction, once a period while
+// it's open and when it's closed.
+//
+// Direction is "in" for accepted connections and "out" for the rest. The
+// port of an outbound one is the remote port if it's below 32768, and
+// "ephemeral" otherwise. An inbound one's is the local port it was
+// accepted on; the port each client happened to get isn't kept, so the
+// clients of a server are counted by address.
+//
+// A datagram socket that isn't connected sends to and receives from any
+// address, so what it did is added under "unconnected" and its local
+// port, with a direction of "none". It's one of those when there's no
+// remote address for it.
+//
+// The table has room for a few times the number of endpoints reported;
+// see topn.h. Endpoints are weighed by bytes sent and received, plus one
+// for each connection and error, and the heaviest are reported each
+// period.
+//
+// A normal lifecycle:
+//   Create
+//   AddCounts
+//   AddCounts
+//   SendReport (sends the heaviest endpoints added since Create or Reset)
+//   Reset
+
+typedef struct _net_agg_t net_agg_t;
+
+typedef struct {
+    uint64_t rx;
+    uint64_t rxBytes;
+    uint64_t tx;
+    uint64_t txBytes;
+    uint64_t connections;
+    uint64_t connects;            // number of connects timed
+    uint64_t connectDuration;     // ns
+    uint64_t errors;              // failed connects
+} net_agg_counts_t;
+
+net_agg_t *netAggCreate(unsigned);
+void netAggDestroy(net_agg_t **);
+void netAggAddCounts(net_agg_t *, const struct sockaddr_storage *, const struct sockaddr_storage *,
+                     int, bool, const net_agg_counts_t *);
+void netAggSendReport(net_agg_t *, mtc_t *);
+void netAggReset(net_agg_t *);
+
+#endif // __NETAGG_H__
@@ -13,7 +13,9 @@ typedef struct {
     bool tsc_invariant;
     bool tsc_rdtscp;
     bool gptimer_avail;
-    uint64_t freq;
+    uint64_t freq;      // counter frequency in Mhz; informational
+    uint64_t mult;      // ns = (ticks * mult) >> shift
+    uint32_t shift;
 } platform_time_t;
 
 platform_time_t* initTime(void);
@@ -28,47 +30,27 @@ platform_time_t* initTime(void);
 // this.
 extern platform_time_t g_time;
 
+// Read the h/w counter; callers must know that it is usable
 static inline uint64_t
-getTime(void) {
-
-    // If we do not have a h/w timer available or we default to not using a
-    // h/w timer then use the kernel timer. Note that no checks for a gate
-    // function in VDSO have been applied.
-    if ((g_time.gptimer_avail == FALSE) || (DEFAULT_HW_TIMER == FALSE)) {
-        uint64_t cnt;
-        struct timespec ts;
-
-        scope_clock_gettime(CLOCK_MONOTONIC, &ts);
-        cnt = ts.tv_sec * 1000000000 + ts.tv_nsec;
-        return cnt;
-    }
-
+getCounter(void) {
 #ifdef __x86_64__
     unsigned low, high;
 
     /*
      * Newer CPUs support a second TSC read instruction.
-     * The new instruction, rdtscp, performs a serialization
-     * instruction before calling RDTSC. Specifically, rdtscp
-     * performs a cpuid instruction then an rdtsc. This is
-     * intended to flush the instruction pipeline befiore
-     * calling rdtsc.
-     *
-     * A serializing instruction is used as the order of
-     * execution is not guaranteed. It's described as
-     * "Out ofOrder Execution". In some cases the read
-     * of the TSC can come before the instruction being
-     * measured. That scenario is not very likely for us
-     * as we tend to measure functions as opposed to
-     * statements.
+     * The new instruction, rdtscp, waits until all previous
+     * instructions have executed before reading the TSC.
+     * This keeps the read of the TSC from being executed
+     * ahead of the instructions being measured. That scenario
+     * is not very likely for us as we tend to measure functions
+     * as opposed to statements.
      *
      * If the rdtscp instruction is available, we use it.
-     * It takes a bit longer to execute due to the extra
-     * serialization instruction (cpuid). However, it's
+     * It takes a bit longer to execute. However, it's
      * supposed to be more accurate.
      */
     if (g_time.tsc_rdtscp == TRUE) {
-        asm volatile("rdtscp" : "=a" (low), "=d" (high));
+        asm volatile("rdtscp" : "=a" (low), "=d" (high) :: "ecx");
     } else {
         asm volatile("rdtsc" : "=a" (low), "=d" (high));
     }
@@ -76,11 +58,8 @@ getTime(void) {
 #elif defined(__aarch64__)
     uint64_t cnt;
     __asm__ volatile (
-        "mrs x1, CNTVCT_EL0 \n"
-        "mov %0, x1  \n"
+        "mrs %0, CNTVCT_EL0 \n"
         : "=r" (cnt)                // output
-        :                           // inputs
-        :                           // clobbered register
         );
 
     return cnt;
@@ -89,63 +68,50 @@ getTime(void) {
 #endif
 }
 
-
-// Return the time delta from start to now in nanoseconds
 static inline uint64_t
-getDuration(uint64_t start)
-{
-    // before the constructor runs, g_time.freq is zero.
-    // Avoid div by zero during this time.
-    if (!g_time.freq) return 0ULL;
+getTime(void) {
 
-    /*
-     * The clock frequency is in Mhz.
-     * In order to get NS resolution we
-     * multiply the difference by 1000.
-     *
-     * If the counter rolls over we adjust
-     * by using the max value of the counter.
-     * A roll over is rare. But, we should handle it.
-     */
-    uint64_t now = getTime();
-    if (start < now) {
-        if ((g_time.gptimer_avail == TRUE) && (DEFAULT_HW_TIMER == TRUE)) {
-            return ((now - start) * 1000) / g_time.freq;
-        } else {
-            return now - start;
-        }
-    } else {
-        return (((ULONG_MAX - start) + now) * 1000) / g_time.freq;
+    // If we do not have a usable h/w timer or we default to not using a
+    // h/w timer then use the kernel timer. osInitTimer() decides whether
+    // the counter is usable and calibrates it. Note that no checks for a
+    // gate function in VDSO have been applied.
+    if ((g_time.gptimer_avail == FALSE) || (DEFAULT_HW_TIMER == FALSE)) {
+        uint64_t cnt;
+        struct timespec ts;
+
+        scope_clock_gettime(CLOCK_MONOTONIC, &ts);
+        cnt = ts.tv_sec * 1000000000 + ts.tv_nsec;
+        return cnt;
     }
 
+    return getCounter();
 }
 
 // Return the time delta from start to now in nanoseconds
 static inline uint64_t
 getDurationNow(uint64_t now, uint64_t start)
 {
-    // before the constructor runs, g_time.freq is zero.
-    // Avoid div by zero during this time.
-    if (!g_time.freq) return 0ULL;
+    // before the constructor runs, g_time.mult is zero.
+    // Report no duration during this time.
+    if (!g_time.mult) return 0ULL;
 
     /*
-     * The clock frequency is in Mhz.
-     * In order to get NS resolution we
-     * multiply the difference by 1000.
+     * A counter that appears to run backwards is clock skew, not a
+     * roll over. Neither counter rolls over in practice.
      *
-     * If the counter rolls over we adjust
-     * by using the max value of the counter.
-     * A roll over is rare. But, we should handle it.
+     * The conversion is a multiply and a shift rather than a divide.
+     * The 128 bit product keeps it exact for any interval.
      */
-    if (start < now) {
-        if ((g_time.gptimer_avail == TRUE) && (DEFAULT_HW_TIMER == TRUE)) {
-            return ((now - start) * 1000) / g_time.freq;
-        } else {
-            return now - start;
-        }
-    } else {
-        return (((ULONG_MAX - start) + now) * 1000) / g_time.freq;
-    }
+    if (now <= start) return 0ULL;
+    return (uint64_t)(((unsigned __int128)(now - start) * g_time.mult) >> g_time.shift);
+}
+
+// Return the time delta from start to now in nanoseconds
+static inline uint64_t
+getDuration(uint64_t start)
+{
+    if (!g_time.mult) return 0ULL;
+    return getDurationNow(getTime(), start);
 }
 
 #endif // __PLATTIME_H__
@@ -10,15 +10,20 @@
 #include <sys/time.h>
 #include <lshpack.h>
 
+#include "arena.h"
 #include "atomic.h"
 #include "com.h"
 #include "dbg.h"
 #include "evtutils.h"
 #include "fn.h"
+#include "fsagg.h"
+#include "grpcagg.h"
+#include "histo.h"
 #include "httpagg.h"
 #include "httpmatch.h"
 #include "metriccapture.h"
 #include "mtcformat.h"
+#include "netagg.h"
 #include "plattime.h"
 #include "report.h"
 #include "strsearch.h"
@@ -37,6 +42,7 @@
 #endif
 
 
+#define LE_FIELD(val)           STRFIELD("le",             (val), 0, TRUE)
 #define DATA_FIELD(val)         STRFIELD("data",           (val), 1, TRUE)
 #define UNIT_FIELD(val)         STRFIELD("unit",           (val), 1, TRUE)
 #define SUMMARY_FIELD(val)      STRFIELD("summary",        (val), 1, TRUE)
@@ -119,20 +125,31 @@ typedef struct http_report_t {
 // and replace it with a measured value.  It'd be one less dependency
 // and could be more accurate.
 static int g_interval = DEFAULT_SUMMARY_PERIOD;
+
+// Set on the periodic thread, and the process it runs in
+static __thread bool t_periodic = FALSE;
+static pid_t g_periodic_pid = 0;
+
 static httpmatch_t *g_httpmatch = NULL;
 static channelstore_t *g_http2_channels = NULL;
 static search_t *g_http_status = NULL;
 static http_agg_t *g_http_agg = NULL;
+static grpc_agg_t *g_grpc_agg = NULL;
+static fs_agg_t *g_fs_agg = NULL;
+static net_agg_t *g_net_agg = NULL;
+static dns_cache_t *g_dns_cache = NULL;
 static uint64_t g_cumulativeEventCount = 0;
 static uint64_t g_numCallsToDoEvent = 0;
 
+static void dnsRepeatsEvent(const dns_answer_t *, unsigned);
+
 // saved state for an HTTP/2 channel
 typedef struct http2Channel {
     // HPAC decoder
     struct lshpack_dec decoder;
 
-    // list of http2Stream_t indexed by stream
-    list_t *streams;
+    // table of http2Stream_t indexed by stream
+    streamtable_t *streams;
 } http2Channel_t;
 
 // saved state for an HTTP/2 stream within a channel
@@ -140,6 +157,9 @@ typedef struct http2Stream {
     // type of the current message being processed
     uint8_t msgType; // 0=unset, 1=request, 2=response
 
+    // END_STREAM was set on the HEADERS frame of the current message
+    bool endStream;
+
     // cJSON node for the content for the event's body.data
     cJSON *jsonData;
 
@@ -154,9 +174,32 @@ typedef struct http2Stream {
     // req/resp content-length values
     int lastReqLen;
     int lastRespLen;
+
+    // gRPC call state; see doGrpcCall()
+    bool     isGrpc;              // "content-type" is application/grpc
+    bool     reqSent;             // we sent the request; we're the client
+    bool     hasGrpcStatus;       // "grpc-status" seen in headers or trailers
+    int      grpcStatus;
+    uint64_t reqMsgs;             // from DATA frame summaries
+    uint64_t respMsgs;
 } http2Stream_t;
 
 
+// Each HTTP/2 channel holds state for at most HTTP2_CHANNEL_MAX_STREAMS
+// streams in at most HTTP2_CHANNEL_MAX_BYTES. Beyond either, the oldest
+// streams are evicted; a stream is normally deleted when its response ends
+// so these are ones that haven't seen one. A stream waiting for its next
+// frame is charged its state (about 3.4KB) plus the JSON built from its
+// headers so far. The HPACK decoder's dynamic table, capped at
+// HTTP2_HPACK_MAX_CAPACITY, comes out of the same budget. Evictions are
+// reported as http.stream.evicted.
+#define HTTP2_CHANNEL_MAX_STREAMS 256
+#define HTTP2_CHANNEL_MAX_BYTES   (1024 * 1024)
+#define HTTP2_HPACK_MAX_CAPACITY  0x4000
+
+// HTTP/2 streams evicted since the last report
+static uint64_t g_http2_evicted = 0;
+
 #define DEFAULT_MIN_DURATION_TIME (1)
 
 static void
@@ -164,7 +207,7 @@ destroyHttpMap(http_map *map)
 {
     if (!map) return;
 
-    if (map->req) scope_free(map->req);
+    if (map->req) arenaFree(map->req);
     scope_free(map);
 }
 
@@ -176,7 +219,11 @@ destroyHttp2Channel(http2Channel_t *info)
 
     lshpack_dec_cleanup(&info->decoder);
     if (info->streams) {
-        lstDestroy(&info->streams);
+        uint64_t evicted = streamTableEvicted(info->streams);
+        if (evicted) {
+            scopeLogInfo("INFO: HTTP/2 channel closed after evicting %"PRIu64" incomplete streams", evicted);
+        }
+        streamTableDestroy(&info->streams);
     }
 
     scope_free(info);
@@ -203,6 +250,8 @@ initReporting(void)
     //     thread exits but we've not gotten to it yet. 
     g_http_status = searchComp(HTTP_STATUS);
     g_http_agg = httpAggCreate();
+    g_grpc_agg = grpcAggCreate();
+    g_dns_cache = dnsCacheCreate(DEFAULT_DNS_CACHE_ENTRIES, dnsRepeatsEvent);
     g_httpmatch = httpMatchCreate(g_netinfo, g_extra_net_info_list, destroyHttpMap);
     g_http2_channels = channelStoreCreate(g_netinfo, g_extra_net_info_list, destroyHttp2Channel);
 }
@@ -212,6 +261,10 @@ destroyReporting(void) {
     channelStoreDestroy(&g_http2_channels);
     httpMatchDestroy(&g_httpmatch);
     httpAggDestroy(&g_http_agg);
+    grpcAggDestroy(&g_grpc_agg);
+    fsAggDestroy(&g_fs_agg);
+    netAggDestroy(&g_net_agg);
+    dnsCacheDestroy(&g_dns_cache);
     searchFree(&g_http_status);
 }
 
@@ -221,6 +274,55 @@ setReportingInterval(int seconds)
     g_interval = seconds;
 }
 
+// Called on the periodic thread, before setVerbosity()
+void
+setReportingFsPaths(config_t *cfg)
+{
+    fsAggDestroy(&g_fs_agg);
+    g_summary.fs.paths = FALSE;
+
+    unsigned top = cfgMtcWatchTop(cfg, CFG_MTC_FS);
+    if (!top) return;
+
+    g_fs_agg = fsAggCreate(top);
+    if (!g_fs_agg) return;
+
+    size_t i;
+    for (i = 0; i < cfgMtcFsNumPaths(cfg); i++) {
+        fsAggPatternAdd(g_fs_agg, cfgMtcFsPath(cfg, i));
+    }
+    g_summary.fs.paths = TRUE;
+}
+
+// Called on the periodic thread, before setVerbosity()
+void
+setReportingNetTop(config_t *cfg)
+{
+    netAggDestroy(&g_net_agg);
+    g_summary.net.remote = FALSE;
+
+    unsigned top = cfgMtcWatchTop(cfg, CFG_MTC_NET);
+    if (!top) return;
+
+    g_net_agg = netAggCreate(top);
+    if (g_net_agg) g_summary.net.remote = TRUE;
+}
+
+// Called on the periodic thread
+void
+setReportingStatsDMaxSeries(config_t *cfg)
+{
+    setMetricCaptureMaxSeries(cfgMtcStatsDMaxSeries(cfg));
+}
+
+// Called on the periodic thread; see PROC_RUSAGE
+void
+setReportingThread(void)
+{
+    t_periodic = TRUE;
+    g_periodic_pid = g_proc.pid;
+}
+
 static void
 sendEvent(mtc_t *mtc, event_t *event)
 {
@@ -930,6 +1032,37 @@ isHttp2FieldEnabled(const char* field, const char *value)
     return headerMatch(fieldRe, field) && headerMatch(valueRe, value);
 }
 
+// A stream's state and header JSON; see HTTP2_CHANNEL_MAX_BYTES
+static size_t
+http2StreamBytes(const http2Stream_t *stream)
+{
+    size_t bytes = sizeof(*stream);
+    if (!stream->jsonData) return bytes;
+
+    const cJSON *item;
+    bytes += sizeof(cJSON);
+    for (item = stream->jsonData->child; item; item = item->next) {
+        bytes += sizeof(cJSON);
+        if (item->string) bytes += scope_strlen(item->string) + 1;
+        if (item->valuestring) bytes += scope_strlen(item->valuestring) + 1;
+    }
+    return bytes;
+}
+
+// Counts what a channel evicted since it had evicted before
+static void
+countHttp2Evictions(http2Channel_t *channel, uint64_t before, uint64_t uid)
+{
+    uint64_t evicted = streamTableEvicted(channel->streams);
+    if (evicted == before) return;
+
+    if (!before) {
+        scopeLogWarn("WARN: HTTP/2 channel 0x%lx has over %zu incomplete streams or %zu bytes; evicting the oldest",
+                uid, (size_t)HTTP2_CHANNEL_MAX_STREAMS, (size_t)HTTP2_CHANNEL_MAX_BYTES);
+    }
+    atomicAddU64(&g_http2_evicted, evicted - before);
+}
+
 static void
 addHttp2NumField(cJSON *jsonData, const char* field, uint32_t value)
 {
@@ -960,6 +1093,30 @@ addHttp2StrFieldLN(cJSON *jsonData, const char* field, const char *value)
     }
 }
 
+// gRPC calls are aggregated into metrics, so only when those are sent
+static bool
+grpcAggEnabled(void)
+{
+    return g_grpc_agg && mtcEnabled(g_mtc) &&
+           cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_HTTP);
+}
+
+static void
+doGrpcCall(http2Stream_t *stream, uint64_t endAt, bool isServer)
+{
+    grpc_call_t call = {
+        .method      = stream->lastTarget,
+        .isServer    = isServer,
+        .status      = stream->hasGrpcStatus ?
+                       stream->grpcStatus : grpcStatusFromHttp(stream->lastStatus),
+        .hasDuration = stream->lastRequestAt && (endAt > stream->lastRequestAt),
+        .duration    = getDurationNow(endAt, stream->lastRequestAt) / 1000000,
+        .reqMsgs     = stream->reqMsgs,
+        .respMsgs    = stream->respMsgs,
+    };
+    grpcAggAddCall(g_grpc_agg, &call);
+}
+
 static void
 doHttp2Frame(protocol_info *proto)
 {
@@ -1053,8 +1210,15 @@ doHttp2Frame(protocol_info *proto)
             }
 
             lshpack_dec_init(&channel->decoder);
-            lshpack_dec_set_max_capacity(&channel->decoder, 0x4000);
-            channel->streams = lstCreate(destroyHttp2Stream);
+            lshpack_dec_set_max_capacity(&channel->decoder, HTTP2_HPACK_MAX_CAPACITY);
+            channel->streams = streamTableCreate(HTTP2_CHANNEL_MAX_STREAMS,
+                    HTTP2_CHANNEL_MAX_BYTES - HTTP2_HPACK_MAX_CAPACITY, destroyHttp2Stream);
+            if (!channel->streams) {
+                destroyHttp2Channel(channel);
+                scopeLogError("ERROR: failed to create stream table");
+                DBG(NULL);
+                return;
+            }
 
             if (channelSave(g_http2_channels, channel, proto->uid, proto->fd) != TRUE) {
                 destroyHttp2Channel(channel);
@@ -1065,7 +1229,7 @@ doHttp2Frame(protocol_info *proto)
         }
 
         // get/create the stream info
-        http2Stream_t *stream = lstFind(channel->streams, fStream);
+        http2Stream_t *stream = streamTableGet(channel->streams, fStream);
         if (!stream) {
             stream = scope_calloc(1, sizeof(http2Stream_t));
             if (!stream) {
@@ -1074,12 +1238,20 @@ doHttp2Frame(protocol_info *proto)
                 return;
             }
 
-            if (lstInsert(channel->streams, fStream, stream) != TRUE) {
+            uint64_t evicted = streamTableEvicted(channel->streams);
+            if (streamTableAdd(channel->streams, fStream, stream) != TRUE) {
                 destroyHttp2Stream(stream);
-                scopeLogError("ERROR: failed to insert decoder");
+                scopeLogError("ERROR: failed to insert stream");
                 DBG(NULL);
                 return;
             }
+            countHttp2Evictions(channel, evicted, proto->uid);
+        }
+
+        // CONTINUATION frames don't carry END_STREAM; remember it from the
+        // HEADERS frame that started the header block.
+        if (fType == 0x01) {
+            stream->endStream = (fFlags & 0x01) ? TRUE : FALSE;
         }
 
         // Rather than keep an event_field_t array like the HTTP/1 logic does,
@@ -1149,6 +1321,19 @@ doHttp2Frame(protocol_info *proto)
             char *val  = out + hdr.val_offset;
             //scopeLogDebug("DEBUG: HTTP/2 decoded header: name=\"%s\", value=\"%s\"", name, val);
 
+            // gRPC calls are recognized by their content-type and end with
+            // a grpc-status, usually in the trailers. These are checked
+            // apart from the chain below so they're still subject to the
+            // header filters for the event.
+            if (!scope_strcasecmp("content-type", name)) {
+                if (!scope_strncmp(val, "application/grpc", sizeof("application/grpc") - 1)) {
+                    stream->isGrpc = TRUE;
+                }
+            } else if (!scope_strcasecmp("grpc-status", name)) {
+                stream->grpcStatus = scope_atoi(val);
+                stream->hasGrpcStatus = TRUE;
+            }
+
             // Update the state of the stream for the given header field. Most
             // of these become entries in the cJSON object that will eventually
             // become the body.data element in the JSON event. Some are stashed
@@ -1242,6 +1427,7 @@ doHttp2Frame(protocol_info *proto)
             // because we don't crack the headers on the data side and
             // therefore don't know if it's a request or response.
             bool isSend     = proto->isServer;
+            bool isRequest  = stream->msgType == 1;
             bool isResponse = stream->msgType == 2;
             bool isServer   = (isSend && isResponse) || (!isSend && !isResponse);
 
@@ -1279,13 +1465,29 @@ doHttp2Frame(protocol_info *proto)
                 addHttp2NumField(stream->jsonData, "net_host_port", scope_ntohs(((struct sockaddr_in*)&proto->localConn)->sin_port));
             }
 
+            // gRPC calls are counted per method when they end instead of
+            // being sent as http.req and http.resp events. A call ends
+            // with END_STREAM on the trailers, or on the response headers
+            // when there's no body (Trailers-Only). With http metrics off
+            // they aren't counted, so they're sent as events like any
+            // other stream.
+            if (stream->isGrpc && grpcAggEnabled()) {
+                if (isRequest) {
+                    stream->reqSent = isSend;
+                } else if (stream->endStream) {
+                    doGrpcCall(stream, post->start_duration, isSend);
+                }
+            }
+
             // If it's a request message...
-            if (stream->msgType == 1) {
+            else if (stream->msgType == 1) {
                 if (isHttp2NameEnabled("http.req")) {
                     // send the request event
                     event_t event = INT_EVENT("http.req", proto->len, SET, NULL);
                     event.data = stream->jsonData;
                     cmdSendHttp(g_ctl, &event, proto->uid, &g_proc);
+                    // jsonData was deleted for us down in cmdSendHttp()
+                    stream->jsonData = NULL;
                 }
             } 
 
@@ -1295,11 +1497,11 @@ doHttp2Frame(protocol_info *proto)
                 http_map *map = httpReqGet(g_httpmatch, post->id.uid);
 
                 // add duration from request
-                unsigned duration; // msecs
+                unsigned duration = 0; // msecs
                 if (stream->lastRequestAt) {
-                    duration = (post->start_duration - stream->lastRequestAt) / 1000000;
+                    duration = getDurationNow(post->start_duration, stream->lastRequestAt) / 1000000;
                 } else if (map && map->start_time) {
-                    duration = (post->start_duration - map->start_time) / 1000000;
+                    duration = getDurationNow(post->start_duration, map->start_time) / 1000000;
                 }
                 addHttp2NumField(stream->jsonData, isServer ?  "http_server_duration" : "http_client_duration", duration);
 
@@ -1336,6 +1538,8 @@ doHttp2Frame(protocol_info *proto)
                     event_t event = INT_EVENT("http.resp", proto->len, SET, NULL);
                     event.data = stream->jsonData;
                     cmdSendHttp(g_ctl, &event, proto->uid, &g_proc);
+                    // jsonData was deleted for us down in cmdSendHttp()
+                    stream->jsonData = NULL;
                 }
 
                 // if metrics are enabled...
@@ -1355,19 +1559,53 @@ doHttp2Frame(protocol_info *proto)
                 }
             }
 
+            else if (stream->endStream) {
+                // trailers ending a stream that wasn't gRPC; nothing to report
+            }
+
             // otherwise, the message type is invalid
             else {
                 scopeLogError("ERROR: HTTP/2 invalid msgType; %d", stream->msgType);
                 DBG(NULL);
             }
 
-            // reset
+            // reset; jsonData is still here if no event was sent
             stream->msgType = 0;
             if (stream->jsonData) {
-                // jsonData was deleted for us down in cmdSendHttp()
-                //cJSON_Delete(stream->jsonData);
+                cJSON_Delete(stream->jsonData);
                 stream->jsonData = NULL;
             }
+
+            // Nothing more comes on a stream once a response or trailers
+            // end it. A request ending it only means the body is done.
+            if (stream->endStream && !isRequest) {
+                streamTableDelete(channel->streams, fStream);
+                return;
+            }
+        }
+
+        // Charge the stream for what it holds until its next frame
+        uint64_t evicted = streamTableEvicted(channel->streams);
+        streamTableCharge(channel->streams, fStream, http2StreamBytes(stream));
+        countHttp2Evictions(channel, evicted, proto->uid);
+    } else if (fType == 0x00) {
+        // DATA frames arrive as summaries; see reportHttp2Data() in
+        // httpstate.c. The payload is the number of gRPC messages that
+        // started in the frame.
+        if (fLen != 4) {
+            scopeLogError("ERROR: HTTP/2 bad DATA summary; len=%d", fLen);
+            DBG(NULL);
+            return;
+        }
+        http2Channel_t *channel = channelGet(g_http2_channels, proto->uid);
+        http2Stream_t *stream = channel ? streamTableGet(channel->streams, fStream) : NULL;
+        if (!stream) return;
+
+        uint32_t msgs = (frame[9]<<24) + (frame[10]<<16) + (frame[11]<<8) + (frame[12]);
+        if (proto->isServer == stream->reqSent) {
+            stream->reqMsgs += msgs;
+        } else {
+            stream->respMsgs += msgs;
         }
     } else {
         scopeLogError("ERROR: HTTP/2 unexpected frame type; type=0x%02d", fType);
@@ -1604,13 +1842,59 @@ doErrorMetric(metric_t type, control_type_t source,
     }
 }
 
+// Build the data of a dns event from a decoded answer
+static cJSON *
+dnsAnswerJson(const dns_answer_t *ans, unsigned repeats)
+{
+    cJSON *json = cJSON_CreateObject();
+    if (!json) return NULL;
+
+    cJSON *addrs = cJSON_CreateArray();
+    if (!addrs) {
+        cJSON_Delete(json);
+        return NULL;
+    }
+
+    cJSON_AddNumberToObjLN(json, "duration", ans->duration);
+    if (ans->domain[0]) cJSON_AddStringToObjLN(json, "domain", ans->domain);
+
+    int i;
+    for (i = 0; i < ans->numAddrs; i++) {
+        char ipaddr[INET6_ADDRSTRLEN];
+        if (!scope_inet_ntop(ans->addrs[i].family, ans->addrs[i].addr,
+                             ipaddr, sizeof(ipaddr))) {
+            continue;
+        }
+        cJSON_AddStringToObjLN(addrs, "addr", ipaddr);
+    }
+    cJSON_AddItemToObject(json, "addrs", addrs);
+
+    if (repeats) cJSON_AddNumberToObjLN(json, "repeats", repeats);
+
+    return json;
+}
+
+// Repeats of an answer that no later report carried out of the cache
+static void
+dnsRepeatsEvent(const dns_answer_t *ans, unsigned repeats)
+{
+    event_field_t evfield[] = {
+        DOMAIN_FIELD(ans->domain),
+        FIELDEND
+    };
+    event_t dnsEvent = INT_EVENT("dns.resp", repeats, DELTA, evfield);
+    dnsEvent.src = CFG_SRC_DNS;
+    dnsEvent.data = dnsAnswerJson(ans, repeats);
+    cmdSendEvent(g_ctl, &dnsEvent, getTime(), &g_proc);
+}
+
 void
-doDNSMetricName(metric_t type, net_info *net)
+doDNSMetricName(metric_t type, dns_info *dns)
 {
-    if (!net || !net->dnsName || !net->dnsName[0]) return;
+    if (!dns || !dns->dnsName[0]) return;
 
-    metric_counters *ctrs = &net->counters;
-    counters_element_t *duration = &net->totalDuration;
+    metric_counters *ctrs = &dns->counters;
+    counters_element_t *duration = &dns->totalDuration;
 
     switch (type) {
     case DNS:
@@ -1623,30 +1907,36 @@ doDNSMetricName(metric_t type, net_info *net)
                     PROC_FIELD(g_proc.procname),
                     PID_FIELD(g_proc.pid),
                     HOST_FIELD(g_proc.hostname),
-                    DOMAIN_FIELD(net->dnsName),
+                    DOMAIN_FIELD(dns->dnsName),
                     UNIT_FIELD("response"),
                     FIELDEND
                 };
                 event_t dnsMetric = INT_EVENT("dns.resp", ctrs->numDNS.evt, DELTA, resp);
                 cmdSendEvent(g_ctl, &dnsMetric, getTime(), &g_proc);
 
-                // This creates a DNS event
-                event_field_t evfield[] = {
-                    DOMAIN_FIELD(net->dnsName),
-                    DURATION_FIELD(duration->evt / 1000000), // convert ns to ms.
-                    FIELDEND
-                };
-                event_t dnsEvent = INT_EVENT("dns.resp", ctrs->numDNS.evt, DELTA, evfield);
-                dnsEvent.src = CFG_SRC_DNS;
-                dnsEvent.data = net->dnsAnswer;
-                cmdSendEvent(g_ctl, &dnsEvent, getTime(), &g_proc);
+                // An answer identical to one reported within its TTL is
+                // only counted; the count goes out with the next report
+                unsigned repeats = 0;
+                if (!dns->hasAnswer ||
+                    dnsCacheReport(g_dns_cache, &dns->answer, scope_time(NULL), &repeats)) {
+                    // This creates a DNS event
+                    event_field_t evfield[] = {
+                        DOMAIN_FIELD(dns->dnsName),
+                        DURATION_FIELD(duration->evt / 1000000), // convert ns to ms.
+                        FIELDEND
+                    };
+                    event_t dnsEvent = INT_EVENT("dns.resp", ctrs->numDNS.evt, DELTA, evfield);
+                    dnsEvent.src = CFG_SRC_DNS;
+                    dnsEvent.data = (dns->hasAnswer) ? dnsAnswerJson(&dns->answer, repeats) : NULL;
+                    cmdSendEvent(g_ctl, &dnsEvent, getTime(), &g_proc);
+                }
             } else {
                 // This create a DNS raw event
                 event_field_t req[] = {
                     PROC_FIELD(g_proc.procname),
                     PID_FIELD(g_proc.pid),
                     HOST_FIELD(g_proc.hostname),
-                    DOMAIN_FIELD(net->dnsName),
+                    DOMAIN_FIELD(dns->dnsName),
                     UNIT_FIELD("request"),
                     FIELDEND
                 };
@@ -1655,7 +1945,7 @@ doDNSMetricName(metric_t type, net_info *net)
 
                 // This creates a DNS event
                 event_field_t evfield[] = {
-                    DOMAIN_FIELD(net->dnsName),
+                    DOMAIN_FIELD(dns->dnsName),
                     FIELDEND
                 };
                 event_t dnsEvent = INT_EVENT("dns.req", ctrs->numDNS.evt, DELTA, evfield);
@@ -1676,7 +1966,7 @@ doDNSMetricName(metric_t type, net_info *net)
             PROC_FIELD(g_proc.procname),
             PID_FIELD(g_proc.pid),
             HOST_FIELD(g_proc.hostname),
-            DOMAIN_FIELD(net->dnsName),
+            DOMAIN_FIELD(dns->dnsName),
             DURATION_FIELD(duration->mtc / 1000000), // convert ns to ms.
             UNIT_FIELD("request"),
             FIELDEND
@@ -1709,7 +1999,7 @@ doDNSMetricName(metric_t type, net_info *net)
                 PROC_FIELD(g_proc.procname),
                 PID_FIELD(g_proc.pid),
                 HOST_FIELD(g_proc.hostname),
-                DOMAIN_FIELD(net->dnsName),
+                DOMAIN_FIELD(dns->dnsName),
                 NUMOPS_FIELD(cachedDurationNum),
                 UNIT_FIELD("millisecond"),
                 FIELDEND
@@ -1742,7 +2032,7 @@ doDNSMetricName(metric_t type, net_info *net)
             PROC_FIELD(g_proc.procname),
             PID_FIELD(g_proc.pid),
             HOST_FIELD(g_proc.hostname),
-            DOMAIN_FIELD(net->dnsName),
+            DOMAIN_FIELD(dns->dnsName),
             NUMOPS_FIELD(cachedDurationNum),
             UNIT_FIELD("millisecond"),
             FIELDEND
@@ -1761,6 +2051,43 @@ doDNSMetricName(metric_t type, net_info *net)
     }
 }
 
+/*
+ * What a counter that only goes up did since the last period. Nothing is
+ * reported without a last value (-1), or when the counter went down; as a
+ * child's do after a fork, or a cgroup's when the process is moved.
+ */
+static void
+doProcDelta(const char *name, long long value, long long *last, const char *unit)
+{
+    long long prev = *last;
+    *last = value;
+    if ((prev < 0) || (value < prev)) return;
+
+    event_field_t fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        UNIT_FIELD(unit),
+        FIELDEND
+    };
+    event_t event = INT_EVENT(name, value - prev, DELTA, fields);
+    sendEvent(g_mtc, &event);
+}
+
+static void
+procStatMetric(const char *name, long long value, const char *unit)
+{
+    event_field_t fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        UNIT_FIELD(unit),
+        FIELDEND
+    };
+    event_t event = INT_EVENT(name, value, CURRENT, fields);
+    sendEvent(g_mtc, &event);
+}
+
 void
 doProcMetric(metric_t type)
 {
@@ -1810,27 +2137,25 @@ doProcMetric(metric_t type)
         break;
     }
 
-    case PROC_MEM:
+    case PROC_STAT:
     {
-        measurement = osGetProcMemory(g_proc.pid);
-        if (measurement == -1) {
+        // One read of /proc/<pid>/stat for all of these
+        proc_stat_t stat;
+        if (!osGetProcStat(g_proc.pid, &stat)) {
+            // as when there are none
+            procStatMetric("proc.child", 0, "process");
             return;
         }
-        event_field_t fields[] = {
-            PROC_FIELD(g_proc.procname),
-            PID_FIELD(g_proc.pid),
-            HOST_FIELD(g_proc.hostname),
-            UNIT_FIELD("kibibyte"),
-            FIELDEND
-        };
-        event_t event = INT_EVENT("proc.mem", measurement, CURRENT, fields);
-        sendEvent(g_mtc, &event);
+        procStatMetric("proc.mem", stat.vsize, "kibibyte");
+        procStatMetric("proc.thread", stat.threads, "thread");
+        procStatMetric("proc.child", stat.threads - 1, "process");
+        procStatMetric("proc.rss", stat.rss, "kibibyte");
         break;
     }
 
-    case PROC_THREAD:
+    case PROC_FD:
     {
-        measurement = osGetNumThreads(g_proc.pid);
+        measurement = osGetNumFds(g_proc.pid);
         if (measurement == -1) {
             return;
         }
@@ -1839,49 +2164,72 @@ doProcMetric(metric_t type)
             PROC_FIELD(g_proc.procname),
             PID_FIELD(g_proc.pid),
             HOST_FIELD(g_proc.hostname),
-            UNIT_FIELD("thread"),
+            UNIT_FIELD("file"),
             FIELDEND
         };
-        event_t event = INT_EVENT("proc.thread", measurement, CURRENT, fields);
+        event_t event = INT_EVENT("proc.fd", measurement, CURRENT, fields);
         sendEvent(g_mtc, &event);
         break;
     }
 
-    case PROC_FD:
+    /*
+     * Counted since the process started; the first period reports all of
+     * it. What the periodic thread did is left out. It wakes up every
+     * millisecond, which would be most of the voluntary switches of an
+     * idle process. At exit, on another thread, there's no telling what
+     * it did since the last period; that part of a period isn't reported.
+     */
+    case PROC_RUSAGE:
     {
-        measurement = osGetNumFds(g_proc.pid);
-        if (measurement == -1) {
+        static long long volState = 0, involState = 0;
+        static long long majorState = 0, minorState = 0;
+        proc_rusage_t usage, ours = {0};
+        if (!t_periodic && (g_periodic_pid == g_proc.pid)) {
             return;
         }
-
-        event_field_t fields[] = {
-            PROC_FIELD(g_proc.procname),
-            PID_FIELD(g_proc.pid),
-            HOST_FIELD(g_proc.hostname),
-            UNIT_FIELD("file"),
-            FIELDEND
-        };
-        event_t event = INT_EVENT("proc.fd", measurement, CURRENT, fields);
-        sendEvent(g_mtc, &event);
+        if (!osGetProcRusage(RUSAGE_SELF, &usage) ||
+            (t_periodic && !osGetProcRusage(RUSAGE_THREAD, &ours))) {
+            return;
+        }
+        usage.volCtxSwitch -= ours.volCtxSwitch;
+        usage.involCtxSwitch -= ours.involCtxSwitch;
+        usage.majorFaults -= ours.majorFaults;
+        usage.minorFaults -= ours.minorFaults;
+        doProcDelta("proc.ctx_switch_vol", usage.volCtxSwitch, &volState, "switch");
+        doProcDelta("proc.ctx_switch_invol", usage.involCtxSwitch, &involState, "switch");
+        doProcDelta("proc.fault_major", usage.majorFaults, &majorState, "fault");
+        doProcDelta("proc.fault_minor", usage.minorFaults, &minorState, "fault");
         break;
     }
 
-    case PROC_CHILD:
+    case PROC_IO:
     {
-        measurement = osGetNumChildProcs(g_proc.pid);
-        if (measurement < 0) {
-            measurement = 0;
+        static long long readState = 0, writeState = 0;
+        long long readBytes, writeBytes;
+        if (!osGetProcIo(g_proc.pid, &readBytes, &writeBytes)) {
+            return;
         }
+        doProcDelta("proc.io_read", readBytes, &readState, "byte");
+        doProcDelta("proc.io_write", writeBytes, &writeState, "byte");
+        break;
+    }
 
-        event_field_t fields[] = {
-            PROC_FIELD(g_proc.procname),
-            PID_FIELD(g_proc.pid),
-            HOST_FIELD(g_proc.hostname),
-            UNIT_FIELD("process"),
-            FIELDEND
-        };
-        event_t event = INT_EVENT("proc.child", measurement, CURRENT, fields);
-        sendEvent(g_mtc, &event);
+    // Counted since the cgroup was created; the first period is a baseline
+    case PROC_CGROUP:
+    {
+        static long long cpuState = -1, memState = -1, ioState = -1;
+        static long long throttledState = -1;
+        cgroup_stats_t stats;
+        if (!osGetCgroupStats(g_proc.pid, &stats)) {
+            return;
+        }
+        if (stats.moved) {
+            cpuState = memState = ioState = throttledState = -1;
+        }
+        doProcDelta("proc.cgroup.cpu_pressure", stats.cpuPressure, &cpuState, "microsecond");
+        doProcDelta("proc.cgroup.mem_pressure", stats.memPressure, &memState, "microsecond");
+        doProcDelta("proc.cgroup.io_pressure", stats.ioPressure, &ioState, "microsecond");
+        doProcDelta("proc.cgroup.cpu_throttled", stats.cpuThrottled, &throttledState, "microsecond");
         break;
     }
 
@@ -2209,6 +2557,37 @@ doFSCloseEvent(fs_info *fs, const char *op)
     }
 }
 
+// Adds what the descriptor did to its path. A live descriptor's counts
+// are taken as they're added to; a closed one's are its last.
+void
+doFSPathMetric(fs_info *fs, control_type_t source)
+{
+    if (!g_fs_agg || !fs || (fs->path[0] == '\0')) return;
+
+    fs_agg_counts_t counts;
+    if (source == PERIODIC) {
+        counts.opens = atomicSwapU64(&fs->numOpen.mtc, 0);
+        counts.reads = atomicSwapU64(&fs->numRead.mtc, 0);
+        counts.readBytes = atomicSwapU64(&fs->readBytes.mtc, 0);
+        counts.writes = atomicSwapU64(&fs->numWrite.mtc, 0);
+        counts.writeBytes = atomicSwapU64(&fs->writeBytes.mtc, 0);
+        counts.seeks = atomicSwapU64(&fs->numSeek.mtc, 0);
+        counts.durations = atomicSwapU64(&fs->numDuration.mtc, 0);
+        counts.durationTotal = atomicSwapU64(&fs->totalDuration.mtc, 0);
+    } else {
+        counts.opens = fs->numOpen.mtc;
+        counts.reads = fs->numRead.mtc;
+        counts.readBytes = fs->readBytes.mtc;
+        counts.writes = fs->numWrite.mtc;
+        counts.writeBytes = fs->writeBytes.mtc;
+        counts.seeks = fs->numSeek.mtc;
+        counts.durations = fs->numDuration.mtc;
+        counts.durationTotal = fs->totalDuration.mtc;
+    }
+
+    fsAggAddCounts(g_fs_agg, fs->path, &counts);
+}
+
 void
 doFSMetric(metric_t type, fs_info *fs, control_type_t source,
            const char *op, ssize_t size, const char *pathname)
@@ -2767,6 +3146,50 @@ doTotalDuration(metric_t type)
     atomicSwapU64(&num->mtc, 0);
 }
 
+// Adds what the socket did to its remote endpoint. A live socket's counts
+// are taken as they're added to; a closed one's are its last. The
+// connection itself is counted once, when its remote end is known.
+// A datagram socket that isn't connected has no one remote end; the
+// address it last used is only that.
+void
+doNetRemoteMetric(net_info *net, control_type_t source)
+{
+    if (!g_net_agg || !net) return;
+
+    bool unconnected = (net->type != SOCK_STREAM) && !net->connected;
+    if (!addrIsNetDomain(&net->remoteConn) &&
+        !(unconnected && addrIsNetDomain(&net->localConn))) return;
+
+    net_agg_counts_t counts = {0};
+    if (source == PERIODIC) {
+        counts.rx = atomicSwapU64(&net->numRX.mtc, 0);
+        counts.rxBytes = atomicSwapU64(&net->rxBytes.mtc, 0);
+        counts.tx = atomicSwapU64(&net->numTX.mtc, 0);
+        counts.txBytes = atomicSwapU64(&net->txBytes.mtc, 0);
+        counts.errors = atomicSwapU64(&net->connectErrors, 0);
+    } else {
+        counts.rx = net->numRX.mtc;
+        counts.rxBytes = net->rxBytes.mtc;
+        counts.tx = net->numTX.mtc;
+        counts.txBytes = net->txBytes.mtc;
+        counts.errors = net->connectErrors;
+    }
+
+    // A stream socket's remote end is set when it's connected; a failed
+    // connect sets only the address it was trying to reach
+    if (!net->remoteCounted && ((net->type != SOCK_STREAM) || net->addrSetRemote)) {
+        net->remoteCounted = TRUE;
+        counts.connections = 1;
+        if (net->connectDuration) {
+            counts.connects = 1;
+            counts.connectDuration = net->connectDuration;
+        }
+    }
+
+    netAggAddCounts(g_net_agg, &net->localConn, (unconnected) ? NULL : &net->remoteConn,
+                    net->type, net->inbound, &counts);
+}
+
 void
 doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
 {
@@ -3274,7 +3697,11 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
         // For next time
         net->dnsSend = FALSE;
 
-        doDNSMetricName(DNS, net);
+        dns_info dns = {.evtype = EVT_DNS, .data_type = DNS, .fd = net->fd,
+                        .totalDuration = net->totalDuration};
+        scope_memmove(&dns.counters, &net->counters, sizeof(dns.counters));
+        scope_memmove(dns.dnsName, net->dnsName, sizeof(dns.dnsName));
+        doDNSMetricName(DNS, &dns);
 
         break;
     }
@@ -3341,7 +3768,6 @@ reportCapturedMetric(const captured_metric_t *metric)
 {
     if (!metric) return;
 
-    const char *value = (const char *)metric->value; // casting away unsigned
     const char *name = (const char *)metric->name; // casting away unsigned
 
     event_field_t builtInFields[] = {
@@ -3352,35 +3778,14 @@ reportCapturedMetric(const captured_metric_t *metric)
     };
     event_field_t *capturedFields = createFieldsForCapturedMetrics(metric->dims);
 
-    // Look for a decimal point.  Comma allows for localization, even
-    // though the regex that creates value currently using does not.
+    // The value was converted when the metric was captured
     event_t out_mtc;
-    char *endptr = NULL;
-    if (scope_strpbrk(value, ".,")) {
-        // Value looks like a floating point value...
-        scope_errno = 0;
-        double doubleval = scope_strtod(value, &endptr);
-        if ((endptr == value) || (scope_errno != 0)) {
-            if (scope_errno == ERANGE) {
-                char *underover = (doubleval == 0.0) ? "underflow" : "overflow";
-                DBG("Couldn't be converted to float: %s (%s)", value, underover);
-            } else {
-                DBG("Couldn't be converted to float: %s", value);
-            }
-            goto out;
-        }
-        event_t flt_met = FLT_EVENT(name, doubleval, typeFromStr(metric->type), builtInFields);
-        scope_memmove(&out_mtc, &flt_met, sizeof(event_t));
-    } else {
-        // Value looks like an integer value...
-        scope_errno = 0;
-        long long int intval = scope_strtoll(value, &endptr, 10);
-        if ((endptr == value) || (scope_errno != 0)) {
-            DBG("Couldn't be converted to long long: %s", value);
-            goto out;
-        }
-        event_t int_met = INT_EVENT(name, intval, typeFromStr(metric->type), builtInFields);
+    if (metric->isint) {
+        event_t int_met = INT_EVENT(name, metric->intval, typeFromStr(metric->type), builtInFields);
         scope_memmove(&out_mtc, &int_met, sizeof(event_t));
+    } else {
+        event_t flt_met = FLT_EVENT(name, metric->fltval, typeFromStr(metric->type), builtInFields);
+        scope_memmove(&out_mtc, &flt_met, sizeof(event_t));
     }
 
     out_mtc.capturedFields = capturedFields;
@@ -3388,7 +3793,6 @@ reportCapturedMetric(const captured_metric_t *metric)
         scopeLogDebug("reportCapturedMetric:cmdSendMetric");
     }
 
-out:
     if (capturedFields) scope_free(capturedFields);
 }
 
@@ -3423,10 +3827,205 @@ doConnection(void)
 void
 doHttpAgg()
 {
+    uint64_t evicted = atomicSwapU64(&g_http2_evicted, 0);
+
     if (cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_HTTP)) {
         httpAggSendReport(g_http_agg, g_mtc);
+        grpcAggSendReport(g_grpc_agg, g_mtc);
+
+        if (evicted) {
+            event_field_t fields[] = {
+                PROC_FIELD(g_proc.procname),
+                PID_FIELD(g_proc.pid),
+                HOST_FIELD(g_proc.hostname),
+                UNIT_FIELD("request"),
+                FIELDEND
+            };
+            event_t evt = INT_EVENT("http.stream.evicted", evicted, DELTA, fields);
+            cmdSendMetric(g_mtc, &evt);
+        }
     }
     httpAggReset(g_http_agg);
+    grpcAggReset(g_grpc_agg);
+}
+
+void
+doFSAgg(void)
+{
+    if (!g_fs_agg) return;
+
+    if (cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_FS)) {
+        fsAggSendReport(g_fs_agg, g_mtc);
+    }
+    fsAggReset(g_fs_agg);
+}
+
+void
+doNetAgg(void)
+{
+    if (!g_net_agg) return;
+
+    if (cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_NET)) {
+        netAggSendReport(g_net_agg, g_mtc);
+    }
+    netAggReset(g_net_agg);
+}
+
+void
+doDNSRepeats(void)
+{
+    dnsCacheFlush(g_dns_cache);
+}
+
+void
+doStatsdAgg(void)
+{
+    // send the statsd metrics captured and aggregated this period
+    reportAllCapturedMetrics();
+}
+
+static const struct {
+    const char *name;
+    metric_watch_t watch;
+} g_latency[HISTO_CLASSES] = {
+    [HISTO_READ]    = {"fs.read.latency",     CFG_MTC_FS},
+    [HISTO_WRITE]   = {"fs.write.latency",    CFG_MTC_FS},
+    [HISTO_OPEN]    = {"fs.open.latency",     CFG_MTC_FS},
+    [HISTO_STAT]    = {"fs.stat.latency",     CFG_MTC_FS},
+    [HISTO_CONNECT] = {"net.connect.latency", CFG_MTC_NET},
+    [HISTO_DNS]     = {"dns.latency",         CFG_MTC_DNS},
+};
+
+// Whether the latency of an operation is recorded; see doLatencyMetric()
+bool
+latencyEnabled(histo_class_t cls)
+{
+    return (cls < HISTO_CLASSES) && mtcEnabled(g_mtc) &&
+           cfgMtcWatchEnable(g_cfg.staticfg, g_latency[cls].watch);
+}
+
+// When to time an operation from, or 0 when it doesn't need timing
+uint64_t
+latencyStartTime(histo_class_t cls)
+{
+    return latencyEnabled(cls) ? getTime() : 0;
+}
+
+/*
+ * Latency histograms, see histo.h, laid out the way Prometheus lays out a
+ * histogram. <name>.bucket is sent once per bucket with the bucket's upper
+ * bound, in microseconds, in "le"; each counts the operations in that
+ * bucket and all the ones below it. <name>.count is all of them. As statsd
+ * counters with an le tag, the buckets add up across processes and hosts.
+ *
+ * Buckets below the first and above the last with anything in them aren't
+ * sent; they'd be 0, or the same as +Inf.
+ */
+void
+doLatencyMetric(void)
+{
+    histo_t histo;
+    char bucket[64], count[64], le[24];
+    int cls, b;
+
+    for (cls = 0; cls < HISTO_CLASSES; cls++) {
+        // Taken either way, so that a period isn't reported twice
+        histoGet(cls, &histo);
+        if (!latencyEnabled(cls)) continue;
+
+        // Don't report zeros
+        if (!histo.count) continue;
+
+        int first = 0, last = HISTO_BUCKETS - 1;
+        while (!histo.bucket[first]) first++;
+        while (!histo.bucket[last]) last--;
+        if (last == HISTO_BUCKETS - 1) last--;
+
+        scope_snprintf(bucket, sizeof(bucket), "%s.bucket", g_latency[cls].name);
+        scope_snprintf(count, sizeof(count), "%s.count", g_latency[cls].name);
+
+        uint64_t total = 0;
+        for (b = 0; b <= last; b++) {
+            total += histo.bucket[b];
+            if (b < first) continue;
+            scope_snprintf(le, sizeof(le), "%llu", 1ULL << b);
+            event_field_t fields[] = {
+                PROC_FIELD(g_proc.procname),
+                PID_FIELD(g_proc.pid),
+                HOST_FIELD(g_proc.hostname),
+                LE_FIELD(le),
+                UNIT_FIELD("operation"),
+                FIELDEND
+            };
+            event_t evt = INT_EVENT(bucket, total, DELTA, fields);
+            cmdSendMetric(g_mtc, &evt);
+        }
+
+        event_field_t fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            LE_FIELD("+Inf"),
+            UNIT_FIELD("operation"),
+            FIELDEND
+        };
+        event_t inf = INT_EVENT(bucket, histo.count, DELTA, fields);
+        cmdSendMetric(g_mtc, &inf);
+
+        event_field_t cfields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            UNIT_FIELD("operation"),
+            FIELDEND
+        };
+        event_t evt = INT_EVENT(count, histo.count, DELTA, cfields);
+        cmdSendMetric(g_mtc, &evt);
+    }
+}
+
+// libscope's own memory; see arena.h
+void
+doArenaMetric(void)
+{
+    arena_stats_t stats;
+    arenaGetStats(&stats);
+
+    event_field_t fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        UNIT_FIELD("byte"),
+        FIELDEND
+    };
+    event_t size = INT_EVENT("scope.arena.size", stats.heapBytes, CURRENT, fields);
+    cmdSendMetric(g_mtc, &size);
+    event_t depot = INT_EVENT("scope.arena.free", stats.depotBytes, CURRENT, fields);
+    cmdSendMetric(g_mtc, &depot);
+
+    event_field_t opfields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        UNIT_FIELD("operation"),
+        FIELDEND
+    };
+    if (stats.refills) {
+        event_t refills = INT_EVENT("scope.arena.refill", stats.refills, DELTA, opfields);
+        cmdSendMetric(g_mtc, &refills);
+    }
+    if (stats.largeAllocs) {
+        event_t large = INT_EVENT("scope.arena.large", stats.largeAllocs, DELTA, opfields);
+        cmdSendMetric(g_mtc, &large);
+    }
+    if (stats.hits) {
+        event_t hits = INT_EVENT("scope.arena.hit", stats.hits, DELTA, opfields);
+        cmdSendMetric(g_mtc, &hits);
+    }
+    if (stats.misses) {
+        event_t misses = INT_EVENT("scope.arena.miss", stats.misses, DELTA, opfields);
+        cmdSendMetric(g_mtc, &misses);
+    }
 }
 
 // Somewhat arbitrary value. Heuristically, on one machine,
@@ -3454,10 +4053,20 @@ doEvent()
 
             if (event->evtype == EVT_NET) {
                 net = (net_info *)data;
-                doNetMetric(net->data_type, net, EVENT_BASED, 0);
+                bool report = TRUE;
+                if ((net->data_type == CONNECTION_DURATION) && g_summary.net.remote) {
+                    doNetRemoteMetric(net, EVENT_BASED);
+                    // A close with nothing sent or received was only posted for that
+                    report = net->rxBytes.evt || net->txBytes.evt ||
+                             net->rxBytes.mtc || net->txBytes.mtc;
+                }
+                if (report) doNetMetric(net->data_type, net, EVENT_BASED, 0);
             } else if (event->evtype == EVT_FS) {
                 fs = (fs_info *)data;
                 doFSMetric(fs->data_type, fs, EVENT_BASED, fs->funcop, 0, fs->path);
+                if ((fs->data_type == FS_CLOSE) && g_summary.fs.paths) {
+                    doFSPathMetric(fs, EVENT_BASED);
+                }
             } else if (event->evtype == EVT_ERR) {
                 staterr = (stat_err_info *)data;
                 doErrorMetric(staterr->data_type, EVENT_BASED, staterr->funcop, staterr->name, &staterr->counters);
@@ -3465,8 +4074,8 @@ doEvent()
                 staterr = (stat_err_info *)data;
                 doStatMetric(staterr->funcop, staterr->name, &staterr->counters);
             } else if (event->evtype == EVT_DNS) {
-                net = (net_info *)data;
-                doDNSMetricName(net->data_type, net);
+                dns_info *dns = (dns_info *)data;
+                doDNSMetricName(dns->data_type, dns);
             } else if (event->evtype == EVT_PROTO) {
                 proto = (protocol_info *)data;
                 doProtocolMetric(proto);
@@ -3495,7 +4104,7 @@ doEvent()
     }
 
 
-    reportAllCapturedMetrics();
+    collectCapturedMetrics();
     ctlFlushLog(g_ctl);
     ctlFlush(g_ctl);
 }
@@ -3593,7 +4202,7 @@ doPayload()
             if (rc < 0) {
                 // unlikely
                 if (pinfo->data) scope_free(pinfo->data);
-                if (pinfo) scope_free(pinfo);
+                if (pinfo) arenaFree(pinfo);
                 DBG(NULL);
                 return;
             }
@@ -3665,7 +4274,7 @@ doPayload()
 
             if (bdata) scope_free(bdata);
             if (pinfo->data) scope_free(pinfo->data);
-            if (pinfo) scope_free(pinfo);
+            if (pinfo) arenaFree(pinfo);
         }
     }
 }
@@ -6,6 +6,7 @@
 #include <sys/types.h>
 
 #include "ctl.h"
+#include "histo.h"
 #include "mtc.h"
 
 typedef enum {
@@ -22,10 +23,11 @@ typedef enum {
     CONNECTION_CLOSE,
     CONNECTION_DURATION,
     PROC_CPU,
-    PROC_MEM,
-    PROC_THREAD,
+    PROC_STAT,      // proc.mem, proc.thread, proc.child and proc.rss
     PROC_FD,
-    PROC_CHILD,
+    PROC_RUSAGE,
+    PROC_IO,
+    PROC_CGROUP,
     NETRX,
     NETTX,
     DNS,
@@ -91,12 +93,24 @@ extern ctl_t *g_ctl;
 void initReporting(void);
 void destroyReporting(void);
 void setReportingInterval(int);
+void setReportingFsPaths(config_t *);
+void setReportingNetTop(config_t *);
+void setReportingStatsDMaxSeries(config_t *);
+void setReportingThread(void);
 void doErrorMetric(metric_t, control_type_t, const char *, const char *, void *);
 void doProcMetric(metric_t);
 void doStatMetric(const char *, const char *, void *);
 void doTotal(metric_t);
 void doTotalDuration(metric_t);
 void doHttpAgg(void);
+void doFSAgg(void);
+void doNetAgg(void);
+void doDNSRepeats(void);
+void doStatsdAgg(void);
+void doArenaMetric(void);
+void doLatencyMetric(void);
+bool latencyEnabled(histo_class_t);
+uint64_t latencyStartTime(histo_class_t);
 void doEvent(void);
 void doPayload(void);
 void doProcStartMetric(void);
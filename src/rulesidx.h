@@ -0,0 +1,88 @@
+#ifndef __RULESIDX_H__
+#define __RULESIDX_H__
+
+#include <stdint.h>
+
+/*
+ * The layout of a compiled rules file, <rules file>.idx
+ *
+ * The loader compiles the index when it installs a rules file. libscope
+ * only ever maps it, and falls back to parsing the rules file when there
+ * is no index for it, or it can't be used.
+ *
+ * The index records the identity (device, inode, size and mtime) of the
+ * rules file it was compiled from; it's only used with that file. Only
+ * the config of an allow rule that matched is parsed, from the yaml text
+ * of it that was saved in the index.
+ *
+ * This header is shared by both; it has no dependencies of its own.
+ */
+#define RULES_IDX_MAGIC      0x58444952     // "RIDX"
+#define RULES_IDX_VERSION    1
+#define RULES_IDX_EXT        ".idx"
+#define RULES_IDX_MAX_SIZE   (64 * 1024 * 1024)
+
+// Index flags
+#define RULES_IDX_PARSED     0x1            // the rules file is valid yaml
+#define RULES_IDX_VALID      0x2            // with an allow or deny rule
+#define RULES_IDX_DENY_ALL   0x4            // a deny rule is _MatchAll_
+
+// The allow rules, in the order they're evaluated
+typedef enum {
+    RULES_OP_PROCNAME,      // str is the procname, hash its hash
+    RULES_OP_PROCNAME_ALL,
+    RULES_OP_ARG,           // str is the arg
+    RULES_OP_ARG_ALL,
+    RULES_OP_CONFIG,        // str is the config as yaml, len long
+} rules_op_type_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t hash;
+    uint32_t str;
+    uint32_t len;
+} rules_op_t;
+
+// The deny procnames are hashed into slots
+typedef struct {
+    uint32_t hash;
+    uint32_t str;           // 0 for an empty slot
+} rules_slot_t;
+
+// Offsets are from the start of the index; strings are at str offsets
+// from strOff, and are null terminated. The first byte isn't a string.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t flags;
+    uint64_t dev;           // of the rules file it was compiled from
+    uint64_t ino;
+    uint64_t fileSize;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+    uint32_t allowOff;      // rules_op_t[allowCount]
+    uint32_t allowCount;
+    uint32_t denyOff;       // rules_slot_t[denySlots], a power of 2
+    uint32_t denySlots;
+    uint32_t argOff;        // uint32_t[argCount], deny args
+    uint32_t argCount;
+    uint32_t unixPath;      // str of source.unixSocketPath, or 0
+    uint32_t strOff;
+    uint32_t strSize;
+    uint32_t pad;
+} rules_idx_hdr_t;
+
+// FNV-1a, of procnames
+static inline uint32_t
+rulesHash(const char *str)
+{
+    uint32_t hash = 0x811c9dc5;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+#endif // __RULESIDX_H__
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -252,6 +253,265 @@ doGotcha(struct link_map *lm, got_list_t *hook, Elf64_Rela *rel, Elf64_Sym *sym,
     return match;
 }
 
+/*
+ * The hooks are indexed with a perfect hash of their names, so that each
+ * relocation of an object is looked up with one hash and one compare
+ * instead of being compared with every hook in turn. Names hash to a
+ * bucket; each bucket has a displacement, found when the index is built,
+ * that sends all of its names to distinct slots.
+ */
+#define GOT_BUCKET_SIZE 4           // names per bucket, on average
+#define GOT_MAX_DISP    (1 << 16)   // before trying with more slots
+#define GOT_NO_BUCKET   UINT32_MAX  // for a name that's listed twice
+
+struct _got_index_t {
+    got_list_t **slot;
+    uint32_t nslots;                // a power of 2
+    uint32_t *disp;
+    uint32_t nbuckets;
+};
+
+static uint64_t
+gotHash(const char *name)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint32_t
+gotBucket(got_index_t *index, uint64_t hash)
+{
+    return (uint32_t)((hash * 0x9e3779b97f4a7c15ULL) >> 32) % index->nbuckets;
+}
+
+static uint32_t
+gotSlot(got_index_t *index, uint64_t hash, uint32_t disp)
+{
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    return (h1 + disp * h2) & (index->nslots - 1);
+}
+
+/*
+ * Place the names of each bucket, biggest buckets first, at the first
+ * displacement that lands them all in empty slots. Returns FALSE if some
+ * bucket can't be placed; the caller tries again with more slots.
+ */
+static bool
+gotIndexPlace(got_index_t *index, got_list_t *hooks, uint64_t *hash, uint32_t *bucket, uint32_t count)
+{
+    uint32_t *members = scope_calloc(count, sizeof(uint32_t));
+    uint32_t *slots = scope_calloc(count, sizeof(uint32_t));
+    uint32_t *size = scope_calloc(index->nbuckets, sizeof(uint32_t));
+    bool placed = FALSE;
+    if (!members || !slots || !size) goto out;
+
+    uint32_t i, b;
+    for (i = 0; i < count; i++) {
+        if (bucket[i] != GOT_NO_BUCKET) size[bucket[i]]++;
+    }
+
+    for (;;) {
+        // the biggest bucket that's left
+        uint32_t big = 0;
+        for (b = 1; b < index->nbuckets; b++) {
+            if (size[b] > size[big]) big = b;
+        }
+        if (!size[big]) break;
+
+        uint32_t n = 0;
+        for (i = 0; i < count; i++) {
+            if (bucket[i] == big) members[n++] = i;
+        }
+        size[big] = 0;
+
+        uint32_t disp;
+        for (disp = 0; disp < GOT_MAX_DISP; disp++) {
+            uint32_t m;
+            for (m = 0; m < n; m++) {
+                slots[m] = gotSlot(index, hash[members[m]], disp);
+                if (index->slot[slots[m]]) break;
+                uint32_t k;
+                for (k = 0; k < m; k++) {
+                    if (slots[k] == slots[m]) break;
+                }
+                if (k < m) break;
+            }
+            if (m == n) break;
+        }
+        if (disp == GOT_MAX_DISP) goto out;
+
+        index->disp[big] = disp;
+        uint32_t m;
+        for (m = 0; m < n; m++) {
+            index->slot[slots[m]] = &hooks[members[m]];
+        }
+    }
+    placed = TRUE;
+
+out:
+    if (members) scope_free(members);
+    if (slots) scope_free(slots);
+    if (size) scope_free(size);
+    return placed;
+}
+
+got_index_t *
+gotIndexCreate(got_list_t *hooks)
+{
+    if (!hooks) return NULL;
+
+    uint32_t count = 0, i, j;
+    while (hooks[count].symbol) count++;
+    if (!count) return NULL;
+
+    got_index_t *index = scope_calloc(1, sizeof(got_index_t));
+    uint64_t *hash = scope_calloc(count, sizeof(uint64_t));
+    uint32_t *bucket = scope_calloc(count, sizeof(uint32_t));
+    if (!index || !hash || !bucket) goto err;
+
+    index->nbuckets = (count + GOT_BUCKET_SIZE - 1) / GOT_BUCKET_SIZE;
+    index->disp = scope_calloc(index->nbuckets, sizeof(uint32_t));
+    if (!index->disp) goto err;
+
+    for (i = 0; i < count; i++) {
+        hash[i] = gotHash(hooks[i].symbol);
+        bucket[i] = gotBucket(index, hash[i]);
+
+        // A hook that's listed twice is indexed once, the first time
+        for (j = 0; j < i; j++) {
+            if ((hash[j] == hash[i]) && (bucket[j] != GOT_NO_BUCKET) &&
+                !scope_strcmp(hooks[j].symbol, hooks[i].symbol)) {
+                bucket[i] = GOT_NO_BUCKET;
+                break;
+            }
+        }
+    }
+
+    for (index->nslots = 4; index->nslots < 2 * count; index->nslots <<= 1);
+    for (; index->nslots <= 64 * count; index->nslots <<= 1) {
+        index->slot = scope_calloc(index->nslots, sizeof(got_list_t *));
+        if (!index->slot) goto err;
+        if (gotIndexPlace(index, hooks, hash, bucket, count)) {
+            scope_free(hash);
+            scope_free(bucket);
+            return index;
+        }
+        scope_free(index->slot);
+        index->slot = NULL;
+        scope_memset(index->disp, 0, index->nbuckets * sizeof(uint32_t));
+    }
+
+err:
+    DBG(NULL);
+    if (hash) scope_free(hash);
+    if (bucket) scope_free(bucket);
+    gotIndexDestroy(&index);
+    return NULL;
+}
+
+void
+gotIndexDestroy(got_index_t **index)
+{
+    if (!index || !*index) return;
+
+    got_index_t *idx = *index;
+    if (idx->slot) scope_free(idx->slot);
+    if (idx->disp) scope_free(idx->disp);
+    scope_free(idx);
+    *index = NULL;
+}
+
+got_list_t *
+gotIndexFind(got_index_t *index, const char *symbol)
+{
+    if (!index || !symbol) return NULL;
+
+    uint64_t hash = gotHash(symbol);
+    uint32_t disp = index->disp[gotBucket(index, hash)];
+    got_list_t *hook = index->slot[gotSlot(index, hash, disp)];
+    if (!hook || scope_strcmp(hook->symbol, symbol)) return NULL;
+    return hook;
+}
+
+/*
+ * Like doGotcha(), for every hook in the index at once; the relocations
+ * are scanned once and each entry is looked up in the index. filter, if
+ * given, is asked about each hook found before it's patched.
+ *
+ * GOT entries are next to one another, so a page made writable stays
+ * writable until an entry on another page comes up.
+ *
+ * Returns the number of entries patched.
+ */
+int
+doGotchaAll(struct link_map *lm, got_index_t *index, Elf64_Rela *rel, Elf64_Sym *sym, char *str, int rsz, bool attach, got_filter_t filter, void *data)
+{
+    if (!lm || !index || !rel || !sym || !str) return 0;
+
+    int i, patched = 0;
+    int page_size = scope_getpagesize();
+    size_t page = 0;        // the page of the last entry
+    int prot = -1;          // its protection, as we found it
+    bool opened = FALSE;    // and whether we made it writable
+
+    for (i = 0; i < rsz / sizeof(Elf64_Rela); i++) {
+        // see doGotcha() for how a relocation leads to its symbol and GOT entry
+        const char *name = sym[ELF64_R_SYM(rel[i].r_info)].st_name + str;
+        got_list_t *hook = gotIndexFind(index, name);
+        if (!hook) continue;
+        if (filter && !filter(hook, data)) continue;
+
+        uint64_t *gaddr = (uint64_t *)(rel[i].r_offset + lm->l_addr);
+        size_t saddr = ROUND_DOWN((size_t)gaddr, page_size);
+
+        if (saddr != page) {
+            if (opened && (osMemPermRestore((void *)page, 16, prot) == FALSE)) {
+                scopeLog(CFG_LOG_DEBUG, "doGotchaAll: osMemPermRestore remove write memory protection flags failed");
+            }
+            page = saddr;
+            opened = FALSE;
+
+            // without a valid protection for the GOT page, leave it alone
+            prot = osGetPageProt((uint64_t)gaddr);
+            if ((prot != -1) && ((prot & PROT_WRITE) == 0)) {
+                if (osMemPermAllow((void *)saddr, 16, prot, PROT_WRITE) == FALSE) {
+                    scopeLog(CFG_LOG_DEBUG, "doGotchaAll: osMemPermAllow add write protection flag failed");
+                    prot = -1;
+                } else {
+                    opened = TRUE;
+                }
+            }
+        }
+        if (prot == -1) continue;
+
+        uint64_t prev = *gaddr;
+        if (attach == TRUE) {
+            // been here before, don't update the GOT entry
+            if ((void *)*gaddr == hook->func) continue;
+            *gaddr = (uint64_t)hook->func;
+        } else {
+            // handle a detach operation
+            *gaddr = *(uint64_t *)hook->gfn;
+        }
+        patched++;
+
+        scopeLog(CFG_LOG_DEBUG, "%s:%d sym=%s offset 0x%lx GOT entry %p saddr 0x%lx, prev=0x%lx, curr=%p",
+                    __FUNCTION__, __LINE__, hook->symbol, rel[i].r_offset, gaddr, saddr, prev, hook->func);
+    }
+
+    if (opened && (osMemPermRestore((void *)page, 16, prot) == FALSE)) {
+        scopeLog(CFG_LOG_DEBUG, "doGotchaAll: osMemPermRestore remove write memory protection flags failed");
+    }
+
+    return patched;
+}
+
 // Locate the needed elf entries from a given link map.
 int
 getElfEntries(struct link_map *lm, Elf64_Rela **rel, Elf64_Sym **sym, char **str, int *rsz)
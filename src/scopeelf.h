@@ -12,6 +12,12 @@ typedef struct {
     void *gfn;
 } got_list_t;
 
+// Hooks indexed by symbol name; see gotIndexCreate()
+typedef struct _got_index_t got_index_t;
+
+// Asked by doGotchaAll() whether to patch a hook it found
+typedef bool (*got_filter_t)(got_list_t *, void *);
+
 typedef struct {
     char *cmd;
     char *buf;
@@ -23,6 +29,10 @@ typedef struct {
 void freeElf(char *, size_t);
 elf_buf_t * getElf(char *);
 int doGotcha(struct link_map *, got_list_t *, Elf64_Rela *, Elf64_Sym *, char *, int, bool);
+got_index_t *gotIndexCreate(got_list_t *);
+void gotIndexDestroy(got_index_t **);
+got_list_t *gotIndexFind(got_index_t *, const char *);
+int doGotchaAll(struct link_map *, got_index_t *, Elf64_Rela *, Elf64_Sym *, char *, int, bool, got_filter_t, void *);
 int getElfEntries(struct link_map *, Elf64_Rela **, Elf64_Sym **, char **, int *rsz);
 Elf64_Shdr* getElfSection(char *, const char *);
 void * getSymbol(const char *, char *);
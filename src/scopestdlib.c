@@ -116,6 +116,7 @@ extern char *              scopelibc_strcasestr(const char *, const char *);
 extern char *              scopelibc_strtok(char *, const char *);
 extern char *              scopelibc_strtok_r(char *, const char *, char **);
 extern const char *        scopelibc_gai_strerror(int);
+extern int                 scopelibc_fnmatch(const char *, const char *, int);
 
 // Network handling operations
 extern int               scopelibc_gethostname(char *, size_t);
@@ -222,6 +223,9 @@ extern int             scopelibc_mq_send(mqd_t, const char *, size_t, unsigned i
 extern ssize_t         scopelibc_mq_receive(mqd_t, char *, size_t, unsigned int *);
 extern int             scopelibc_mq_unlink(const char *);
 extern int             scopelibc_mq_getattr(mqd_t, struct mq_attr *);
+extern int             scopelibc_inotify_init1(int);
+extern int             scopelibc_inotify_add_watch(int, const char *, uint32_t);
+extern int             scopelibc_inotify_rm_watch(int, int);
 
 static int g_go_static;
 
@@ -752,6 +756,11 @@ scope_gai_strerror(int errcode) {
     return scopelibc_gai_strerror(errcode);
 }
 
+int
+scope_fnmatch(const char *pattern, const char *string, int flags) {
+    return scopelibc_fnmatch(pattern, string, flags);
+}
+
 
 // Network handling operations
 
@@ -1311,6 +1320,21 @@ scope_mq_getattr(mqd_t mqd, struct mq_attr *attr) {
     return scopelibc_mq_getattr(mqd, attr);
 }
 
+int
+scope_inotify_init1(int flags) {
+    return scopelibc_inotify_init1(flags);
+}
+
+int
+scope_inotify_add_watch(int fd, const char *pathname, uint32_t mask) {
+    return scopelibc_inotify_add_watch(fd, pathname, mask);
+}
+
+int
+scope_inotify_rm_watch(int fd, int wd) {
+    return scopelibc_inotify_rm_watch(fd, wd);
+}
+
 char *
 scope_secure_getenv(const char *name) {
     return getenv(name);
@@ -4,10 +4,12 @@
 #include <arpa/inet.h>
 #include <arpa/nameser.h>
 #include <dirent.h>
+#include <fnmatch.h>
 #include <grp.h>
 #include <link.h>
 #include <locale.h>
 #include <sys/auxv.h>
+#include <sys/inotify.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
@@ -210,6 +212,7 @@ char *             scope_strcasestr(const char *, const char *);
 char *             scope_strtok(char *, const char *);
 char *             scope_strtok_r(char *, const char *, char **);
 const char *       scope_gai_strerror(int);
+int                scope_fnmatch(const char *, const char *, int);
 
 // Network handling operations
 int             scope_gethostname(char *, size_t);
@@ -315,6 +318,9 @@ int           scope_mq_send(mqd_t, const char *, size_t, unsigned int);
 ssize_t       scope_mq_receive(mqd_t, char *, size_t, unsigned int *);
 int           scope_mq_unlink(const char *);
 int           scope_mq_getattr(mqd_t, struct mq_attr *);
+int           scope_inotify_init1(int);
+int           scope_inotify_add_watch(int, const char *, uint32_t);
+int           scope_inotify_rm_watch(int, int);
 
 
 #endif // __SCOPE_STDLIB_H__
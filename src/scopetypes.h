@@ -93,6 +93,8 @@ typedef struct
 } export_sm_t;
 
 #define CFG_MAX_VERBOSITY 9
+#define CFG_MAX_WATCH_TOP 1000
+#define CFG_MAX_STATSD_MAX_SERIES 65536
 #define CFG_FILE_NAME "scope.yml"
 
 #define DEFAULT_MTC_ENABLE TRUE
@@ -105,9 +107,11 @@ typedef struct
 #define DEFAULT_STATSD_MAX_LEN 512
 #define DEFAULT_STATSD_PREFIX ""
 #define DEFAULT_MTC_STATSD_ENABLE TRUE
+#define DEFAULT_STATSD_MAX_SERIES 2048
 #define DEFAULT_CUSTOM_TAGS NULL
 #define DEFAULT_NUM_TAGS 8
 #define DEFAULT_MTC_VERBOSITY 4
+#define DEFAULT_MTC_WATCH_TOP 0
 #define DEFAULT_COMMAND_DIR "/tmp"
 #define DEFAULT_LOG_LEVEL CFG_LOG_WARN
 #define DEFAULT_SUMMARY_PERIOD 10
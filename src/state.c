@@ -11,11 +11,14 @@
 #include <fcntl.h>
 #include <pthread.h>
 
+#include "arena.h"
 #include "atomic.h"
 #include "com.h"
 #include "dbg.h"
 #include "dns.h"
 #include "evtutils.h"
+#include "gocontext.h"
+#include "histo.h"
 #include "httpstate.h"
 #include "metriccapture.h"
 #include "mtcformat.h"
@@ -45,13 +48,24 @@ uint64_t g_http_guard[NET_ENTRIES];
 summary_t g_summary = {{0}};
 net_info *g_netinfo;
 fs_info *g_fsinfo;
+// Non-zero for descriptors the syscall filter in gocontext.S passes to
+// c_syscall. It's kept here, where descriptors start and stop being tracked,
+// so that it covers the ones opened through libc as well as through Go.
+// stdio always has an entry.
+uint8_t g_go_fd_filter[GO_FD_FILTER_SIZE] = {1, 1, 1};
 metric_counters g_ctrs = {{0}};
 int g_mtc_addr_output = TRUE;
+static bool g_net_batched = FALSE;
 static bool g_force_payloads_to_disk = FALSE;
 static protocol_def_t *g_tls_protocol_def = NULL;
 static protocol_def_t *g_http_protocol_def = NULL;
 static protocol_def_t *g_statsd_protocol_def = NULL;
 
+// The last DNS response decoded on this thread, by getDNSAnswer(), and
+// its descriptor. It goes out with the DNS event that doRecv() posts.
+static __thread dns_answer_t g_dns_answer;
+static __thread int g_dns_answer_fd = -1;
+
 // Linked list, indexed by channel ID, of net_info pointers used in
 // doProtocol() when it's not provided with a valid file descriptor.
 list_t *g_extra_net_info_list = NULL;
@@ -182,8 +196,7 @@ addProtocol(request_t *req)
 
     proto = req->protocol;
 
-    proto->re = pcre2_compile((PCRE2_SPTR)proto->regex, PCRE2_ZERO_TERMINATED,
-                              0, &errornumber, &erroroffset, NULL);
+    proto->re = regexCompile(proto->regex, &errornumber, &erroroffset);
 
     if (proto->re == NULL) {
         destroyProtEntry(proto);
@@ -215,16 +228,11 @@ initPayloadDetect(void)
     g_tls_protocol_def->binary = TRUE;
     g_tls_protocol_def->len = PAYLOAD_BYTESRC;
     g_tls_protocol_def->regex = PAYLOAD_REGEX;
-    g_tls_protocol_def->re = pcre2_compile((PCRE2_SPTR)g_tls_protocol_def->regex,
-                                           PCRE2_ZERO_TERMINATED, 0,
-                                           &errornumber, &erroroffset, NULL);
+    g_tls_protocol_def->re = regexCompile(g_tls_protocol_def->regex,
+                                          &errornumber, &erroroffset);
     if (g_tls_protocol_def->re == NULL) {
         goto error;
     }
-    g_tls_protocol_def->match_data = pcre2_match_data_create_from_pattern(g_tls_protocol_def->re, NULL);
-    if (g_tls_protocol_def->match_data == NULL) {
-        goto error;
-    }
 
     // Setup the HTTP protocol-detect regex
     errornumber = 0;
@@ -233,16 +241,11 @@ initPayloadDetect(void)
     g_http_protocol_def->protname = "HTTP";
     g_http_protocol_def->regex = "(?:HTTP\\/1\\.[0-2]|PRI \\* HTTP\\/2\\.0\r\n\r\nSM\r\n\r\n)";
     g_http_protocol_def->detect = TRUE;
-    g_http_protocol_def->re = pcre2_compile((PCRE2_SPTR)g_http_protocol_def->regex,
-                                            PCRE2_ZERO_TERMINATED, 0,
-                                            &errornumber, &erroroffset, NULL);
+    g_http_protocol_def->re = regexCompile(g_http_protocol_def->regex,
+                                           &errornumber, &erroroffset);
     if (g_http_protocol_def->re == NULL) {
         goto error;
     }
-    g_http_protocol_def->match_data = pcre2_match_data_create_from_pattern(g_http_protocol_def->re, NULL);
-    if (g_http_protocol_def->match_data == NULL) {
-        goto error;
-    }
 
     // Setup the StatsD protocol-detect regex
     errornumber = 0;
@@ -251,16 +254,11 @@ initPayloadDetect(void)
     g_statsd_protocol_def->protname = "STATSD";
     g_statsd_protocol_def->regex = "^([^:]+):([\\d.]+)\\|(c|g|ms|s|h)";
     g_statsd_protocol_def->detect = TRUE;
-    g_statsd_protocol_def->re = pcre2_compile((PCRE2_SPTR)g_statsd_protocol_def->regex,
-                                            PCRE2_ZERO_TERMINATED, 0,
-                                            &errornumber, &erroroffset, NULL);
+    g_statsd_protocol_def->re = regexCompile(g_statsd_protocol_def->regex,
+                                             &errornumber, &erroroffset);
     if (g_statsd_protocol_def->re == NULL) {
         goto error;
     }
-    g_statsd_protocol_def->match_data = pcre2_match_data_create_from_pattern(g_statsd_protocol_def->re, NULL);
-    if (g_statsd_protocol_def->match_data == NULL) {
-        goto error;
-    }
 
     return;
 
@@ -279,21 +277,28 @@ static void
 destroyPayloadDetect(void) {
     if (g_statsd_protocol_def) {
         pcre2_code_free(g_statsd_protocol_def->re);
-        pcre2_match_data_free(g_statsd_protocol_def->match_data);
         scope_free(g_statsd_protocol_def);
     }
     if (g_http_protocol_def) {
         pcre2_code_free(g_http_protocol_def->re);
-        pcre2_match_data_free(g_http_protocol_def->match_data);
         scope_free(g_http_protocol_def);
     }
     if (g_tls_protocol_def) {
         pcre2_code_free(g_tls_protocol_def->re);
-        pcre2_match_data_free(g_tls_protocol_def->match_data);
         scope_free(g_tls_protocol_def);
     }
 }
 
+/*
+ * The config adds to the protocol list, and every process reads its
+ * config; the rest of our state is only needed by one that's scoped.
+ */
+void
+initProtocolList(void)
+{
+    if (!g_protlist) g_protlist = lstCreate(destroyProtEntry);
+}
+
 void
 initState(void)
 {
@@ -325,7 +330,7 @@ initState(void)
         g_http_guard_enabled = (spin_env && !scope_strcmp(spin_env, "true"));
     }
 
-    g_protlist = lstCreate(destroyProtEntry);
+    initProtocolList();
     initPayloadDetect();
 
     g_extra_net_info_list = lstCreate(destroyNetInfo);
@@ -337,6 +342,7 @@ void
 resetState(void)
 {
     scope_memset(&g_ctrs, 0, sizeof(struct metric_counters_t));
+    histoReset();
 }
 
 void
@@ -437,8 +443,12 @@ postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const cha
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
+    // Bail if only events need it and they're being rate limited
+    if (!(mtcEnabled(g_mtc) && mtc_needs_reporting) &&
+        ctlEvtRateLimited(g_ctl, CFG_SRC_METRIC)) return FALSE;
+
     size_t len = sizeof(struct stat_err_info_t);
-    stat_err_info *sep = scope_calloc(1, len);
+    stat_err_info *sep = arenaCalloc(1, len);
     if (!sep) return FALSE;
 
     sep->evtype = stat_err;
@@ -483,14 +493,26 @@ postFSState(int fd, metric_t type, fs_info *fs, const char *funcop, const char *
 
     // Bail if we don't need to post
     int mtc_needs_reporting = summarize && !*summarize;
+
+    // A close takes what's left of the descriptor's counts to its path,
+    // if the periodic report hasn't already taken all of them
+    if ((type == FS_CLOSE) && g_summary.fs.paths && fs &&
+        (fs->numOpen.mtc || fs->numRead.mtc || fs->numWrite.mtc || fs->numSeek.mtc)) {
+        mtc_needs_reporting = TRUE;
+    }
+
     int need_to_post =
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_FS) ||
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
+    // Bail if only events need it and they're being rate limited
+    if (!(mtcEnabled(g_mtc) && mtc_needs_reporting) &&
+        ctlEvtRateLimited(g_ctl, CFG_SRC_FS)) return FALSE;
+
     size_t len = sizeof(struct fs_info_t);
-    fs_info *fsp = scope_calloc(1, len);
+    fs_info *fsp = arenaCalloc(1, len);
     if (!fsp) return FALSE;
 
     if (fs) scope_memmove(fsp, fs, len);
@@ -522,26 +544,40 @@ postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
-    size_t len = sizeof(struct net_info_t);
-    net_info *netp = scope_calloc(1, len);
-    if (!netp) return FALSE;
+    // Bail if only events need it and they're being rate limited
+    if (!(mtcEnabled(g_mtc) && mtc_needs_reporting) &&
+        ctlEvtRateLimited(g_ctl, CFG_SRC_DNS)) return FALSE;
 
-    if (net) scope_memmove(netp, net, len);
-    netp->fd = fd;
-    netp->evtype = EVT_DNS;
-    netp->data_type = type;
+    dns_info *dnsp = arenaCalloc(1, sizeof(dns_info));
+    if (!dnsp) return FALSE;
+
+    dnsp->fd = fd;
+    dnsp->evtype = EVT_DNS;
+    dnsp->data_type = type;
+
+    if (net) {
+        dnsp->totalDuration = net->totalDuration;
+        scope_memmove(dnsp->dnsName, net->dnsName, sizeof(dnsp->dnsName));
+    }
 
     if (duration > 0) {
-        addToInterfaceCounts(&netp->totalDuration, duration);
+        addToInterfaceCounts(&dnsp->totalDuration, duration);
     }
 
     if (domain) {
-        scope_strncpy(netp->dnsName, domain, scope_strnlen(domain, sizeof(netp->dnsName)));
+        scope_strncpy(dnsp->dnsName, domain, scope_strnlen(domain, sizeof(dnsp->dnsName)));
     }
 
-    scope_memmove(&netp->counters, &g_ctrs, sizeof(g_ctrs));
+    // The answer decoded from the response this thread just received
+    if ((type == DNS) && (fd != -1) && (g_dns_answer_fd == fd)) {
+        scope_memmove(&dnsp->answer, &g_dns_answer, sizeof(dnsp->answer));
+        dnsp->hasAnswer = TRUE;
+        g_dns_answer_fd = -1;
+    }
 
-    cmdPostEvent(g_ctl, (char *)netp);
+    scope_memmove(&dnsp->counters, &g_ctrs, sizeof(g_ctrs));
+
+    cmdPostEvent(g_ctl, (char *)dnsp);
 
     return mtc_needs_reporting;
 }
@@ -568,19 +604,29 @@ postNetState(int fd, metric_t type, net_info *net)
 
     // Bail if we don't need to post
     int mtc_needs_reporting = summarize && !*summarize;
+
+    // A close takes what's left of the socket's counts to its endpoint
+    if ((type == CONNECTION_DURATION) && g_summary.net.remote) mtc_needs_reporting = TRUE;
+
+    int http_needs_cleanup =
+        (type==CONNECTION_DURATION && net && (net->http[HTTP_RX].version || net->http[HTTP_TX].version));
     int need_to_post =
         // if raw metrics are enabled
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
         // if NET events are enabled
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_NET) ||
         // if it's a closed HTTP channel (so we can cleanup)
-        (type==CONNECTION_DURATION && net && (net->http[HTTP_RX].version || net->http[HTTP_TX].version)) ||
+        http_needs_cleanup ||
         // if metrics are enabled and it's one we report
         (mtcEnabled(g_mtc) && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
+    // Bail if only events need it and they're being rate limited
+    if (!http_needs_cleanup && !(mtcEnabled(g_mtc) && mtc_needs_reporting) &&
+        ctlEvtRateLimited(g_ctl, CFG_SRC_NET)) return FALSE;
+
     size_t len = sizeof(struct net_info_t);
-    net_info *netp = scope_calloc(1, len);
+    net_info *netp = arenaMalloc(len);
     if (!netp) return FALSE;
 
     scope_memmove(netp, net, len);
@@ -659,7 +705,8 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
         }
 
         if ((g_netinfo[fd].rxBytes.evt > 0) || (g_netinfo[fd].txBytes.evt > 0) ||
-            (g_netinfo[fd].rxBytes.mtc > 0) || (g_netinfo[fd].txBytes.mtc > 0)) {
+            (g_netinfo[fd].rxBytes.mtc > 0) || (g_netinfo[fd].txBytes.mtc > 0) ||
+            g_summary.net.remote) {
             if (postNetState(fd, type, &g_netinfo[fd])) {
                 atomicSwapU64(&g_netinfo[fd].numDuration.mtc, 0);
                 atomicSwapU64(&g_netinfo[fd].totalDuration.mtc, 0);
@@ -710,6 +757,10 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
         addToInterfaceCounts(&g_netinfo[fd].rxBytes, size);
         sock_summary_bucket_t bucket = getNetRxTxBucket(&g_netinfo[fd]);
         addToInterfaceCounts(&g_ctrs.netrxBytes[bucket], size);
+        if (g_net_batched) {
+            g_netinfo[fd].rxPending = TRUE;
+            break;
+        }
         if (postNetState(fd, type, &g_netinfo[fd])) {
             atomicSwapU64(&g_netinfo[fd].numRX.mtc, 0);
             atomicSwapU64(&g_netinfo[fd].rxBytes.mtc, 0);
@@ -727,6 +778,10 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
         addToInterfaceCounts(&g_netinfo[fd].txBytes, size);
         sock_summary_bucket_t bucket = getNetRxTxBucket(&g_netinfo[fd]);
         addToInterfaceCounts(&g_ctrs.nettxBytes[bucket], size);
+        if (g_net_batched) {
+            g_netinfo[fd].txPending = TRUE;
+            break;
+        }
         if (postNetState(fd, type, &g_netinfo[fd])) {
             atomicSwapU64(&g_netinfo[fd].numTX.mtc, 0);
             atomicSwapU64(&g_netinfo[fd].txBytes.mtc, 0);
@@ -763,8 +818,9 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
     {
         int rc;
 
+        if (latencyEnabled(HISTO_DNS)) histoRecord(HISTO_DNS, size);
         addToInterfaceCounts(&g_ctrs.dnsDurationNum, 1);
-        addToInterfaceCounts(&g_ctrs.dnsDurationTotal, 0);
+        addToInterfaceCounts(&g_ctrs.dnsDurationTotal, size);
 
         if (getNetEntry(fd)) {
             rc = postDNSState(fd, type, &g_netinfo[fd], size, pathname);
@@ -949,6 +1005,12 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
     }
 }
 
+static void
+setFdTracked(int fd, bool tracked)
+{
+    if ((fd > STDERR_FILENO) && (fd < GO_FD_FILTER_SIZE)) g_go_fd_filter[fd] = tracked;
+}
+
 bool
 isProtocolSet(int fd)
 {
@@ -958,11 +1020,48 @@ isProtocolSet(int fd)
     return FALSE;
 }
 
+static bool
+httpConsumerEnabled(void)
+{
+    return (cfgEvtEnable(g_cfg.staticfg) && cfgEvtFormatSourceEnabled(g_cfg.staticfg, CFG_SRC_HTTP)) ||
+           (cfgMtcEnable(g_cfg.staticfg) && cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_HTTP));
+}
+
+static bool
+statsdConsumerEnabled(void)
+{
+    return cfgMtcEnable(g_cfg.staticfg) && cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_STATSD);
+}
+
+/*
+ * Tells interpositions that have to work to get at a TLS payload (the
+ * Java agent goes through JNI for every buffer) whether doProtocol()
+ * would do anything with it. A negative sockfd only gets the global check.
+ */
+bool
+protocolConsumerEnabled(int sockfd)
+{
+    if (cfgPayEnable(g_cfg.staticfg)) return TRUE;
+
+    net_info *net = getNetEntry(sockfd);
+    if (net && net->protoDetect == DETECT_FALSE) return FALSE;
+    if (net && net->protoDetect == DETECT_TRUE && net->protoProtoDef) {
+        protocol_def_t *protoDef = net->protoProtoDef;
+        if (protoDef->payload) return TRUE;
+        if (!scope_strcasecmp(protoDef->protname, "HTTP")) return httpConsumerEnabled();
+        if (!scope_strcasecmp(protoDef->protname, "STATSD")) return statsdConsumerEnabled();
+        return FALSE;
+    }
+
+    // Detection is still pending; configured protocols may emit detect events
+    return httpConsumerEnabled() || statsdConsumerEnabled() ||
+           (g_prot_sequence && ctlEvtSourceEnabled(g_ctl, CFG_SRC_NET));
+}
+
 static bool
 setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size_t len)
 {
     char *data, *cpdata = NULL;
-    pcre2_match_data *match_data;
     protocol_info *proto;
     bool ret = FALSE;
 
@@ -1003,9 +1102,7 @@ setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size
         cvlen = cvlen * 2;
     }
 
-    match_data = pcre2_match_data_create_from_pattern(protoDef->re, NULL);
-    if (pcre2_match_wrapper(protoDef->re, (PCRE2_SPTR)data, (PCRE2_SIZE)cvlen, 0, 0,
-                            match_data, NULL) > 0) {
+    if (regexMatch(protoDef->re, (PCRE2_SPTR)data, (PCRE2_SIZE)cvlen, NULL) > 0) {
         scopeLog(CFG_LOG_DEBUG, "fd:%d detected %s", sockfd, protoDef->protname);
 
         if (net) {
@@ -1018,8 +1115,6 @@ setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size
             {
                 if (cpdata)
                     scope_free(cpdata);
-                if (match_data)
-                    pcre2_match_data_free(match_data);
                 return FALSE;
             }
             proto->len = sizeof(protocol_def_t);
@@ -1034,7 +1129,6 @@ setProtocol(int sockfd, protocol_def_t *protoDef, net_info *net, char *buf, size
         if (net) net->protoDetect = DETECT_FALSE;
     }
 
-    if (match_data) pcre2_match_data_free(match_data);
     if (cpdata) scope_free(cpdata);
 
     return ret;
@@ -1086,7 +1180,7 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
         return -1;
     }
 
-    payload_info *pinfo = scope_calloc(1, sizeof(struct payload_info_t));
+    payload_info *pinfo = arenaCalloc(1, sizeof(struct payload_info_t));
     if (!pinfo) {
         return -1;
     }
@@ -1094,7 +1188,7 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
     if (dtype == BUF) {
         pinfo->data = scope_calloc(1, len);
         if (!pinfo->data) {
-            scope_free(pinfo);
+            arenaFree(pinfo);
             return -1;
         }
         scope_memmove(pinfo->data, buf, len);
@@ -1109,7 +1203,7 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
                 char *temp = scope_realloc(pinfo->data, blen + iov->iov_len);
                 if (!temp) {
                     if (pinfo->data) scope_free(pinfo->data);
-                    scope_free(pinfo);
+                    arenaFree(pinfo);
                     return -1;
                 }
 
@@ -1128,7 +1222,7 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
                 char *temp = scope_realloc(pinfo->data, blen + iov[i].iov_len);
                 if (!temp) {
                     if (pinfo->data) scope_free(pinfo->data);
-                    scope_free(pinfo);
+                    arenaFree(pinfo);
                     return -1;
                 }
 
@@ -1140,7 +1234,7 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
         len = blen;
     } else {
         // no data, no need to continue
-        scope_free(pinfo);
+        arenaFree(pinfo);
         return -1;
     }
 
@@ -1165,7 +1259,7 @@ extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
 
     if (cmdPostPayload(g_ctl, (char *)pinfo) == -1) {
         if (pinfo->data) scope_free(pinfo->data);
-        if (pinfo) scope_free(pinfo);
+        if (pinfo) arenaFree(pinfo);
         return -1;
     }
 
@@ -1208,10 +1302,8 @@ detectTLS(int sockfd, net_info *net, void *buf, size_t len, metric_t src, src_da
     }
 
     // Apply the regex to the hex-string payload
-    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(tls_proto_def->re, NULL);
-    if ((rc = pcre2_match_wrapper(tls_proto_def->re, (PCRE2_SPTR)cpdata,
-                                  (PCRE2_SIZE)alen, 0, 0,
-                                  match_data, NULL)) > 0)
+    if ((rc = regexMatch(tls_proto_def->re, (PCRE2_SPTR)cpdata,
+                         (PCRE2_SIZE)alen, NULL)) > 0)
     {
         // matched, set the detect-state to TRUE
         net->tlsDetect = DETECT_TRUE;
@@ -1231,7 +1323,6 @@ detectTLS(int sockfd, net_info *net, void *buf, size_t len, metric_t src, src_da
             scopeLog(CFG_LOG_DEBUG, "%s: fd:%d TLS regex failed", __FUNCTION__, sockfd);
         }
     }
-    pcre2_match_data_free(match_data);
 }
 
 static void
@@ -1357,12 +1448,11 @@ doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_dat
         if (net && net->protoProtoDef) {
             // Process HTTP if detected and http or metrics are enabled
             if ((!scope_strcasecmp(net->protoProtoDef->protname, "HTTP")) &&
-                ((cfgEvtEnable(g_cfg.staticfg) && cfgEvtFormatSourceEnabled(g_cfg.staticfg, CFG_SRC_HTTP)) ||
-                 (cfgMtcEnable(g_cfg.staticfg) && (cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_HTTP))))) {
+                httpConsumerEnabled()) {
                 doHttp(sockfd, net, buf, len, src, dtype);
             }
 
-            if (cfgMtcEnable(g_cfg.staticfg) && cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_STATSD) &&
+            if (statsdConsumerEnabled() &&
                 !scope_strcasecmp(net->protoProtoDef->protname, "STATSD")) {
 
                 doMetricCapture(sockfd, net, buf, len, src, dtype);
@@ -1373,6 +1463,38 @@ doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_dat
     return TRUE;
 }
 
+/*
+ * With net batching on, receives and sends on a socket are only counted
+ * as they happen. What was counted is posted once a period, by reportFD(),
+ * and when the socket is closed; a net.rx or net.tx event carries the
+ * socket's totals, so one post covers any number of calls. It's on for
+ * Go apps, where servers can have many thousands of connections.
+ */
+void
+setNetBatched(bool batched)
+{
+    g_net_batched = batched;
+}
+
+static void
+postNetBatch(int fd, net_info *net)
+{
+    if (net->rxPending) {
+        net->rxPending = FALSE;
+        if (postNetState(fd, NETRX, net)) {
+            atomicSwapU64(&net->numRX.mtc, 0);
+            atomicSwapU64(&net->rxBytes.mtc, 0);
+        }
+    }
+    if (net->txPending) {
+        net->txPending = FALSE;
+        if (postNetState(fd, NETTX, net)) {
+            atomicSwapU64(&net->numTX.mtc, 0);
+            atomicSwapU64(&net->txBytes.mtc, 0);
+        }
+    }
+}
+
 void
 setVerbosity(unsigned verbosity)
 {
@@ -1384,12 +1506,23 @@ setVerbosity(unsigned verbosity)
     summarize->fs.stat =        (verbosity < 7);
     summarize->fs.seek =        (verbosity < 8);
     summarize->fs.read_write =  (verbosity < 9);
+    if (summarize->fs.paths) {
+        // What's by descriptor is reported by path instead
+        summarize->fs.open_close = TRUE;
+        summarize->fs.seek = TRUE;
+        summarize->fs.read_write = TRUE;
+    }
 
     summarize->net.error =      (verbosity < 5);
     summarize->net.dnserror =   (verbosity < 5);
     summarize->net.dns =        (verbosity < 6);
     summarize->net.open_close = (verbosity < 7);
     summarize->net.rx_tx =      (verbosity < 9);
+    if (summarize->net.remote) {
+        // What's by descriptor is reported by remote endpoint instead
+        summarize->net.open_close = TRUE;
+        summarize->net.rx_tx = TRUE;
+    }
 }
 
 bool
@@ -1451,7 +1584,7 @@ getFSEntry(int fd)
                 return NULL;
         }
 
-        doOpen(fd, name, FD, description);
+        doOpen(fd, 0, name, FD, description);
 
         return &g_fsinfo[fd];
     }
@@ -1530,6 +1663,7 @@ addSock(int fd, int type, int family)
 
         scope_memset(&g_netinfo[fd], 0, sizeof(struct net_info_t));
         g_netinfo[fd].active = TRUE;
+        setFdTracked(fd, TRUE);
         g_netinfo[fd].type = type;
         g_netinfo[fd].localConn.ss_family = family;
         g_netinfo[fd].uid = getTime();
@@ -1604,6 +1738,113 @@ doSetConnection(int sd, const struct sockaddr *addr, socklen_t len, control_type
     }
 }
 
+/*
+ * What a connect() did, for reporting by remote endpoint. duration is
+ * how long a successful one took. A failed one is counted against the
+ * address it was trying to reach.
+ */
+void
+doRemoteConnect(int sd, const struct sockaddr *addr, socklen_t len, uint64_t duration, int success)
+{
+    net_info *net;
+
+    if (!g_summary.net.remote || !addr || (len <= 0)) return;
+    if ((net = getNetEntry(sd)) == NULL) return;
+
+    net->connectPending = FALSE;
+    if (success) {
+        // connecting a datagram socket to AF_UNSPEC disconnects it
+        net->connected = (addr->sa_family != AF_UNSPEC);
+        net->connectDuration = duration;
+        return;
+    }
+
+    if (!net->addrSetRemote && (len <= sizeof(net->remoteConn))) {
+        scope_memmove(&net->remoteConn, addr, len);
+    }
+    atomicAddU64(&net->connectErrors, 1);
+}
+
+/*
+ * A non-blocking connect() that's in progress. The application learns how
+ * it went from poll() and getsockopt(SO_ERROR), which aren't interposed, so
+ * it's finished by the first send or receive on the socket, or its close.
+ * start is when it was called, or 0 if it isn't timed.
+ */
+void
+doRemoteConnectStart(int sd, const struct sockaddr *addr, socklen_t len, uint64_t start)
+{
+    net_info *net;
+
+    if ((!start && !g_summary.net.remote) || !addr || (len <= 0)) return;
+    if ((net = getNetEntry(sd)) == NULL) return;
+
+    // Until it's connected, it's counted against the address it's trying
+    if (g_summary.net.remote && !net->addrSetRemote && (len <= sizeof(net->remoteConn))) {
+        scope_memmove(&net->remoteConn, addr, len);
+    }
+    net->connectPending = TRUE;
+    net->connectStart = start;
+}
+
+// A send or receive worked, so it's connected. Timed to then; the time
+// it takes the application to notice is counted too.
+static void
+doRemoteConnectDone(net_info *net)
+{
+    if (!net->connectPending) return;
+
+    uint64_t duration = 0;
+    if (net->connectStart) {
+        duration = getDuration(net->connectStart);
+        histoRecord(HISTO_CONNECT, duration);
+    }
+    net->connectPending = FALSE;
+    net->connected = TRUE;
+    net->connectDuration = duration;
+}
+
+// Closed without a send or receive; it failed unless it has a peer
+static void
+doRemoteConnectClose(int sd, net_info *net)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+
+    if (!net->connectPending) return;
+
+    net->connectPending = FALSE;
+    if (!g_summary.net.remote) return;
+
+    if (getpeername(sd, (struct sockaddr *)&addr, &addrlen) != -1) {
+        net->connected = TRUE;
+        doSetConnection(sd, (struct sockaddr *)&addr, addrlen, REMOTE);
+    } else {
+        atomicAddU64(&net->connectErrors, 1);
+    }
+}
+
+/*
+ * An address the application itself got back from getsockname() or
+ * getpeername(). Recording it here means doSetAddrs() doesn't need to
+ * repeat the syscall on the first send or receive.
+ */
+void
+doSetAppAddr(int sd, const struct sockaddr *addr, socklen_t len, control_type_t endp)
+{
+    net_info *net;
+
+    if (!addr || (len <= 0)) return;
+    if ((addr->sa_family != AF_INET) && (addr->sa_family != AF_INET6)) return;
+    if (((net = getNetEntry(sd)) == NULL) || (net->type != SOCK_STREAM)) return;
+
+    // A listener's local address is usually a wildcard and accepted sockets
+    // copy it. Leave it unset so they get the address the kernel assigned them.
+    if ((endp == LOCAL) && (net->addrSetRemote == FALSE)) return;
+
+    doSetConnection(sd, addr, len, endp);
+}
+
 int
 doSetAddrs(int sockfd)
 {
@@ -1611,6 +1852,14 @@ doSetAddrs(int sockfd)
     socklen_t addrlen = sizeof(struct sockaddr_storage);
     net_info *net;
 
+    // Called on every send and receive; once a TCP connection's addresses
+    // are known there is nothing left to do
+    if (((net = getNetEntry(sockfd)) != NULL) && (net->type == SOCK_STREAM) &&
+        (net->addrSetLocal == TRUE) && (net->addrSetRemote == TRUE) &&
+        !addrIsUnixDomain(&net->remoteConn) && !addrIsUnixDomain(&net->localConn)) {
+        return 0;
+    }
+
     // Only do this if output is enabled
     int need_to_track_addrs =
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
@@ -1834,101 +2083,22 @@ getDNSName(int sd, void *pkt, int pktlen)
     return 0;
 }
 
-#define DNSDONE(var1, var2) {if (var1) cJSON_Delete(var1); if (var2) cJSON_Delete(var2); return FALSE;}
-
-static bool
-parseDNSAnswer(char *buf, size_t len, cJSON *json, cJSON *addrs, int first)
-{
-    int i, nmsg;
-    ns_rr rr;
-    ns_msg handle;
-
-    // init ns lib
-    if (scope_ns_initparse((const unsigned char *)buf, len, &handle) == -1) {
-        scopeLogError("ERROR:init parse");
-        return FALSE;
-    }
-
-    nmsg = ns_msg_count(handle, ns_s_an);
-
-    if (nmsg > 0) {
-        for (i = 0; i < nmsg; i++) {
-            char ipaddr[128];
-            //char dispbuf[4096];
-
-            if (scope_ns_parserr(&handle, ns_s_an, i, &rr) == -1) {
-                scopeLogError("ERROR:parse rr");
-                return FALSE;
-            }
-
-            // do this once, after we get the rr
-            if (first == 0) {
-                if (!cJSON_AddStringToObjLN(json, "domain", ns_rr_name(rr))) {
-                    continue;
-                }
-                first = 1;
-            }
-
-            //ns_sprintrr(&handle, &rr, NULL, NULL, dispbuf, sizeof (dispbuf));
-            //scopeLog(CFG_LOG_DEBUG, "%s", dispbuf);
-
-            // type A is IPv4, AAA is IPv6
-            if (ns_rr_type(rr) == ns_t_a) {
-                if (!scope_inet_ntop(AF_INET, (struct sockaddr_in *)rr.rdata,
-                               ipaddr, sizeof(ipaddr))) {
-                    continue;
-                }
-            } else if (ns_rr_type(rr) == ns_t_aaaa) {
-                if (!scope_inet_ntop(AF_INET6, (struct sockaddr_in6 *)rr.rdata,
-                               ipaddr, sizeof(ipaddr))) {
-                    continue;
-                }
-            } else {
-                DBG("DNS response received without an IP address");
-                continue;
-            }
-
-            //scope_snprintf(dispbuf, sizeof(dispbuf), "resolved addr is %s\n", ipaddr);
-            //scopeLog(CFG_LOG_DEBUG, "%s", dispbuf);
-
-            if (!cJSON_AddStringToObjLN(addrs, "addr", ipaddr)) {
-                continue;
-            }
-        }
-        return TRUE;
-    }
-
-    return FALSE;
-}
-
 bool
 getDNSAnswer(int sockfd, char *buf, size_t len, src_data_t dtype)
 {
-    bool result;
+    bool result = FALSE;
     struct net_info_t *net = getNetEntry(sockfd);
 
     if (!buf || !net || (len <= 0)) return FALSE;
 
-    cJSON *json = cJSON_CreateObject();
-    if (!json) return FALSE;
-
-    cJSON *addrs = cJSON_CreateArray();
-    if (!addrs) DNSDONE(json, addrs);
-
-    if (net->startTime == 0) {
-        if (!cJSON_AddNumberToObjLN(json, "duration", 0)) {
-            DNSDONE(json, addrs);
-        }
-    } else {
-        if (!cJSON_AddNumberToObjLN(json, "duration",
-                                    getDuration(net->startTime) / 1000000)) {
-            DNSDONE(json, addrs);
-        }
-    }
+    // Decoded here, posted with the DNS event from doRecv
+    g_dns_answer_fd = -1;
+    scope_memset(&g_dns_answer, 0, sizeof(g_dns_answer));
+    bool tcp = (net->type == SOCK_STREAM);
 
     switch (dtype) {
     case BUF:
-        result = parseDNSAnswer(buf, len, json, addrs, 0);
+        result = dnsAnswerParse((unsigned char *)buf, len, tcp, &g_dns_answer);
         break;
 
     case MSG:
@@ -1940,8 +2110,9 @@ getDNSAnswer(int sockfd, char *buf, size_t len, src_data_t dtype)
         for (i = 0; i < msg->msg_iovlen; i++) {
             iov = &msg->msg_iov[i];
             if (iov && iov->iov_base && (iov->iov_len > 0)) {
+                size_t iovlen = (iov->iov_len < len) ? iov->iov_len : len;
                 // do we have at least one good pass?
-                if (parseDNSAnswer((char *)iov->iov_base, len, json, addrs, i) == TRUE) {
+                if (dnsAnswerParse((unsigned char *)iov->iov_base, iovlen, tcp, &g_dns_answer) == TRUE) {
                     result = TRUE;
                 } else {
                     // should we stop if an iov doesn't parse? probably.
@@ -1959,7 +2130,7 @@ getDNSAnswer(int sockfd, char *buf, size_t len, src_data_t dtype)
 
         for (i = 0; i < len; i++) {
             if (iov[i].iov_base && (iov[i].iov_len > 0)) {
-                if (parseDNSAnswer((char *)iov[i].iov_base, len, json, addrs, i)  == TRUE) {
+                if (dnsAnswerParse((unsigned char *)iov[i].iov_base, iov[i].iov_len, tcp, &g_dns_answer) == TRUE) {
                     result = TRUE;
                 } else {
                     break;
@@ -1970,16 +2141,14 @@ getDNSAnswer(int sockfd, char *buf, size_t len, src_data_t dtype)
     }
 
     default:
-        DNSDONE(json, addrs);
+        return FALSE;
     }
 
     if (result == TRUE) {
-        cJSON_AddItemToObject(json, "addrs", addrs);
-        net->dnsAnswer = json;
-    } else {
-        net->dnsAnswer = NULL;
-        if (json) cJSON_Delete(json);
-        if (addrs) cJSON_Delete(addrs);
+        if (net->startTime) {
+            g_dns_answer.duration = getDuration(net->startTime) / 1000000;
+        }
+        g_dns_answer_fd = sockfd;
     }
 
     return TRUE;
@@ -1993,6 +2162,7 @@ doRecv(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
             doAddNewSock(sockfd);
         }
 
+        doRemoteConnectDone(&g_netinfo[sockfd]);
         doSetAddrs(sockfd);
 
         /*
@@ -2038,6 +2208,7 @@ doSend(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
             doAddNewSock(sockfd);
         }
 
+        doRemoteConnectDone(&g_netinfo[sockfd]);
         doSetAddrs(sockfd);
         doUpdateState(NETTX, sockfd, rc, NULL, NULL);
 
@@ -2070,6 +2241,9 @@ doAccept(int oldsd, int newsd, struct sockaddr *addr, socklen_t *addrlen, char *
     doDupSock(oldsd, newsd);
 
     if (getNetEntry(newsd) != NULL) {
+        // A new connection, not another descriptor for the listener's
+        g_netinfo[newsd].inbound = TRUE;
+        g_netinfo[newsd].remoteCounted = FALSE;
         if (addr && addrlen) doSetConnection(newsd, addr, *addrlen, REMOTE);
         doUpdateState(OPEN_PORTS, newsd, 1, func, NULL);
         doUpdateState(NET_CONNECTIONS, newsd, 1, func, NULL);
@@ -2090,8 +2264,13 @@ reportFD(int fd, control_type_t source)
     if (ninfo) {
         ninfo->fd = fd;
         if (!g_summary.net.rx_tx) {
+            // This reports any batch as well
+            ninfo->rxPending = FALSE;
+            ninfo->txPending = FALSE;
             doNetMetric(NETTX, ninfo, source, 0);
             doNetMetric(NETRX, ninfo, source, 0);
+        } else {
+            postNetBatch(fd, ninfo);
         }
         if (!g_summary.net.open_close) {
             doNetMetric(OPEN_PORTS, ninfo, source, 0);
@@ -2099,6 +2278,9 @@ reportFD(int fd, control_type_t source)
             doNetMetric(CONNECTION_CLOSE, ninfo, source, 0);
             doNetMetric(CONNECTION_DURATION, ninfo, source, 0);
         }
+        if (g_summary.net.remote) {
+            doNetRemoteMetric(ninfo, source);
+        }
     }
 
     struct fs_info_t *finfo = getFSEntry(fd);
@@ -2112,6 +2294,9 @@ reportFD(int fd, control_type_t source)
         if (!g_summary.fs.seek) {
             doFSMetric(FS_SEEK, finfo, source, "seek", 0, NULL);
         }
+        if (g_summary.fs.paths) {
+            doFSPathMetric(finfo, source);
+        }
     }
 }
 
@@ -2145,6 +2330,7 @@ doRead(int fd, uint64_t initialTime, int success, const void *buf, ssize_t bytes
             // Don't count data from stdin
             if ((fd > 2) || scope_strncmp(fs->path, "std", 3)) {
                 uint64_t duration = getDuration(initialTime);
+                if (latencyEnabled(HISTO_READ)) histoRecord(HISTO_READ, duration);
                 doUpdateState(FS_DURATION, fd, duration, func, NULL);
                 doUpdateState(FS_READ, fd, bytes, func, NULL);
             }
@@ -2178,6 +2364,7 @@ doWrite(int fd, uint64_t initialTime, int success, const void *buf, ssize_t byte
             // Don't count data from stdout, stderr
             if ((fd > 2) || scope_strncmp(fs->path, "std", 3)) {
                 uint64_t duration = getDuration(initialTime);
+                if (latencyEnabled(HISTO_WRITE)) histoRecord(HISTO_WRITE, duration);
                 doUpdateState(FS_DURATION, fd, duration, func, NULL);
                 doUpdateState(FS_WRITE, fd, bytes, func, NULL);
             }
@@ -2223,9 +2410,12 @@ doSeek(int fd, int success, const char *func)
 }
 
 #ifdef __linux__
+// initialTime is 0 when the call wasn't timed
 void
-doStatPath(const char *path, int rc, const char *func)
+doStatPath(const char *path, uint64_t initialTime, int rc, const char *func)
 {
+    if (initialTime) histoRecord(HISTO_STAT, getDuration(initialTime));
+
     if (rc != -1) {
         scopeLog(CFG_LOG_TRACE, "%s", func);
         doUpdateState(FS_STAT, -1, 0, func, path);
@@ -2235,10 +2425,12 @@ doStatPath(const char *path, int rc, const char *func)
 }
 
 void
-doStatFd(int fd, int rc, const char* func)
+doStatFd(int fd, uint64_t initialTime, int rc, const char* func)
 {
     struct fs_info_t *fs = getFSEntry(fd);
 
+    if (initialTime) histoRecord(HISTO_STAT, getDuration(initialTime));
+
     if (rc != -1) {
         scopeLog(CFG_LOG_DEBUG, "fd:%d %s", fd, func);
         if (fs) {
@@ -2259,7 +2451,7 @@ doDupFile(int oldfd, int newfd, const char *func)
         return -1;
     }
 
-    doOpen(newfd, g_fsinfo[oldfd].path, g_fsinfo[oldfd].type, func);
+    doOpen(newfd, 0, g_fsinfo[oldfd].path, g_fsinfo[oldfd].type, func);
     return 0;
 }
 
@@ -2272,6 +2464,7 @@ doDupSock(int oldfd, int newfd)
 
     scope_memmove(&g_netinfo[newfd], &g_netinfo[oldfd], sizeof(struct net_info_t));
     g_netinfo[newfd].active = TRUE;
+    setFdTracked(newfd, TRUE);
     g_netinfo[newfd].uid = getTime();
     g_netinfo[newfd].numTX = (counters_element_t){.mtc=0, .evt=0};
     g_netinfo[newfd].numRX = (counters_element_t){.mtc=0, .evt=0};
@@ -2280,6 +2473,13 @@ doDupSock(int oldfd, int newfd)
     g_netinfo[newfd].startTime = 0ULL;
     g_netinfo[newfd].totalDuration = (counters_element_t){.mtc=0, .evt=0};
     g_netinfo[newfd].numDuration = (counters_element_t){.mtc=0, .evt=0};
+    // The connection is the original's, and is counted with it
+    g_netinfo[newfd].remoteCounted = TRUE;
+    g_netinfo[newfd].connectPending = FALSE;
+    g_netinfo[newfd].connectDuration = 0ULL;
+    g_netinfo[newfd].connectErrors = 0ULL;
+    g_netinfo[newfd].rxPending = FALSE;
+    g_netinfo[newfd].txPending = FALSE;
 
     // don't dup the HTTP state
     resetHttp(g_netinfo[newfd].http);
@@ -2360,6 +2560,8 @@ doClose(int fd, const char *func)
     if (guard_enabled) while (!atomicCasU64(&g_http_guard[fd], 0ULL, 1ULL));
 
     if (ninfo != NULL) {
+        doRemoteConnectClose(fd, ninfo);
+        postNetBatch(fd, ninfo);
         doUpdateState(OPEN_PORTS, fd, -1, func, NULL);
         doUpdateState(NET_CONNECTIONS, fd, -1, func, NULL);
         doUpdateState(CONNECTION_CLOSE, fd, -1, func, NULL);
@@ -2378,13 +2580,17 @@ doClose(int fd, const char *func)
 
     if (ninfo) ninfo->active = FALSE;
     if (fsinfo) scope_memset(fsinfo, 0, sizeof(struct fs_info_t));
+    setFdTracked(fd, FALSE);
 
     if (guard_enabled) while (!atomicCasU64(&g_http_guard[fd], 1ULL, 0ULL));
 }
 
+// initialTime is 0 for a descriptor that wasn't opened by a timed call
 void
-doOpen(int fd, const char *path, fs_type_t type, const char *func)
+doOpen(int fd, uint64_t initialTime, const char *path, fs_type_t type, const char *func)
 {
+    if (initialTime) histoRecord(HISTO_OPEN, getDuration(initialTime));
+
     if (fd == -1) {
         doUpdateState(FS_ERR_OPEN_CLOSE, -1, 0, func, path);
         return;
@@ -2424,6 +2630,7 @@ doOpen(int fd, const char *path, fs_type_t type, const char *func)
 */
         scope_memset(&g_fsinfo[fd], 0, sizeof(struct fs_info_t));
         g_fsinfo[fd].active = TRUE;
+        setFdTracked(fd, TRUE);
         g_fsinfo[fd].type = type;
         g_fsinfo[fd].uid = getTime();
         scope_strncpy(g_fsinfo[fd].path, path, sizeof(g_fsinfo[fd].path));
@@ -35,15 +35,20 @@ typedef enum {
     FS_CONTENT_TEXT     // File content type text
 } fs_content_type_t;
 
+void initProtocolList(void);
 void initState(void);
 void resetState(void);
 void destroyState(void);
 
 bool payloadToDiskForced(void);
 void setVerbosity(unsigned);
+void setNetBatched(bool);
 void addSock(int, int, int);
 int doBlockConnection(int, const struct sockaddr *);
 void doSetConnection(int, const struct sockaddr *, socklen_t, control_type_t);
+void doSetAppAddr(int, const struct sockaddr *, socklen_t, control_type_t);
+void doRemoteConnect(int, const struct sockaddr *, socklen_t, uint64_t, int);
+void doRemoteConnectStart(int, const struct sockaddr *, socklen_t, uint64_t);
 int doSetAddrs(int);
 int doAddNewSock(int);
 int getDNSName(int, void *, int);
@@ -56,15 +61,15 @@ void reportAllFds(control_type_t);
 void doRead(int, uint64_t, int, const void *, ssize_t, const char *, src_data_t, size_t);
 void doWrite(int, uint64_t, int, const void *, ssize_t, const char *, src_data_t, size_t);
 void doSeek(int, int, const char *);
-void doStatPath(const char *, int, const char *);
-void doStatFd(int, int, const char *);
+void doStatPath(const char *, uint64_t, int, const char *);
+void doStatFd(int, uint64_t, int, const char *);
 int doDupFile(int, int, const char *);
 int doDupSock(int, int);
 void doDup(int, int, const char *, int);
 void doDup2(int, int, int, const char *);
 void doDelete(const char *, const char *);
 void doClose(int, const char *);
-void doOpen(int, const char *, fs_type_t, const char *);
+void doOpen(int, uint64_t, const char *, fs_type_t, const char *);
 void doSendFile(int, int, uint64_t, int, const char *);
 void doCloseAndReportFailures(int, int, const char *);
 void doCloseAllStreams(void);
@@ -79,5 +84,6 @@ void setRemoteClose(int, int);
 void setFSContentType(int, fs_content_type_t);
 fs_content_type_t getFSContentType(int);
 bool isProtocolSet(int);
+bool protocolConsumerEnabled(int);
 
 #endif // __STATE_H__
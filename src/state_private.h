@@ -3,6 +3,7 @@
 
 #include <limits.h>
 #include <sys/socket.h>
+#include "dnsanswer.h"
 
 #define NET_ENTRIES 1024
 #define FS_ENTRIES 1024
@@ -76,6 +77,7 @@ typedef struct {
         int stat;
         int seek;
         int error;
+        int paths;      // by path, not descriptor; see fsagg.h
     } fs;
     struct {
         int open_close;
@@ -83,6 +85,7 @@ typedef struct {
         int dns;
         int error;
         int dnserror;
+        int remote;     // by remote endpoint, not descriptor; see netagg.h
     } net;
 } summary_t;
 
@@ -133,8 +136,20 @@ typedef struct {
     uint8_t *buf;  // bytes array pointer
     size_t   len;  // num bytes used
     size_t   size; // num bytes allocated
+    size_t   skip; // payload bytes still to come of a frame we don't stash
 } http_buf_t;
 
+// gRPC message framing within the DATA frames of one HTTP/2 stream.
+// Each message has a 5 byte prefix; a compressed flag and a length.
+#define GRPC_MSG_STREAMS 4
+typedef struct {
+    uint32_t stream;   // 0 when unused
+    uint32_t left;     // bytes of the current message still to come
+    uint32_t len;      // length from the prefix being read
+    uint8_t  have;     // bytes of the prefix read so far
+    uint8_t  notGrpc;  // the payload isn't framed as gRPC messages
+} grpc_msg_t;
+
 typedef struct protocol_info_t {
     metric_t evtype;
     metric_t ptype;
@@ -168,6 +183,11 @@ typedef struct {
 
     // HTTP/2 state
     http_buf_t http2Buf; // buffers for partial frames
+
+    // gRPC messages are counted in DATA frames as they're skipped
+    grpc_msg_t grpcMsg[GRPC_MSG_STREAMS]; // framing of recent streams
+    grpc_msg_t *dataMsg;                  // for the DATA frame being skipped
+    uint32_t dataMsgs;                    // messages started in that frame
 } http_state_t;
 
 typedef struct net_info_t {
@@ -194,7 +214,6 @@ typedef struct net_info_t {
     uint64_t lnode;
     uint64_t rnode;
     char dnsName[MAX_HOSTNAME];
-    cJSON *dnsAnswer;
     struct sockaddr_storage localConn;
     struct sockaddr_storage remoteConn;
     metric_counters counters;
@@ -205,8 +224,33 @@ typedef struct net_info_t {
     detect_type_t protoDetect;     // state for protocol detection on this channel
     protocol_def_t* protoProtoDef; // The protocol-detector that matched
 
+    // for reporting by remote endpoint
+    bool inbound;                // it was accepted
+    bool connected;              // a datagram socket's connect() succeeded
+    bool remoteCounted;          // the connection has been reported
+    bool connectPending;         // a non-blocking connect() is in progress
+    uint64_t connectStart;       // of the pending connect, if it's timed
+    uint64_t connectDuration;    // ns, of a timed connect
+    uint64_t connectErrors;
+
+    // rx/tx counted since the last post, when batched; see setNetBatched()
+    bool rxPending;
+    bool txPending;
 } net_info;
 
+// Posted for DNS requests, responses and durations. A response carries
+// the decoded answer; JSON for it is built on the reporting thread.
+typedef struct dns_info_t {
+    metric_t evtype;
+    metric_t data_type;
+    int fd;
+    bool hasAnswer;
+    counters_element_t totalDuration;
+    metric_counters counters;
+    char dnsName[MAX_HOSTNAME];
+    dns_answer_t answer;
+} dns_info;
+
 typedef struct fs_info_t {
     metric_t evtype;
     metric_t data_type;
@@ -253,7 +297,9 @@ sock_summary_bucket_t getNetRxTxBucket(net_info *);
 
 // The hiding of objects forces these to be defined here
 void doFSMetric(metric_t, struct fs_info_t *, control_type_t, const char *, ssize_t, const char *);
+void doFSPathMetric(struct fs_info_t *, control_type_t);
 void doNetMetric(metric_t, struct net_info_t *, control_type_t, ssize_t);
+void doNetRemoteMetric(struct net_info_t *, control_type_t);
 void doUnixEndpoint(int, net_info *);
 void resetInterfaceCounts(counters_element_t *);
 void addToInterfaceCounts(counters_element_t *, uint64_t);
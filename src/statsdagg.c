@@ -0,0 +1,486 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include "dbg.h"
+#include "statsdagg.h"
+#include "scopestdlib.h"
+
+// Sketch buckets are log-linear: each power of two is split into
+// SKETCH_SUB equal buckets, so a bucket's midpoint is within about 3% of
+// any value in it.  Bucket boundaries are fixed, which makes sketches
+// mergeable by adding counts.  SKETCH_BUCKETS covers 16 powers of two;
+// when values span more than that, the lowest buckets are collapsed
+// into one, which keeps the high quantiles accurate.
+#define SKETCH_SUB_BITS 4
+#define SKETCH_SUB (1 << SKETCH_SUB_BITS)
+#define SKETCH_BUCKETS 256
+
+// Longest dims we'll sort, and the most tags in them.  Longer dims are
+// used as they came.
+#define MAX_SORTED_DIMS 1024
+#define MAX_SORTED_TAGS 64
+
+typedef enum {
+    SERIES_COUNTER,
+    SERIES_GAUGE,
+    SERIES_SKETCH,
+} series_kind_t;
+
+typedef struct {
+    bool indexed;               // base has been set
+    int base;                   // bucket index of counts[0]
+    uint64_t zeros;             // samples <= 0
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+    uint32_t counts[SKETCH_BUCKETS];
+} sketch_t;
+
+typedef struct {
+    uint32_t hash;
+    series_kind_t kind;
+    char *name;                 // name, type and dims follow the struct
+    char *type;
+    char *dims;                 // sorted; NULL if none
+    bool isint;                 // counters and gauges
+    long long intval;
+    double fltval;
+    sketch_t *sketch;           // timers and histograms
+} series_t;
+
+struct _statsd_agg_t {
+    series_t **table;           // open addressed; at least twice max
+    size_t size;
+    size_t count;
+    size_t max;
+    uint64_t overflow;          // samples of series past max
+};
+
+statsd_agg_t *
+statsdAggCreate(size_t maxSeries)
+{
+    if (!maxSeries) maxSeries = DEFAULT_STATSD_MAX_SERIES;
+
+    size_t size = 16;
+    while (size < maxSeries * 2) size <<= 1;
+
+    statsd_agg_t *agg = scope_calloc(1, sizeof(*agg));
+    series_t **table = scope_calloc(size, sizeof(*table));
+    if (!agg || !table) {
+        if (agg) scope_free(agg);
+        if (table) scope_free(table);
+        DBG("agg = %p, table = %p", agg, table);
+        return NULL;
+    }
+
+    agg->table = table;
+    agg->size = size;
+    agg->max = maxSeries;
+
+    return agg;
+}
+
+void
+statsdAggDestroy(statsd_agg_t **agg_ptr)
+{
+    if (!agg_ptr || !*agg_ptr) return;
+
+    statsd_agg_t *agg = *agg_ptr;
+    statsdAggReset(agg);
+
+    scope_free(agg->table);
+    scope_free(agg);
+
+    *agg_ptr = NULL;
+}
+
+void
+statsdAggReset(statsd_agg_t *agg)
+{
+    if (!agg) return;
+
+    size_t i;
+    for (i = 0; i < agg->size; i++) {
+        series_t *series = agg->table[i];
+        if (!series) continue;
+        if (series->sketch) scope_free(series->sketch);
+        scope_free(series);
+        agg->table[i] = NULL;
+    }
+    agg->count = 0;
+    agg->overflow = 0;
+}
+
+size_t
+statsdAggSeriesCount(statsd_agg_t *agg)
+{
+    return (agg) ? agg->count : 0;
+}
+
+typedef union {
+    double d;
+    uint64_t u;
+} double_bits_t;
+
+static int
+sketchIndex(double value)
+{
+    double_bits_t bits = {.d = value};
+    int exp = (int)((bits.u >> 52) & 0x7ff) - 1023;
+    int sub = (int)((bits.u >> (52 - SKETCH_SUB_BITS)) & (SKETCH_SUB - 1));
+    return exp * SKETCH_SUB + sub;
+}
+
+// Returns the midpoint of the bucket
+static double
+sketchValue(int index)
+{
+    int exp = index >> SKETCH_SUB_BITS;
+    int sub = index & (SKETCH_SUB - 1);
+    double_bits_t bits = {.u = (uint64_t)(exp + 1023) << 52};
+    return bits.d * (1.0 + (sub + 0.5) / SKETCH_SUB);
+}
+
+static void
+sketchAdd(sketch_t *sketch, double value, uint32_t weight)
+{
+    if (!sketch->count || (value < sketch->min)) sketch->min = value;
+    if (!sketch->count || (value > sketch->max)) sketch->max = value;
+    sketch->count += weight;
+    sketch->sum += value * weight;
+
+    // Zero, negative, and too small for a normal double
+    double_bits_t bits = {.d = value};
+    if ((value <= 0.0) || !((bits.u >> 52) & 0x7ff)) {
+        sketch->zeros += weight;
+        return;
+    }
+
+    int index = sketchIndex(value);
+    if (!sketch->indexed) {
+        // Leave room on both sides of the first value
+        sketch->base = index - SKETCH_BUCKETS / 2;
+        sketch->indexed = TRUE;
+    }
+
+    if (index < sketch->base) {
+        index = sketch->base;
+    } else if (index >= sketch->base + SKETCH_BUCKETS) {
+        // Slide the window up, collapsing the lowest buckets into one
+        int shift = index - (sketch->base + SKETCH_BUCKETS - 1);
+        uint32_t folded = 0;
+        int i;
+        for (i = 0; (i < shift) && (i < SKETCH_BUCKETS); i++) {
+            folded += sketch->counts[i];
+        }
+        if (shift < SKETCH_BUCKETS) {
+            scope_memmove(sketch->counts, &sketch->counts[shift],
+                          (SKETCH_BUCKETS - shift) * sizeof(sketch->counts[0]));
+            scope_memset(&sketch->counts[SKETCH_BUCKETS - shift], 0,
+                         shift * sizeof(sketch->counts[0]));
+        } else {
+            scope_memset(sketch->counts, 0, sizeof(sketch->counts));
+        }
+        sketch->counts[0] += folded;
+        sketch->base += shift;
+    }
+
+    sketch->counts[index - sketch->base] += weight;
+}
+
+static double
+sketchQuantile(const sketch_t *sketch, double q)
+{
+    if (!sketch->count) return 0.0;
+
+    uint64_t rank = (uint64_t)(q * (sketch->count - 1));
+    double value = sketch->max;
+
+    if (rank < sketch->zeros) {
+        value = 0.0;
+    } else {
+        uint64_t seen = sketch->zeros;
+        int i;
+        for (i = 0; i < SKETCH_BUCKETS; i++) {
+            seen += sketch->counts[i];
+            if (seen > rank) {
+                value = sketchValue(sketch->base + i);
+                break;
+            }
+        }
+    }
+
+    if (value < sketch->min) value = sketch->min;
+    if (value > sketch->max) value = sketch->max;
+    return value;
+}
+
+static bool
+seriesKind(const char *type, series_kind_t *kind)
+{
+    if (!scope_strcmp(type, "c")) {
+        *kind = SERIES_COUNTER;
+    } else if (!scope_strcmp(type, "g")) {
+        *kind = SERIES_GAUGE;
+    } else if (!scope_strcmp(type, "ms") || !scope_strcmp(type, "h")) {
+        *kind = SERIES_SKETCH;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Returns dims with its tags in sorted order, so tag order doesn't
+// create distinct series.  The result may be dims itself or buf.
+static const char *
+sortDims(const char *dims, char *buf, size_t buflen)
+{
+    if (!dims || !dims[0]) return NULL;
+
+    size_t len = scope_strlen(dims);
+    if ((dims[0] != '#') || (len >= buflen)) return dims;
+
+    char copy[MAX_SORTED_DIMS];
+    char *tags[MAX_SORTED_TAGS];
+    int numtags = 0;
+
+    scope_strncpy(copy, dims + 1, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    char *tag = copy;
+    while (tag) {
+        if (numtags >= MAX_SORTED_TAGS) return dims;
+        tags[numtags++] = tag;
+        if ((tag = scope_strchr(tag, ','))) *tag++ = '\0';
+    }
+
+    // Insertion sort; there are never many tags
+    int i, j;
+    for (i = 1; i < numtags; i++) {
+        char *key = tags[i];
+        for (j = i; (j > 0) && (scope_strcmp(tags[j - 1], key) > 0); j--) {
+            tags[j] = tags[j - 1];
+        }
+        tags[j] = key;
+    }
+
+    char *pos = buf;
+    *pos++ = '#';
+    for (i = 0; i < numtags; i++) {
+        size_t taglen = scope_strlen(tags[i]);
+        if (i) *pos++ = ',';
+        scope_memcpy(pos, tags[i], taglen);
+        pos += taglen;
+    }
+    *pos = '\0';
+
+    return buf;
+}
+
+static uint32_t
+seriesHash(const char *name, const char *type, const char *dims)
+{
+    // FNV-1a over name, type and dims
+    uint32_t hash = 2166136261U;
+    const char *strs[] = {name, type, dims};
+    int i;
+    for (i = 0; i < sizeof(strs)/sizeof(strs[0]); i++) {
+        const unsigned char *c;
+        for (c = (const unsigned char *)strs[i]; c && *c; c++) {
+            hash ^= *c;
+            hash *= 16777619U;
+        }
+        hash ^= '|';
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static bool
+seriesMatches(const series_t *series, uint32_t hash, const char *name,
+              const char *type, const char *dims)
+{
+    if (series->hash != hash) return FALSE;
+    if (scope_strcmp(series->name, name) || scope_strcmp(series->type, type)) {
+        return FALSE;
+    }
+    if (!series->dims || !dims) return series->dims == dims;
+    return !scope_strcmp(series->dims, dims);
+}
+
+static series_t *
+seriesCreate(uint32_t hash, series_kind_t kind, const char *name,
+             const char *type, const char *dims)
+{
+    size_t namelen = scope_strlen(name) + 1;
+    size_t typelen = scope_strlen(type) + 1;
+    size_t dimslen = (dims) ? scope_strlen(dims) + 1 : 0;
+
+    series_t *series = scope_calloc(1, sizeof(*series) + namelen + typelen + dimslen);
+    if (!series) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    if ((kind == SERIES_SKETCH) &&
+        !(series->sketch = scope_calloc(1, sizeof(*series->sketch)))) {
+        DBG(NULL);
+        scope_free(series);
+        return NULL;
+    }
+
+    char *pos = (char *)(series + 1);
+    series->name = scope_memcpy(pos, name, namelen);
+    pos += namelen;
+    series->type = scope_memcpy(pos, type, typelen);
+    pos += typelen;
+    series->dims = (dims) ? scope_memcpy(pos, dims, dimslen) : NULL;
+    series->hash = hash;
+    series->kind = kind;
+    series->isint = TRUE;
+
+    return series;
+}
+
+bool
+statsdAggAddMetric(statsd_agg_t *agg, const captured_metric_t *metric)
+{
+    if (!agg || !metric || !metric->name || !metric->type) return FALSE;
+
+    const char *name = (const char *)metric->name;
+    const char *type = (const char *)metric->type;
+    series_kind_t kind;
+    if (!seriesKind(type, &kind)) return FALSE;
+
+    char sorted[MAX_SORTED_DIMS];
+    const char *dims = sortDims((const char *)metric->dims, sorted, sizeof(sorted));
+    uint32_t hash = seriesHash(name, type, dims);
+
+    // Find the series, or the empty slot where it goes
+    size_t i = hash & (agg->size - 1);
+    series_t *series;
+    while ((series = agg->table[i]) &&
+           !seriesMatches(series, hash, name, type, dims)) {
+        i = (i + 1) & (agg->size - 1);
+    }
+
+    if (!series) {
+        if (agg->count >= agg->max) {
+            agg->overflow++;
+            return TRUE;
+        }
+        if (!(series = seriesCreate(hash, kind, name, type, dims))) return FALSE;
+        agg->table[i] = series;
+        agg->count++;
+    }
+
+    double rate = ((metric->rate > 0.0) && (metric->rate < 1.0)) ? metric->rate : 1.0;
+    double value = (metric->isint) ? metric->intval : metric->fltval;
+
+    switch (kind) {
+        case SERIES_COUNTER:
+        {
+            // A sampled counter stands for 1/rate as many counts
+            double scaled = value / rate;
+            bool isint = metric->isint && (scaled < (double)LLONG_MAX) &&
+                         (scaled > (double)LLONG_MIN) &&
+                         (scaled == (double)(long long)scaled);
+            if (series->isint && isint) {
+                series->intval += (long long)scaled;
+            } else {
+                double sum = (series->isint) ? series->intval : series->fltval;
+                series->isint = FALSE;
+                series->fltval = sum + scaled;
+            }
+            break;
+        }
+        case SERIES_GAUGE:
+            series->isint = metric->isint;
+            series->intval = metric->intval;
+            series->fltval = metric->fltval;
+            break;
+        case SERIES_SKETCH:
+            // Likewise, a sampled timer stands for 1/rate samples
+            sketchAdd(series->sketch, value, (uint32_t)(1.0 / rate + 0.5));
+            break;
+    }
+
+    return TRUE;
+}
+
+static void
+reportValue(statsd_agg_report_fn report, const char *name, const char *type,
+            const char *dims, bool isint, long long intval, double fltval)
+{
+    // The report function is allowed to scribble on dims; give it a copy
+    size_t dimslen = (dims) ? scope_strlen(dims) + 1 : 1;
+    char dimscopy[dimslen];
+    if (dims) scope_memcpy(dimscopy, dims, dimslen);
+
+    captured_metric_t out = {
+        .name = (unsigned char *)name,
+        .type = (unsigned char *)type,
+        .dims = (dims) ? (unsigned char *)dimscopy : NULL,
+        .isint = isint,
+        .intval = intval,
+        .fltval = fltval,
+        .rate = 1.0,
+    };
+    report(&out);
+}
+
+static void
+reportSketch(statsd_agg_report_fn report, const series_t *series)
+{
+    const sketch_t *sketch = series->sketch;
+    if (!sketch->count) return;
+
+    struct {
+        const char *suffix;
+        double value;
+    } stats[] = {
+        {"min",           sketch->min},
+        {"max",           sketch->max},
+        {"avg",           sketch->sum / sketch->count},
+        {"median",        sketchQuantile(sketch, 0.50)},
+        {"95percentile",  sketchQuantile(sketch, 0.95)},
+        {"99percentile",  sketchQuantile(sketch, 0.99)},
+    };
+
+    size_t namelen = scope_strlen(series->name) + sizeof(".95percentile");
+    char name[namelen];
+
+    scope_snprintf(name, namelen, "%s.count", series->name);
+    reportValue(report, name, "c", series->dims, TRUE, sketch->count, 0.0);
+
+    int i;
+    for (i = 0; i < sizeof(stats)/sizeof(stats[0]); i++) {
+        scope_snprintf(name, namelen, "%s.%s", series->name, stats[i].suffix);
+        reportValue(report, name, "g", series->dims, FALSE, 0, stats[i].value);
+    }
+}
+
+void
+statsdAggSendReport(statsd_agg_t *agg, statsd_agg_report_fn report)
+{
+    if (!agg || !report) return;
+
+    size_t i;
+    for (i = 0; i < agg->size; i++) {
+        series_t *series = agg->table[i];
+        if (!series) continue;
+
+        if (series->kind == SERIES_SKETCH) {
+            reportSketch(report, series);
+        } else {
+            reportValue(report, series->name, series->type, series->dims,
+                        series->isint, series->intval, series->fltval);
+        }
+    }
+
+    if (agg->overflow) {
+        reportValue(report, STATSD_AGG_OVERFLOW, "c", NULL, TRUE, agg->overflow, 0.0);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef __STATSDAGG_H__
+#define __STATSDAGG_H__
+#include "metriccapture.h"
+
+// This aggregates StatsD metrics captured from the scoped process, so
+// that each distinct metric is reported once per summary period.
+//
+// Metrics are keyed by name, type and dims (with the tags sorted).
+//   counters (c)            summed
+//   gauges (g)              last value
+//   timers (ms), hists (h)  added to a sketch; reported as
+//                           <name>.count, .min, .max, .avg, .median,
+//                           .95percentile and .99percentile
+// Once the aggregator holds maxSeries distinct metrics, samples of any
+// new ones are counted and reported as STATSD_AGG_OVERFLOW. maxSeries
+// comes from metric > watch[statsd] > maxseries; 0 is the default.
+//
+// A normal lifecycle:
+//   Create
+//   AddMetric
+//   AddMetric
+//   SendReport (reports everything added since Create or Reset)
+//   Reset
+
+#define STATSD_AGG_OVERFLOW "statsd.overflow"
+
+typedef struct _statsd_agg_t statsd_agg_t;
+typedef void (*statsd_agg_report_fn)(const captured_metric_t *);
+
+statsd_agg_t *statsdAggCreate(size_t);
+void statsdAggDestroy(statsd_agg_t **);
+bool statsdAggAddMetric(statsd_agg_t *, const captured_metric_t *);
+void statsdAggSendReport(statsd_agg_t *, statsd_agg_report_fn);
+void statsdAggReset(statsd_agg_t *);
+size_t statsdAggSeriesCount(statsd_agg_t *);
+
+#endif // __STATSDAGG_H__
@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include "dbg.h"
+#include "scopestdlib.h"
+#include "topn.h"
+
+typedef struct {
+    char *key;
+    uint64_t hash;
+    uint64_t weight;
+    uint64_t error;
+    uint32_t heap;              // where it is in the heap
+} topn_node_t;
+
+struct _topn_t {
+    size_t capacity;
+    size_t count;
+    size_t stride;              // of a node and its value
+    char *nodes;
+    uint32_t *heap;             // of node numbers; the lightest is first
+    uint32_t *slot;             // node number + 1, by hash of the key
+    size_t slots;               // a power of two
+    uint64_t evicted;
+};
+
+#define NODE(t, n) ((topn_node_t *)((t)->nodes + (size_t)(n) * (t)->stride))
+#define VALUE(t, n) ((void *)(NODE(t, n) + 1))
+
+topn_t *
+topnCreate(size_t capacity, size_t valueSize)
+{
+    if (!capacity || (capacity > UINT32_MAX / 4)) {
+        DBG("%zu", capacity);
+        return NULL;
+    }
+
+    topn_t *topn = scope_calloc(1, sizeof(*topn));
+    if (!topn) goto err;
+
+    // keep the hash no more than half full
+    topn->slots = 1;
+    while (topn->slots < capacity * 2) topn->slots <<= 1;
+
+    topn->capacity = capacity;
+    topn->stride = ROUND_UP(sizeof(topn_node_t) + valueSize, sizeof(uint64_t));
+    topn->nodes = scope_calloc(capacity, topn->stride);
+    topn->heap = scope_calloc(capacity, sizeof(uint32_t));
+    topn->slot = scope_calloc(topn->slots, sizeof(uint32_t));
+    if (!topn->nodes || !topn->heap || !topn->slot) goto err;
+
+    return topn;
+
+err:
+    DBG(NULL);
+    topnDestroy(&topn);
+    return NULL;
+}
+
+void
+topnDestroy(topn_t **topn_ptr)
+{
+    if (!topn_ptr || !*topn_ptr) return;
+
+    topn_t *topn = *topn_ptr;
+    if (topn->nodes && topn->slot) topnReset(topn);
+
+    if (topn->nodes) scope_free(topn->nodes);
+    if (topn->heap) scope_free(topn->heap);
+    if (topn->slot) scope_free(topn->slot);
+    scope_free(topn);
+
+    *topn_ptr = NULL;
+}
+
+static uint64_t
+hashOfKey(const char *key)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *key; key++) {
+        hash ^= (unsigned char)*key;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// The slot the key is in, or the empty one it would go in
+static size_t
+findSlot(topn_t *topn, const char *key, uint64_t hash)
+{
+    size_t i = hash & (topn->slots - 1);
+    while (topn->slot[i]) {
+        topn_node_t *node = NODE(topn, topn->slot[i] - 1);
+        if ((node->hash == hash) && !scope_strcmp(node->key, key)) break;
+        i = (i + 1) & (topn->slots - 1);
+    }
+    return i;
+}
+
+// Linear probing; the entries after it that would have gone in the
+// freed slot are moved back into it.
+static void
+removeSlot(topn_t *topn, size_t i)
+{
+    size_t mask = topn->slots - 1;
+    size_t j = i;
+    topn->slot[i] = 0;
+
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!topn->slot[j]) break;
+        size_t home = NODE(topn, topn->slot[j] - 1)->hash & mask;
+        // Leave it if its home is cyclically in (i, j]
+        if (((j > i) && (home > i) && (home <= j)) ||
+            ((j < i) && ((home > i) || (home <= j)))) continue;
+        topn->slot[i] = topn->slot[j];
+        topn->slot[j] = 0;
+        i = j;
+    }
+}
+
+static void
+heapSwap(topn_t *topn, uint32_t a, uint32_t b)
+{
+    uint32_t tmp = topn->heap[a];
+    topn->heap[a] = topn->heap[b];
+    topn->heap[b] = tmp;
+    NODE(topn, topn->heap[a])->heap = a;
+    NODE(topn, topn->heap[b])->heap = b;
+}
+
+static void
+heapUp(topn_t *topn, uint32_t pos)
+{
+    while (pos) {
+        uint32_t parent = (pos - 1) / 2;
+        if (NODE(topn, topn->heap[parent])->weight <= NODE(topn, topn->heap[pos])->weight) break;
+        heapSwap(topn, pos, parent);
+        pos = parent;
+    }
+}
+
+static void
+heapDown(topn_t *topn, uint32_t pos)
+{
+    for (;;) {
+        uint32_t least = pos;
+        uint32_t child = pos * 2 + 1;
+        if ((child < topn->count) &&
+            (NODE(topn, topn->heap[child])->weight < NODE(topn, topn->heap[least])->weight)) {
+            least = child;
+        }
+        child++;
+        if ((child < topn->count) &&
+            (NODE(topn, topn->heap[child])->weight < NODE(topn, topn->heap[least])->weight)) {
+            least = child;
+        }
+        if (least == pos) break;
+        heapSwap(topn, pos, least);
+        pos = least;
+    }
+}
+
+// Returns the key's value, or NULL if it couldn't be added
+void *
+topnAdd(topn_t *topn, const char *key, uint64_t weight)
+{
+    if (!topn || !key) return NULL;
+
+    uint64_t hash = hashOfKey(key);
+    size_t i = findSlot(topn, key, hash);
+    if (topn->slot[i]) {
+        uint32_t n = topn->slot[i] - 1;
+        topn_node_t *node = NODE(topn, n);
+        node->weight += weight;
+        heapDown(topn, node->heap);
+        return VALUE(topn, n);
+    }
+
+    char *copy = scope_strdup(key);
+    if (!copy) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    uint32_t n;
+    topn_node_t *node;
+    if (topn->count < topn->capacity) {
+        n = topn->count++;
+        node = NODE(topn, n);
+        node->weight = weight;
+        node->error = 0;
+        node->heap = n;
+        topn->heap[n] = n;
+        heapUp(topn, n);
+    } else {
+        // Take over the lightest
+        n = topn->heap[0];
+        node = NODE(topn, n);
+        removeSlot(topn, findSlot(topn, node->key, node->hash));
+        scope_free(node->key);
+        node->error = node->weight;
+        node->weight += weight;
+        heapDown(topn, 0);
+        topn->evicted++;
+        i = findSlot(topn, key, hash);
+    }
+
+    node->key = copy;
+    node->hash = hash;
+    scope_memset(VALUE(topn, n), 0, topn->stride - sizeof(topn_node_t));
+    topn->slot[i] = n + 1;
+    return VALUE(topn, n);
+}
+
+static void
+entryDown(topn_entry_t *entry, size_t count, size_t pos)
+{
+    for (;;) {
+        size_t least = pos;
+        size_t child = pos * 2 + 1;
+        if ((child < count) && (entry[child].weight < entry[least].weight)) least = child;
+        child++;
+        if ((child < count) && (entry[child].weight < entry[least].weight)) least = child;
+        if (least == pos) break;
+        topn_entry_t tmp = entry[pos];
+        entry[pos] = entry[least];
+        entry[least] = tmp;
+        pos = least;
+    }
+}
+
+static void
+entryUp(topn_entry_t *entry, size_t pos)
+{
+    while (pos) {
+        size_t parent = (pos - 1) / 2;
+        if (entry[parent].weight <= entry[pos].weight) break;
+        topn_entry_t tmp = entry[pos];
+        entry[pos] = entry[parent];
+        entry[parent] = tmp;
+        pos = parent;
+    }
+}
+
+/*
+ * Fills entry with up to max of the heaviest, heaviest first, and returns
+ * how many. The keys and values are the table's; they're good until the
+ * next Add or Reset.
+ */
+size_t
+topnGet(topn_t *topn, topn_entry_t *entry, size_t max)
+{
+    if (!topn || !entry || !max) return 0;
+
+    // entry is used as a heap of the heaviest seen so far, lightest first
+    size_t count = 0;
+    uint32_t n;
+    for (n = 0; n < topn->count; n++) {
+        topn_node_t *node = NODE(topn, n);
+        if ((count == max) && (node->weight <= entry[0].weight)) continue;
+
+        topn_entry_t e = {node->key, node->weight, node->error, VALUE(topn, n)};
+        if (count < max) {
+            entry[count] = e;
+            entryUp(entry, count++);
+        } else {
+            entry[0] = e;
+            entryDown(entry, count, 0);
+        }
+    }
+
+    // and sorted by moving the lightest to the end
+    size_t left;
+    for (left = count; left > 1; left--) {
+        topn_entry_t tmp = entry[0];
+        entry[0] = entry[left - 1];
+        entry[left - 1] = tmp;
+        entryDown(entry, left - 1, 0);
+    }
+
+    return count;
+}
+
+void
+topnReset(topn_t *topn)
+{
+    if (!topn) return;
+
+    uint32_t n;
+    for (n = 0; n < topn->count; n++) {
+        scope_free(NODE(topn, n)->key);
+    }
+    topn->count = 0;
+    topn->evicted = 0;
+    scope_memset(topn->slot, 0, topn->slots * sizeof(uint32_t));
+}
+
+size_t
+topnCount(topn_t *topn)
+{
+    return (topn) ? topn->count : 0;
+}
+
+// Keys that took over another's entry, since Create or Reset
+uint64_t
+topnEvicted(topn_t *topn)
+{
+    return (topn) ? topn->evicted : 0;
+}
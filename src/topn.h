@@ -0,0 +1,45 @@
+#ifndef __TOPN_H__
+#define __TOPN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
+
+// This keeps the heaviest keys of a stream with too many distinct keys
+// to count them all, in a table of a fixed number of entries. It's the
+// "space-saving" algorithm (Metwally, Agrawal and El Abbadi).
+//
+// Each entry has a key, a weight and a value the caller fills in. A key
+// that isn't in a full table takes over the lightest entry, along with
+// its weight; error is the weight it took over, so a key's own weight is
+// between weight - error and weight. Any key with more than 1/capacity
+// of the total weight is certain to be in the table.
+//
+// The value is zeroed when a key gets an entry, so it only counts what
+// was added since then.
+//
+// A normal lifecycle:
+//   Create
+//   Add
+//   Add
+//   Get (the heaviest entries, heaviest first)
+//   Reset (empties the table)
+
+typedef struct _topn_t topn_t;
+
+typedef struct {
+    const char *key;
+    uint64_t weight;
+    uint64_t error;
+    void *value;
+} topn_entry_t;
+
+topn_t *topnCreate(size_t, size_t);
+void topnDestroy(topn_t **);
+void *topnAdd(topn_t *, const char *, uint64_t);
+size_t topnGet(topn_t *, topn_entry_t *, size_t);
+void topnReset(topn_t *);
+size_t topnCount(topn_t *);
+uint64_t topnEvicted(topn_t *);
+
+#endif // __TOPN_H__
@@ -19,6 +19,7 @@
 #include <setjmp.h>
 #include <dirent.h>
 
+#include "arena.h"
 #include "atomic.h"
 #include "cfg.h"
 #include "cfgutils.h"
@@ -26,6 +27,7 @@
 #include "dbg.h"
 #include "dns.h"
 #include "fn.h"
+#include "histo.h"
 #include "httpagg.h"
 #include "os.h"
 #include "plattime.h"
@@ -52,6 +54,11 @@ static mtc_t *g_prevmtc = NULL;
 static ctl_t *g_prevctl = NULL;
 static const char *g_cmddir;
 static list_t *g_nsslist;
+static bool g_dormant = FALSE;
+static ipc_watch_t g_ipc = {.notifyFd = -1, .reqWd = -1, .reqDesc = (mqd_t)-1};
+static int g_cmdwatch = -1;
+static int g_cliwatch = -1;
+static char g_cmdwatchdir[PATH_MAX];
 static uint64_t reentrancy_guard = 0ULL;
 static rlim_t g_max_fds = 0;
 
@@ -64,9 +71,12 @@ __thread int g_ssl_fd = -1;
 // Forward declaration
 static void *periodic(void *);
 static void doConfig(config_t *);
+static void initActive(config_t *);
+static void initDormant(void);
 static void threadNow(int, siginfo_t *, void *);
 static void uv__read_hook(void *);
 static got_list_t inject_hook_list[];
+static got_index_t *g_hook_index = NULL;
 
 #ifdef __linux__
 extern unsigned long scope_fs;
@@ -248,24 +258,37 @@ freeNssEntry(void *data)
     scope_free(nssentry);
 }
 
-static time_t
-fileModTime(const char *path)
+typedef struct {
+    void *handle;
+    bool rules;
+} hook_filter_t;
+
+/*
+ * Only hook what the object can resolve. If the proc passes the rules
+ * then GOT hook all else only hook execve.
+ * TODO; all execv?
+ */
+static bool
+hookFilter(got_list_t *hook, void *data)
 {
-    int fd;
-    struct stat statbuf;
+    hook_filter_t *filter = data;
+    if ((filter->rules == FALSE) && !scope_strstr(hook->symbol, "execve")) return FALSE;
+    return (dlsym(filter->handle, hook->symbol) != NULL);
+}
 
-    if (!path) return 0;
+// Built once; the hook list doesn't change. Threads in dlopen() at the
+// same time may each build one; the first published is kept.
+static got_index_t *
+hookIndex(void)
+{
+    if (g_hook_index) return g_hook_index;
 
-    if ((fd = scope_open(path, O_RDONLY)) == -1) return 0;
-    
-    if (scope_fstat(fd, &statbuf) < 0) {
-        scope_close(fd);
-        return 0;
+    got_index_t *index = gotIndexCreate(inject_hook_list);
+    if (!index) return NULL;
+    if (!atomicCasU64((uint64_t *)&g_hook_index, (uint64_t)NULL, (uint64_t)index)) {
+        gotIndexDestroy(&index);
     }
-
-    scope_close(fd);
-    // STATMODTIME from os.h as timespec names are different between OSs
-    return STATMODTIME(statbuf);
+    return g_hook_index;
 }
 
 /*
@@ -309,17 +332,9 @@ hookAll(struct dl_phdr_info *info, size_t size, void *data)
 
     // Get the link map and ELF sections in advance of something matching
     if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            // if the proc passes the rules then GOT hook all else only hook execve
-            // TODO; all execv?
-            if (((*rules == TRUE) || scope_strstr(inject_hook_list[i].symbol, "execve")) &&
-                dlsym(handle, inject_hook_list[i].symbol)) {
-                if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from shared obj %s",
-                             inject_hook_list[i].symbol, info->dlpi_name);
-                }
-            }
-        }
+        hook_filter_t filter = {.handle = handle, .rules = *rules};
+        int patched = doGotchaAll(lm, hookIndex(), rel, sym, str, rsz, TRUE, hookFilter, &filter);
+        scopeLog(CFG_LOG_DEBUG, "\tGOT patched %d symbols from shared obj %s", patched, info->dlpi_name);
     }
 
     dlclose(handle);
@@ -350,17 +365,9 @@ hookAllAttach(struct dl_phdr_info *info, size_t size, void *data)
 
     // Get the link map and ELF sections in advance of something matching
     if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            // if the proc passes the rules then GOT hook all else only hook execve
-            // TODO; all execv?
-            if (((*rules == TRUE) || scope_strstr(inject_hook_list[i].symbol, "execve")) &&
-                dlsym(handle, inject_hook_list[i].symbol)) {
-                if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from shared obj %s",
-                             inject_hook_list[i].symbol, info->dlpi_name);
-                }
-            }
-        }
+        hook_filter_t filter = {.handle = handle, .rules = *rules};
+        int patched = doGotchaAll(lm, hookIndex(), rel, sym, str, rsz, TRUE, hookFilter, &filter);
+        scopeLog(CFG_LOG_DEBUG, "\tGOT patched %d symbols from shared obj %s", patched, info->dlpi_name);
     }
 
     dlclose(handle);
@@ -381,16 +388,9 @@ hookMain(bool rules)
 
     // Get the link map and ELF sections in advance of something matching
     if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            // if the proc passes the rules then GOT hook all else only hook execve
-            // TODO; all execv?
-            if (((rules == TRUE) || scope_strstr(inject_hook_list[i].symbol, "execve")) &&
-                dlsym(handle, inject_hook_list[i].symbol)) {
-                if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from main", inject_hook_list[i].symbol);
-                }
-            }
-        }
+        hook_filter_t filter = {.handle = handle, .rules = rules};
+        int patched = doGotchaAll(lm, hookIndex(), rel, sym, str, rsz, TRUE, hookFilter, &filter);
+        scopeLog(CFG_LOG_DEBUG, "\tGOT patched %d symbols from main", patched);
     }
 
     dlclose(handle);
@@ -421,12 +421,8 @@ unHookAll(struct dl_phdr_info *info, size_t size, void *data)
 
     // Get the link map and ELF sections in advance of something matching
     if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-            if (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, FALSE) != -1) {
-                scopeLog(CFG_LOG_DEBUG, "\tGOT detached %s from shared obj %s",
-                         inject_hook_list[i].symbol, info->dlpi_name);
-            }
-        }
+        int patched = doGotchaAll(lm, hookIndex(), rel, sym, str, rsz, FALSE, NULL, NULL);
+        scopeLog(CFG_LOG_DEBUG, "\tGOT detached %d symbols from shared obj %s", patched, info->dlpi_name);
     }
 
     dlclose(handle);
@@ -439,7 +435,9 @@ cmdDetach(void)
     if (!g_cfg.funcs_attached) return TRUE;
 
     scopeLog(CFG_LOG_DEBUG, "%s:%d", __FUNCTION__, __LINE__);
+    osMapsLoad();
     dl_iterate_phdr(unHookAll, NULL);
+    osMapsRelease();
     g_cfg.funcs_attached = FALSE;
     return TRUE;
 }
@@ -452,8 +450,13 @@ cmdAttach(void)
     bool rules = TRUE;
     scopeLog(CFG_LOG_DEBUG, "%s:%d", __FUNCTION__, __LINE__);
 
+    // Attached for the first time; what the constructor left for now
+    initDormant();
+
+    osMapsLoad();
     dl_iterate_phdr(hookAllAttach, &rules);
     hookMain(rules);
+    osMapsRelease();
 
     g_cfg.funcs_attached = TRUE;
 
@@ -485,17 +488,17 @@ static void
 ipcCommunication(void) {
     size_t appMqSize = -1;
     long msgCount = -1;
-    char name[256] = {0};
+    const char *name = g_ipc.respName;
 
     /*
     * Handle incoming message queue
     * - check if it exists
     * - check if there are message request on it
     */
-    scope_snprintf(name, sizeof(name), "/ScopeIPCIn.%d", g_proc.pid);
-    mqd_t mqRequestDesc  = ipcOpenConnection(name, O_RDONLY | O_NONBLOCK);
+    mqd_t mqRequestDesc = ipcWatchRequestQueue(&g_ipc);
 
     if (ipcIsActive(mqRequestDesc, &appMqSize, &msgCount) == FALSE) {
+        ipcWatchRelease(&g_ipc, mqRequestDesc);
         return;
     }
 
@@ -508,9 +511,6 @@ ipcCommunication(void) {
     * Handle output message queue
     * - check if it exists
     */
-    scope_memset(name, 0, sizeof(name));
-    scope_snprintf(name, sizeof(name), "/ScopeIPCOut.%d", g_proc.pid);
-
     mqd_t mqResponseDesc = ipcOpenConnection(name, O_WRONLY | O_NONBLOCK);
     if (ipcIsActive(mqResponseDesc, &cliMqSize, &msgCount) == FALSE) {
         scopeLogError("%s is not active.", name);
@@ -545,47 +545,17 @@ ipcCommunication(void) {
     ipcCloseConnection(mqResponseDesc);
 
 cleanupReqMq:
-    ipcCloseConnection(mqRequestDesc);
+    ipcWatchRelease(&g_ipc, mqRequestDesc);
 }
 
+// Called when there's data on the control connection
 static void
-remoteConfig(void)
+remoteConfig(int fd)
 {
-    int timeout;
-    struct pollfd fds;
     int rc, success, numtries;
     FILE *fs;
     char buf[1024];
     char path[PATH_MAX];
-    
-    // to be clear; a 1ms timeout
-    timeout = 1;
-    scope_memset(&fds, 0x0, sizeof(fds));
-
-    // We want to accept incoming requests on TCP, unix, and edge.
-    // However, we don't currently support receiving on TLS connections.
-    int acceptRequests = transportSupportsCommandControl(ctlTransport(g_ctl, CFG_CTL));
-    fds.events = (acceptRequests) ? POLLIN : 0;
-
-    fds.fd = ctlConnection(g_ctl, CFG_CTL);
-
-    rc = scope_poll(&fds, 1, timeout);
-
-    /*
-     * Error from poll;
-     * doing this separtately in order to count errors. Necessary?
-     */
-    if (rc < 0) {
-        DBG(NULL);
-        return;
-    }
-
-    /*
-     * Timeout or no read data?
-     * We can track exceptions where revents != POLLIN. Necessary?
-     */
-    if ((rc == 0) || (fds.revents == 0) || ((fds.revents & POLLIN) == 0) ||
-        ((fds.revents & POLLHUP) != 0) || ((fds.revents & POLLNVAL) != 0)) return;
 
     scope_snprintf(path, sizeof(path), "/tmp/cfg.%d", g_proc.pid);
     if ((fs = scope_fopen(path, "a+")) == NULL) {
@@ -597,7 +567,7 @@ remoteConfig(void)
     success = rc = scope_errno = numtries = 0;
     do {
         numtries++;
-        rc = scope_recv(fds.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        rc = scope_recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
         if (rc <= 0) {
             // Something has happened to this incoming message
             break;
@@ -741,6 +711,9 @@ doConfig(config_t *cfg)
         g_thread.startTime = tv.tv_sec + g_thread.interval;
     }
 
+    setReportingFsPaths(cfg);
+    setReportingNetTop(cfg);
+    setReportingStatsDMaxSeries(cfg);
     setVerbosity(cfgMtcVerbosity(cfg));
 
     g_cmddir = cfgCmdDir(cfg);
@@ -774,11 +747,11 @@ static int
 dynConfig(void)
 {
     FILE *fs;
-    time_t now;
+    struct stat sb;
     char *path;
     char userpath[PATH_MAX];
     char clipath[PATH_MAX];
-    static time_t modtime = 0;
+    static struct stat done = {0};
 
     scope_snprintf(userpath, sizeof(userpath), "%s/%s.%d", g_cmddir, DYN_CONFIG_PREFIX, g_proc.pid);
     scope_snprintf(clipath, sizeof(clipath), "%s/%s.%d", DYN_CONFIG_CLI_DIR, DYN_CONFIG_CLI_PREFIX, g_proc.pid);
@@ -792,15 +765,18 @@ dynConfig(void)
         return 0;
     }
 
-    // Have we already processed this file?
-    now = fileModTime(path);
-    if (now == modtime) {
+    // Have we already processed this file? One we couldn't remove is
+    // only applied again when it's replaced or written again.
+    if (scope_stat(path, &sb) == -1) return 0;
+    if ((sb.st_dev == done.st_dev) && (sb.st_ino == done.st_ino) &&
+        (sb.st_mtim.tv_sec == done.st_mtim.tv_sec) &&
+        (sb.st_mtim.tv_nsec == done.st_mtim.tv_nsec)) {
         // Been there, try to remove the file and we're done
         scope_unlink(path);
         return 0;
     }
 
-    modtime = now;
+    done = sb;
 
     // Open the command file
     if ((fs = scope_fopen(path, "r")) == NULL) return -1;
@@ -820,6 +796,78 @@ dynConfig(void)
     return 0;
 }
 
+static void
+cmdWatchStop(void)
+{
+    ipcWatchRemove(&g_ipc, g_cmdwatch);
+    if (g_cliwatch != g_cmdwatch) ipcWatchRemove(&g_ipc, g_cliwatch);
+    g_cmdwatch = -1;
+    g_cliwatch = -1;
+}
+
+/*
+ * Watches the command directories, so that dynConfig() is only called
+ * when a command file has been written. They're watched with the inotify
+ * instance that's watching for the CLI's request queue; call after
+ * ipcWatchStart(), or cmdWatchStop(). Returns FALSE if they can't be
+ * watched; dynConfig() is then called every period to look for one.
+ */
+static bool
+cmdWatchStart(void)
+{
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+    if (!g_cmddir) return FALSE;
+    scope_strncpy(g_cmdwatchdir, g_cmddir, sizeof(g_cmdwatchdir) - 1);
+
+    if (((g_cmdwatch = ipcWatchAdd(&g_ipc, g_cmddir, mask)) == -1) ||
+        ((g_cliwatch = ipcWatchAdd(&g_ipc, DYN_CONFIG_CLI_DIR, mask)) == -1)) {
+        cmdWatchStop();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Handles an event of the command directories; sets *written if it's
+ * of a command file for this process. When a directory isn't watched
+ * any more (it was removed, moved, or unmounted, or the inotify instance
+ * stopped working) we look every period from now on; and now, in case
+ * we missed one.
+ */
+static void
+cmdWatchUpdate(const struct inotify_event *event, void *data)
+{
+    char username[64];
+    char cliname[64];
+    bool *written = data;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+        *written = TRUE;
+        return;
+    }
+    if (event->wd == -1) {
+        g_cmdwatch = -1;
+        g_cliwatch = -1;
+        *written = TRUE;
+        return;
+    }
+    if ((event->wd != g_cmdwatch) && (event->wd != g_cliwatch)) return;
+
+    if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+        cmdWatchStop();
+        *written = TRUE;
+        return;
+    }
+
+    scope_snprintf(username, sizeof(username), "%s.%d", DYN_CONFIG_PREFIX, g_proc.pid);
+    scope_snprintf(cliname, sizeof(cliname), "%s.%d", DYN_CONFIG_CLI_PREFIX, g_proc.pid);
+    if (event->len && (!scope_strcmp(event->name, username) ||
+                       !scope_strcmp(event->name, cliname))) {
+        *written = TRUE;
+    }
+}
+
 static void
 threadNow(int sig, siginfo_t *info, void *secret)
 {
@@ -837,6 +885,10 @@ threadNow(int sig, siginfo_t *info, void *secret)
         }
     }
 
+    // Nothing the thread uses exists in a dormant process until it's
+    // attached; cmdAttach() starts it then
+    if (!g_cfg.staticfg) return;
+
     if (!atomicCasU64(&serialize, 0ULL, 1ULL)) return;
 
     // Create one thread at most
@@ -1001,6 +1053,7 @@ doReset(void)
     g_thread.once = 0;
     g_thread.startTime = tv.tv_sec + g_thread.interval;
 
+    arenaAtFork();
     resetState();
 
     // set stdout/stderr to unknown
@@ -1032,12 +1085,17 @@ reportPeriodicStuff(void)
     doEvent();
     doPayload();
 
+    // aggregate and send captured statsd metrics
+    doStatsdAgg();
+
     if (cfgMtcWatchEnable(g_cfg.staticfg, CFG_MTC_PROC)) {
         doProcMetric(PROC_CPU);
-        doProcMetric(PROC_MEM);
-        doProcMetric(PROC_THREAD);
+        doProcMetric(PROC_STAT);
         doProcMetric(PROC_FD);
-        doProcMetric(PROC_CHILD);
+        doProcMetric(PROC_RUSAGE);
+        doProcMetric(PROC_IO);
+        doProcMetric(PROC_CGROUP);
+        doArenaMetric();
     }
 
     // report totals (not by file descriptor/socket descriptor)
@@ -1061,6 +1119,7 @@ reportPeriodicStuff(void)
     doTotalDuration(TOT_FS_DURATION);
     doTotalDuration(TOT_NET_DURATION);
     doTotalDuration(TOT_DNS_DURATION);
+    doLatencyMetric();
 
     // Having NULL in the third and fourth parameters (func and name)
     // is how report.c knows that this doErrorMetric() is a "summary"
@@ -1075,6 +1134,14 @@ reportPeriodicStuff(void)
     // report net and file by descriptor
     reportAllFds(PERIODIC);
 
+    // or file by path and net by remote endpoint, once the descriptors'
+    // counts are in
+    doFSAgg();
+    doNetAgg();
+
+    // repeated dns answers that no later report carried out
+    doDNSRepeats();
+
     mtcFlush(g_mtc);
 }
 
@@ -1195,10 +1262,70 @@ enableSnapshot(config_t *cfg) {
     }
 }
 
+/*
+ * Waits up to 1ms for a request; on the control connection, from the
+ * CLI, or in a command file. The CLI's request queue is only looked for
+ * by name on every pass when we can't watch for it.
+ */
+static void
+handleRequests(void)
+{
+    int rc;
+    struct pollfd fds[3];
+    bool written = FALSE;
+
+    // to be clear; a 1ms timeout
+    int timeout = 1;
+    scope_memset(fds, 0x0, sizeof(fds));
+
+    // We want to accept incoming requests on TCP, unix, and edge.
+    // However, we don't currently support receiving on TLS connections.
+    int acceptRequests = transportSupportsCommandControl(ctlTransport(g_ctl, CFG_CTL));
+    fds[0].events = (acceptRequests) ? POLLIN : 0;
+    fds[0].fd = ctlConnection(g_ctl, CFG_CTL);
+
+    // Negative descriptors are ignored. The command directories are
+    // watched with the same inotify instance as the request queue.
+    fds[1].fd = g_ipc.notifyFd;
+    fds[1].events = POLLIN;
+    fds[2].fd = g_ipc.reqDesc;
+    fds[2].events = POLLIN;
+
+    rc = scope_poll(fds, ARRAY_SIZE(fds), timeout);
+
+    /*
+     * Error from poll;
+     * doing this separtately in order to count errors. Necessary?
+     */
+    if (rc < 0) {
+        DBG(NULL);
+        return;
+    }
+
+    /*
+     * Read data on the control connection?
+     * We can track exceptions where revents != POLLIN. Necessary?
+     */
+    if ((rc > 0) && ((fds[0].revents & POLLIN) != 0) &&
+        ((fds[0].revents & POLLHUP) == 0) && ((fds[0].revents & POLLNVAL) == 0)) {
+        remoteConfig(fds[0].fd);
+    }
+
+    if ((rc > 0) && (fds[1].revents != 0)) ipcWatchUpdate(&g_ipc, cmdWatchUpdate, &written);
+
+    if ((g_ipc.reqWd == -1) || ((fds[2].revents & POLLIN) != 0)) {
+        ipcCommunication();
+    }
+
+    if (written) dynConfig();
+}
 
 static void *
 periodic(void *arg)
 {
+    // See threadNow(); not until initActive() has run
+    if (!g_cfg.staticfg) return NULL;
+
     // Mask all the signals for this thread to avoid issues with go runtime.
     // Go runtime installs their own signal handlers so the go signal handler 
     // may get executed in the context of this thread, which will cause the app to 
@@ -1215,6 +1342,14 @@ periodic(void *arg)
     }
 
     pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    // We created this thread, so its stack is known to be big enough
+    // for pcre2 without switching to one of the pooled regex stacks.
+    regexSetStackHeadroom(TRUE);
+
+    // proc metrics leave out what this thread does
+    setReportingThread();
+
     bool perf;
     static time_t summaryTime, logReportTime;
 
@@ -1224,6 +1359,16 @@ periodic(void *arg)
 
     perf = checkEnv(PRESERVE_PERF_REPORTING, "true");
 
+    // After a fork, this is the child's thread; it has a new pid. What
+    // the parent watched was closed with the parent's inotify instance.
+    ipcWatchStart(&g_ipc, g_proc.pid);
+    g_cmdwatch = -1;
+    g_cliwatch = -1;
+
+    // And a command file could have been written before we were watching
+    cmdWatchStart();
+    dynConfig();
+
     while (1) {
         // we are trying to exit, do nothing
         if (g_exitdone == TRUE) {
@@ -1232,8 +1377,16 @@ periodic(void *arg)
 
         scope_gettimeofday(&tv, NULL);
         if (tv.tv_sec >= summaryTime) {
-            // Process dynamic config changes, if any
-            dynConfig();
+            // Process dynamic config changes, if any. A watched command
+            // directory has its changes processed as they're made; but
+            // the config can name a new one.
+            if (g_cmdwatch == -1) {
+                dynConfig();
+            } else if (g_cmddir && scope_strcmp(g_cmdwatchdir, g_cmddir)) {
+                cmdWatchStop();
+                cmdWatchStart();
+                dynConfig();
+            }
 
             // TODO: need to ensure that the previous object is no longer in use
             // Clean up previous objects if they exist.
@@ -1271,8 +1424,7 @@ periodic(void *arg)
                 atomicCasU64(&reentrancy_guard, 1ULL, 0ULL);
             }
         }
-        remoteConfig();
-        ipcCommunication();
+        handleRequests();
     }
 
     return NULL;
@@ -1457,14 +1609,9 @@ hookSharedObjs(struct dl_phdr_info *info, size_t size, void *data)
 
     // Get the link map and ELF sections in advance of something matching
     if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) && (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
-        for (int i=0; inject_hook_list[i].symbol; i++) {
-
-            if ((dlsym(handle, inject_hook_list[i].symbol)) &&
-                (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1)) {
-                    scopeLog(CFG_LOG_DEBUG, "\tGOT patched %s from shared obj %s",
-                             inject_hook_list[i].symbol, info->dlpi_name);
-            }
-        }
+        hook_filter_t filter = {.handle = handle, .rules = TRUE};
+        int patched = doGotchaAll(lm, hookIndex(), rel, sym, str, rsz, TRUE, hookFilter, &filter);
+        scopeLog(CFG_LOG_DEBUG, "\tGOT patched %d symbols from shared obj %s", patched, info->dlpi_name);
     }
 
     dlclose(handle);
@@ -1485,7 +1632,9 @@ hookInject(void)
             return FALSE;
         }
 
+        osMapsLoad();
         dl_iterate_phdr(hookSharedObjs, libscopeHandle);
+        osMapsRelease();
         dlclose(libscopeHandle);
 
         return TRUE;
@@ -1509,6 +1658,9 @@ initHook(int attachedFlag, bool scopedFlag, elf_buf_t *ebuf, char *full_path)
         // If executed from the filesystem it's path will be scopedyn
         if (full_path && (scope_strstr(full_path, "scopedyn") == NULL) && (scope_strstr(full_path, "memfd") == NULL)) {
             if (!ebuf) return;
+            // The Go hooks and the thread need all of our state; a Go
+            // process isn't left dormant
+            initDormant();
             initGoHook(ebuf);
             threadNow(0, NULL, NULL);
         }
@@ -1520,8 +1672,10 @@ initHook(int attachedFlag, bool scopedFlag, elf_buf_t *ebuf, char *full_path)
         hookInject();
     } else {
         // GOT hooking all interposed funcs
+        osMapsLoad();
         dl_iterate_phdr(hookAll, &scopedFlag);
         hookMain(scopedFlag);
+        osMapsRelease();
     }
 
     // libmusl
@@ -1886,6 +2040,17 @@ typedef struct {
     config_t *cfg;
 } settings_t;
 
+// scope.yml, with the env vars applied over it
+static config_t *
+readCfg(void)
+{
+    char *path = cfgPath();
+    config_t *cfg = cfgRead(path);
+    if (path) scope_free(path);
+    cfgProcessEnvironment(cfg);
+    return cfg;
+}
+
 /*
 * We actively scope applications:
 * - when we are attaching
@@ -1935,20 +2100,70 @@ getSettings(bool attachedFlag)
         }
     }
 
-    if (readCfgFile == TRUE) {
-        char *path = NULL;
-        path = cfgPath();
+    if (!scopedFlag) {
+        // Not scoped; there's no use for scope.yml unless it's attached
+        if (cfg) cfgDestroy(&cfg);
+    } else if (readCfgFile == TRUE) {
         if (cfg) cfgDestroy(&cfg);
-        cfg = cfgRead(path);
-        if (path) scope_free(path);
+        cfg = readCfg();
+    } else {
+        cfgProcessEnvironment(cfg);
     }
-    cfgProcessEnvironment(cfg);
 
     settings_t settings = {.isActive = scopedFlag,
                           .cfg = cfg};
     return settings;
 }
 
+/*
+ * A process that was left dormant reads its config only when it's first
+ * needed; see getSettings().
+ */
+static void
+initDormant(void)
+{
+    if (!g_dormant) return;
+    g_dormant = FALSE;
+    initActive(readCfg());
+}
+
+/*
+ * Everything a process needs to be scoped. Called from the constructor,
+ * or when a dormant process is first attached.
+ */
+static void
+initActive(config_t *cfg)
+{
+    initState();
+
+    g_nsslist = lstCreate(freeNssEntry);
+
+    initTime();
+
+    // on aarch64, the crypto subsystem installs handlers for SIGILL
+    // (contrib/openssl/crypto/armcap.c) to determine which version of
+    // ARM processor we're on.  Do this before enableSnapshot() below.
+    transportInit();
+
+    doConfig(cfg);
+
+    // TODO: if we update the configuration via IPC it will not be updated
+    enableSnapshot(cfg);
+
+    g_staticfg = cfg;
+    if (!g_dbg) dbgInit();
+    g_getdelim = 0;
+
+    g_cfg.staticfg = g_staticfg;
+    g_cfg.cfgStr = jsonStringFromCfg(g_staticfg);
+    g_cfg.blockconn = DEFAULT_PORTBLOCK;
+
+    // replaces atexit(handleExit);  Allows events to be reported before
+    // the TLS destructors are run.  This mechanism is used regardless
+    // of whether TLS is actually configured on any transport.
+    transportRegisterForExitNotification(handleExit);
+}
+
 /*
 * This is a helper function designed to facilitate the debugging process
 * of the constructor. To utilize this function, place a call to dbgConstructorFn()
@@ -2019,11 +2234,8 @@ init(void)
     int attachedFlag = 0;
     initEnv(&attachedFlag);
 
-    initState();
-
-    g_nsslist = lstCreate(freeNssEntry);
-
-    initTime();
+    // The config can add protocols; that's all of our state it needs
+    initProtocolList();
 
     // settings contain isActive and cfg fields which depend on the existance and
     // contents of a rules file, env vars, scope.yml, etc.
@@ -2039,30 +2251,17 @@ init(void)
         return;
     }
 
-    // on aarch64, the crypto subsystem installs handlers for SIGILL
-    // (contrib/openssl/crypto/armcap.c) to determine which version of
-    // ARM processor we're on.  Do this before enableSnapshot() below.
-    transportInit();
-
-    doConfig(settings.cfg);
-
-    // Currently we enable snapshot feature only in case of constructor
-    // TODO: if we update the configuration via IPC it will not be updated
-    enableSnapshot(settings.cfg);
-
-    g_staticfg = settings.cfg;
-    if (!g_dbg) dbgInit();
-    g_getdelim = 0;
-
+    /*
+     * A process that isn't scoped is left dormant. It has the execve
+     * hooks (below) and nothing else of ours; no tracking tables, no
+     * transports, no thread. It's all set up if it's ever attached.
+     */
     g_cfg.funcs_attached = settings.isActive;
-    g_cfg.staticfg = g_staticfg;
-    g_cfg.cfgStr = jsonStringFromCfg(g_staticfg);
-    g_cfg.blockconn = DEFAULT_PORTBLOCK;
-
-    // replaces atexit(handleExit);  Allows events to be reported before
-    // the TLS destructors are run.  This mechanism is used regardless
-    // of whether TLS is actually configured on any transport.
-    transportRegisterForExitNotification(handleExit);
+    if (settings.isActive) {
+        initActive(settings.cfg);
+    } else {
+        g_dormant = TRUE;
+    }
 
     initHook(attachedFlag, settings.isActive, ebuf, full_path);
 
@@ -2214,10 +2413,11 @@ open(const char *pathname, int flags, ...)
     struct FuncArgs fArgs;
 
     WRAP_CHECK(open, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     LOAD_FUNC_ARGS_VALIST(fArgs, flags);
 
     fd = g_fn.open(pathname, flags, fArgs.arg[0]);
-    doOpen(fd, pathname, FD, "open");
+    doOpen(fd, initialTime, pathname, FD, "open");
 
     return fd;
 }
@@ -2229,9 +2429,10 @@ openat(int dirfd, const char *pathname, int flags, ...)
     struct FuncArgs fArgs;
 
     WRAP_CHECK(openat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     LOAD_FUNC_ARGS_VALIST(fArgs, flags);
     fd = g_fn.openat(dirfd, pathname, flags, fArgs.arg[0]);
-    doOpen(fd, pathname, FD, "openat");
+    doOpen(fd, initialTime, pathname, FD, "openat");
 
     return fd;
 }
@@ -2242,9 +2443,10 @@ opendir(const char *name)
     DIR *dirp;
 
     WRAP_CHECK(opendir, NULL);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     dirp = g_fn.opendir(name);
     int fd = (dirp) ? dirfd(dirp) : -1;
-    doOpen(fd, name, FD, "opendir");
+    doOpen(fd, initialTime, name, FD, "opendir");
 
     return dirp;
 }
@@ -2289,8 +2491,9 @@ creat(const char *pathname, mode_t mode)
     int fd;
 
     WRAP_CHECK(creat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     fd = g_fn.creat(pathname, mode);
-    doOpen(fd, pathname, FD, "creat");
+    doOpen(fd, initialTime, pathname, FD, "creat");
 
     return fd;
 }
@@ -2301,9 +2504,10 @@ fopen(const char *pathname, const char *mode)
     FILE *stream;
 
     WRAP_CHECK(fopen, NULL);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     stream = g_fn.fopen(pathname, mode);
     int fd = (stream) ? fileno(stream) : -1;
-    doOpen(fd, pathname, STREAM, "fopen");
+    doOpen(fd, initialTime, pathname, STREAM, "fopen");
 
     return stream;
 }
@@ -2314,11 +2518,12 @@ freopen(const char *pathname, const char *mode, FILE *orig_stream)
     FILE *stream;
 
     WRAP_CHECK(freopen, NULL);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     stream = g_fn.freopen(pathname, mode, orig_stream);
     // freopen just changes the mode if pathname is null
     if (stream != NULL) {
         if (pathname != NULL) {
-            doOpen(fileno(stream), pathname, STREAM, "freopen");
+            doOpen(fileno(stream), initialTime, pathname, STREAM, "freopen");
             doClose(fileno(orig_stream), "freopen");
         }
     } else {
@@ -2507,9 +2712,10 @@ open64(const char *pathname, int flags, ...)
     struct FuncArgs fArgs;
 
     WRAP_CHECK(open64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     LOAD_FUNC_ARGS_VALIST(fArgs, flags);
     fd = g_fn.open64(pathname, flags, fArgs.arg[0]);
-    doOpen(fd, pathname, FD, "open64");
+    doOpen(fd, initialTime, pathname, FD, "open64");
 
     return fd;
 }
@@ -2521,9 +2727,10 @@ openat64(int dirfd, const char *pathname, int flags, ...)
     struct FuncArgs fArgs;
 
     WRAP_CHECK(openat64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     LOAD_FUNC_ARGS_VALIST(fArgs, flags);
     fd = g_fn.openat64(dirfd, pathname, flags, fArgs.arg[0]);
-    doOpen(fd, pathname, FD, "openat64");
+    doOpen(fd, initialTime, pathname, FD, "openat64");
 
     return fd;
 }
@@ -2534,8 +2741,9 @@ __open_2(const char *file, int oflag)
     int fd;
 
     WRAP_CHECK(__open_2, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     fd = g_fn.__open_2(file, oflag);
-    doOpen(fd, file, FD, "__open_2");
+    doOpen(fd, initialTime, file, FD, "__open_2");
 
     return fd;
 }
@@ -2546,8 +2754,9 @@ __open64_2(const char *file, int oflag)
     int fd;
 
     WRAP_CHECK(__open64_2, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     fd = g_fn.__open64_2(file, oflag);
-    doOpen(fd, file, FD, "__open64_2");
+    doOpen(fd, initialTime, file, FD, "__open64_2");
 
     return fd;
 }
@@ -2556,8 +2765,9 @@ EXPORTOFF int
 __openat_2(int fd, const char *file, int oflag)
 {
     WRAP_CHECK(__openat_2, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     fd = g_fn.__openat_2(fd, file, oflag);
-    doOpen(fd, file, FD, "__openat_2");
+    doOpen(fd, initialTime, file, FD, "__openat_2");
 
     return fd;
 }
@@ -2569,8 +2779,9 @@ creat64(const char *pathname, mode_t mode)
     int fd;
 
     WRAP_CHECK(creat64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     fd = g_fn.creat64(pathname, mode);
-    doOpen(fd, pathname, FD, "creat64");
+    doOpen(fd, initialTime, pathname, FD, "creat64");
 
     return fd;
 }
@@ -2581,9 +2792,10 @@ fopen64(const char *pathname, const char *mode)
     FILE *stream;
 
     WRAP_CHECK(fopen64, NULL);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     stream = g_fn.fopen64(pathname, mode);
     int fd = (stream) ? fileno(stream) : -1;
-    doOpen(fd, pathname, STREAM, "fopen64");
+    doOpen(fd, initialTime, pathname, STREAM, "fopen64");
 
     return stream;
 }
@@ -2594,10 +2806,11 @@ freopen64(const char *pathname, const char *mode, FILE *orig_stream)
     FILE *stream;
 
     WRAP_CHECK(freopen64, NULL);
+    uint64_t initialTime = latencyStartTime(HISTO_OPEN);
     stream = g_fn.freopen64(pathname, mode, orig_stream);
     // freopen just changes the mode if pathname is null
     int fd = (stream) ? fileno(stream) : -1;
-    doOpen(fd, pathname, STREAM, "freopen64");
+    doOpen(fd, initialTime, pathname, STREAM, "freopen64");
     if ((stream != NULL) && (pathname != NULL)) {
         doClose(fileno(orig_stream), "freopen64");
     }
@@ -2817,9 +3030,10 @@ EXPORTOFF int
 statfs64(const char *path, struct statfs64 *buf)
 {
     WRAP_CHECK(statfs64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.statfs64(path, buf);
 
-    doStatPath(path, rc, "statfs64");
+    doStatPath(path, initialTime, rc, "statfs64");
 
     return rc;
 }
@@ -2828,9 +3042,10 @@ EXPORTOFF int
 fstatfs64(int fd, struct statfs64 *buf)
 {
     WRAP_CHECK(fstatfs64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.fstatfs64(fd, buf);
 
-    doStatFd(fd, rc, "fstatfs64");
+    doStatFd(fd, initialTime, rc, "fstatfs64");
 
     return rc;
 }
@@ -2850,9 +3065,10 @@ EXPORTOFF int
 __xstat(int ver, const char *path, struct stat *stat_buf)
 {
     WRAP_CHECK(__xstat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__xstat(ver, path, stat_buf);
 
-    doStatPath(path, rc, "__xstat");
+    doStatPath(path, initialTime, rc, "__xstat");
 
     return rc;    
 }
@@ -2861,9 +3077,10 @@ EXPORTOFF int
 __xstat64(int ver, const char *path, struct stat64 *stat_buf)
 {
     WRAP_CHECK(__xstat64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__xstat64(ver, path, stat_buf);
 
-    doStatPath(path, rc, "__xstat64");
+    doStatPath(path, initialTime, rc, "__xstat64");
 
     return rc;    
 }
@@ -2872,9 +3089,10 @@ EXPORTOFF int
 __lxstat(int ver, const char *path, struct stat *stat_buf)
 {
     WRAP_CHECK(__lxstat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__lxstat(ver, path, stat_buf);
 
-    doStatPath(path, rc, "__lxstat");
+    doStatPath(path, initialTime, rc, "__lxstat");
 
     return rc;
 }
@@ -2883,9 +3101,10 @@ EXPORTOFF int
 __lxstat64(int ver, const char *path, struct stat64 *stat_buf)
 {
     WRAP_CHECK(__lxstat64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__lxstat64(ver, path, stat_buf);
 
-    doStatPath(path, rc, "__lxstat64");
+    doStatPath(path, initialTime, rc, "__lxstat64");
 
     return rc;
 }
@@ -2894,9 +3113,10 @@ EXPORTOFF int
 __fxstat(int ver, int fd, struct stat *stat_buf)
 {
     WRAP_CHECK(__fxstat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__fxstat(ver, fd, stat_buf);
 
-    doStatFd(fd, rc, "__fxstat");
+    doStatFd(fd, initialTime, rc, "__fxstat");
 
     return rc;
 }
@@ -2905,9 +3125,10 @@ EXPORTOFF int
 __fxstat64(int ver, int fd, struct stat64 * stat_buf)
 {
     WRAP_CHECK(__fxstat64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__fxstat64(ver, fd, stat_buf);
 
-    doStatFd(fd, rc, "__fxstat64");
+    doStatFd(fd, initialTime, rc, "__fxstat64");
 
     return rc;
 }
@@ -2916,9 +3137,10 @@ EXPORTOFF int
 __fxstatat(int ver, int dirfd, const char *path, struct stat *stat_buf, int flags)
 {
     WRAP_CHECK(__fxstatat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__fxstatat(ver, dirfd, path, stat_buf, flags);
 
-    doStatPath(path, rc, "__fxstatat");
+    doStatPath(path, initialTime, rc, "__fxstatat");
 
     return rc;
 }
@@ -2927,9 +3149,10 @@ EXPORTOFF int
 __fxstatat64(int ver, int dirfd, const char * path, struct stat64 * stat_buf, int flags)
 {
     WRAP_CHECK(__fxstatat64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.__fxstatat64(ver, dirfd, path, stat_buf, flags);
 
-    doStatPath(path, rc, "__fxstatat64");
+    doStatPath(path, initialTime, rc, "__fxstatat64");
 
     return rc;
 }
@@ -2940,9 +3163,10 @@ statx(int dirfd, const char *pathname, int flags,
       unsigned int mask, struct statx *statxbuf)
 {
     WRAP_CHECK(statx, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.statx(dirfd, pathname, flags, mask, statxbuf);
 
-    doStatPath(pathname, rc, "statx");
+    doStatPath(pathname, initialTime, rc, "statx");
 
     return rc;
 }
@@ -2952,9 +3176,10 @@ EXPORTOFF int
 statfs(const char *path, struct statfs *buf)
 {
     WRAP_CHECK(statfs, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.statfs(path, buf);
 
-    doStatPath(path, rc, "statfs");
+    doStatPath(path, initialTime, rc, "statfs");
 
     return rc;
 }
@@ -2963,9 +3188,10 @@ EXPORTOFF int
 fstatfs(int fd, struct statfs *buf)
 {
     WRAP_CHECK(fstatfs, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.fstatfs(fd, buf);
 
-    doStatFd(fd, rc, "fstatfs");
+    doStatFd(fd, initialTime, rc, "fstatfs");
 
     return rc;
 }
@@ -2974,9 +3200,10 @@ EXPORTOFF int
 statvfs(const char *path, struct statvfs *buf)
 {
     WRAP_CHECK(statvfs, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.statvfs(path, buf);
 
-    doStatPath(path, rc, "statvfs");
+    doStatPath(path, initialTime, rc, "statvfs");
 
     return rc;
 }
@@ -2985,9 +3212,10 @@ EXPORTOFF int
 statvfs64(const char *path, struct statvfs64 *buf)
 {
     WRAP_CHECK(statvfs64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.statvfs64(path, buf);
 
-    doStatPath(path, rc, "statvfs64");
+    doStatPath(path, initialTime, rc, "statvfs64");
 
     return rc;
 }
@@ -2996,9 +3224,10 @@ EXPORTOFF int
 fstatvfs(int fd, struct statvfs *buf)
 {
     WRAP_CHECK(fstatvfs, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.fstatvfs(fd, buf);
 
-    doStatFd(fd, rc, "fstatvfs");
+    doStatFd(fd, initialTime, rc, "fstatvfs");
 
     return rc;
 }
@@ -3007,9 +3236,10 @@ EXPORTOFF int
 fstatvfs64(int fd, struct statvfs64 *buf)
 {
     WRAP_CHECK(fstatvfs64, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.fstatvfs64(fd, buf);
 
-    doStatFd(fd, rc, "fstatvfs64");
+    doStatFd(fd, initialTime, rc, "fstatvfs64");
 
     return rc;
 }
@@ -3018,9 +3248,10 @@ EXPORTOFF int
 access(const char *pathname, int mode)
 {
     WRAP_CHECK(access, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.access(pathname, mode);
 
-    doStatPath(pathname, rc, "access");
+    doStatPath(pathname, initialTime, rc, "access");
 
     return rc;
 }
@@ -3029,9 +3260,10 @@ EXPORTOFF int
 faccessat(int dirfd, const char *pathname, int mode, int flags)
 {
     WRAP_CHECK(faccessat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.faccessat(dirfd, pathname, mode, flags);
 
-    doStatPath(pathname, rc, "faccessat");
+    doStatPath(pathname, initialTime, rc, "faccessat");
 
     return rc;
 }
@@ -3095,9 +3327,10 @@ EXPORTOFF int
 stat(const char *pathname, struct stat *statbuf)
 {
     WRAP_CHECK(stat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.stat(pathname, statbuf);
 
-    doStatPath(pathname, rc, "stat");
+    doStatPath(pathname, initialTime, rc, "stat");
 
     return rc;
 }
@@ -3106,9 +3339,10 @@ EXPORTOFF int
 fstat(int fd, struct stat *statbuf)
 {
     WRAP_CHECK(fstat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.fstat(fd, statbuf);
 
-    doStatFd(fd, rc, "fstat");
+    doStatFd(fd, initialTime, rc, "fstat");
 
     return rc;
 }
@@ -3117,9 +3351,10 @@ EXPORTOFF int
 lstat(const char *pathname, struct stat *statbuf)
 {
     WRAP_CHECK(lstat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.lstat(pathname, statbuf);
 
-    doStatPath(pathname, rc, "lstat");
+    doStatPath(pathname, initialTime, rc, "lstat");
 
     return rc;
 }
@@ -3128,9 +3363,10 @@ EXPORTOFF int
 fstatat(int fd, const char *path, struct stat *buf, int flag)
 {
     WRAP_CHECK(fstatat, -1);
+    uint64_t initialTime = latencyStartTime(HISTO_STAT);
     int rc = g_fn.fstatat(fd, path, buf, flag);
 
-    doStatFd(fd, rc, "fstatat");
+    doStatFd(fd, initialTime, rc, "fstatat");
 
     return rc;
 }
@@ -4268,21 +4504,20 @@ dlopen(const char *filename, int flags)
         Elf64_Sym *sym = NULL;
         Elf64_Rela *rel = NULL;
         char *str = NULL;
-        int i, rsz = 0;
+        int rsz = 0;
 
         // Get the link map and ELF sections in advance of something matching
+        osMapsLoad();
         if ((dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm) != -1) &&
             (getElfEntries(lm, &rel, &sym, &str, &rsz) != -1)) {
             scopeLog(CFG_LOG_DEBUG, "\tlibrary:  %s", lm->l_name);
 
-            // for each symbol in the list try to hook
-            for (i=0; inject_hook_list[i].symbol; i++) {
-                if ((dlsym(handle, inject_hook_list[i].symbol)) &&
-                    (doGotcha(lm, (got_list_t *)&inject_hook_list[i], rel, sym, str, rsz, TRUE) != -1)) {
-                    scopeLog(CFG_LOG_DEBUG, "\tdlopen interposed  %s", inject_hook_list[i].symbol);
-                }
-            }
+            // hook each symbol in the list that the library uses
+            hook_filter_t filter = {.handle = handle, .rules = TRUE};
+            int patched = doGotchaAll(lm, hookIndex(), rel, sym, str, rsz, TRUE, hookFilter, &filter);
+            scopeLog(CFG_LOG_DEBUG, "\tdlopen interposed %d symbols", patched);
         }
+        osMapsRelease();
     }
 
     return handle;
@@ -5350,13 +5585,27 @@ connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
         return -1;
     }
 
+    // Not timed unless net metrics are wanted; per remote ones too
+    uint64_t initialTime = latencyStartTime(HISTO_CONNECT);
     rc = g_fn.connect(sockfd, addr, addrlen);
     if (rc != -1) {
+        uint64_t duration = 0;
+        if (initialTime) {
+            duration = getDuration(initialTime);
+            histoRecord(HISTO_CONNECT, duration);
+        }
         doSetConnection(sockfd, addr, addrlen, REMOTE);
+        doRemoteConnect(sockfd, addr, addrlen, duration, TRUE);
         doUpdateState(NET_CONNECTIONS, sockfd, 1, "connect", NULL);
 
         scopeLog(CFG_LOG_DEBUG, "fd:%d connect", sockfd);
     } else {
+        // in progress isn't failed; it's finished by a send, receive or close
+        if (errno == EINPROGRESS) {
+            doRemoteConnectStart(sockfd, addr, addrlen, initialTime);
+        } else {
+            doRemoteConnect(sockfd, addr, addrlen, 0, FALSE);
+        }
         doUpdateState(NET_ERR_CONN, sockfd, 0, "connect", "nopath");
     }
 
@@ -5631,7 +5880,7 @@ doAccessRights(struct msghdr *msg)
                 if ((sbuf.st_mode & S_IFMT) == S_IFSOCK) {
                     doAddNewSock(recvfd[i]);
                 } else {
-                    doOpen(recvfd[i], "Received_File_Descriptor", FD, "recvmsg");
+                    doOpen(recvfd[i], 0, "Received_File_Descriptor", FD, "recvmsg");
                 }
             } else {
                 DBG("errno: %d", errno);
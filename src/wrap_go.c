@@ -91,23 +91,24 @@ uint64_t g_syscall_return = 0;
 uint64_t g_rawsyscall_return = 0;
 uint64_t g_syscall6_return = 0;
 
+// Indexed by tap_id so a hook finds its entry without a search
 tap_t g_tap[] = {
-    {tap_syscall,              "syscall.Syscall",       /* .abi0 */       go_hook_reg_syscall,              NULL, 0},
-    {tap_rawsyscall,           "syscall.RawSyscall",    /* .abi0 */       go_hook_reg_rawsyscall,           NULL, 0},
-    {tap_syscall6,             "syscall.Syscall6",      /* .abi0 */       go_hook_reg_syscall6,             NULL, 0},
-    {tap_tls_client_read,      "net/http.(*persistConn).readResponse",    go_hook_reg_tls_client_read,      NULL, 0},
-    {tap_tls_client_write,     "net/http.persistConnWriter.Write",        go_hook_reg_tls_client_write,     NULL, 0},
-    {tap_tls_server_read,      "net/http.(*connReader).Read",             go_hook_reg_tls_server_read,      NULL, 0},
-    {tap_tls_server_write,     "net/http.checkConnErrorWriter.Write",     go_hook_reg_tls_server_write,     NULL, 0},
-    {tap_http2_client_read,    "net/http.(*http2clientConnReadLoop).run", go_hook_reg_http2_client_read,    NULL, 0},
-    {tap_http2_client_write,   "net/http.http2stickyErrWriter.Write",     go_hook_reg_http2_client_write,   NULL, 0},
-    {tap_http2_server_read,    "net/http.(*http2serverConn).readFrames",  go_hook_reg_http2_server_read,    NULL, 0},
-    {tap_http2_server_write,   "net/http.(*http2serverConn).Flush",       go_hook_reg_http2_server_write,   NULL, 0},
-    {tap_http2_server_preface, "net/http.(*http2serverConn).readPreface", go_hook_reg_http2_server_preface, NULL, 0},
-    {tap_exit,                 "runtime.exit",          /* .abi0 */       go_hook_exit,                     NULL, 0},
-    {tap_die,                  "runtime.dieFromSignal", /* .abi0 */       go_hook_die,                      NULL, 0},
-    {tap_sighandler,           "runtime.sighandler",    /* .abi0 */       go_hook_sighandler,               NULL, 0},
-    {tap_end,                  "",                                        NULL,                             NULL, 0},
+    [tap_syscall]              = {tap_syscall,              "syscall.Syscall",       /* .abi0 */       go_hook_reg_syscall,              NULL, 0},
+    [tap_rawsyscall]           = {tap_rawsyscall,           "syscall.RawSyscall",    /* .abi0 */       go_hook_reg_rawsyscall,           NULL, 0},
+    [tap_syscall6]             = {tap_syscall6,             "syscall.Syscall6",      /* .abi0 */       go_hook_reg_syscall6,             NULL, 0},
+    [tap_tls_client_read]      = {tap_tls_client_read,      "net/http.(*persistConn).readResponse",    go_hook_reg_tls_client_read,      NULL, 0},
+    [tap_tls_client_write]     = {tap_tls_client_write,     "net/http.persistConnWriter.Write",        go_hook_reg_tls_client_write,     NULL, 0},
+    [tap_tls_server_read]      = {tap_tls_server_read,      "net/http.(*connReader).Read",             go_hook_reg_tls_server_read,      NULL, 0},
+    [tap_tls_server_write]     = {tap_tls_server_write,     "net/http.checkConnErrorWriter.Write",     go_hook_reg_tls_server_write,     NULL, 0},
+    [tap_http2_client_read]    = {tap_http2_client_read,    "net/http.(*http2clientConnReadLoop).run", go_hook_reg_http2_client_read,    NULL, 0},
+    [tap_http2_client_write]   = {tap_http2_client_write,   "net/http.http2stickyErrWriter.Write",     go_hook_reg_http2_client_write,   NULL, 0},
+    [tap_http2_server_read]    = {tap_http2_server_read,    "net/http.(*http2serverConn).readFrames",  go_hook_reg_http2_server_read,    NULL, 0},
+    [tap_http2_server_write]   = {tap_http2_server_write,   "net/http.(*http2serverConn).Flush",       go_hook_reg_http2_server_write,   NULL, 0},
+    [tap_http2_server_preface] = {tap_http2_server_preface, "net/http.(*http2serverConn).readPreface", go_hook_reg_http2_server_preface, NULL, 0},
+    [tap_exit]                 = {tap_exit,                 "runtime.exit",          /* .abi0 */       go_hook_exit,                     NULL, 0},
+    [tap_die]                  = {tap_die,                  "runtime.dieFromSignal", /* .abi0 */       go_hook_die,                      NULL, 0},
+    [tap_sighandler]           = {tap_sighandler,           "runtime.sighandler",    /* .abi0 */       go_hook_sighandler,               NULL, 0},
+    [tap_end]                  = {tap_end,                  "",                                        NULL,                             NULL, 0},
 };
 
 go_schema_t go_11_schema = {
@@ -282,13 +283,7 @@ go_schema_t go_17_schema_arm = {
 
 tap_t *
 tap_entry(enum tap_id id) {
-    for (tap_t *tap = g_go_schema->tap; tap->assembly_fn; tap++) {
-        if (tap->id == id) {
-            return tap;
-        }
-    }
-    // TODO exit and crash if not found
-    return NULL;
+    return &g_go_schema->tap[id];
 }
 
 static void
@@ -1304,29 +1299,11 @@ initGoHook(elf_buf_t *ebuf)
         sysprint("ERROR: funchook_install failed.  (%s)\n",
                 funchook_error_message(funchook));
         funchook_destroy(funchook);
-    }
-}
-
-static void *
-return_addr(assembly_fn fn)
-{
-    for (tap_t *tap = g_go_schema->tap; tap->assembly_fn; tap++) {
-        if (tap->assembly_fn == fn) return tap->return_addr;
-    }
-
-    scopeLogError("FATAL ERROR: no return addr");
-    exit(-1);
-}
-
-static uint32_t
-frame_size(assembly_fn fn)
-{
-    for (tap_t *tap = g_go_schema->tap; tap->assembly_fn; tap++) {
-        if (tap->assembly_fn == fn) return tap->frame_size;
+        return;
     }
 
-    scopeLogWarn("WARN: no frame size");
-    exit(-1);
+    // Count rx/tx per connection and post once a period, not per syscall
+    setNetBatched(TRUE);
 }
 
 /*
@@ -1349,9 +1326,9 @@ frame_size(assembly_fn fn)
  * input params at the beginning of the function, and return values at the return.
  */
 inline static void *
-do_cfunc(char *stackptr, void *cfunc, void *gfunc)
+do_cfunc(char *stackptr, void *cfunc, tap_t *tap)
 {
-    if (g_cfg.funcs_attached == FALSE) return return_addr(gfunc);
+    if (g_cfg.funcs_attached == FALSE) return tap->return_addr;
 
     char *sys_stack = stackptr;
     char *g_stack = (char *)*(uint64_t *)(sys_stack + G_STACK);
@@ -1367,14 +1344,13 @@ do_cfunc(char *stackptr, void *cfunc, void *gfunc)
      * (because register values are copied onto the callee stack).
      */
     if (g_go_minor_ver <= 16) {
-        uint32_t frame_offset = frame_size(gfunc);
-        g_stack += frame_offset;
+        g_stack += tap->frame_size;
     }
 
     void (*chandler)(char *sstack, char *gstack) = (void (*)(char *, char *))cfunc;
     chandler(sys_stack, g_stack);
 
-    return return_addr(gfunc);
+    return tap->return_addr;
 }
 
 /*
@@ -1435,7 +1411,7 @@ c_syscall(char *sys_stack, char *g_stack)
             }
 
             funcprint("Scope: open of %ld\n", rc);
-            doOpen(rc, path, FD, "open");
+            doOpen(rc, 0, path, FD, "open");
         }
         break;
     case SYS_unlinkat:
@@ -1482,6 +1458,22 @@ c_syscall(char *sys_stack, char *g_stack)
             doAccept(fd, rc, addr, addrlen, "go_accept4");
         }
         break;
+    case SYS_getsockname:
+    case SYS_getpeername:
+        {
+            // The net package asks for both ends of every connection it
+            // accepts or dials; keep the answers rather than asking again
+            if (rc == -1) return;
+
+            uint64_t fd           = *(int64_t *)(sys_stack + g_go_schema->arg_offsets.c_syscall_p1);
+            struct sockaddr *addr = *(struct sockaddr **)(sys_stack + g_go_schema->arg_offsets.c_syscall_p2);
+            socklen_t *addrlen    = *(socklen_t **)(sys_stack + g_go_schema->arg_offsets.c_syscall_p3);
+            if (!addrlen) return;
+
+            funcprint("Scope: %s of %ld\n", (syscall_num == SYS_getsockname) ? "getsockname" : "getpeername", fd);
+            doSetAppAddr(fd, addr, *addrlen, (syscall_num == SYS_getsockname) ? LOCAL : REMOTE);
+        }
+        break;
     case SYS_read:
         {
             uint64_t fd = *(int64_t *)(sys_stack + g_go_schema->arg_offsets.c_syscall_p1);
@@ -1508,19 +1500,19 @@ c_syscall(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_syscall(char *stackptr)
 {
-    return do_cfunc(stackptr, c_syscall, tap_entry(tap_syscall)->assembly_fn);
+    return do_cfunc(stackptr, c_syscall, tap_entry(tap_syscall));
 }
 
 EXPORTON void *
 go_rawsyscall(char *stackptr)
 {
-    return do_cfunc(stackptr, c_syscall, tap_entry(tap_rawsyscall)->assembly_fn);
+    return do_cfunc(stackptr, c_syscall, tap_entry(tap_rawsyscall));
 }
 
 EXPORTON void *
 go_syscall6(char *stackptr)
 {
-    return do_cfunc(stackptr, c_syscall, tap_entry(tap_syscall6)->assembly_fn);
+    return do_cfunc(stackptr, c_syscall, tap_entry(tap_syscall6));
 }
 
 // Extract data from net/http.(*connReader).Read (tls server read)
@@ -1557,7 +1549,7 @@ c_tls_server_read(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_tls_server_read(char *stackptr)
 {
-    return do_cfunc(stackptr, c_tls_server_read, tap_entry(tap_tls_server_read)->assembly_fn);
+    return do_cfunc(stackptr, c_tls_server_read, tap_entry(tap_tls_server_read));
 }
 
 // Extract data from net/http.checkConnErrorWriter.Write (tls server write)
@@ -1586,7 +1578,7 @@ c_tls_server_write(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_tls_server_write(char *stackptr)
 {
-    return do_cfunc(stackptr, c_tls_server_write, tap_entry(tap_tls_server_write)->assembly_fn);
+    return do_cfunc(stackptr, c_tls_server_write, tap_entry(tap_tls_server_write));
 }
 
 // Extract data from net/http.(*persistConn).readResponse (tls client read)
@@ -1622,7 +1614,7 @@ c_tls_client_read(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_tls_client_read(char *stackptr)
 {
-    return do_cfunc(stackptr, c_tls_client_read, tap_entry(tap_tls_client_read)->assembly_fn);
+    return do_cfunc(stackptr, c_tls_client_read, tap_entry(tap_tls_client_read));
 }
 
 // Extract data from net/http.persistConnWriter.Write (tls client write)
@@ -1650,7 +1642,7 @@ c_tls_client_write(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_tls_client_write(char *stackptr)
 {
-    return do_cfunc(stackptr, c_tls_client_write, tap_entry(tap_tls_client_write)->assembly_fn);
+    return do_cfunc(stackptr, c_tls_client_write, tap_entry(tap_tls_client_write));
 }
 
 // Extract data from net/http.(*http2serverConn).readFrames (tls http2 server read)
@@ -1695,7 +1687,7 @@ c_http2_server_read(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_http2_server_read(char *stackptr)
 {
-    return do_cfunc(stackptr, c_http2_server_read, tap_entry(tap_http2_server_read)->assembly_fn);
+    return do_cfunc(stackptr, c_http2_server_read, tap_entry(tap_http2_server_read));
 }
 
 // Extract data from net/http.(*http2serverConn).Flush (tls http2 server write)
@@ -1743,7 +1735,7 @@ c_http2_server_write(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_http2_server_write(char *stackptr)
 {
-    return do_cfunc(stackptr, c_http2_server_write, tap_entry(tap_http2_server_write)->assembly_fn);
+    return do_cfunc(stackptr, c_http2_server_write, tap_entry(tap_http2_server_write));
 }
 
 // Extract data from net/http.(*http2serverConn).readPreface (tls http2 server write)
@@ -1774,7 +1766,7 @@ c_http2_server_preface(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_http2_server_preface(char *stackptr)
 {
-    return do_cfunc(stackptr, c_http2_server_preface, tap_entry(tap_http2_server_preface)->assembly_fn);
+    return do_cfunc(stackptr, c_http2_server_preface, tap_entry(tap_http2_server_preface));
 }
 
 /*
@@ -1827,7 +1819,7 @@ c_http2_client_read(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_http2_client_read(char *stackptr)
 {
-    return do_cfunc(stackptr, c_http2_client_read, tap_entry(tap_http2_client_read)->assembly_fn);
+    return do_cfunc(stackptr, c_http2_client_read, tap_entry(tap_http2_client_read));
 }
 
 // Extract data from net/http.http2stickyErrWriter.Write (tls http2 client write)
@@ -1850,7 +1842,7 @@ c_http2_client_write(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_http2_client_write(char *stackptr)
 {
-    return do_cfunc(stackptr, c_http2_client_write, tap_entry(tap_http2_client_write)->assembly_fn);
+    return do_cfunc(stackptr, c_http2_client_write, tap_entry(tap_http2_client_write));
 }
 
 extern void handleExit(void);
@@ -1911,13 +1903,13 @@ c_exit(char *sys_stack)
 EXPORTON void *
 go_exit(char *stackptr)
 {
-    return do_cfunc(stackptr, c_exit, tap_entry(tap_exit)->assembly_fn);
+    return do_cfunc(stackptr, c_exit, tap_entry(tap_exit));
 }
 
 EXPORTON void *
 go_die(char *stackptr)
 {
-    return do_cfunc(stackptr, c_exit, tap_entry(tap_die)->assembly_fn);
+    return do_cfunc(stackptr, c_exit, tap_entry(tap_die));
 }
 
 static void
@@ -1936,5 +1928,5 @@ c_sighandler(char *sys_stack, char *g_stack)
 EXPORTON void *
 go_sighandler(char *stackptr)
 {
-    return do_cfunc(stackptr, c_sighandler, tap_entry(tap_sighandler)->assembly_fn);
+    return do_cfunc(stackptr, c_sighandler, tap_entry(tap_sighandler));
 }
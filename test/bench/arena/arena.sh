@@ -0,0 +1,44 @@
+#!/bin/bash
+# Measures how the cost of posting events to the reporting thread scales
+# with the number of application threads. With metric verbosity 9 every
+# write is posted as its own event object, allocated on the writing
+# thread and freed on the reporting thread.
+# Requires cc and a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./arena.sh [writes per thread]
+
+COUNT=${1:-200000}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/arenabench.XXXXXX)
+
+cc -O2 -pthread -o $WORKDIR/arenaload arenaload.c || exit 1
+
+cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: true
+  format:
+    type: statsd
+    verbosity: 9
+  transport:
+    type: file
+    path: /dev/null
+  watch:
+    - type: fs
+event:
+  enable: false
+cribl:
+  enable: false
+libscope:
+  summaryperiod: 1
+  log:
+    level: error
+EOCFG
+
+for THREADS in 1 4 16; do
+    printf "Unscoped "
+    $WORKDIR/arenaload $THREADS $COUNT
+    printf "Scoped   "
+    SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB $WORKDIR/arenaload $THREADS $COUNT
+done
+
+rm -rf $WORKDIR
@@ -0,0 +1,67 @@
+/*
+ * Threads write to /dev/null as fast as they can and the total rate is
+ * reported. Scoped with metric verbosity 9, every write posts an event
+ * object to the reporting thread, which frees it, so this is mostly a
+ * measure of how well allocating on many threads and freeing on one
+ * scales.
+ * Usage: arenaload [threads] [writes per thread]
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+static long g_count;
+
+static void *
+writer(void *arg)
+{
+    char c = 'x';
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd == -1) {
+        perror("open");
+        return NULL;
+    }
+    for (long i = 0; i < g_count; i++) {
+        if (write(fd, &c, 1) != 1) {
+            perror("write");
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    int threads = (argc > 1) ? atoi(argv[1]) : 8;
+    g_count = (argc > 2) ? atol(argv[2]) : 200000;
+    if (threads < 1 || threads > 1024 || g_count < 1) {
+        fprintf(stderr, "usage: %s [threads <= 1024] [writes per thread]\n", argv[0]);
+        return 1;
+    }
+
+    pthread_t tid[threads];
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&tid[i], NULL, writer, NULL)) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    for (int i = 0; i < threads; i++) pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%d threads x %ld writes; %.0f writes/s, max rss %ld KB\n",
+           threads, g_count, threads * g_count / secs, ru.ru_maxrss);
+    return 0;
+}
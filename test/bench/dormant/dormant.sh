@@ -0,0 +1,57 @@
+#!/bin/bash
+# Measures what libscope costs a process the rules file denies, which
+# with ld.so.preload is most processes on a host. Such a process should
+# look like it was never preloaded; the startup time and resident set
+# size are compared with the same command run without libscope.
+# Requires a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./dormant.sh [count]
+
+COUNT=${1:-1000}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/dormantbench.XXXXXX)
+
+cat > $WORKDIR/scope_rules << EORULES
+allow:
+- procname: nginx
+  config:
+    metric:
+      enable: true
+deny:
+- procname: true
+- procname: sleep
+EORULES
+
+# Prints the mean wall time of one run of /bin/true, in ms
+run() {
+    local start=$(date +%s%N)
+    for ((i = 0; i < COUNT; i++)); do
+        "$@" /bin/true > /dev/null
+    done
+    local end=$(date +%s%N)
+    awk -v ns=$((end - start)) -v n=$COUNT 'BEGIN { printf "%.3f ms\n", ns / n / 1000000 }'
+}
+
+# Prints the resident set size of a sleeping process, in kB
+rss() {
+    "$@" /bin/sleep 10 &
+    local pid=$!
+    sleep 1
+    awk '/^VmRSS/ { printf "%d kB\n", $2 }' /proc/$pid/status
+    kill $pid
+    wait $pid 2>/dev/null
+}
+
+echo "$COUNT x /bin/true, denied by the rules file"
+printf "Unscoped  "
+run env
+printf "Denied    "
+run env SCOPE_RULES=$WORKDIR/scope_rules LD_PRELOAD=$LIB
+
+echo "RSS of /bin/sleep, denied by the rules file"
+printf "Unscoped  "
+rss env
+printf "Denied    "
+rss env SCOPE_RULES=$WORKDIR/scope_rules LD_PRELOAD=$LIB
+
+rm -rf $WORKDIR
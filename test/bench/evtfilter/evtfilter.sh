@@ -0,0 +1,62 @@
+#!/bin/bash
+# Measures formatted events/sec with default and non-default event filters.
+# Requires a built lib/linux/<arch>/libscope.so
+# Usage: ./evtfilter.sh [number of writes]
+
+COUNT=${1:-200000}
+LIB=$(realpath ../../../lib/linux/$(uname -m)/libscope.so)
+WORKDIR=$(mktemp -d /tmp/evtfilter.XXXXXX)
+
+write_config() {
+    # $1 - metric name filter, $2 - field filter, $3 - value filter
+    cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: false
+event:
+  enable: true
+  transport:
+    type: file
+    path: $WORKDIR/events.json
+  format:
+    type: ndjson
+    maxeventpersec: 0
+  watch:
+    - type: metric
+      name: $1
+      field: $2
+      value: $3
+    - type: fs
+      name: $1
+      field: $2
+      value: $3
+cribl:
+  enable: false
+libscope:
+  summaryperiod: 1
+  log:
+    level: error
+EOCFG
+}
+
+run_scoped() {
+    # $1 - description
+    rm -f $WORKDIR/events.json
+    START=$(date +%s%N)
+    SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB \
+        dd if=/dev/zero of=$WORKDIR/out bs=1 count=$COUNT > /dev/null 2>&1
+    END=$(date +%s%N)
+    EVENTS=$(wc -l < $WORKDIR/events.json 2>/dev/null || echo 0)
+    MSEC=$(( (END - START) / 1000000 ))
+    printf "%s:\n" "$1"
+    printf "Events:\t%s\n" $EVENTS
+    printf "Time:\t%s ms\n" $MSEC
+    printf "Rate:\t%s events/sec\n\n" $(( EVENTS * 1000 / (MSEC ? MSEC : 1) ))
+}
+
+write_config '.*' '.*' '.*'
+run_scoped "Default filters"
+
+write_config '^fs\.(read|write|open|close)' '^(proc|pid|fd|file|op|host)$' '^[0-9]+$|out$'
+run_scoped "Non-default filters"
+
+rm -rf $WORKDIR
@@ -0,0 +1,68 @@
+#!/bin/bash
+# Measures the cost of scoping a Go net/http server. Each request is a
+# read and a write on a socket the Go hooks track. Runs once over
+# keep-alive connections and once with a new connection per request,
+# which exercises accept and connection address capture.
+# Requires go and the scope CLI (bin/linux/<arch>/scope) built from this tree.
+# To compare before/after, run once with SCOPE pointing at each build.
+# Usage: [SCOPE=/path/to/scope] ./gonet.sh [count]
+
+COUNT=${1:-20000}
+PORT=${PORT:-18080}
+SCOPE=${SCOPE:-$(realpath ../../../bin/linux/$(uname -m)/scope)}
+WORKDIR=$(mktemp -d /tmp/gonetbench.XXXXXX)
+
+# The server is built static, as most Go binaries in the wild are
+CGO_ENABLED=0 go build -o $WORKDIR/server server.go || exit 1
+go build -o $WORKDIR/load load.go || exit 1
+
+cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: true
+  format:
+    type: statsd
+  transport:
+    type: file
+    path: $WORKDIR/metrics.out
+  watch:
+    - type: net
+event:
+  enable: true
+  transport:
+    type: file
+    path: $WORKDIR/events.json
+  format:
+    type: ndjson
+  watch:
+    - type: net
+      name: .*
+      field: .*
+      value: .*
+cribl:
+  enable: false
+libscope:
+  summaryperiod: 1
+  log:
+    level: error
+EOCFG
+
+run() {
+    local label=$1
+    shift
+    "$@" $WORKDIR/server $PORT &
+    local pid=$!
+    sleep 1
+    for MODE in keepalive new; do
+        local flag=""
+        [ $MODE = new ] && flag="-new"
+        printf "%-9s %-9s " $label $MODE
+        $WORKDIR/load -url http://127.0.0.1:$PORT/ -n $COUNT $flag
+    done
+    kill $pid
+    wait $pid 2>/dev/null
+}
+
+run unscoped env
+run scoped $SCOPE run --userconfig $WORKDIR/scope.yml --
+
+rm -rf $WORKDIR
@@ -0,0 +1,53 @@
+// Load generator for gonet.sh. Each worker issues requests over a
+// keep-alive connection, or over a new connection per request with -new.
+package main
+
+import (
+	"flag"
+	"fmt"
+	"io"
+	"net/http"
+	"os"
+	"sync"
+	"time"
+)
+
+func main() {
+	url := flag.String("url", "http://127.0.0.1:8080/", "target")
+	count := flag.Int("n", 20000, "total requests")
+	workers := flag.Int("c", 8, "concurrent workers")
+	newConn := flag.Bool("new", false, "new connection per request")
+	flag.Parse()
+
+	var wg sync.WaitGroup
+	var mu sync.Mutex
+	failed := 0
+	start := time.Now()
+
+	for w := 0; w < *workers; w++ {
+		wg.Add(1)
+		go func(n int) {
+			defer wg.Done()
+			client := &http.Client{Transport: &http.Transport{DisableKeepAlives: *newConn}}
+			for i := 0; i < n; i++ {
+				resp, err := client.Get(*url)
+				if err != nil {
+					mu.Lock()
+					failed++
+					mu.Unlock()
+					continue
+				}
+				io.Copy(io.Discard, resp.Body)
+				resp.Body.Close()
+			}
+		}(*count / *workers)
+	}
+	wg.Wait()
+
+	elapsed := time.Since(start)
+	if failed > 0 {
+		fmt.Fprintf(os.Stderr, "%d requests failed\n", failed)
+	}
+	fmt.Printf("%d requests in %v; %.0f req/s\n", *count, elapsed.Round(time.Millisecond),
+		float64(*count)/elapsed.Seconds())
+}
@@ -0,0 +1,61 @@
+#!/bin/bash
+# Measures the cost of scoping HTTP/2 traffic with many streams
+# multiplexed on one connection, and how much memory libscope holds
+# for them. The load generator runs the client and a gRPC-like server
+# in one process, so the peak RSS it reports includes the stream state
+# kept for both sides.
+# Requires cc and a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./h2c.sh [count]
+
+COUNT=${1:-200000}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/h2cbench.XXXXXX)
+
+cc -O2 -pthread -o $WORKDIR/h2cload h2cload.c || exit 1
+
+cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: true
+  format:
+    type: statsd
+  transport:
+    type: file
+    path: $WORKDIR/metrics.out
+  watch:
+    - type: http
+event:
+  enable: true
+  transport:
+    type: file
+    path: $WORKDIR/events.json
+  format:
+    type: ndjson
+  watch:
+    - type: http
+      name: .*
+      field: .*
+      value: .*
+cribl:
+  enable: false
+libscope:
+  summaryperiod: 1
+  log:
+    level: warning
+    transport:
+      type: file
+      path: $WORKDIR/scope.log
+EOCFG
+
+for INFLIGHT in 10 1000; do
+    printf "Unscoped "
+    $WORKDIR/h2cload $COUNT $INFLIGHT
+    printf "Scoped   "
+    SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB $WORKDIR/h2cload $COUNT $INFLIGHT
+done
+
+# Streams are evicted when more are open than a channel's cap (256),
+# or when the frames ending them were lost to a full event queue
+grep -h "evicting" $WORKDIR/scope.log
+
+rm -rf $WORKDIR
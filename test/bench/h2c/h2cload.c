@@ -0,0 +1,244 @@
+/*
+ * A local h2c (HTTP/2 over cleartext TCP, prior knowledge) load
+ * generator. A client and a server thread talk over loopback; the
+ * client keeps a batch of unary gRPC calls in flight on one connection
+ * and the server answers each the way a gRPC service does: response
+ * HEADERS, a DATA frame with one message and trailers that end the
+ * stream.
+ *
+ * Prints the request rate and the peak RSS, which is where per-stream
+ * state kept by libscope shows up.
+ *
+ * Usage: h2cload [requests] [streams in flight] [data bytes]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAGIC "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define FRAME_DATA 0x00
+#define FRAME_HEADERS 0x01
+#define FRAME_SETTINGS 0x04
+#define FLAG_END_STREAM 0x01
+#define FLAG_END_HEADERS 0x04
+
+// :method POST, :scheme http, :path /bench.Echo/Ping, :authority localhost,
+// content-type application/grpc (none indexed)
+static const unsigned char g_req_block[] = {
+    0x83, 0x86,
+    0x04, 0x10, '/', 'b', 'e', 'n', 'c', 'h', '.', 'E', 'c', 'h', 'o', '/', 'P', 'i', 'n', 'g',
+    0x01, 0x09, 'l', 'o', 'c', 'a', 'l', 'h', 'o', 's', 't',
+    0x0f, 0x10, 0x10, 'a', 'p', 'p', 'l', 'i', 'c', 'a', 't', 'i', 'o', 'n', '/', 'g', 'r', 'p', 'c',
+};
+// :status 200, content-type application/grpc
+static const unsigned char g_resp_block[] = {
+    0x88,
+    0x0f, 0x10, 0x10, 'a', 'p', 'p', 'l', 'i', 'c', 'a', 't', 'i', 'o', 'n', '/', 'g', 'r', 'p', 'c',
+};
+// one empty message
+static const unsigned char g_req_msg[] = { 0x00, 0x00, 0x00, 0x00, 0x00 };
+// grpc-status: 0 (literal name, not indexed)
+static const unsigned char g_trailer_block[] = {
+    0x00, 0x0b, 'g', 'r', 'p', 'c', '-', 's', 't', 'a', 't', 'u', 's', 0x01, '0',
+};
+
+static size_t g_data_len = 64;
+
+static size_t
+putFrame(unsigned char *out, uint8_t type, uint8_t flags, uint32_t stream,
+         const unsigned char *payload, size_t len)
+{
+    out[0] = (len >> 16) & 0xff;
+    out[1] = (len >> 8) & 0xff;
+    out[2] = len & 0xff;
+    out[3] = type;
+    out[4] = flags;
+    out[5] = (stream >> 24) & 0x7f;
+    out[6] = (stream >> 16) & 0xff;
+    out[7] = (stream >> 8) & 0xff;
+    out[8] = stream & 0xff;
+    if (payload) {
+        memcpy(out + 9, payload, len);
+    } else if (len >= 5) {
+        // one gRPC message filling the frame
+        uint32_t msglen = len - 5;
+        memset(out + 9, 'x', len);
+        out[9] = 0;
+        out[10] = (msglen >> 24) & 0xff;
+        out[11] = (msglen >> 16) & 0xff;
+        out[12] = (msglen >> 8) & 0xff;
+        out[13] = msglen & 0xff;
+    }
+    return 9 + len;
+}
+
+static int
+readFull(int fd, void *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t rc = read(fd, (char *)buf + got, len - got);
+        if (rc <= 0) return -1;
+        got += rc;
+    }
+    return 0;
+}
+
+static int
+writeFull(int fd, const void *buf, size_t len)
+{
+    size_t put = 0;
+    while (put < len) {
+        ssize_t rc = write(fd, (const char *)buf + put, len - put);
+        if (rc <= 0) return -1;
+        put += rc;
+    }
+    return 0;
+}
+
+// Reads one frame; the payload is left in buf
+static int
+readFrame(int fd, unsigned char *buf, size_t size, uint8_t *type, uint8_t *flags, uint32_t *stream)
+{
+    unsigned char hdr[9];
+    if (readFull(fd, hdr, sizeof(hdr))) return -1;
+    size_t len = (hdr[0] << 16) | (hdr[1] << 8) | hdr[2];
+    if (len > size) return -1;
+    *type = hdr[3];
+    *flags = hdr[4];
+    *stream = ((hdr[5] & 0x7f) << 24) | (hdr[6] << 16) | (hdr[7] << 8) | hdr[8];
+    return readFull(fd, buf, len);
+}
+
+static void *
+server(void *arg)
+{
+    int lfd = *(int *)arg;
+    int fd = accept(lfd, NULL, NULL);
+    if (fd == -1) return NULL;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    size_t bufsize = 3 * 9 + sizeof(g_resp_block) + g_data_len + sizeof(g_trailer_block);
+    unsigned char *out = malloc(bufsize);
+    unsigned char in[16384];
+    char magic[sizeof(MAGIC) - 1];
+    if (!out || readFull(fd, magic, sizeof(magic))) goto done;
+
+    unsigned char settings[9];
+    writeFull(fd, settings, putFrame(settings, FRAME_SETTINGS, 0, 0, NULL, 0));
+
+    uint8_t type, flags;
+    uint32_t stream;
+    while (!readFrame(fd, in, sizeof(in), &type, &flags, &stream)) {
+        // the request ends with its message
+        if (type != FRAME_DATA || !(flags & FLAG_END_STREAM)) continue;
+        size_t len = 0;
+        len += putFrame(out + len, FRAME_HEADERS, FLAG_END_HEADERS, stream,
+                        g_resp_block, sizeof(g_resp_block));
+        len += putFrame(out + len, FRAME_DATA, 0, stream, NULL, g_data_len);
+        len += putFrame(out + len, FRAME_HEADERS, FLAG_END_HEADERS | FLAG_END_STREAM,
+                        stream, g_trailer_block, sizeof(g_trailer_block));
+        if (writeFull(fd, out, len)) break;
+    }
+
+done:
+    free(out);
+    close(fd);
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    long count = (argc > 1) ? atol(argv[1]) : 100000;
+    long inflight = (argc > 2) ? atol(argv[2]) : 100;
+    if (argc > 3) g_data_len = atol(argv[3]);
+    if (count < 1 || inflight < 1 || g_data_len < 5 || g_data_len > 16384) {
+        fprintf(stderr, "usage: %s [requests] [streams in flight] [data bytes 5..16384]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_in sa = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t salen = sizeof(sa);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd == -1 || bind(lfd, (struct sockaddr *)&sa, salen) ||
+        listen(lfd, 1) || getsockname(lfd, (struct sockaddr *)&sa, &salen)) {
+        perror("listen");
+        return 1;
+    }
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, server, &lfd);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&sa, salen)) {
+        perror("connect");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    unsigned char *batch = malloc(inflight * (9 + sizeof(g_req_block) + 9 + sizeof(g_req_msg)));
+    unsigned char in[16384];
+    if (!batch) return 1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    unsigned char settings[9];
+    writeFull(fd, MAGIC, sizeof(MAGIC) - 1);
+    writeFull(fd, settings, putFrame(settings, FRAME_SETTINGS, 0, 0, NULL, 0));
+
+    uint32_t nextStream = 1;
+    long done = 0;
+    while (done < count) {
+        long n = (count - done < inflight) ? count - done : inflight;
+        size_t len = 0;
+        for (long i = 0; i < n; i++, nextStream += 2) {
+            len += putFrame(batch + len, FRAME_HEADERS, FLAG_END_HEADERS,
+                            nextStream, g_req_block, sizeof(g_req_block));
+            len += putFrame(batch + len, FRAME_DATA, FLAG_END_STREAM,
+                            nextStream, g_req_msg, sizeof(g_req_msg));
+        }
+        if (writeFull(fd, batch, len)) {
+            perror("write");
+            return 1;
+        }
+
+        uint8_t type, flags;
+        uint32_t stream;
+        long ended = 0;
+        while (ended < n) {
+            if (readFrame(fd, in, sizeof(in), &type, &flags, &stream)) {
+                fprintf(stderr, "connection closed\n");
+                return 1;
+            }
+            if (flags & FLAG_END_STREAM) ended++;
+        }
+        done += n;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    shutdown(fd, SHUT_WR);
+    pthread_join(tid, NULL);
+    close(fd);
+    close(lfd);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%ld requests, %ld in flight; %.0f req/s, max rss %ld KB\n",
+           count, inflight, count / secs, ru.ru_maxrss);
+    free(batch);
+    return 0;
+}
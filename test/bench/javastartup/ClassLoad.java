@@ -0,0 +1,30 @@
+import java.io.BufferedReader;
+import java.io.FileReader;
+
+/*
+ * Loads (without initializing) every class named in a class list, one
+ * binary name per line as in $JAVA_HOME/lib/classlist, and reports the time.
+ * Usage: java ClassLoad <class list>
+ */
+public class ClassLoad {
+    public static void main(String[] args) throws Exception {
+        int loaded = 0;
+        long start = System.nanoTime();
+        try (BufferedReader in = new BufferedReader(new FileReader(args[0]))) {
+            String line;
+            while ((line = in.readLine()) != null) {
+                if (line.isEmpty() || line.startsWith("#") || line.startsWith("@")) continue;
+                int space = line.indexOf(' ');
+                String name = (space < 0 ? line : line.substring(0, space)).replace('/', '.');
+                try {
+                    Class.forName(name, false, ClassLoad.class.getClassLoader());
+                    loaded++;
+                } catch (Throwable t) {
+                    // not every listed class is loadable in every configuration
+                }
+            }
+        }
+        long ns = System.nanoTime() - start;
+        System.out.printf("%d classes loaded in %.1f ms%n", loaded, ns / 1e6);
+    }
+}
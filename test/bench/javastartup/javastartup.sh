@@ -0,0 +1,45 @@
+#!/bin/bash
+# Measures JVM startup and class loading time with and without libscope
+# loaded as a Java agent. Every class load goes through the agent's class
+# file load hook until the hooks it needs have been installed.
+# Requires a JDK 11+ (java, javac and $JAVA_HOME/lib/classlist) and a built
+# lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./javastartup.sh [runs]
+
+RUNS=${1:-10}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+JAVA_HOME=${JAVA_HOME:-$(dirname $(dirname $(realpath $(which java))))}
+CLASSLIST=$JAVA_HOME/lib/classlist
+WORKDIR=$(mktemp -d /tmp/javastartup.XXXXXX)
+
+[ -f $CLASSLIST ] || { echo "$CLASSLIST not found"; exit 1; }
+javac -d $WORKDIR ClassLoad.java || exit 1
+
+cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: false
+event:
+  enable: false
+cribl:
+  enable: false
+libscope:
+  log:
+    level: error
+EOCFG
+
+run() {
+    local label=$1
+    shift
+    local start=$(date +%s%N)
+    for i in $(seq $RUNS); do
+        "$@" java -cp $WORKDIR ClassLoad $CLASSLIST > $WORKDIR/last.out
+    done
+    local end=$(date +%s%N)
+    printf "%-9s %s; %d ms per JVM run\n" $label "$(cat $WORKDIR/last.out)" $(( (end - start) / 1000000 / RUNS ))
+}
+
+run unscoped env
+run scoped env SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB
+
+rm -rf $WORKDIR
@@ -0,0 +1,125 @@
+import java.io.FileInputStream;
+import java.nio.ByteBuffer;
+import java.security.KeyStore;
+import javax.net.ssl.KeyManagerFactory;
+import javax.net.ssl.SSLContext;
+import javax.net.ssl.SSLEngine;
+import javax.net.ssl.SSLEngineResult;
+import javax.net.ssl.SSLEngineResult.HandshakeStatus;
+import javax.net.ssl.TrustManagerFactory;
+
+/*
+ * In-process TLS throughput: a client and a server SSLEngine exchange
+ * HTTP/1.1 requests and responses through direct ByteBuffers, so every
+ * record goes through SSLEngineImpl.wrap()/unwrap().
+ * Usage: java TlsLoopback <keystore> <password> <count> <payload size>
+ */
+public class TlsLoopback {
+    private static SSLEngine client;
+    private static SSLEngine server;
+    private static ByteBuffer clientOut, clientIn, serverOut, serverIn;
+    private static ByteBuffer cToS, sToC;
+
+    public static void main(String[] args) throws Exception {
+        char[] pass = args[1].toCharArray();
+        int count = Integer.parseInt(args[2]);
+        int size = Integer.parseInt(args[3]);
+
+        KeyStore ks = KeyStore.getInstance("JKS");
+        ks.load(new FileInputStream(args[0]), pass);
+        KeyManagerFactory kmf = KeyManagerFactory.getInstance("SunX509");
+        kmf.init(ks, pass);
+        TrustManagerFactory tmf = TrustManagerFactory.getInstance("SunX509");
+        tmf.init(ks);
+        SSLContext ctx = SSLContext.getInstance("TLS");
+        ctx.init(kmf.getKeyManagers(), tmf.getTrustManagers(), null);
+
+        client = ctx.createSSLEngine("localhost", 443);
+        client.setUseClientMode(true);
+        server = ctx.createSSLEngine();
+        server.setUseClientMode(false);
+
+        int app = client.getSession().getApplicationBufferSize();
+        int net = client.getSession().getPacketBufferSize();
+        clientIn = ByteBuffer.allocateDirect(Math.max(app, size) + 64);
+        serverIn = ByteBuffer.allocateDirect(Math.max(app, size) + 64);
+        cToS = ByteBuffer.allocateDirect(net * 4 + size);
+        sToC = ByteBuffer.allocateDirect(net * 4 + size);
+
+        byte[] body = new byte[size];
+        byte[] req = ("GET /bench HTTP/1.1\r\nHost: localhost\r\n\r\n").getBytes();
+        byte[] hdr = ("HTTP/1.1 200 OK\r\nContent-Length: " + size + "\r\n\r\n").getBytes();
+        clientOut = ByteBuffer.allocateDirect(req.length);
+        serverOut = ByteBuffer.allocateDirect(hdr.length + size);
+
+        handshake();
+
+        long start = System.nanoTime();
+        for (int i = 0; i < count; i++) {
+            clientOut.clear();
+            clientOut.put(req).flip();
+            transfer(client, clientOut, cToS, server, serverIn);
+            serverOut.clear();
+            serverOut.put(hdr).put(body).flip();
+            transfer(server, serverOut, sToC, client, clientIn);
+        }
+        long ns = System.nanoTime() - start;
+        double secs = ns / 1e9;
+        System.out.printf("%d exchanges in %.3f s: %.0f exchanges/s, %.1f MB/s%n",
+            count, secs, count / secs, (double)count * (size + hdr.length + req.length) / secs / 1e6);
+    }
+
+    private static void transfer(SSLEngine from, ByteBuffer src, ByteBuffer net,
+                                 SSLEngine to, ByteBuffer dst) throws Exception {
+        while (src.hasRemaining()) {
+            from.wrap(src, net);
+        }
+        net.flip();
+        while (net.hasRemaining()) {
+            dst.clear();
+            SSLEngineResult r = to.unwrap(net, dst);
+            if (r.getStatus() != SSLEngineResult.Status.OK) break;
+        }
+        net.clear();
+    }
+
+    private static void runTasks(SSLEngine engine) {
+        Runnable task;
+        while ((task = engine.getDelegatedTask()) != null) task.run();
+    }
+
+    private static void handshake() throws Exception {
+        ByteBuffer empty = ByteBuffer.allocate(0);
+        client.beginHandshake();
+        server.beginHandshake();
+        while (!done(client) || !done(server)) {
+            step(client, empty, cToS, sToC);
+            step(server, empty, sToC, cToS);
+        }
+        cToS.clear();
+        sToC.clear();
+    }
+
+    private static boolean done(SSLEngine e) {
+        HandshakeStatus hs = e.getHandshakeStatus();
+        return hs == HandshakeStatus.FINISHED || hs == HandshakeStatus.NOT_HANDSHAKING;
+    }
+
+    private static void step(SSLEngine e, ByteBuffer empty, ByteBuffer out, ByteBuffer in) throws Exception {
+        switch (e.getHandshakeStatus()) {
+            case NEED_WRAP:
+                e.wrap(empty, out);
+                break;
+            case NEED_UNWRAP:
+                in.flip();
+                e.unwrap(in, e == client ? clientIn : serverIn);
+                in.compact();
+                break;
+            case NEED_TASK:
+                runTasks(e);
+                break;
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#!/bin/bash
+# Measures in-process TLS throughput through SSLEngine wrap()/unwrap()
+# with and without libscope loaded as a Java agent:
+#   unscoped - no agent
+#   idle     - agent loaded, nothing consumes TLS payloads
+#   http     - agent loaded, HTTP events and metrics enabled
+#   payload  - agent loaded, payloads enabled
+# Requires a JDK (java, javac, keytool) and a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./javatls.sh [count] [payload size]
+
+COUNT=${1:-200000}
+SIZE=${2:-16384}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/javatls.XXXXXX)
+
+javac -d $WORKDIR TlsLoopback.java || exit 1
+keytool -genkeypair -keystore $WORKDIR/bench.jks -storepass benchpass -keypass benchpass \
+    -alias bench -keyalg RSA -keysize 2048 -dname "CN=localhost" -validity 1 > /dev/null 2>&1 || exit 1
+
+write_config() {
+    # $1 - http watch enabled, $2 - payloads enabled
+    cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: $1
+  format:
+    type: statsd
+  transport:
+    type: file
+    path: $WORKDIR/metrics.out
+  watch:
+    - type: http
+event:
+  enable: $1
+  transport:
+    type: file
+    path: $WORKDIR/events.json
+  format:
+    type: ndjson
+    maxeventpersec: 0
+  watch:
+    - type: http
+      name: .*
+      field: .*
+      value: .*
+payload:
+  enable: $2
+  dir: $WORKDIR/payloads
+cribl:
+  enable: false
+libscope:
+  summaryperiod: 1
+  log:
+    level: error
+EOCFG
+}
+
+run() {
+    printf "%-9s" "$1"
+    shift
+    "$@" java -cp $WORKDIR TlsLoopback $WORKDIR/bench.jks benchpass $COUNT $SIZE
+}
+
+run unscoped env
+write_config false false
+run idle env SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB
+write_config true false
+run http env SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB
+write_config false true
+run payload env SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB
+
+rm -rf $WORKDIR
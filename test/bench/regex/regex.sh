@@ -0,0 +1,61 @@
+#!/bin/bash
+# Measures the cost of libscope's datapath regex call sites:
+#   connect - TLS detection (detectTLS) and protocol detection (setProtocol)
+#   http    - HTTP/1 header parsing (getContentLength, hasUpgrade)
+#   statsd  - StatsD metric capture (doMetricBuffer)
+# Requires cc and a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./regex.sh [count]
+
+COUNT=${1:-20000}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/regexbench.XXXXXX)
+
+cc -O2 -o $WORKDIR/regexload regexload.c || exit 1
+
+cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: true
+  format:
+    type: statsd
+  transport:
+    type: file
+    path: $WORKDIR/metrics.out
+  watch:
+    - type: statsd
+    - type: net
+    - type: http
+event:
+  enable: true
+  transport:
+    type: file
+    path: $WORKDIR/events.json
+  format:
+    type: ndjson
+    maxeventpersec: 0
+  watch:
+    - type: http
+      name: .*
+      field: .*
+      value: .*
+cribl:
+  enable: false
+libscope:
+  summaryperiod: 1
+  log:
+    level: error
+EOCFG
+
+for MODE in connect http statsd; do
+    # connect uses a new ephemeral port per op; keep it to something sane
+    N=$COUNT
+    [ $MODE = connect ] && [ $N -gt 5000 ] && N=5000
+
+    printf "Unscoped "
+    $WORKDIR/regexload $MODE $N
+    printf "Scoped   "
+    SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB $WORKDIR/regexload $MODE $N
+    echo
+done
+
+rm -rf $WORKDIR
@@ -0,0 +1,132 @@
+/*
+ * Drives each of libscope's datapath regex call sites over loopback:
+ *   connect - one request per connection; TLS and protocol detection
+ *   http    - requests on one connection; HTTP/1 content-length, upgrade
+ *   statsd  - datagrams on one socket; StatsD metric capture
+ * Prints the mean time per operation.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REQUEST "POST /bench HTTP/1.1\r\nHost: localhost\r\n" \
+                "Content-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello"
+#define STATSD "bench.counter:1|c|#host:localhost,app:bench"
+
+static unsigned long long
+nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+listener(struct sockaddr_in *addr, int type)
+{
+    socklen_t len = sizeof(*addr);
+    int sd = socket(AF_INET, type, 0);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sd == -1) ||
+        bind(sd, (struct sockaddr *)addr, sizeof(*addr)) ||
+        getsockname(sd, (struct sockaddr *)addr, &len) ||
+        ((type == SOCK_STREAM) && listen(sd, 128))) {
+        perror("listener");
+        exit(1);
+    }
+    return sd;
+}
+
+// Accepts connections and throws away whatever arrives on them
+static pid_t
+sink(int sd)
+{
+    pid_t pid = fork();
+    if (pid) return pid;
+
+    char buf[4096];
+    int cd;
+    while ((cd = accept(sd, NULL, NULL)) != -1) {
+        while (read(cd, buf, sizeof(buf)) > 0);
+        close(cd);
+    }
+    _exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s connect|http|statsd <count>\n", argv[0]);
+        return 1;
+    }
+
+    const char *mode = argv[1];
+    long i, count = strtol(argv[2], NULL, 10);
+    struct sockaddr_in addr;
+    unsigned long long start, end;
+    pid_t pid = 0;
+    int sd;
+
+    if (!strcmp(mode, "statsd")) {
+        int ld = listener(&addr, SOCK_DGRAM);
+        sd = socket(AF_INET, SOCK_DGRAM, 0);
+        start = nowNs();
+        for (i = 0; i < count; i++) {
+            sendto(sd, STATSD, sizeof(STATSD) - 1, 0,
+                   (struct sockaddr *)&addr, sizeof(addr));
+        }
+        end = nowNs();
+        close(ld);
+    } else if (!strcmp(mode, "http")) {
+        int ld = listener(&addr, SOCK_STREAM);
+        pid = sink(ld);
+        sd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(sd, (struct sockaddr *)&addr, sizeof(addr))) {
+            perror("connect");
+            return 1;
+        }
+        start = nowNs();
+        for (i = 0; i < count; i++) {
+            if (write(sd, REQUEST, sizeof(REQUEST) - 1) == -1) break;
+        }
+        end = nowNs();
+        close(ld);
+    } else if (!strcmp(mode, "connect")) {
+        int ld = listener(&addr, SOCK_STREAM);
+        pid = sink(ld);
+        start = nowNs();
+        for (i = 0; i < count; i++) {
+            sd = socket(AF_INET, SOCK_STREAM, 0);
+            if (connect(sd, (struct sockaddr *)&addr, sizeof(addr))) {
+                perror("connect");
+                break;
+            }
+            if (write(sd, REQUEST, sizeof(REQUEST) - 1) == -1) break;
+            close(sd);
+        }
+        end = nowNs();
+        close(ld);
+    } else {
+        fprintf(stderr, "unknown mode %s\n", mode);
+        return 1;
+    }
+
+    if (pid) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+
+    printf("%s:\t%ld ops\t%llu ns/op\n", mode, i, (end - start) / (i ? i : 1));
+    return 0;
+}
@@ -0,0 +1,66 @@
+#!/bin/bash
+# Measures what libscope adds to the startup of a process that the rules
+# file denies, which with ld.so.preload is most processes on a host. The
+# rules file has as many allow rules as asked for, each with a config,
+# like one that's managed by Edge; the command is on its deny list.
+# Requires a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./rules.sh [count] [rules] [command [args]]
+
+COUNT=${1:-1000}
+RULES=${2:-100}
+shift 2
+CMD=${@:-/bin/true}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/rulesbench.XXXXXX)
+
+{
+    echo "allow:"
+    for ((i = 0; i < RULES; i++)); do
+        cat << EORULE
+- procname: app$i
+  arg: --instance=$i
+  config:
+    metric:
+      enable: true
+      transport:
+        type: unix
+        path: /opt/cribl/state/appscope.sock
+    event:
+      enable: true
+      watch:
+      - type: file
+        name: (\/logs?\/)|(\.log$)
+      - type: http
+        name: .*
+    libscope:
+      log:
+        level: warning
+EORULE
+    done
+    echo "deny:"
+    echo "- procname: $(basename ${CMD%% *})"
+} > $WORKDIR/scope_rules
+
+# Prints the mean wall time of one run of the command, in ms
+run() {
+    local start=$(date +%s%N)
+    for ((i = 0; i < COUNT; i++)); do
+        "$@" $CMD > /dev/null
+    done
+    local end=$(date +%s%N)
+    awk -v ns=$((end - start)) -v n=$COUNT 'BEGIN { printf "%.3f ms\n", ns / n / 1000000 }'
+}
+
+echo "$COUNT x $CMD, denied by a rules file with $RULES allow rules"
+printf "Unscoped        "
+run env
+# A directory where the index would be keeps it from being written
+mkdir $WORKDIR/scope_rules.idx
+printf "Rules file      "
+run env SCOPE_RULES=$WORKDIR/scope_rules LD_PRELOAD=$LIB
+rmdir $WORKDIR/scope_rules.idx
+printf "Compiled rules  "
+run env SCOPE_RULES=$WORKDIR/scope_rules LD_PRELOAD=$LIB
+
+rm -rf $WORKDIR
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Measures what libscope adds to the startup of a short-lived process,
+# most of which is GOT patching in its constructor. Shell pipelines, cron
+# jobs and CI steps scoped with ld.so.preload pay this for every process.
+# Requires a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./startup.sh [count] [command [args]]
+
+COUNT=${1:-1000}
+shift
+CMD=${@:-/bin/true}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/startupbench.XXXXXX)
+
+cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: true
+  format:
+    type: statsd
+  transport:
+    type: file
+    path: $WORKDIR/metrics.out
+event:
+  enable: false
+cribl:
+  enable: false
+libscope:
+  log:
+    level: error
+EOCFG
+
+# Prints the mean wall time of one run of the command, in ms
+run() {
+    local start=$(date +%s%N)
+    for ((i = 0; i < COUNT; i++)); do
+        "$@" $CMD > /dev/null
+    done
+    local end=$(date +%s%N)
+    awk -v ns=$((end - start)) -v n=$COUNT 'BEGIN { printf "%.3f ms\n", ns / n / 1000000 }'
+}
+
+echo "$COUNT x $CMD"
+printf "Unscoped "
+run env
+printf "Scoped   "
+run env SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB
+
+rm -rf $WORKDIR
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Measures the per-call cost of interposed writes, which is dominated by
+# the two timestamps libscope takes around each call when summarized
+# metrics are the only output.
+# Requires cc and a built lib/linux/<arch>/libscope.so
+# To compare before/after, run once with LIB pointing at each build.
+# Usage: [LIB=/path/to/libscope.so] ./timer.sh [count]
+
+COUNT=${1:-1000000}
+LIB=${LIB:-$(realpath ../../../lib/linux/$(uname -m)/libscope.so)}
+WORKDIR=$(mktemp -d /tmp/timerbench.XXXXXX)
+
+cc -O2 -o $WORKDIR/timerload timerload.c || exit 1
+
+cat > $WORKDIR/scope.yml << EOCFG
+metric:
+  enable: true
+  format:
+    type: statsd
+  transport:
+    type: file
+    path: $WORKDIR/metrics.out
+  watch:
+    - type: fs
+event:
+  enable: false
+cribl:
+  enable: false
+libscope:
+  summaryperiod: 10
+  log:
+    level: error
+EOCFG
+
+printf "Unscoped "
+$WORKDIR/timerload $WORKDIR/data $COUNT
+printf "Scoped   "
+SCOPE_CONF_PATH=$WORKDIR/scope.yml LD_PRELOAD=$LIB $WORKDIR/timerload $WORKDIR/data $COUNT
+
+rm -rf $WORKDIR
@@ -0,0 +1,41 @@
+/*
+ * Issues small writes to a file as fast as it can and reports the
+ * average cost per call. Every scoped write takes two timestamps,
+ * so differences between libscope builds at this size are mostly
+ * the cost of getTime() and getDuration().
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+int
+main(int argc, char **argv)
+{
+    long count = (argc > 2) ? atol(argv[2]) : 1000000;
+    const char *path = (argc > 1) ? argv[1] : "/dev/null";
+    struct timespec t0, t1;
+    char c = 'x';
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("open");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < count; i++) {
+        if (write(fd, &c, 1) != 1) {
+            perror("write");
+            return 1;
+        }
+        if ((i & 0xffff) == 0) lseek(fd, 0, SEEK_SET);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    close(fd);
+
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("%ld writes; %.1f ns per write\n", count, ns / count);
+    return 0;
+}
@@ -69,6 +69,7 @@ run_test test/${OS}/coredumptest
 run_test test/${OS}/ipctest
 run_test test/${OS}/snapshottest
 run_test test/${OS}/ostest
+run_test test/${OS}/scopeelftest
 run_test test/${OS}/ocitest
 run_test test/${OS}/evtutilstest
 run_test test/${OS}/strsettest
@@ -93,9 +94,18 @@ if [ "${OS}" = "linux" ]; then
     run_test test/${OS}/reporttest
     run_test test/${OS}/javabcitest
     run_test test/${OS}/httpheadertest
+    run_test test/${OS}/metriccapturetest
 fi
 run_test test/${OS}/httpmatchtest
 run_test test/${OS}/httpaggtest
+run_test test/${OS}/grpcaggtest
+run_test test/${OS}/arenatest
+run_test test/${OS}/histotest
+run_test test/${OS}/topntest
+run_test test/${OS}/fsaggtest
+run_test test/${OS}/netaggtest
+run_test test/${OS}/statsdaggtest
+run_test test/${OS}/dnsanswertest
 run_test test/${OS}/selfinterposetest
 
 # Loader tests
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "dbg.h"
+#include "test.h"
+
+#define NUM_OBJS 1000
+
+static void *g_objs[NUM_OBJS];
+
+static void
+arenaMallocAndCallocWork(void **state)
+{
+    size_t sizes[] = {1, 16, 72, 312, 1664, 4312, 8000};
+    int i;
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned char *ptr = arenaMalloc(sizes[i]);
+        assert_non_null(ptr);
+        assert_int_equal((uintptr_t)ptr % 16, 0);
+        memset(ptr, 0xa5, sizes[i]);
+        arenaFree(ptr);
+
+        // The same object comes back, zeroed this time
+        unsigned char *zeroed = arenaCalloc(1, sizes[i]);
+        assert_ptr_equal(zeroed, ptr);
+        size_t j;
+        for (j = 0; j < sizes[i]; j++) assert_int_equal(zeroed[j], 0);
+        arenaFree(zeroed);
+    }
+
+    assert_null(arenaCalloc(SIZE_MAX / 2, 4));
+}
+
+static void
+arenaFreeForNullDoesNotCrash(void **state)
+{
+    arenaFree(NULL);
+    arenaGetStats(NULL);
+}
+
+static void
+arenaLargeAllocationsComeFromTheHeap(void **state)
+{
+    arena_stats_t stats;
+    arenaGetStats(&stats);
+
+    char *ptr = arenaMalloc(100000);
+    assert_non_null(ptr);
+    memset(ptr, 'x', 100000);
+    arenaFree(ptr);
+
+    arenaGetStats(&stats);
+    assert_int_equal(stats.largeAllocs, 1);
+
+    // counted since the last call
+    arenaGetStats(&stats);
+    assert_int_equal(stats.largeAllocs, 0);
+}
+
+static void
+arenaCountsHitsAndMisses(void **state)
+{
+    arena_stats_t stats;
+    arenaGetStats(&stats);
+
+    // Nothing else here uses this class; the first one is from the heap
+    char *ptr = arenaMalloc(7000);
+    assert_non_null(ptr);
+    arenaGetStats(&stats);
+    assert_int_equal(stats.hits, 0);
+    assert_int_equal(stats.misses, 1);
+
+    // So is the rest of its batch, the first time each is handed out;
+    // anything freed and handed out again isn't
+    char *more = arenaMalloc(7000);
+    arenaFree(ptr);
+    ptr = arenaMalloc(7000);
+    arenaGetStats(&stats);
+    assert_int_equal(stats.hits, 1);
+    assert_int_equal(stats.misses, 1);
+    arenaFree(ptr);
+    arenaFree(more);
+
+    // Too big for a class is always a miss
+    ptr = arenaMalloc(100000);
+    arenaFree(ptr);
+    arenaGetStats(&stats);
+    assert_int_equal(stats.hits, 0);
+    assert_int_equal(stats.misses, 1);
+}
+
+// arg is how many to allocate
+static void *
+allocObjs(void *arg)
+{
+    int i;
+    for (i = 0; i < (intptr_t)arg; i++) {
+        g_objs[i] = arenaMalloc(300);
+        if (!g_objs[i]) return NULL;
+        memset(g_objs[i], i & 0xff, 300);
+    }
+    return (void *)1;
+}
+
+static void
+arenaObjectsFreedOnAnotherThreadAreReused(void **state)
+{
+    arena_stats_t before, after;
+    pthread_t thread;
+    void *ok = NULL;
+
+    // Allocated on one thread, freed on this one
+    assert_int_equal(pthread_create(&thread, NULL, allocObjs, (void *)NUM_OBJS), 0);
+    assert_int_equal(pthread_join(thread, &ok), 0);
+    assert_non_null(ok);
+    int i;
+    for (i = 0; i < NUM_OBJS; i++) arenaFree(g_objs[i]);
+
+    // All but what this thread still caches went to the depot
+    arenaGetStats(&before);
+    assert_true(before.depotBytes >= (NUM_OBJS - 64) * 384);
+    assert_true(before.heapBytes >= NUM_OBJS * 384);
+
+    // Another thread gets them from the depot instead of the heap
+    assert_int_equal(pthread_create(&thread, NULL, allocObjs, (void *)(NUM_OBJS / 2)), 0);
+    assert_int_equal(pthread_join(thread, &ok), 0);
+    assert_non_null(ok);
+    arenaGetStats(&after);
+    assert_int_equal(after.heapBytes, before.heapBytes);
+    assert_true(after.depotBytes < before.depotBytes);
+    assert_true(after.refills >= NUM_OBJS / 2 / 32);
+
+    for (i = 0; i < NUM_OBJS / 2; i++) arenaFree(g_objs[i]);
+}
+
+static void
+arenaDepotIsBounded(void **state)
+{
+    arena_stats_t before, after;
+    int count = 1000, i;
+    void **objs = calloc(count, sizeof(void *));
+    assert_non_null(objs);
+
+    arenaGetStats(&before);
+    for (i = 0; i < count; i++) {
+        objs[i] = arenaMalloc(6000);
+        assert_non_null(objs[i]);
+    }
+    arenaGetStats(&after);
+    assert_true(after.heapBytes - before.heapBytes >= count * 6144);
+
+    // Only 4MB of all classes is kept; the rest goes back to the heap
+    for (i = 0; i < count; i++) arenaFree(objs[i]);
+    arenaGetStats(&after);
+    assert_true(after.depotBytes <= 4 * 1024 * 1024);
+    assert_true(after.heapBytes - before.heapBytes <= 4 * 1024 * 1024 + 2 * 32 * 6144);
+
+    free(objs);
+}
+
+static void
+arenaBigBuffersComeFromTheHeap(void **state)
+{
+    arena_stats_t stats;
+    arenaGetStats(&stats);
+
+    // A buffer that fits a class but is past the buffer limit
+    char *big = arenaMallocBuffer(4000);
+    char *small = arenaMallocBuffer(1000);
+    assert_non_null(big);
+    assert_non_null(small);
+    memset(big, 0xa5, 4000);
+    arenaGetStats(&stats);
+    assert_int_equal(stats.largeAllocs, 1);
+    arenaFree(big);
+    arenaFree(small);
+
+    // The same size from arenaMalloc is a class object
+    big = arenaMalloc(4000);
+    assert_non_null(big);
+    arenaFree(big);
+    arenaGetStats(&stats);
+    assert_int_equal(stats.largeAllocs, 0);
+}
+
+static void
+arenaFreeTwiceIsIgnored(void **state)
+{
+    char *ptr = arenaMalloc(100);
+    assert_non_null(ptr);
+    arenaFree(ptr);
+    arenaFree(ptr);
+    assert_int_equal(dbgCountMatchingLines("src/arena.c"), 1);
+    dbgInit();
+
+    // And the object is only handed out once
+    char *a = arenaMalloc(100);
+    char *b = arenaMalloc(100);
+    assert_ptr_not_equal(a, b);
+    arenaFree(a);
+    arenaFree(b);
+}
+
+static void
+arenaAtForkUnlocksTheDepot(void **state)
+{
+    arenaAtFork();
+
+    // still works afterwards
+    allocObjs((void *)NUM_OBJS);
+    int i;
+    for (i = 0; i < NUM_OBJS; i++) {
+        assert_non_null(g_objs[i]);
+        arenaFree(g_objs[i]);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(arenaMallocAndCallocWork),
+        cmocka_unit_test(arenaFreeForNullDoesNotCrash),
+        cmocka_unit_test(arenaLargeAllocationsComeFromTheHeap),
+        cmocka_unit_test(arenaCountsHitsAndMisses),
+        cmocka_unit_test(arenaObjectsFreedOnAnotherThreadAreReused),
+        cmocka_unit_test(arenaDepotIsBounded),
+        cmocka_unit_test(arenaBigBuffersComeFromTheHeap),
+        cmocka_unit_test(arenaFreeTwiceIsIgnored),
+        cmocka_unit_test(arenaAtForkUnlocksTheDepot),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
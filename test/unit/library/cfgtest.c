@@ -187,6 +187,69 @@ cfgMtcVerbositySetAndGet(void **state)
     cfgDestroy(&config);
 }
 
+static void
+cfgMtcWatchTopSetAndGet(void **state)
+{
+    config_t *config = cfgCreateDefault();
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_FS), DEFAULT_MTC_WATCH_TOP);
+    cfgMtcWatchTopSet(config, 10, CFG_MTC_FS);
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_FS), 10);
+    cfgMtcWatchTopSet(config, UINT_MAX, CFG_MTC_FS);
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_FS), CFG_MAX_WATCH_TOP);
+
+    cfgMtcWatchTopSet(config, 20, CFG_MTC_NET);
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_NET), 20);
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_FS), CFG_MAX_WATCH_TOP);
+
+    // Only fs and net have it
+    cfgMtcWatchTopSet(config, 10, CFG_MTC_HTTP);
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_HTTP), DEFAULT_MTC_WATCH_TOP);
+    assert_int_equal(dbgCountMatchingLines("src/cfg.c"), 1);
+    dbgInit();
+    cfgDestroy(&config);
+}
+
+static void
+cfgMtcStatsDMaxSeriesSetAndGet(void **state)
+{
+    config_t *config = cfgCreateDefault();
+    assert_int_equal(cfgMtcStatsDMaxSeries(config), DEFAULT_STATSD_MAX_SERIES);
+    cfgMtcStatsDMaxSeriesSet(config, 100);
+    assert_int_equal(cfgMtcStatsDMaxSeries(config), 100);
+    cfgMtcStatsDMaxSeriesSet(config, 0);
+    assert_int_equal(cfgMtcStatsDMaxSeries(config), 100);
+    cfgMtcStatsDMaxSeriesSet(config, UINT_MAX);
+    assert_int_equal(cfgMtcStatsDMaxSeries(config), CFG_MAX_STATSD_MAX_SERIES);
+    cfgDestroy(&config);
+    assert_int_equal(cfgMtcStatsDMaxSeries(config), DEFAULT_STATSD_MAX_SERIES);
+}
+
+static void
+cfgMtcFsPathSetAndGet(void **state)
+{
+    config_t *config = cfgCreateDefault();
+    assert_int_equal(cfgMtcFsNumPaths(config), 0);
+    assert_null(cfgMtcFsPath(config, 0));
+
+    cfgMtcFsPathSet(config, "/tmp");
+    cfgMtcFsPathSet(config, "");
+    cfgMtcFsPathSet(config, NULL);
+    cfgMtcFsPathSet(config, "/var/*/data");
+    assert_int_equal(cfgMtcFsNumPaths(config), 2);
+    assert_string_equal(cfgMtcFsPath(config, 0), "/tmp");
+    assert_string_equal(cfgMtcFsPath(config, 1), "/var/*/data");
+    assert_null(cfgMtcFsPath(config, -1));
+    assert_null(cfgMtcFsPath(config, 2));
+
+    cfgMtcFsPathsClear(config);
+    assert_int_equal(cfgMtcFsNumPaths(config), 0);
+    assert_null(cfgMtcFsPath(config, 0));
+    cfgMtcFsPathSet(config, "/opt");
+    assert_int_equal(cfgMtcFsNumPaths(config), 1);
+    cfgMtcFsPathsClear(NULL);
+    cfgDestroy(&config);
+}
+
 static void
 cfgMtcPeriodSetAndGet(void **state)
 {
@@ -683,6 +746,9 @@ main(int argc, char *argv[])
         cmocka_unit_test(cfgMtcStatsDPrefixSetAndGet),
         cmocka_unit_test(cfgMtcStatsDMaxLenSetAndGet),
         cmocka_unit_test(cfgMtcVerbositySetAndGet),
+        cmocka_unit_test(cfgMtcWatchTopSetAndGet),
+        cmocka_unit_test(cfgMtcStatsDMaxSeriesSetAndGet),
+        cmocka_unit_test(cfgMtcFsPathSetAndGet),
         cmocka_unit_test(cfgMtcPeriodSetAndGet),
         cmocka_unit_test(cfgMtcWatchEnableSetAndGet),
         cmocka_unit_test(cfgCmdDirSetAndGet),
@@ -11,6 +11,7 @@
 #include "fn.h"
 #include "com.h"
 #include "cfgutils.h"
+#include "loader/rulescompile.h"
 #include "scopestdlib.h"
 #include "test.h"
 #include "dbg.h"
@@ -657,6 +658,102 @@ cfgProcessEnvironmentMtcVerbosity(void **state)
     cfgProcessEnvironment(cfg);
 }
 
+static void
+cfgProcessEnvironmentMtcWatchFsTop(void **state)
+{
+    config_t *cfg = cfgCreateDefault();
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_FS), DEFAULT_MTC_WATCH_TOP);
+    assert_int_equal(cfgMtcFsNumPaths(cfg), 0);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_METRIC_FS_TOP", "20", 1), 0);
+    assert_int_equal(setenv("SCOPE_METRIC_FS_PATHS", "/tmp:/var/lib/data/*/part-*", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_FS), 20);
+    assert_int_equal(cfgMtcFsNumPaths(cfg), 2);
+    assert_string_equal(cfgMtcFsPath(cfg, 0), "/tmp");
+    assert_string_equal(cfgMtcFsPath(cfg, 1), "/var/lib/data/*/part-*");
+    assert_null(cfgMtcFsPath(cfg, 2));
+
+    // unrecognised value should not affect cfg
+    assert_int_equal(unsetenv("SCOPE_METRIC_FS_PATHS"), 0);
+    assert_int_equal(setenv("SCOPE_METRIC_FS_TOP", "lots", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_FS), 20);
+    assert_int_equal(cfgMtcFsNumPaths(cfg), 2);
+
+    // a new value replaces the paths, as a command file would set it
+    assert_int_equal(setenv("SCOPE_METRIC_FS_PATHS", "/opt/app", 1), 0);
+    cfgProcessEnvironment(cfg);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcFsNumPaths(cfg), 1);
+    assert_string_equal(cfgMtcFsPath(cfg, 0), "/opt/app");
+
+    // and an empty one leaves none
+    assert_int_equal(setenv("SCOPE_METRIC_FS_PATHS", "", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcFsNumPaths(cfg), 0);
+    assert_int_equal(unsetenv("SCOPE_METRIC_FS_PATHS"), 0);
+
+    // 0 turns it off again
+    assert_int_equal(setenv("SCOPE_METRIC_FS_TOP", "0", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_FS), 0);
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_FS_TOP"), 0);
+
+    // Just don't crash on null cfg
+    cfgDestroy(&cfg);
+    cfgProcessEnvironment(cfg);
+}
+
+static void
+cfgProcessEnvironmentMtcWatchNetTop(void **state)
+{
+    config_t *cfg = cfgCreateDefault();
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_NET), DEFAULT_MTC_WATCH_TOP);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_METRIC_NET_TOP", "15", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_NET), 15);
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_FS), DEFAULT_MTC_WATCH_TOP);
+
+    // unrecognised value should not affect cfg
+    assert_int_equal(setenv("SCOPE_METRIC_NET_TOP", "-", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcWatchTop(cfg, CFG_MTC_NET), 15);
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_NET_TOP"), 0);
+
+    // Just don't crash on null cfg
+    cfgDestroy(&cfg);
+    cfgProcessEnvironment(cfg);
+}
+
+static void
+cfgProcessEnvironmentStatsDMaxSeries(void **state)
+{
+    config_t *cfg = cfgCreateDefault();
+    assert_int_equal(cfgMtcStatsDMaxSeries(cfg), DEFAULT_STATSD_MAX_SERIES);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_METRIC_STATSD_MAXSERIES", "500", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcStatsDMaxSeries(cfg), 500);
+
+    // unrecognised value should not affect cfg
+    assert_int_equal(setenv("SCOPE_METRIC_STATSD_MAXSERIES", "many", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcStatsDMaxSeries(cfg), 500);
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_STATSD_MAXSERIES"), 0);
+
+    // Just don't crash on null cfg
+    cfgDestroy(&cfg);
+    cfgProcessEnvironment(cfg);
+}
+
 static void
 cfgProcessEnvironmentLogLevel(void **state)
 {
@@ -1768,6 +1865,48 @@ cfgReadYamlOrderWithinStructureDoesntMatter(void **state)
     deleteFile(path);
 }
 
+static void
+cfgReadMtcWatchTopAndPaths(void **state)
+{
+    const char *yamlText =
+        "---\n"
+        "metric:\n"
+        "  watch:\n"
+        "    - top: 25                       # before type is fine\n"
+        "      type: fs\n"
+        "      paths:\n"
+        "        - /tmp\n"
+        "        - /var/lib/data/*/part-*\n"
+        "    - type: net\n"
+        "      top: 10\n"
+        "      paths:                        # only for fs\n"
+        "        - /ignored\n"
+        "    - top: 5                        # without a type\n"
+        "    - type: statsd\n"
+        "      maxseries: 300\n"
+        "...\n";
+    const char *path = CFG_FILE_NAME;
+    writeFile(path, yamlText);
+
+    g_protlist = lstCreate(destroyProtEntry);
+    assert_non_null(g_protlist);
+    config_t *config = cfgRead(path);
+    assert_non_null(config);
+    assert_int_equal(cfgMtcWatchEnable(config, CFG_MTC_FS), TRUE);
+    assert_int_equal(cfgMtcWatchEnable(config, CFG_MTC_NET), TRUE);
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_FS), 25);
+    assert_int_equal(cfgMtcWatchTop(config, CFG_MTC_NET), 10);
+    assert_int_equal(cfgMtcStatsDMaxSeries(config), 300);
+    assert_int_equal(cfgMtcFsNumPaths(config), 2);
+    assert_string_equal(cfgMtcFsPath(config, 0), "/tmp");
+    assert_string_equal(cfgMtcFsPath(config, 1), "/var/lib/data/*/part-*");
+
+    cfgDestroy(&config);
+    lstDestroy(&g_protlist);
+    g_prot_sequence = 0;
+    deleteFile(path);
+}
+
 static void
 cfgReadEnvSubstitution(void **state)
 {
@@ -2985,6 +3124,133 @@ rulesUnixPathPresent(void **state)
     scope_free(unixPath);
 }
 
+// What the loader does when it installs a rules file
+static void
+compileRules(const char *path)
+{
+    struct stat sbuf;
+    char idxPath[PATH_MAX];
+    void *idx = NULL;
+    size_t size = 0;
+
+    int fd = open(path, O_RDONLY);
+    assert_int_not_equal(fd, -1);
+    assert_int_equal(fstat(fd, &sbuf), 0);
+    char *yaml = malloc(sbuf.st_size + 1);
+    assert_non_null(yaml);
+    assert_int_equal(read(fd, yaml, sbuf.st_size), sbuf.st_size);
+    close(fd);
+    assert_true(rulesCompile(yaml, sbuf.st_size, &sbuf, &idx, &size));
+    free(yaml);
+
+    snprintf(idxPath, sizeof(idxPath), "%s.idx", path);
+    fd = open(idxPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert_int_not_equal(fd, -1);
+    assert_int_equal(write(fd, idx, size), size);
+    close(fd);
+    free(idx);
+}
+
+static void
+rulesIndexIsUsed(void **state)
+{
+    char dir[] = "/tmp/cfgutilsrulesXXXXXX";
+    char path[PATH_MAX];
+    char idxPath[PATH_MAX];
+    assert_non_null(mkdtemp(dir));
+    snprintf(path, sizeof(path), "%s/scope_rules", dir);
+    snprintf(idxPath, sizeof(idxPath), "%s.idx", path);
+    writeFile(path,
+        "allow:\n"
+        "- arg: --verbose\n"
+        "- procname: redis\n"
+        "  config:\n"
+        "    libscope:\n"
+        "      log:\n"
+        "        level: error\n"
+        "        transport:\n"
+        "          type: file\n"
+        "          path: '/tmp/redis \"1\".log'\n"
+        "deny:\n"
+        "- procname: git\n"
+        "- arg: --dry-run\n"
+        "source:\n"
+        "  unixSocketPath: /run/appscope/appscope.sock\n");
+
+    // The library never writes an index
+    assert_int_equal(cfgRulesFileIsValid(path), TRUE);
+    assert_int_equal(access(idxPath, F_OK), -1);
+
+    compileRules(path);
+    assert_int_equal(cfgRulesFileIsValid(path), TRUE);
+
+    config_t *cfg = cfgCreateDefault();
+    assert_int_equal(cfgRulesStatus("redis", "redis", path, cfg), RULES_SCOPED_WITH_CFG);
+    assert_int_equal(cfgLogLevel(cfg), CFG_LOG_ERROR);
+    assert_string_equal(cfgTransportPath(cfg, CFG_LOG), "/tmp/redis \"1\".log");
+    cfgDestroy(&cfg);
+
+    cfg = cfgCreateDefault();
+    assert_int_equal(cfgRulesStatus("git", "git", path, cfg), RULES_NOT_SCOPED);
+    assert_int_equal(cfgRulesStatus("ls", "ls --verbose", path, cfg), RULES_SCOPED_WITH_CFG);
+    assert_int_equal(cfgRulesStatus("ls", "ls --verbose --dry-run", path, cfg), RULES_NOT_SCOPED);
+    assert_int_equal(cfgRulesStatus("ls", "ls", path, cfg), RULES_NOT_SCOPED);
+    cfgDestroy(&cfg);
+
+    assert_int_equal(setenv("SCOPE_RULES", path, 1), 0);
+    char *unixPath = cfgRulesUnixPath();
+    assert_int_equal(unsetenv("SCOPE_RULES"), 0);
+    assert_string_equal(unixPath, "/run/appscope");
+    scope_free(unixPath);
+
+    unlink(idxPath);
+    unlink(path);
+    rmdir(dir);
+}
+
+static void
+rulesIndexIsNotUsedWhenItCantBeTrusted(void **state)
+{
+    char dir[] = "/tmp/cfgutilsrulesXXXXXX";
+    char path[PATH_MAX];
+    char idxPath[PATH_MAX];
+    assert_non_null(mkdtemp(dir));
+    snprintf(path, sizeof(path), "%s/scope_rules", dir);
+    snprintf(idxPath, sizeof(idxPath), "%s.idx", path);
+
+    // An index for what the rules file was isn't used
+    writeFile(path, "allow:\n- procname: redis\n");
+    compileRules(path);
+    writeFile(path, "allow:\n- procname: redis\ndeny:\n- procname: redis\n");
+    config_t *cfg = cfgCreateDefault();
+    assert_int_equal(cfgRulesStatus("redis", "redis", path, cfg), RULES_NOT_SCOPED);
+
+    // Nor is one that anyone could have written
+    writeFile(path, "allow:\n- procname: redis\n");
+    compileRules(path);
+    writeFile(path, "deny:\n- procname: redis\n");
+    compileRules(path);
+    assert_int_equal(chmod(idxPath, 0666), 0);
+    writeFile(path, "allow:\n- procname: redis\n");
+    assert_int_equal(cfgRulesStatus("redis", "redis", path, cfg), RULES_SCOPED_WITH_CFG);
+
+    // Nor one that isn't an index
+    writeFile(idxPath, "deny:\n- procname: redis\n");
+    assert_int_equal(cfgRulesStatus("redis", "redis", path, cfg), RULES_SCOPED_WITH_CFG);
+
+    // A rules file that isn't yaml is compiled to an index that says so
+    unlink(idxPath);
+    writeFile(path, "allow: [redis\n");
+    compileRules(path);
+    assert_int_equal(cfgRulesFileIsValid(path), FALSE);
+    assert_int_equal(cfgRulesStatus("redis", "redis", path, cfg), RULES_ERROR);
+    cfgDestroy(&cfg);
+
+    unlink(idxPath);
+    unlink(path);
+    rmdir(dir);
+}
+
 // Defined in src/cfgutils.c
 // This is not a proper test, it just exists to make valgrind output
 // more readable when analyzing this test, by deallocating the compiled
@@ -3041,6 +3307,9 @@ main(int argc, char *argv[])
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &fs),
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &dns),
         cmocka_unit_test(cfgProcessEnvironmentMtcVerbosity),
+        cmocka_unit_test(cfgProcessEnvironmentMtcWatchFsTop),
+        cmocka_unit_test(cfgProcessEnvironmentMtcWatchNetTop),
+        cmocka_unit_test(cfgProcessEnvironmentStatsDMaxSeries),
         cmocka_unit_test(cfgProcessEnvironmentLogLevel),
         cmocka_unit_test_prestate(cfgProcessEnvironmentTransport, &dest_mtc),
         cmocka_unit_test_prestate(cfgProcessEnvironmentTransport, &dest_evt),
@@ -3061,6 +3330,7 @@ main(int argc, char *argv[])
         cmocka_unit_test(cfgReadBadYamlReturnsDefaults),
         cmocka_unit_test(cfgReadExtraFieldsAreHarmless),
         cmocka_unit_test(cfgReadYamlOrderWithinStructureDoesntMatter),
+        cmocka_unit_test(cfgReadMtcWatchTopAndPaths),
         cmocka_unit_test(cfgReadEnvSubstitution),
         cmocka_unit_test(jsonObjectFromCfgAndjsonStringFromCfgRoundTrip),
         cmocka_unit_test(initLogReturnsPtr),
@@ -3092,6 +3362,8 @@ main(int argc, char *argv[])
         cmocka_unit_test(rulesMatchAllInDeny),
         cmocka_unit_test(rulesUnixPathMissing),
         cmocka_unit_test(rulesUnixPathPresent),
+        cmocka_unit_test(rulesIndexIsUsed),
+        cmocka_unit_test(rulesIndexIsNotUsedWhenItCantBeTrusted),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
         cmocka_unit_test(cfgReadProtocol),
         cmocka_unit_test(cfgReadCustomEmptyFilter),
@@ -121,6 +121,72 @@ msgStartHasExpectedSubNodes(void** state)
     cfgDestroy(&cfg);
 }
 
+static void
+regexMatchReturnsCaptures(void** state)
+{
+    pcre2_code *re = regexCompile("(a+)(b+)", NULL, NULL);
+    assert_non_null(re);
+
+    const char *str = "xaabbbc";
+    pcre2_match_data *results = NULL;
+    assert_int_equal(regexMatch(re, (PCRE2_SPTR)str, scope_strlen(str), &results), 3);
+    assert_non_null(results);
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(results);
+    assert_int_equal(ovector[2], 1);
+    assert_int_equal(ovector[3], 3);
+    assert_int_equal(ovector[4], 3);
+    assert_int_equal(ovector[5], 6);
+    regexMatchRelease(results);
+
+    // No match means no results to release
+    results = (pcre2_match_data *)0x1;
+    assert_int_equal(regexMatch(re, (PCRE2_SPTR)"xyz", 3, &results), PCRE2_ERROR_NOMATCH);
+    assert_null(results);
+
+    // Pool entries are given back; this would run the pool dry if not
+    int i;
+    for (i = 0; i < 1000; i++) {
+        assert_int_equal(regexMatch(re, (PCRE2_SPTR)str, scope_strlen(str), &results), 3);
+        regexMatchRelease(results);
+        assert_int_equal(regexMatch(re, (PCRE2_SPTR)str, scope_strlen(str), NULL), 3);
+    }
+
+    // From a thread with stack headroom, with a null terminated subject
+    regexSetStackHeadroom(TRUE);
+    assert_int_equal(regexMatch(re, (PCRE2_SPTR)str, PCRE2_ZERO_TERMINATED, NULL), 3);
+    regexSetStackHeadroom(FALSE);
+
+    pcre2_code_free(re);
+
+    assert_int_equal(regexMatch(NULL, (PCRE2_SPTR)str, 1, NULL), PCRE2_ERROR_NULL);
+}
+
+static void
+regexMatchHandlesMoreCapturesThanPooled(void** state)
+{
+    // One more capture group than the pooled match data has room for
+    char pattern[REGEX_OVEC_MAX * 3 + 1] = {0};
+    char subject[REGEX_OVEC_MAX + 1] = {0};
+    int i;
+    for (i = 0; i < REGEX_OVEC_MAX; i++) {
+        scope_strcat(pattern, "(.)");
+        subject[i] = 'a' + i;
+    }
+
+    pcre2_code *re = regexCompile(pattern, NULL, NULL);
+    assert_non_null(re);
+
+    pcre2_match_data *results = NULL;
+    assert_int_equal(regexMatch(re, (PCRE2_SPTR)subject, REGEX_OVEC_MAX, &results),
+                     REGEX_OVEC_MAX + 1);
+    assert_non_null(results);
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(results);
+    assert_int_equal(ovector[REGEX_OVEC_MAX * 2], REGEX_OVEC_MAX - 1);
+    regexMatchRelease(results);
+
+    pcre2_code_free(re);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -132,6 +198,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(cmdSendResponseDoesNotCrash),
         cmocka_unit_test(cmdParseDoesNotCrash),
         cmocka_unit_test(msgStartHasExpectedSubNodes),
+        cmocka_unit_test(regexMatchReturnsCaptures),
+        cmocka_unit_test(regexMatchHandlesMoreCapturesThanPooled),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "ctl.h"
 #include "circbuf.h"
@@ -813,6 +814,57 @@ ctlSendLogConsoleNoneAsciiData(void **state)
     destroyState();
 }
 
+static void
+ctlSendLogRateLimitedDropIsNotAnError(void **state)
+{
+    initState();
+    const char *console_path = "stdout";
+    char binary[] = {(char)128, (char)157, (char)234, '\0'};
+    const char *text = "hello world";
+    proc_id_t proc = {.pid = 1,
+                      .ppid = 1,
+                      .hostname = "foo",
+                      .procname = "foo",
+                      .cmd = "foo",
+                      .id = "foo"};
+    ctl_t *ctl = ctlCreate();
+    assert_non_null(ctl);
+    ctlAllowBinaryConsoleSet(ctl, FALSE);
+    doOpen(30, 0, console_path, FD, "open");
+
+    evt_fmt_t *evt = evtFormatCreate();
+    assert_non_null(evt);
+    ctlEvtSet(ctl, evt);
+    evtFormatRateLimitSet(evt, 1);
+    event_t e = INT_EVENT("stdout", 1, DELTA, NULL);
+    e.src = CFG_SRC_CONSOLE;
+
+    time_t initial, current;
+restart:
+    time(&initial);
+
+    // Use up the budget, and get the notice
+    int i;
+    for (i = 0; i < 2; i++) {
+        cJSON *json = evtFormatMetric(evt, &e, 12345, &proc);
+        if (json) cJSON_Delete(json);
+    }
+    assert_true(evtFormatRateLimited(evt, CFG_SRC_CONSOLE));
+
+    // Dropped on purpose; what the fd has written is still tracked
+    assert_int_equal(ctlSendLog(ctl, 30, console_path, binary, strlen(binary), 0, &proc), 0);
+    assert_int_equal(getFSContentType(30), FS_CONTENT_BINARY);
+    assert_int_equal(ctlSendLog(ctl, 30, console_path, text, strlen(text), 0, &proc), 0);
+    assert_int_equal(getFSContentType(30), FS_CONTENT_TEXT);
+
+    time(&current);
+    if (current != initial) goto restart;
+
+    doClose(30, "close");
+    ctlDestroy(&ctl);
+    destroyState();
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -841,6 +893,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(ctlDelProtocol),
         cmocka_unit_test(ctlSendLogConsoleAsciiData),
         cmocka_unit_test(ctlSendLogConsoleNoneAsciiData),
+        cmocka_unit_test(ctlSendLogRateLimitedDropIsNotAnError),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
 
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "dnsanswer.h"
+#include "test.h"
+
+// www.google.com A 172.217.6.4, ttl 5 (the response in dnstest.c)
+static const unsigned char g_resp_a[] = {
+    0xde, 0xaf, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x03, 'w', 'w', 'w', 0x06, 'g', 'o', 'o', 'g', 'l', 'e', 0x03, 'c', 'o', 'm', 0x00,
+    0x00, 0x01, 0x00, 0x01,
+    0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x00, 0x04,
+    0xac, 0xd9, 0x06, 0x04,
+};
+
+// www.example.com CNAME edge.example.net, which has an A (ttl 60) and an
+// AAAA (ttl 30), with compressed owner names and an EDNS OPT record in
+// the additional section
+static const unsigned char g_resp_cname[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01,
+    // question at 12: www.example.com A IN
+    0x03, 'w', 'w', 'w', 0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x03, 'c', 'o', 'm', 0x00,
+    0x00, 0x01, 0x00, 0x01,
+    // answer at 33: www.example.com CNAME edge.example.net
+    0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x12,
+    // rdata at 45: edge.example.net
+    0x04, 'e', 'd', 'g', 'e', 0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x03, 'n', 'e', 't', 0x00,
+    // answer: edge.example.net A 10.1.2.3
+    0xc0, 0x2d, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x04,
+    0x0a, 0x01, 0x02, 0x03,
+    // answer: edge.example.net AAAA 2001:db8::1
+    0xc0, 0x2d, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x00, 0x1e, 0x00, 0x10,
+    0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    // additional: OPT
+    0x00, 0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static void
+dnsAnswerParsesA(void **state)
+{
+    dns_answer_t ans = {0};
+    assert_true(dnsAnswerParse(g_resp_a, sizeof(g_resp_a), FALSE, &ans));
+    assert_string_equal(ans.domain, "www.google.com");
+    assert_int_equal(ans.numAddrs, 1);
+    assert_int_equal(ans.ttl, 5);
+    assert_int_equal(ans.addrs[0].family, AF_INET);
+
+    char ip[INET6_ADDRSTRLEN];
+    assert_non_null(inet_ntop(AF_INET, ans.addrs[0].addr, ip, sizeof(ip)));
+    assert_string_equal(ip, "172.217.6.4");
+}
+
+static void
+dnsAnswerFollowsCnameAndCompression(void **state)
+{
+    dns_answer_t ans = {0};
+    assert_true(dnsAnswerParse(g_resp_cname, sizeof(g_resp_cname), FALSE, &ans));
+    assert_string_equal(ans.domain, "www.example.com");
+    assert_int_equal(ans.numAddrs, 2);
+    assert_int_equal(ans.ttl, 30);
+
+    char ip[INET6_ADDRSTRLEN];
+    assert_int_equal(ans.addrs[0].family, AF_INET);
+    assert_non_null(inet_ntop(AF_INET, ans.addrs[0].addr, ip, sizeof(ip)));
+    assert_string_equal(ip, "10.1.2.3");
+    assert_int_equal(ans.addrs[1].family, AF_INET6);
+    assert_non_null(inet_ntop(AF_INET6, ans.addrs[1].addr, ip, sizeof(ip)));
+    assert_string_equal(ip, "2001:db8::1");
+}
+
+static void
+dnsAnswerHandlesTcpLength(void **state)
+{
+    unsigned char pkt[sizeof(g_resp_a) + 2];
+    pkt[0] = 0;
+    pkt[1] = sizeof(g_resp_a);
+    memcpy(&pkt[2], g_resp_a, sizeof(g_resp_a));
+
+    dns_answer_t ans = {0};
+    assert_true(dnsAnswerParse(pkt, sizeof(pkt), TRUE, &ans));
+    assert_string_equal(ans.domain, "www.google.com");
+    assert_int_equal(ans.numAddrs, 1);
+
+    // Without the flag, the length is read as the header
+    memset(&ans, 0, sizeof(ans));
+    assert_false(dnsAnswerParse(pkt, sizeof(pkt), FALSE, &ans));
+}
+
+static void
+dnsAnswerRejectsBadPackets(void **state)
+{
+    dns_answer_t ans = {0};
+
+    assert_false(dnsAnswerParse(NULL, 0, FALSE, &ans));
+    assert_false(dnsAnswerParse(g_resp_a, 11, FALSE, &ans));
+
+    // A query, not a response
+    unsigned char pkt[sizeof(g_resp_a)];
+    memcpy(pkt, g_resp_a, sizeof(pkt));
+    pkt[2] = 0x01;
+    assert_false(dnsAnswerParse(pkt, sizeof(pkt), FALSE, &ans));
+
+    // Truncated in the question
+    assert_false(dnsAnswerParse(g_resp_a, 20, FALSE, &ans));
+
+    // Answer name that points at itself
+    memcpy(pkt, g_resp_a, sizeof(pkt));
+    pkt[32] = 0xc0;
+    pkt[33] = 32;
+    memset(&ans, 0, sizeof(ans));
+    assert_false(dnsAnswerParse(pkt, sizeof(pkt), FALSE, &ans));
+    assert_int_equal(ans.numAddrs, 0);
+
+    // Address runs past the end
+    memset(&ans, 0, sizeof(ans));
+    assert_false(dnsAnswerParse(g_resp_a, sizeof(g_resp_a) - 1, FALSE, &ans));
+    assert_int_equal(ans.numAddrs, 0);
+}
+
+static unsigned g_flushed_repeats = 0;
+static char g_flushed_domain[MAX_HOSTNAME];
+
+static void
+recordFlush(const dns_answer_t *ans, unsigned repeats)
+{
+    g_flushed_repeats += repeats;
+    strncpy(g_flushed_domain, ans->domain, sizeof(g_flushed_domain) - 1);
+}
+
+static void
+dnsCacheSummarizesRepeats(void **state)
+{
+    dns_cache_t *cache = dnsCacheCreate(DEFAULT_DNS_CACHE_ENTRIES, NULL);
+    assert_non_null(cache);
+
+    dns_answer_t ans = {0};
+    assert_true(dnsAnswerParse(g_resp_cname, sizeof(g_resp_cname), FALSE, &ans));
+
+    unsigned repeats = 99;
+    assert_true(dnsCacheReport(cache, &ans, 1000, &repeats));
+    assert_int_equal(repeats, 0);
+
+    // Identical, within the ttl of 30
+    assert_false(dnsCacheReport(cache, &ans, 1010, &repeats));
+
+    // The same addresses in another order are the same answer
+    dns_answer_t swapped = ans;
+    swapped.addrs[0] = ans.addrs[1];
+    swapped.addrs[1] = ans.addrs[0];
+    assert_false(dnsCacheReport(cache, &swapped, 1020, &repeats));
+
+    // A different answer is reported
+    dns_answer_t other = {0};
+    assert_true(dnsAnswerParse(g_resp_a, sizeof(g_resp_a), FALSE, &other));
+    assert_true(dnsCacheReport(cache, &other, 1020, &repeats));
+
+    // Once the ttl has passed, reported with the count of repeats
+    assert_true(dnsCacheReport(cache, &ans, 1030, &repeats));
+    assert_int_equal(repeats, 2);
+    assert_false(dnsCacheReport(cache, &ans, 1031, &repeats));
+
+    // A ttl of zero is never held
+    ans.ttl = 0;
+    assert_true(dnsCacheReport(cache, &ans, 2000, &repeats));
+    assert_true(dnsCacheReport(cache, &ans, 2000, &repeats));
+
+    dnsCacheDestroy(&cache);
+    assert_null(cache);
+}
+
+static void
+dnsCacheFlushesRepeats(void **state)
+{
+    // One entry, so every answer maps to it
+    dns_cache_t *cache = dnsCacheCreate(1, recordFlush);
+    assert_non_null(cache);
+
+    dns_answer_t ans = {0};
+    assert_true(dnsAnswerParse(g_resp_cname, sizeof(g_resp_cname), FALSE, &ans));
+    dns_answer_t other = {0};
+    assert_true(dnsAnswerParse(g_resp_a, sizeof(g_resp_a), FALSE, &other));
+
+    unsigned repeats;
+    g_flushed_repeats = 0;
+    assert_true(dnsCacheReport(cache, &ans, 1000, &repeats));
+    assert_false(dnsCacheReport(cache, &ans, 1001, &repeats));
+    assert_false(dnsCacheReport(cache, &ans, 1002, &repeats));
+    assert_int_equal(g_flushed_repeats, 0);
+
+    // A colliding answer takes the entry over and flushes the count
+    assert_true(dnsCacheReport(cache, &other, 1003, &repeats));
+    assert_int_equal(repeats, 0);
+    assert_int_equal(g_flushed_repeats, 2);
+    assert_string_equal(g_flushed_domain, ans.domain);
+
+    // The periodic flush hands out the count and keeps the entry
+    g_flushed_repeats = 0;
+    assert_false(dnsCacheReport(cache, &other, 1004, &repeats));
+    dnsCacheFlush(cache);
+    assert_int_equal(g_flushed_repeats, 1);
+    assert_string_equal(g_flushed_domain, other.domain);
+    assert_false(dnsCacheReport(cache, &other, 1005, &repeats));
+
+    // Nothing is flushed twice
+    g_flushed_repeats = 0;
+    dnsCacheFlush(cache);
+    assert_int_equal(g_flushed_repeats, 1);
+    dnsCacheFlush(cache);
+    assert_int_equal(g_flushed_repeats, 1);
+
+    // Nor carried with the next report after the ttl
+    assert_true(dnsCacheReport(cache, &other, 2000, &repeats));
+    assert_int_equal(repeats, 0);
+
+    dnsCacheDestroy(&cache);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(dnsAnswerParsesA),
+        cmocka_unit_test(dnsAnswerFollowsCnameAndCompression),
+        cmocka_unit_test(dnsAnswerHandlesTcpLength),
+        cmocka_unit_test(dnsAnswerRejectsBadPackets),
+        cmocka_unit_test(dnsCacheSummarizesRepeats),
+        cmocka_unit_test(dnsCacheFlushesRepeats),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
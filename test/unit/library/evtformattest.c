@@ -241,6 +241,50 @@ evtFormatMetricWithAndWithoutMatchingValueFilter(void** state)
     evtFormatDestroy(&evt);
 }
 
+static void
+evtFormatMetricWithManyNamesIsFiltered(void** state)
+{
+    evt_fmt_t* evt = evtFormatCreate();
+    assert_non_null(evt);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, 1);
+    evtFormatNameFilterSet(evt, CFG_SRC_METRIC, "^keep");
+
+    proc_id_t proc = {.pid = 4848,
+                      .ppid = 4847,
+                      .hostname = "host",
+                      .procname = "evttest",
+                      .cmd = "cmd-4",
+                      .id = "host-evttest-cmd-4"};
+
+    // Many more distinct names than the filter remembers, twice over
+    int pass, i;
+    for (pass=0; pass<2; pass++) {
+        for (i=0; i<2000; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s.%d", (i % 2) ? "keep" : "drop", i);
+            event_t e = INT_EVENT(name, i, DELTA, NULL);
+            cJSON *json = evtFormatMetric(evt, &e, 12345, &proc);
+            if (i % 2) {
+                assert_non_null(json);
+                cJSON_Delete(json);
+            } else {
+                assert_null(json);
+            }
+        }
+    }
+
+    // Changing the filter has to forget what was remembered
+    evtFormatNameFilterSet(evt, CFG_SRC_METRIC, "^drop");
+    event_t keep = INT_EVENT("keep.1", 1, DELTA, NULL);
+    event_t drop = INT_EVENT("drop.0", 1, DELTA, NULL);
+    assert_null(evtFormatMetric(evt, &keep, 12345, &proc));
+    cJSON *json = evtFormatMetric(evt, &drop, 12345, &proc);
+    assert_non_null(json);
+    cJSON_Delete(json);
+
+    evtFormatDestroy(&evt);
+}
+
 static void
 evtFormatMetricRateLimitReturnsNotice(void** state)
 {
@@ -303,6 +347,74 @@ evtFormatMetricRateLimitReturnsNotice(void** state)
     evtFormatDestroy(&evt);
 }
 
+static void
+evtFormatMetricRateLimitDropsAndIsPerSource(void** state)
+{
+    const unsigned ratelimit = 5; // 5 events per second for test
+
+    evt_fmt_t* evt = evtFormatCreate();
+    assert_non_null(evt);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, 1);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_NET, 1);
+    evtFormatRateLimitSet(evt, ratelimit);
+
+    event_t e = INT_EVENT("Hey", 1, DELTA, NULL);
+    event_t n = INT_EVENT("net.open", 1, DELTA, NULL);
+    n.src = CFG_SRC_NET;
+    proc_id_t proc = {.pid = 4848,
+                      .ppid = 4847,
+                      .hostname = "host",
+                      .procname = "evttest",
+                      .cmd = "cmd-4",
+                      .id = "host-evttest-cmd-4"};
+    cJSON* json;
+
+    time_t initial, current;
+    int i;
+restart:
+    time(&initial);
+    assert_false(evtFormatRateLimited(evt, CFG_SRC_METRIC));
+
+    // Use up the budget, and get the notice
+    for (i=0; i<=ratelimit; i++) {
+        json = evtFormatMetric(evt, &e, 12345, &proc);
+        assert_non_null(json);
+        cJSON_Delete(json);
+    }
+    assert_true(evtFormatRateLimited(evt, CFG_SRC_METRIC));
+
+    // Past the notice, events are dropped and counted
+    for (i=0; i<3; i++) {
+        assert_null(evtFormatMetric(evt, &e, 12345, &proc));
+    }
+
+    // Net events have a budget of their own
+    assert_false(evtFormatRateLimited(evt, CFG_SRC_NET));
+    json = evtFormatMetric(evt, &n, 12345, &proc);
+    assert_non_null(json);
+    cJSON_Delete(json);
+
+    time(&current);
+    if (initial != current) {
+        // This test depends on running all of the above in the same second.
+        evtFormatDestroy(&evt);
+        evt = evtFormatCreate();
+        evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, 1);
+        evtFormatSourceEnabledSet(evt, CFG_SRC_NET, 1);
+        evtFormatRateLimitSet(evt, ratelimit);
+        goto restart;
+    }
+
+    assert_int_equal(evtFormatRateLimitDropped(evt, CFG_SRC_METRIC), 4);
+    assert_int_equal(evtFormatRateLimitDropped(evt, CFG_SRC_NET), 0);
+
+    // Drops on the datapath are counted too
+    evtFormatRateLimitDrop(evt, CFG_SRC_METRIC);
+    assert_int_equal(evtFormatRateLimitDropped(evt, CFG_SRC_METRIC), 5);
+
+    evtFormatDestroy(&evt);
+}
+
 static void
 evtFormatMetricRateLimitCanBeTurnedOff(void** state)
 {
@@ -863,7 +975,9 @@ main(int argc, char* argv[])
         cmocka_unit_test(evtFormatMetricWithAndWithoutMatchingNameFilter),
         cmocka_unit_test(evtFormatMetricWithAndWithoutMatchingFieldFilter),
         cmocka_unit_test(evtFormatMetricWithAndWithoutMatchingValueFilter),
+        cmocka_unit_test(evtFormatMetricWithManyNamesIsFiltered),
         cmocka_unit_test(evtFormatMetricRateLimitReturnsNotice),
+        cmocka_unit_test(evtFormatMetricRateLimitDropsAndIsPerSource),
         cmocka_unit_test(evtFormatMetricRateLimitCanBeTurnedOff),
         cmocka_unit_test(fmtEventJsonValue),
         cmocka_unit_test(fmtEventJsonWithCustomTags),
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "evtutils.h"
 #include "test.h"
 #include "scopestdlib.h"
@@ -68,6 +69,29 @@ evtFreeDoesNotCrash(void **state) {
     }
 }
 
+static void
+evtProtoAllocInSteadyStateDoesNotUseTheHeap(void **state) {
+    arena_stats_t stats;
+    int i;
+
+    // The first round fills the arena; every round after reuses it
+    for (i = 0; i < 100; i++) {
+        protocol_info *h1 = evtProtoAllocHttp1(FALSE);
+        protocol_info *h2 = evtProtoAllocHttp2Frame(200);
+        protocol_info *detect = evtProtoAllocDetect("HTTP");
+        assert_non_null(h1);
+        assert_non_null(h2);
+        assert_non_null(detect);
+        evtFree((evt_type *)h1);
+        evtFree((evt_type *)h2);
+        evtFree((evt_type *)detect);
+        if (!i) arenaGetStats(&stats);
+    }
+
+    arenaGetStats(&stats);
+    assert_int_equal(stats.misses, 0);
+    assert_int_equal(stats.hits, 99 * 7);
+}
 
 int
 main(int argc, char* argv[])
@@ -80,6 +104,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(evtProtoAllocDetectAndFree),
         cmocka_unit_test(evtProtoFreeDoesNotCrash),
         cmocka_unit_test(evtFreeDoesNotCrash),
+        cmocka_unit_test(evtProtoAllocInSteadyStateDoesNotUseTheHeap),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
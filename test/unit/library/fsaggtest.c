@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fsagg.h"
+#include "test.h"
+
+// test.c has an implementation of cmdSendMetric, so the actual
+// value of this isn't really used, but it needs to be non-null.
+mtc_t *bogus_mtc_addr = (mtc_t*)0xDEADBEEF;
+
+static void
+fsAggCreateReturnsNonNull(void **state)
+{
+    fs_agg_t *fs_agg = fsAggCreate(10);
+    assert_non_null(fs_agg);
+    fsAggDestroy(&fs_agg);
+    assert_null(fs_agg);
+
+    // top of 0 is off
+    assert_null(fsAggCreate(0));
+}
+
+static void
+fsAggForNullDoesNotCrash(void **state)
+{
+    fs_agg_counts_t counts = {.opens = 1};
+
+    fsAggDestroy(NULL);
+    assert_false(fsAggPatternAdd(NULL, "/tmp"));
+    assert_string_equal(fsAggKey(NULL, "/tmp/a"), "/tmp/a");
+    fsAggAddCounts(NULL, "/tmp/a", &counts);
+    fsAggSendReport(NULL, bogus_mtc_addr);
+    fsAggReset(NULL);
+
+    fs_agg_t *fs_agg = fsAggCreate(10);
+    assert_false(fsAggPatternAdd(fs_agg, NULL));
+    assert_false(fsAggPatternAdd(fs_agg, ""));
+    assert_null(fsAggKey(fs_agg, NULL));
+    fsAggAddCounts(fs_agg, NULL, &counts);
+    fsAggAddCounts(fs_agg, "", &counts);
+    fsAggAddCounts(fs_agg, "/tmp/a", NULL);
+
+    g_send_metric_count = 0;
+    fsAggSendReport(fs_agg, NULL);
+    fsAggSendReport(fs_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 0);
+    fsAggDestroy(&fs_agg);
+}
+
+static void
+fsAggKeyCollapsesPaths(void **state)
+{
+    fs_agg_t *fs_agg = fsAggCreate(10);
+    assert_true(fsAggPatternAdd(fs_agg, "/var/lib/data/*/part-*"));
+    assert_true(fsAggPatternAdd(fs_agg, "/tmp"));
+    assert_true(fsAggPatternAdd(fs_agg, "/var/lib"));
+
+    // a glob; * doesn't match /
+    assert_string_equal(fsAggKey(fs_agg, "/var/lib/data/2023/part-00001"),
+                        "/var/lib/data/*/part-*");
+    assert_string_equal(fsAggKey(fs_agg, "/var/lib/data/2024/part-00002"),
+                        "/var/lib/data/*/part-*");
+
+    // a directory counts what's under it
+    assert_string_equal(fsAggKey(fs_agg, "/tmp"), "/tmp");
+    assert_string_equal(fsAggKey(fs_agg, "/tmp/a/b/c"), "/tmp");
+    assert_string_equal(fsAggKey(fs_agg, "/tmpfile"), "/tmpfile");
+
+    // the first that matches is used
+    assert_string_equal(fsAggKey(fs_agg, "/var/lib/data/2023/index"), "/var/lib");
+
+    // and a path that doesn't match any is itself
+    assert_string_equal(fsAggKey(fs_agg, "/etc/passwd"), "/etc/passwd");
+
+    fsAggDestroy(&fs_agg);
+}
+
+static void
+fsAggAddCountsHappyPath(void **state)
+{
+    fs_agg_t *fs_agg = fsAggCreate(10);
+    fsAggPatternAdd(fs_agg, "/tmp");
+
+    fs_agg_counts_t a = {.opens = 1, .reads = 2, .readBytes = 200,
+                         .durations = 2, .durationTotal = 4000};
+    fs_agg_counts_t b = {.opens = 1, .writes = 3, .writeBytes = 30,
+                         .seeks = 1, .durations = 3, .durationTotal = 6000};
+    fsAggAddCounts(fs_agg, "/tmp/a", &a);
+    fsAggAddCounts(fs_agg, "/tmp/b", &b);
+    fsAggAddCounts(fs_agg, "/etc/hosts", &a);
+
+    // nothing happened on this one
+    fs_agg_counts_t none = {0};
+    fsAggAddCounts(fs_agg, "/etc/passwd", &none);
+
+    expect_t expect[] = {
+        {"fs.path.open",     "file",   "/tmp",        0},
+        {"fs.path.read",     "file",   "/tmp",        0},
+        {"fs.path.read",     "numops", "2",           0},
+        {"fs.path.write",    "file",   "/tmp",        0},
+        {"fs.path.seek",     "file",   "/tmp",        0},
+        {"fs.path.duration", "file",   "/tmp",        0},
+        {"fs.path.open",     "file",   "/etc/hosts",  0},
+        {"fs.path.open",     "file",   "/etc/passwd", 0},
+        {"fs.path.open",     "summary", "true",       0},
+        {NULL, NULL, NULL, 0}
+    };
+    g_expect = expect;
+    g_send_metric_count = 0;
+    fsAggSendReport(fs_agg, bogus_mtc_addr);
+    g_expect = NULL;
+    assert_int_equal(expect[0].total, 2);
+    assert_int_equal(expect[1].total, 200);
+    assert_int_equal(expect[2].total, 400);     // both reads of 200 bytes
+    assert_int_equal(expect[3].total, 30);
+    assert_int_equal(expect[4].total, 1);
+    assert_int_equal(expect[5].total, 2);       // 10 us over 5 ops
+    assert_int_equal(expect[6].total, 1);
+    assert_int_equal(expect[7].total, 0);
+    assert_int_equal(expect[8].total, 3);
+    // /tmp: open, read, write, seek, duration; /etc/hosts: open, read, duration
+    assert_int_equal(g_send_metric_count, 8);
+
+    // Reset forgets it all
+    fsAggReset(fs_agg);
+    g_send_metric_count = 0;
+    fsAggSendReport(fs_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 0);
+
+    fsAggDestroy(&fs_agg);
+}
+
+static void
+fsAggSendReportIsTopPaths(void **state)
+{
+    fs_agg_t *fs_agg = fsAggCreate(3);
+
+    // Many more paths than are reported; path i has i opens
+    int i;
+    for (i = 1; i <= 1000; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/data/file%d", i);
+        fs_agg_counts_t counts = {.opens = i};
+        fsAggAddCounts(fs_agg, path, &counts);
+    }
+
+    expect_t expect[] = {
+        {"fs.path.open", "file", "/data/file1000", 0},
+        {"fs.path.open", "file", "/data/file999",  0},
+        {"fs.path.open", "file", "/data/file998",  0},
+        {NULL, NULL, NULL, 0}
+    };
+    g_expect = expect;
+    g_send_metric_count = 0;
+    fsAggSendReport(fs_agg, bogus_mtc_addr);
+    g_expect = NULL;
+    assert_int_equal(g_send_metric_count, 3);
+    assert_true(expect[0].total >= 1000);
+    assert_true(expect[1].total >= 999);
+    assert_true(expect[2].total >= 998);
+
+    fsAggDestroy(&fs_agg);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(fsAggCreateReturnsNonNull),
+        cmocka_unit_test(fsAggForNullDoesNotCrash),
+        cmocka_unit_test(fsAggKeyCollapsesPaths),
+        cmocka_unit_test(fsAggAddCountsHappyPath),
+        cmocka_unit_test(fsAggSendReportIsTopPaths),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
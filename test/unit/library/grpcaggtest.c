@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "grpcagg.h"
+#include "test.h"
+
+// test.c has an implementation of cmdSendMetric, so the actual
+// value of this isn't really used, but it needs to be non-null.
+mtc_t *bogus_mtc_addr = (mtc_t*)0xDEADBEEF;
+
+static void
+grpcAggCreateReturnsNonNull(void **state)
+{
+    grpc_agg_t *grpc_agg = grpcAggCreate();
+    assert_non_null(grpc_agg);
+    grpcAggDestroy(&grpc_agg);
+    assert_null(grpc_agg);
+}
+
+static void
+grpcAggForNullDoesNotCrash(void **state)
+{
+    grpc_agg_t *grpc_agg = NULL;
+    grpcAggDestroy(&grpc_agg);
+    grpcAggDestroy(NULL);
+    grpcAggAddCall(NULL, NULL);
+    grpcAggSendReport(NULL, NULL);
+    grpcAggReset(NULL);
+}
+
+static void
+grpcAggAddCallHappyPath(void **state)
+{
+    grpc_agg_t *grpc_agg = grpcAggCreate();
+
+    // any report before we've received calls should be empty
+    g_send_metric_count = 0;
+    grpcAggSendReport(grpc_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 0);
+
+    grpc_call_t ok = {
+        .method = "/helloworld.Greeter/SayHello",
+        .isServer = TRUE,
+        .status = 0,
+        .hasDuration = TRUE,
+        .duration = 3,
+        .reqMsgs = 1,
+        .respMsgs = 1,
+    };
+    grpc_call_t slow = ok;
+    slow.duration = 700;
+    grpc_call_t failed = ok;
+    failed.status = 14;
+    failed.duration = 30000;
+    failed.respMsgs = 0;
+    grpc_call_t client = ok;
+    client.isServer = FALSE;
+
+    grpcAggAddCall(grpc_agg, &ok);
+    grpcAggAddCall(grpc_agg, &ok);
+    grpcAggAddCall(grpc_agg, &slow);
+    grpcAggAddCall(grpc_agg, &failed);
+    grpcAggAddCall(grpc_agg, &client);
+
+    expect_t expect[] = {
+        {"grpc.req",                    "grpc_status",  "0",          0},
+        {"grpc.req",                    "grpc_status",  "14",         0},
+        {"grpc.req",                    "grpc_role",    "client",     0},
+        {"grpc.req",                    "grpc_service", "helloworld.Greeter", 0},
+        {"grpc.req",                    "grpc_method",  "SayHello",   0},
+        {"grpc.duration.server",        "numops",       "4",          0},
+        {"grpc.duration.server.bucket", "le",           "5",          0},
+        {"grpc.duration.server.bucket", "le",           "1000",       0},
+        {"grpc.duration.server.bucket", "le",           "+Inf",       0},
+        {"grpc.duration.server.bucket", "le",           "1",          0},
+        {"grpc.duration.server.bucket", "le",           "10",         0},
+        {"grpc.req.messages",           "grpc_role",    "server",     0},
+        {"grpc.resp.messages",          "grpc_role",    "server",     0},
+        {NULL, NULL, NULL, 0}
+    };
+    g_expect = expect;
+    grpcAggSendReport(grpc_agg, bogus_mtc_addr);
+    g_expect = NULL;
+
+    assert_int_equal(expect[0].total, 4);      // three ok, one client
+    assert_int_equal(expect[1].total, 1);
+    assert_int_equal(expect[2].total, 1);
+    assert_int_equal(expect[3].total, 5);
+    assert_int_equal(expect[4].total, 5);
+    assert_int_equal(expect[5].total, 3 + 3 + 700 + 30000);
+    assert_int_equal(expect[6].total, 2);      // buckets are cumulative
+    assert_int_equal(expect[7].total, 3);
+    assert_int_equal(expect[8].total, 4);
+    assert_int_equal(expect[9].total, 0);      // empty buckets aren't sent
+    assert_int_equal(expect[10].total, 2);
+    assert_int_equal(expect[11].total, 4);
+    assert_int_equal(expect[12].total, 3);
+
+    // But if we reset, then the report shouldn't send anything
+    g_send_metric_count = 0;
+    grpcAggReset(grpc_agg);
+    grpcAggSendReport(grpc_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 0);
+
+    grpcAggDestroy(&grpc_agg);
+}
+
+static void
+grpcAggAddCallIgnoresBadInput(void **state)
+{
+    grpc_agg_t *grpc_agg = grpcAggCreate();
+
+    // no method (the request was evicted) isn't counted
+    grpc_call_t call = {.method = "", .status = 0};
+    grpcAggAddCall(grpc_agg, &call);
+    call.method = NULL;
+    grpcAggAddCall(grpc_agg, &call);
+    g_send_metric_count = 0;
+    grpcAggSendReport(grpc_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 0);
+
+    // an out of range status is UNKNOWN
+    call.method = "noslash";
+    call.status = 99;
+    grpcAggAddCall(grpc_agg, &call);
+    expect_t expect[] = {
+        {"grpc.req", "grpc_status", "2", 0},
+        {"grpc.req", "grpc_service", "noslash", 0},
+        {NULL, NULL, NULL, 0}
+    };
+    g_expect = expect;
+    grpcAggSendReport(grpc_agg, bogus_mtc_addr);
+    g_expect = NULL;
+    assert_int_equal(expect[0].total, 1);
+    assert_int_equal(expect[1].total, 1);
+
+    grpcAggDestroy(&grpc_agg);
+
+    // the DBG from the bad status
+    assert_int_equal(dbgCountMatchingLines("src/grpcagg.c"), 1);
+    dbgInit();
+}
+
+static void
+grpcAggAddCallWithManyMethodsIsBounded(void **state)
+{
+    grpc_agg_t *grpc_agg = grpcAggCreate();
+
+    // More than MAX_METHODS (1024 when this was written), which also
+    // exercises growing the table from its default size
+    int i;
+    for (i = 0; i < 1500; i++) {
+        char method[64];
+        snprintf(method, sizeof(method), "/svc.S/M%d", i);
+        grpc_call_t call = {.method = method, .status = 0};
+        grpcAggAddCall(grpc_agg, &call);
+        grpcAggAddCall(grpc_agg, &call);
+    }
+
+    expect_t expect[] = {
+        {"grpc.req", "grpc_method", "M0",     0},
+        {"grpc.req", "grpc_method", "M1000",  0},
+        {"grpc.req", "grpc_method", "M1499",  0},
+        {"grpc.req", "grpc_method", "_other", 0},
+        {"grpc.req", "grpc_status", NULL,     0},
+        {NULL, NULL, NULL, 0}
+    };
+    g_expect = expect;
+    g_send_metric_count = 0;
+    grpcAggSendReport(grpc_agg, bogus_mtc_addr);
+    g_expect = NULL;
+    assert_int_equal(expect[0].total, 2);
+    assert_int_equal(expect[1].total, 2);
+    assert_int_equal(expect[2].total, 0);
+    assert_int_equal(expect[3].total, 2 * (1500 - 1024));
+    assert_int_equal(expect[4].total, 3000);
+    assert_int_equal(g_send_metric_count, 1024 + 1);
+
+    grpcAggDestroy(&grpc_agg);
+}
+
+static void
+grpcStatusFromHttpMapsCodes(void **state)
+{
+    assert_int_equal(grpcStatusFromHttp(400), 13);
+    assert_int_equal(grpcStatusFromHttp(401), 16);
+    assert_int_equal(grpcStatusFromHttp(403), 7);
+    assert_int_equal(grpcStatusFromHttp(404), 12);
+    assert_int_equal(grpcStatusFromHttp(503), 14);
+    assert_int_equal(grpcStatusFromHttp(200), 2);
+    assert_int_equal(grpcStatusFromHttp(0), 2);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(grpcAggCreateReturnsNonNull),
+        cmocka_unit_test(grpcAggForNullDoesNotCrash),
+        cmocka_unit_test(grpcAggAddCallHappyPath),
+        cmocka_unit_test(grpcAggAddCallIgnoresBadInput),
+        cmocka_unit_test(grpcAggAddCallWithManyMethodsIsBounded),
+        cmocka_unit_test(grpcStatusFromHttpMapsCodes),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
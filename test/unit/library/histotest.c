@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dbg.h"
+#include "histo.h"
+#include "test.h"
+
+#define NUM_THREADS 8
+#define NUM_RECORDS 10000
+
+static int
+histoSetup(void **state)
+{
+    histoReset();
+    return 0;
+}
+
+static void
+histoBucketsArePowersOfTwoOfMicroseconds(void **state)
+{
+    histo_t histo;
+
+    histoRecord(HISTO_READ, 0);
+    histoRecord(HISTO_READ, 999);           // < 1 us
+    histoRecord(HISTO_READ, 1000);          // 1 us
+    histoRecord(HISTO_READ, 1999);          // still 1 us
+    histoRecord(HISTO_READ, 2000);          // 2 us; < 4 us
+    histoRecord(HISTO_READ, 1000000);       // 1 ms; < 1024 us
+    histoRecord(HISTO_READ, 3600000000000); // an hour goes in the last one
+
+    histoGet(HISTO_READ, &histo);
+    assert_int_equal(histo.count, 7);
+    assert_int_equal(histo.bucket[0], 2);
+    assert_int_equal(histo.bucket[1], 2);
+    assert_int_equal(histo.bucket[2], 1);
+    assert_int_equal(histo.bucket[10], 1);
+    assert_int_equal(histo.bucket[HISTO_BUCKETS - 1], 1);
+
+    // Nothing went to the others
+    histoGet(HISTO_WRITE, &histo);
+    assert_int_equal(histo.count, 0);
+}
+
+static void
+histoGetIsSinceTheLastCall(void **state)
+{
+    histo_t histo;
+
+    histoRecord(HISTO_OPEN, 5000);
+    histoRecord(HISTO_OPEN, 5000);
+    histoGet(HISTO_OPEN, &histo);
+    assert_int_equal(histo.count, 2);
+    assert_int_equal(histo.bucket[3], 2);
+
+    histoGet(HISTO_OPEN, &histo);
+    assert_int_equal(histo.count, 0);
+    assert_int_equal(histo.bucket[3], 0);
+
+    histoRecord(HISTO_OPEN, 5000);
+    histoGet(HISTO_OPEN, &histo);
+    assert_int_equal(histo.count, 1);
+}
+
+static void *
+recordLots(void *arg)
+{
+    int i;
+    for (i = 0; i < NUM_RECORDS; i++) {
+        histoRecord(HISTO_STAT, (i % 4) * 1000);
+    }
+    return NULL;
+}
+
+static void
+histoCountsFromManyThreadsAddUp(void **state)
+{
+    pthread_t thread[NUM_THREADS];
+    histo_t histo;
+    int i;
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_create(&thread[i], NULL, recordLots, NULL), 0);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        assert_int_equal(pthread_join(thread[i], NULL), 0);
+    }
+
+    histoGet(HISTO_STAT, &histo);
+    assert_int_equal(histo.count, NUM_THREADS * NUM_RECORDS);
+    assert_int_equal(histo.bucket[0], NUM_THREADS * NUM_RECORDS / 4);
+    assert_int_equal(histo.bucket[1], NUM_THREADS * NUM_RECORDS / 4);
+    assert_int_equal(histo.bucket[2], NUM_THREADS * NUM_RECORDS / 2);
+}
+
+static void
+histoResetForgetsEverything(void **state)
+{
+    histo_t histo;
+
+    histoRecord(HISTO_CONNECT, 100000);
+    histoRecord(HISTO_DNS, 100000);
+    histoReset();
+
+    histoGet(HISTO_CONNECT, &histo);
+    assert_int_equal(histo.count, 0);
+    histoGet(HISTO_DNS, &histo);
+    assert_int_equal(histo.count, 0);
+
+    // and counts from zero afterwards
+    histoRecord(HISTO_DNS, 100000);
+    histoGet(HISTO_DNS, &histo);
+    assert_int_equal(histo.count, 1);
+    assert_int_equal(histo.bucket[7], 1);
+}
+
+static void
+histoBadClassIsIgnored(void **state)
+{
+    histo_t histo;
+
+    histoRecord(HISTO_CLASSES, 1000);
+    histoGet(HISTO_CLASSES, &histo);
+    histoGet(HISTO_READ, NULL);
+    assert_int_equal(dbgCountMatchingLines("src/histo.c"), 2);
+    dbgInit();
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(histoBucketsArePowersOfTwoOfMicroseconds, histoSetup),
+        cmocka_unit_test_setup(histoGetIsSinceTheLastCall, histoSetup),
+        cmocka_unit_test_setup(histoCountsFromManyThreadsAddUp, histoSetup),
+        cmocka_unit_test_setup(histoResetForgetsEverything, histoSetup),
+        cmocka_unit_test_setup(histoBadClassIsIgnored, histoSetup),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -334,6 +334,66 @@ xAppScopeHeaderExtract(void **state)
     cfgDestroy(&cfg);
 }
 
+static void
+protocolConsumerFollowsConfig(void **state)
+{
+    config_t *cfg = cfgCreateDefault();
+    g_cfg.staticfg = cfg;
+    cfgEvtEnableSet(cfg, FALSE);
+    cfgMtcEnableSet(cfg, FALSE);
+    assert_false(protocolConsumerEnabled(-1));
+
+    cfgPayEnableSet(cfg, TRUE);
+    assert_true(protocolConsumerEnabled(-1));
+
+    cfgPayEnableSet(cfg, FALSE);
+    cfgEvtEnableSet(cfg, TRUE);
+    assert_true(protocolConsumerEnabled(-1));
+
+    // Nothing past detection consumes a channel with no protocol
+    net_info *net = getNet(3);
+    assert_non_null(net);
+    assert_true(protocolConsumerEnabled(3));
+    net->protoDetect = DETECT_FALSE;
+    assert_false(protocolConsumerEnabled(3));
+    net->protoDetect = DETECT_PENDING;
+
+    cfgDestroy(&cfg);
+}
+
+static void
+appAddrSkipsListenerLocal(void **state)
+{
+    addSock(4, SOCK_STREAM, AF_INET);
+    net_info *net = getNetEntry(4);
+    assert_non_null(net);
+
+    struct sockaddr_in sa = {0};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(8080);
+
+    // No remote yet, so this looks like a listener
+    doSetAppAddr(4, (struct sockaddr *)&sa, sizeof(sa), LOCAL);
+    assert_false(net->addrSetLocal);
+
+    inet_pton(AF_INET, "192.1.2.99", &sa.sin_addr);
+    sa.sin_port = htons(7777);
+    doSetAppAddr(4, (struct sockaddr *)&sa, sizeof(sa), REMOTE);
+    assert_true(net->addrSetRemote);
+
+    inet_pton(AF_INET, "192.1.2.3", &sa.sin_addr);
+    sa.sin_port = htons(8080);
+    doSetAppAddr(4, (struct sockaddr *)&sa, sizeof(sa), LOCAL);
+    assert_true(net->addrSetLocal);
+    struct sockaddr_in *local = (struct sockaddr_in *)&net->localConn;
+    assert_int_equal(ntohs(local->sin_port), 8080);
+
+    // Nothing left for doSetAddrs to look up
+    assert_int_equal(doSetAddrs(4), 0);
+
+    doClose(4, "close");
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -347,6 +407,8 @@ main(int argc, char *argv[])
         cmocka_unit_test(headerRequestUnix),
         cmocka_unit_test(userDefinedHeaderExtract),
         cmocka_unit_test(xAppScopeHeaderExtract),
+        cmocka_unit_test(protocolConsumerFollowsConfig),
+        cmocka_unit_test(appAddrSkipsListenerLocal),
     };
     return cmocka_run_group_tests(tests, needleTestSetup, needleTestTeardown);
 }
@@ -267,6 +267,148 @@ httpReqExpireRequestsFromEmptyFlag(void **state)
 
     httpMatchDestroy(&match);
 }
+static int g_streams_freed = 0;
+
+static void
+freeStream(void *data)
+{
+    assert_non_null(data);
+    g_streams_freed++;
+    scope_free(data);
+}
+
+static void
+streamTableCreateReturnsNullWithBadParams(void **state)
+{
+    assert_null(streamTableCreate(0, 0, freeStream));
+    assert_null(streamTableCreate(8, 0, NULL));
+    streamTableDestroy(NULL);
+}
+
+static void
+streamTableAddGetAndDeleteWork(void **state)
+{
+    streamtable_t *table = streamTableCreate(64, 0, freeStream);
+    assert_non_null(table);
+    g_streams_freed = 0;
+
+    uint32_t id;
+    for (id = 1; id < 2 * 64; id += 2) {
+        uint32_t *data = scope_malloc(sizeof(uint32_t));
+        *data = id;
+        assert_true(streamTableAdd(table, id, data));
+    }
+    assert_int_equal(streamTableCount(table), 64);
+
+    // a duplicate isn't added
+    uint32_t dup = 1;
+    assert_false(streamTableAdd(table, 1, &dup));
+
+    for (id = 1; id < 2 * 64; id += 2) {
+        uint32_t *data = streamTableGet(table, id);
+        assert_non_null(data);
+        assert_int_equal(*data, id);
+    }
+    assert_null(streamTableGet(table, 2));
+
+    // delete every other one and make sure the rest can still be found
+    for (id = 1; id < 2 * 64; id += 4) {
+        assert_true(streamTableDelete(table, id));
+        assert_false(streamTableDelete(table, id));
+    }
+    assert_int_equal(streamTableCount(table), 32);
+    assert_int_equal(g_streams_freed, 32);
+    for (id = 1; id < 2 * 64; id += 2) {
+        uint32_t *data = streamTableGet(table, id);
+        if ((id - 1) % 4) {
+            assert_non_null(data);
+            assert_int_equal(*data, id);
+        } else {
+            assert_null(data);
+        }
+    }
+    assert_int_equal(streamTableEvicted(table), 0);
+
+    streamTableDestroy(&table);
+    assert_null(table);
+    assert_int_equal(g_streams_freed, 64);
+}
+
+static void
+streamTableEvictsOldestWhenFull(void **state)
+{
+    streamtable_t *table = streamTableCreate(4, 0, freeStream);
+    assert_non_null(table);
+    g_streams_freed = 0;
+
+    uint32_t id;
+    for (id = 1; id <= 4; id++) {
+        assert_true(streamTableAdd(table, id, scope_malloc(1)));
+    }
+    assert_int_equal(streamTableEvicted(table), 0);
+
+    // deleting one makes room without an eviction
+    assert_true(streamTableDelete(table, 2));
+    assert_true(streamTableAdd(table, 5, scope_malloc(1)));
+    assert_int_equal(streamTableEvicted(table), 0);
+
+    // now full; 1 and then 3 are the oldest
+    assert_true(streamTableAdd(table, 6, scope_malloc(1)));
+    assert_true(streamTableAdd(table, 7, scope_malloc(1)));
+    assert_int_equal(streamTableEvicted(table), 2);
+    assert_int_equal(streamTableCount(table), 4);
+    assert_null(streamTableGet(table, 1));
+    assert_null(streamTableGet(table, 3));
+    assert_non_null(streamTableGet(table, 4));
+    assert_non_null(streamTableGet(table, 5));
+    assert_non_null(streamTableGet(table, 6));
+    assert_non_null(streamTableGet(table, 7));
+    assert_int_equal(g_streams_freed, 3);
+
+    streamTableDestroy(&table);
+    assert_int_equal(g_streams_freed, 7);
+}
+
+static void
+streamTableEvictsOldestOverBudget(void **state)
+{
+    streamtable_t *table = streamTableCreate(8, 100, freeStream);
+    assert_non_null(table);
+    g_streams_freed = 0;
+
+    uint32_t id;
+    for (id = 1; id <= 4; id++) {
+        assert_true(streamTableAdd(table, id, scope_malloc(1)));
+        assert_true(streamTableCharge(table, id, 20));
+    }
+    assert_int_equal(streamTableBytes(table), 80);
+
+    // a charge replaces the last one; 1 grows, then 4 does and the oldest
+    // (1 and 2) go to fit it
+    assert_true(streamTableCharge(table, 1, 30));
+    assert_int_equal(streamTableBytes(table), 90);
+    assert_true(streamTableCharge(table, 4, 70));
+    assert_int_equal(streamTableEvicted(table), 2);
+    assert_null(streamTableGet(table, 1));
+    assert_null(streamTableGet(table, 2));
+    assert_non_null(streamTableGet(table, 3));
+    assert_int_equal(streamTableBytes(table), 90);
+
+    // deleting gives the bytes back
+    assert_true(streamTableDelete(table, 3));
+    assert_int_equal(streamTableBytes(table), 70);
+
+    // too big on its own, it goes too
+    assert_false(streamTableCharge(table, 4, 101));
+    assert_null(streamTableGet(table, 4));
+    assert_int_equal(streamTableBytes(table), 0);
+    assert_int_equal(streamTableEvicted(table), 3);
+    assert_false(streamTableCharge(table, 4, 10));
+
+    streamTableDestroy(&table);
+    assert_int_equal(g_streams_freed, 4);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -284,6 +426,10 @@ main(int argc, char *argv[])
         cmocka_unit_test(httpReqExpireRequestsFromCircBufCount),
         cmocka_unit_test(httpReqExpireRequestsAtDifferentTimes),
         cmocka_unit_test(httpReqExpireRequestsFromEmptyFlag),
+        cmocka_unit_test(streamTableCreateReturnsNullWithBadParams),
+        cmocka_unit_test(streamTableAddGetAndDeleteWork),
+        cmocka_unit_test(streamTableEvictsOldestWhenFull),
+        cmocka_unit_test(streamTableEvictsOldestOverBudget),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, setup, teardown);
@@ -1,8 +1,10 @@
 #define _GNU_SOURCE
 #include <stdint.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "arena.h"
 #include "ctl.h"
 #include "dbg.h"
 #include "fn.h"
@@ -26,9 +28,9 @@ freeMsg(struct protocol_info_t** msg_ptr)
     struct http_post_t *post = msg ? (struct http_post_t*) msg->data : NULL;
     char *header = post ? post->hdr : NULL;
 
-    if (header) scope_free(header);
-    if (post) scope_free(post);
-    if (msg) scope_free(msg);
+    if (header) arenaFree(header);
+    if (post) arenaFree(post);
+    if (msg) arenaFree(msg);
     *msg_ptr = NULL;
 }
 
@@ -279,6 +281,162 @@ doHttpWhichExceedsReallocSize(void** state)
 
 }
 
+// An HTTP/2 frame header for len bytes of payload
+static void
+setHttp2FrameHeader(unsigned char *frame, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream)
+{
+    frame[0] = (len >> 16) & 0xff;
+    frame[1] = (len >> 8) & 0xff;
+    frame[2] = len & 0xff;
+    frame[3] = type;
+    frame[4] = flags;
+    frame[5] = (stream >> 24) & 0x7f;
+    frame[6] = (stream >> 16) & 0xff;
+    frame[7] = (stream >> 8) & 0xff;
+    frame[8] = stream & 0xff;
+}
+
+static void
+doHttp2WithSplitHeadersFrame(void** state)
+{
+    freeMsg(&g_msg); // left by earlier tests
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    net.http[HTTP_RX].version = 2;
+    net.http[HTTP_TX].version = 2;
+
+    // HEADERS, END_HEADERS, stream 1 with ":method: GET" (index 2)
+    unsigned char frame[10];
+    setHttp2FrameHeader(frame, 1, 0x01, 0x04, 1);
+    frame[9] = 0x82;
+
+    // a few bytes of the header aren't enough for anything
+    assert_false(doHttp(3, &net, (char *)frame, 4, NETRX, BUF));
+    assert_null(g_msg);
+    assert_non_null(net.http[HTTP_RX].http2Buf.buf);
+    assert_int_equal(net.http[HTTP_RX].http2Buf.len, 4);
+
+    // the rest of the header but not the payload
+    assert_false(doHttp(3, &net, (char *)&frame[4], 5, NETRX, BUF));
+    assert_null(g_msg);
+    assert_int_equal(net.http[HTTP_RX].http2Buf.len, 9);
+
+    // the whole frame is reported and the stash is given back
+    assert_true(doHttp(3, &net, (char *)&frame[9], 1, NETRX, BUF));
+    assert_non_null(g_msg);
+    assert_int_equal(g_msg->len, sizeof(frame));
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    assert_memory_equal(post->hdr, frame, sizeof(frame));
+    assert_null(net.http[HTTP_RX].http2Buf.buf);
+    assert_int_equal(net.http[HTTP_RX].http2Buf.len, 0);
+    freeMsg(&g_msg);
+
+    resetHttp(net.http);
+}
+
+static void
+doHttp2SkipsDataFrames(void** state)
+{
+    freeMsg(&g_msg); // left by earlier tests
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    net.http[HTTP_RX].version = 2;
+    net.http[HTTP_TX].version = 2;
+
+    // A DATA frame bigger than the default max frame size, then a HEADERS
+    // frame, delivered in pieces that don't line up with the frames
+    size_t dataLen = 64 * 1024;
+    size_t total = 9 + dataLen + 10;
+    unsigned char *buf = calloc(1, total);
+    assert_non_null(buf);
+    setHttp2FrameHeader(buf, dataLen, 0x00, 0x00, 1);
+    setHttp2FrameHeader(&buf[9 + dataLen], 1, 0x01, 0x05, 1);
+    buf[total - 1] = 0x88;
+
+    size_t pos = 0;
+    size_t chunk = 1000;
+    while (pos + chunk < total - 10) {
+        assert_false(doHttp(3, &net, (char *)&buf[pos], chunk, NETRX, BUF));
+        assert_null(g_msg);
+        // nothing of the DATA frame is kept
+        assert_null(net.http[HTTP_RX].http2Buf.buf);
+        pos += chunk;
+    }
+    assert_true(doHttp(3, &net, (char *)&buf[pos], total - pos, NETRX, BUF));
+    assert_non_null(g_msg);
+    assert_int_equal(g_msg->len, 10);
+    assert_int_equal(net.http[HTTP_RX].http2Buf.skip, 0);
+    assert_null(net.http[HTTP_RX].http2Buf.buf);
+    freeMsg(&g_msg);
+
+    // a frame header split right before a DATA frame's payload
+    assert_false(doHttp(3, &net, (char *)buf, 5, NETRX, BUF));
+    assert_non_null(net.http[HTTP_RX].http2Buf.buf);
+    assert_false(doHttp(3, &net, (char *)&buf[5], 4, NETRX, BUF));
+    assert_null(net.http[HTTP_RX].http2Buf.buf);
+    assert_int_equal(net.http[HTTP_RX].http2Buf.skip, dataLen);
+
+    resetHttp(net.http);
+    assert_int_equal(net.http[HTTP_RX].http2Buf.skip, 0);
+    free(buf);
+}
+
+static void
+doHttp2CountsGrpcMessages(void** state)
+{
+    freeMsg(&g_msg); // left by earlier tests
+    net_info net = {0};
+    net.type = SOCK_STREAM;
+    net.http[HTTP_RX].version = 2;
+    net.http[HTTP_TX].version = 2;
+
+    // One DATA frame on stream 3 with two messages; 3 and 0 bytes long,
+    // then the first part of a third
+    unsigned char frame[9 + 8 + 5 + 5 + 2];
+    size_t len = sizeof(frame) - 9;
+    setHttp2FrameHeader(frame, len, 0x00, 0x00, 3);
+    unsigned char payload[] = {
+        0x00, 0x00, 0x00, 0x00, 0x03, 'a', 'b', 'c',
+        0x01, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x04, 'w', 'x',
+    };
+    memcpy(&frame[9], payload, len);
+
+    // split in the middle of the second prefix; nothing until the end
+    assert_false(doHttp(3, &net, (char *)frame, 20, NETRX, BUF));
+    assert_null(g_msg);
+    assert_false(doHttp(3, &net, (char *)&frame[20], sizeof(frame) - 20, NETRX, BUF));
+    assert_non_null(g_msg);
+
+    // The summary is a DATA frame with the count as its payload
+    assert_int_equal(g_msg->len, 9 + 4);
+    struct http_post_t *post = (struct http_post_t*) g_msg->data;
+    unsigned char expected[9 + 4];
+    setHttp2FrameHeader(expected, 4, 0x00, 0x00, 3);
+    memcpy(&expected[9], "\x00\x00\x00\x03", 4);
+    assert_memory_equal(post->hdr, expected, sizeof(expected));
+    freeMsg(&g_msg);
+
+    // The rest of the third message, then a fourth, in the next frame
+    unsigned char next[9 + 2 + 6];
+    setHttp2FrameHeader(next, 8, 0x00, 0x01, 3);
+    memcpy(&next[9], "yz\x00\x00\x00\x00\x01q", 8);
+    assert_false(doHttp(3, &net, (char *)next, sizeof(next), NETRX, BUF));
+    assert_non_null(g_msg);
+    post = (struct http_post_t*) g_msg->data;
+    assert_int_equal(((unsigned char *)post->hdr)[12], 1);
+    freeMsg(&g_msg);
+
+    // DATA that isn't gRPC framed isn't summarized
+    unsigned char json[9 + 7];
+    setHttp2FrameHeader(json, 7, 0x00, 0x01, 5);
+    memcpy(&json[9], "{\"a\":1}", 7);
+    assert_false(doHttp(3, &net, (char *)json, sizeof(json), NETRX, BUF));
+    assert_null(g_msg);
+
+    resetHttp(net.http);
+}
+
 
 int
 main(int argc, char* argv[])
@@ -294,6 +452,9 @@ main(int argc, char* argv[])
         cmocka_unit_test(doHttpWithInterleavedEncryption),
         cmocka_unit_test(doHttpWhichRequiresRealloc),
         cmocka_unit_test(doHttpWhichExceedsReallocSize),
+        cmocka_unit_test(doHttp2WithSplitHeadersFrame),
+        cmocka_unit_test(doHttp2SkipsDataFrames),
+        cmocka_unit_test(doHttp2CountsGrpcMessages),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, needleTestSetup, needleTestTeardown);
@@ -852,6 +852,151 @@ ipcHandlerMultipleFrameErrorTimeoutFrame(void **state) {
     assert_int_equal(status, 0);
 }
 
+static void
+ipcHandlerScopeResponseMultipleFrames(void **state) {
+    const char *ipcConnName = "/testConnection";
+    int status;
+    mqd_t mqReadWriteDes;
+    ipc_resp_result_t res;
+    int uniqueId = 5657;
+    char buf[64];
+    char scopeData[256] = {0};
+    size_t scopeDataLen = 0;
+    int remain = 0;
+
+    struct mq_attr attr = {.mq_flags = 0,
+                           .mq_maxmsg = 10,
+                           .mq_msgsize = sizeof(buf),
+                           .mq_curmsgs = 0};
+
+    mqReadWriteDes = scope_mq_open(ipcConnName, O_RDWR | O_CREAT | O_CLOEXEC | O_NONBLOCK, 0666, &attr);
+    assert_int_not_equal(mqReadWriteDes, -1);
+
+    res = ipcSendSuccessfulResponse(mqReadWriteDes, attr.mq_msgsize, "{\"req\":1}", uniqueId);
+    assert_int_equal(res, RESP_RESULT_OK);
+    status = scope_mq_getattr(mqReadWriteDes, &attr);
+    assert_int_equal(status, 0);
+    assert_true(attr.mq_curmsgs > 1);
+
+    // Every frame but the last is partial; the data is split between them
+    long frames = attr.mq_curmsgs;
+    long i;
+    for (i = 0; i < frames; i++) {
+        ssize_t dataLen = scope_mq_receive(mqReadWriteDes, buf, sizeof(buf), 0);
+        assert_int_not_equal(dataLen, -1);
+
+        cJSON *mqResp = cJSON_Parse(buf);
+        assert_non_null(mqResp);
+        cJSON *item = cJSON_GetObjectItemCaseSensitive(mqResp, "status");
+        assert_non_null(item);
+        assert_int_equal(item->valueint, (i == frames - 1) ? 200 : 206);
+        item = cJSON_GetObjectItemCaseSensitive(mqResp, "uniq");
+        assert_non_null(item);
+        assert_int_equal(item->valueint, uniqueId);
+        item = cJSON_GetObjectItemCaseSensitive(mqResp, "remain");
+        assert_non_null(item);
+        if (i == 0) remain = item->valueint;
+        cJSON_Delete(mqResp);
+
+        size_t metaLen = scope_strlen(buf) + 1;
+        assert_true(scopeDataLen + dataLen - metaLen < sizeof(scopeData));
+        scope_memcpy(scopeData + scopeDataLen, buf + metaLen, dataLen - metaLen);
+        scopeDataLen += dataLen - metaLen;
+    }
+
+    assert_int_equal(remain, scopeDataLen);
+    cJSON *scopeResp = cJSON_Parse(scopeData);
+    assert_non_null(scopeResp);
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(scopeResp, "status");
+    assert_non_null(item);
+    assert_int_equal(item->valueint, 200);
+    cJSON_Delete(scopeResp);
+
+    status = scope_mq_close(mqReadWriteDes);
+    assert_int_equal(status, 0);
+    status = scope_mq_unlink(ipcConnName);
+    assert_int_equal(status, 0);
+}
+
+static void
+ipcHandlerResponseQueueStaysFull(void **state) {
+    const char *ipcConnName = "/testConnection";
+    int status;
+    mqd_t mqReadWriteDes;
+    ipc_resp_result_t res;
+    int uniqueId = 5658;
+
+    // Room for one frame, and nobody reading it
+    struct mq_attr attr = {.mq_flags = 0,
+                           .mq_maxmsg = 1,
+                           .mq_msgsize = 64,
+                           .mq_curmsgs = 0};
+
+    mqReadWriteDes = scope_mq_open(ipcConnName, O_RDWR | O_CREAT | O_CLOEXEC | O_NONBLOCK, 0666, &attr);
+    assert_int_not_equal(mqReadWriteDes, -1);
+
+    res = ipcSendSuccessfulResponse(mqReadWriteDes, attr.mq_msgsize, "{\"req\":1}", uniqueId);
+    assert_int_equal(res, RESP_SEND_RETRY_LIMIT);
+
+    status = scope_mq_close(mqReadWriteDes);
+    assert_int_equal(status, 0);
+    status = scope_mq_unlink(ipcConnName);
+    assert_int_equal(status, 0);
+}
+
+// Waits for a request queue the watch is watching for to come or go
+static void
+waitForWatch(ipc_watch_t *watch) {
+    if (watch->reqWd == -1) return;
+
+    struct pollfd fds = {.fd = watch->notifyFd, .events = POLLIN};
+    assert_int_equal(scope_poll(&fds, 1, 1000), 1);
+    ipcWatchUpdate(watch, NULL, NULL);
+}
+
+static void
+ipcWatchFindsTheRequestQueue(void **state) {
+    ipc_watch_t watch = {.notifyFd = -1, .reqWd = -1, .reqDesc = (mqd_t)-1};
+    int status;
+
+    // Bigger than any pid, so no process has these queues
+    ipcWatchStart(&watch, 4194305);
+    assert_string_equal(watch.reqName, "/ScopeIPCIn.4194305");
+    assert_string_equal(watch.respName, "/ScopeIPCOut.4194305");
+    assert_int_equal(watch.reqDesc, -1);
+    assert_int_equal(ipcWatchRequestQueue(&watch), -1);
+
+    // The CLI creates it; it's opened when it's seen, if it's watched
+    mqd_t cliDes = scope_mq_open(watch.reqName, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NONBLOCK, 0666, NULL);
+    assert_int_not_equal(cliDes, -1);
+    waitForWatch(&watch);
+    if (watch.reqWd != -1) assert_int_not_equal(watch.reqDesc, -1);
+
+    // A request can be polled for
+    mqd_t reqDes = ipcWatchRequestQueue(&watch);
+    assert_int_not_equal(reqDes, -1);
+    status = scope_mq_send(cliDes, "test", sizeof("test"), 0);
+    assert_int_equal(status, 0);
+    struct pollfd fds = {.fd = reqDes, .events = POLLIN};
+    assert_int_equal(scope_poll(&fds, 1, 1000), 1);
+    size_t mqSize;
+    long msgCount;
+    assert_true(ipcIsActive(reqDes, &mqSize, &msgCount));
+    assert_int_equal(msgCount, 1);
+    ipcWatchRelease(&watch, reqDes);
+
+    // The CLI removes it
+    status = scope_mq_close(cliDes);
+    assert_int_equal(status, 0);
+    status = scope_mq_unlink(watch.reqName);
+    assert_int_equal(status, 0);
+    waitForWatch(&watch);
+    assert_int_equal(watch.reqDesc, -1);
+    assert_int_equal(ipcWatchRequestQueue(&watch), -1);
+
+    if (watch.notifyFd != -1) scope_close(watch.notifyFd);
+}
+
 int
 main(int argc, char* argv[]) {
     printf("running %s\n", argv[0]);
@@ -875,6 +1020,9 @@ main(int argc, char* argv[]) {
         cmocka_unit_test(ipcHandlerScopeResponseGetCfgSingleMsg),
         cmocka_unit_test(ipcHandlerScopeResponseSetCfgSingleMsg),
         cmocka_unit_test(ipcHandlerMultipleFrameErrorTimeoutFrame),
+        cmocka_unit_test(ipcHandlerScopeResponseMultipleFrames),
+        cmocka_unit_test(ipcHandlerResponseQueueStaysFull),
+        cmocka_unit_test(ipcWatchFindsTheRequestQueue),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "metriccapture.h"
+#include "statsdagg.h"
+#include "scopestdlib.h"
+#include "test.h"
+
+#define MAX_REPORTED 16
+static captured_metric_t g_reported[MAX_REPORTED];
+static char g_reported_dims[MAX_REPORTED][64];
+static int g_num_reported = 0;
+
+void
+__wrap_reportCapturedMetric(const captured_metric_t *metric)
+{
+    if (g_num_reported >= MAX_REPORTED) fail();
+    captured_metric_t *copy = &g_reported[g_num_reported];
+    *copy = *metric;
+    copy->name = (unsigned char *)scope_strdup((char *)metric->name);
+    copy->type = (unsigned char *)scope_strdup((char *)metric->type);
+    g_reported_dims[g_num_reported][0] = '\0';
+    if (metric->dims) {
+        scope_strncpy(g_reported_dims[g_num_reported], (char *)metric->dims, 63);
+    }
+    copy->dims = NULL;
+    g_num_reported++;
+}
+
+static void
+clearReported(void)
+{
+    int i;
+    for (i = 0; i < g_num_reported; i++) {
+        scope_free(g_reported[i].name);
+        scope_free(g_reported[i].type);
+    }
+    g_num_reported = 0;
+}
+
+static int
+findReported(const char *name, const char *type, const char *dims)
+{
+    int i;
+    for (i = 0; i < g_num_reported; i++) {
+        if (!scope_strcmp((char *)g_reported[i].name, name) &&
+            !scope_strcmp((char *)g_reported[i].type, type) &&
+            !scope_strcmp(g_reported_dims[i], dims)) return i;
+    }
+    return -1;
+}
+
+static int
+metricCaptureSetup(void **state)
+{
+    initMetricCapture();
+    return groupSetup(state);
+}
+
+static int
+metricCaptureTeardown(void **state)
+{
+    clearReported();
+    destroyMetricCapture();
+    return groupTeardown(state);
+}
+
+static size_t
+parse(const char *str, statsd_line_t *line)
+{
+    return statsdParseLine(str, scope_strlen(str), line);
+}
+
+static void
+statsdParseLineBasic(void **state)
+{
+    statsd_line_t line;
+    const char *str = "my.counter:42|c";
+
+    assert_int_equal(parse(str, &line), scope_strlen(str));
+    assert_ptr_equal(line.name, str);
+    assert_int_equal(line.namelen, 10);
+    assert_int_equal(line.typelen, 1);
+    assert_memory_equal(line.type, "c", 1);
+    assert_null(line.dims);
+    assert_true(line.isint);
+    assert_int_equal(line.intval, 42);
+    assert_true(line.rate == 1.0);
+
+    assert_int_equal(parse("response.time:3.5|ms", &line), 20);
+    assert_non_null(line.name);
+    assert_int_equal(line.typelen, 2);
+    assert_false(line.isint);
+    assert_true(line.fltval == 3.5);
+
+    // Every type
+    assert_int_equal(parse("a:1|g", &line), 5);
+    assert_non_null(line.name);
+    assert_int_equal(parse("a:1|s", &line), 5);
+    assert_non_null(line.name);
+    assert_int_equal(parse("a:1|h", &line), 5);
+    assert_non_null(line.name);
+}
+
+static void
+statsdParseLineExtensions(void **state)
+{
+    statsd_line_t line;
+
+    // Sample rate and tags, in either order
+    const char *str = "page.views:1|c|@0.25|#env:prod,app:web";
+    assert_int_equal(parse(str, &line), scope_strlen(str));
+    assert_non_null(line.name);
+    assert_true(line.rate == 0.25);
+    assert_int_equal(line.dimslen, 17);
+    assert_memory_equal(line.dims, "#env:prod,app:web", 17);
+
+    str = "page.views:1|c|#env:prod|@1";
+    assert_int_equal(parse(str, &line), scope_strlen(str));
+    assert_non_null(line.name);
+    assert_true(line.rate == 1.0);
+    assert_int_equal(line.dimslen, 9);
+
+    // Unknown DogStatsD sections are skipped
+    str = "a:1|g|#env:prod|c:abc123|T1656581400";
+    assert_int_equal(parse(str, &line), scope_strlen(str));
+    assert_non_null(line.name);
+    assert_int_equal(line.dimslen, 9);
+}
+
+static void
+statsdParseLineRejectsInvalid(void **state)
+{
+    statsd_line_t line;
+    const char *bad[] = {
+        ":1|c",                  // no name
+        "a|c",                   // no value
+        "a:|c",                  // empty value
+        "a:x|c",                 // not a number
+        "a:1",                   // no type
+        "a:1|",                  // empty type
+        "a:1|x",                 // unknown type
+        "a:1|cc",                // unknown type
+        "a:1|c|@0",              // sample rate out of range
+        "a:1|c|@2",              // sample rate out of range
+        "a:1|c|@x",              // sample rate not a number
+        "a:1.2.3|g",             // not a number
+    };
+    int i;
+    for (i = 0; i < sizeof(bad)/sizeof(bad[0]); i++) {
+        assert_int_equal(parse(bad[i], &line), scope_strlen(bad[i]));
+        assert_null(line.name);
+    }
+
+    assert_int_equal(statsdParseLine(NULL, 10, &line), 0);
+    assert_int_equal(statsdParseLine("a:1|c", 0, &line), 0);
+}
+
+static void
+statsdParseLineMultiLine(void **state)
+{
+    const char *str = "a:1|c\nbogus\r\nb:2|g|#x:y\r\n\nc:3|ms";
+    const char *pos = str;
+    size_t len = scope_strlen(str);
+    const char *names[] = {"a", NULL, "b", NULL, "c"};
+    statsd_line_t line;
+    size_t consumed;
+    int i = 0;
+
+    while ((consumed = statsdParseLine(pos, len, &line))) {
+        assert_true(i < sizeof(names)/sizeof(names[0]));
+        if (names[i]) {
+            assert_non_null(line.name);
+            assert_memory_equal(line.name, names[i], line.namelen);
+        } else {
+            assert_null(line.name);
+        }
+        pos += consumed;
+        len -= consumed;
+        i++;
+    }
+    assert_int_equal(i, 5);
+
+    // The \r isn't part of the tags
+    parse("b:2|g|#x:y\r\n", &line);
+    assert_int_equal(line.dimslen, 4);
+}
+
+static void
+reportAllCapturedMetricsAggregates(void **state)
+{
+    net_info net = {0};
+    char pkt1[] = "hits:1|c|#a:b\nhits:2|c|#a:b\nhits:1|c\nload:5|g\nlat:10|ms";
+    char pkt2[] = "hits:1|c|@0.5|#a:b\nload:7|g\nlat:20|ms\nrate:0.5|c\nrate:1|c\nusers:7|s";
+
+    clearReported();
+    assert_true(doMetricCapture(3, &net, pkt1, scope_strlen(pkt1), NETTX, BUF));
+    collectCapturedMetrics();
+    assert_true(doMetricCapture(3, &net, pkt2, scope_strlen(pkt2), NETTX, BUF));
+    collectCapturedMetrics();
+
+    // Sets aren't aggregated; everything else waits for the period to end
+    assert_int_equal(g_num_reported, 1);
+    assert_int_equal(findReported("users", "s", ""), 0);
+    clearReported();
+
+    reportAllCapturedMetrics();
+
+    // hits (with and without dims), load, rate and 7 for the lat timer
+    assert_int_equal(g_num_reported, 11);
+
+    int i = findReported("hits", "c", "#a:b");
+    assert_true(i >= 0);
+    assert_true(g_reported[i].isint);
+    assert_int_equal(g_reported[i].intval, 5); // 1 + 2 + 1/0.5
+
+    i = findReported("hits", "c", "");
+    assert_true(i >= 0);
+    assert_int_equal(g_reported[i].intval, 1);
+
+    i = findReported("load", "g", "");
+    assert_true(i >= 0);
+    assert_int_equal(g_reported[i].intval, 7);
+
+    i = findReported("rate", "c", "");
+    assert_true(i >= 0);
+    assert_false(g_reported[i].isint);
+    assert_true(g_reported[i].fltval == 1.5);
+
+    i = findReported("lat.count", "c", "");
+    assert_true(i >= 0);
+    assert_int_equal(g_reported[i].intval, 2);
+    i = findReported("lat.max", "g", "");
+    assert_true(i >= 0);
+    assert_true(g_reported[i].fltval == 20.0);
+
+    // Nothing left over for next time
+    clearReported();
+    reportAllCapturedMetrics();
+    assert_int_equal(g_num_reported, 0);
+}
+
+static void
+setMetricCaptureMaxSeriesKeepsThePeriod(void **state)
+{
+    net_info net = {0};
+    char pkt1[] = "a:1|c\nb:1|c";
+    char pkt2[] = "c:1|c\nd:1|c\ne:1|c";
+
+    clearReported();
+    assert_true(doMetricCapture(3, &net, pkt1, scope_strlen(pkt1), NETTX, BUF));
+    collectCapturedMetrics();
+
+    // What was held before the change is reported with it
+    setMetricCaptureMaxSeries(2);
+    assert_int_equal(g_num_reported, 2);
+    assert_true(findReported("a", "c", "") >= 0);
+    assert_true(findReported("b", "c", "") >= 0);
+    clearReported();
+
+    // Past the new limit, the rest are counted as overflow
+    assert_true(doMetricCapture(3, &net, pkt2, scope_strlen(pkt2), NETTX, BUF));
+    reportAllCapturedMetrics();
+    assert_int_equal(g_num_reported, 3);
+    assert_true(findReported("c", "c", "") >= 0);
+    assert_true(findReported("d", "c", "") >= 0);
+    assert_true(findReported(STATSD_AGG_OVERFLOW, "c", "") >= 0);
+    clearReported();
+
+    // The same limit, or none, changes nothing
+    setMetricCaptureMaxSeries(2);
+    setMetricCaptureMaxSeries(0);
+    assert_int_equal(g_num_reported, 0);
+
+    setMetricCaptureMaxSeries(DEFAULT_STATSD_MAX_SERIES);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(statsdParseLineBasic),
+        cmocka_unit_test(statsdParseLineExtensions),
+        cmocka_unit_test(statsdParseLineRejectsInvalid),
+        cmocka_unit_test(statsdParseLineMultiLine),
+        cmocka_unit_test(reportAllCapturedMetricsAggregates),
+        cmocka_unit_test(setMetricCaptureMaxSeriesKeepsThePeriod),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, metricCaptureSetup, metricCaptureTeardown);
+}
@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "netagg.h"
+#include "test.h"
+
+// test.c has an implementation of cmdSendMetric, so the actual
+// value of this isn't really used, but it needs to be non-null.
+mtc_t *bogus_mtc_addr = (mtc_t*)0xDEADBEEF;
+
+static struct sockaddr_storage
+inet4(const char *ip, int port)
+{
+    struct sockaddr_storage ss = {0};
+    struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    inet_pton(AF_INET, ip, &sin->sin_addr);
+    return ss;
+}
+
+static struct sockaddr_storage
+inet6(const char *ip, int port)
+{
+    struct sockaddr_storage ss = {0};
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(port);
+    inet_pton(AF_INET6, ip, &sin6->sin6_addr);
+    return ss;
+}
+
+static void
+netAggCreateReturnsNonNull(void **state)
+{
+    net_agg_t *net_agg = netAggCreate(10);
+    assert_non_null(net_agg);
+    netAggDestroy(&net_agg);
+    assert_null(net_agg);
+
+    // top of 0 is off
+    assert_null(netAggCreate(0));
+}
+
+static void
+netAggForNullDoesNotCrash(void **state)
+{
+    net_agg_counts_t counts = {.connections = 1};
+    struct sockaddr_storage local = inet4("10.0.0.9", 40000);
+    struct sockaddr_storage remote = inet4("10.0.0.1", 80);
+
+    netAggDestroy(NULL);
+    netAggAddCounts(NULL, &local, &remote, SOCK_STREAM, FALSE, &counts);
+    netAggSendReport(NULL, bogus_mtc_addr);
+    netAggReset(NULL);
+
+    net_agg_t *net_agg = netAggCreate(10);
+    netAggAddCounts(net_agg, NULL, &remote, SOCK_STREAM, FALSE, &counts);
+    netAggAddCounts(net_agg, &local, &remote, SOCK_STREAM, FALSE, NULL);
+
+    // Only inet addresses are counted
+    struct sockaddr_storage unix_remote = {.ss_family = AF_UNIX};
+    netAggAddCounts(net_agg, &local, &unix_remote, SOCK_STREAM, FALSE, &counts);
+
+    g_send_metric_count = 0;
+    netAggSendReport(net_agg, NULL);
+    netAggSendReport(net_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 0);
+    netAggDestroy(&net_agg);
+}
+
+static void
+netAggAddCountsHappyPath(void **state)
+{
+    net_agg_t *net_agg = netAggCreate(10);
+
+    // Two connections out to the same service, one of them timed
+    struct sockaddr_storage local = inet4("10.0.0.9", 40000);
+    struct sockaddr_storage server = inet4("10.0.0.1", 443);
+    net_agg_counts_t a = {.connections = 1, .tx = 2, .txBytes = 200,
+                          .rx = 1, .rxBytes = 1000,
+                          .connects = 1, .connectDuration = 4000};
+    net_agg_counts_t b = {.connections = 1, .tx = 1, .txBytes = 100};
+    netAggAddCounts(net_agg, &local, &server, SOCK_STREAM, FALSE, &a);
+    netAggAddCounts(net_agg, &local, &server, SOCK_STREAM, FALSE, &b);
+
+    // Clients are counted by the port they connected to, not theirs,
+    // even when it's a high one
+    net_agg_counts_t c = {.connections = 1, .rx = 1, .rxBytes = 10};
+    struct sockaddr_storage listener = inet6("::", 40443);
+    struct sockaddr_storage client = inet6("fe80::1", 40001);
+    netAggAddCounts(net_agg, &listener, &client, SOCK_STREAM, TRUE, &c);
+    client = inet6("fe80::1", 50002);
+    netAggAddCounts(net_agg, &listener, &client, SOCK_STREAM, TRUE, &c);
+
+    // Failures to connect
+    struct sockaddr_storage down = inet4("10.0.0.2", 5432);
+    net_agg_counts_t failed = {.errors = 1};
+    netAggAddCounts(net_agg, &local, &down, SOCK_STREAM, FALSE, &failed);
+    netAggAddCounts(net_agg, &local, &down, SOCK_STREAM, FALSE, &failed);
+
+    // An unconnected datagram socket, by its local port
+    struct sockaddr_storage dns = inet4("0.0.0.0", 53);
+    net_agg_counts_t datagrams = {.rx = 3, .rxBytes = 300};
+    netAggAddCounts(net_agg, &dns, NULL, SOCK_DGRAM, FALSE, &datagrams);
+
+    // and nothing at all
+    net_agg_counts_t none = {0};
+    netAggAddCounts(net_agg, &local, &down, SOCK_DGRAM, FALSE, &none);
+
+    expect_t expect[] = {
+        {"net.remote.conn",             "remoteip",  "10.0.0.1",    0},
+        {"net.remote.tx",               "remotep",   "443",         0},
+        {"net.remote.rx",               "direction", "out",         0},
+        {"net.remote.connect.duration", "remoteip",  "10.0.0.1",    0},
+        {"net.remote.conn",             "localp",    "40443",       0},
+        {"net.remote.rx",               "remoteip",  "fe80::1",     0},
+        {"net.remote.rx",               "direction", "in",          0},
+        {"net.remote.error",            "remotep",   "5432",        0},
+        {"net.remote.conn",             "proto",     "TCP",         0},
+        {"net.remote.conn",             "proto",     "UDP",         0},
+        {"net.remote.tx",               "numops",    "3",           0},
+        {"net.remote.rx",               "remoteip",  "unconnected", 0},
+        {"net.remote.rx",               "localp",    "53",          0},
+        {"net.remote.rx",               "direction", "none",        0},
+        {"net.remote.rx",               "remotep",   NULL,          0},
+        {NULL, NULL, NULL, 0}
+    };
+    g_expect = expect;
+    g_send_metric_count = 0;
+    netAggSendReport(net_agg, bogus_mtc_addr);
+    g_expect = NULL;
+    assert_int_equal(expect[0].total, 2);
+    assert_int_equal(expect[1].total, 300);
+    assert_int_equal(expect[2].total, 1000);
+    assert_int_equal(expect[3].total, 4);       // 4 us over 1 op
+    assert_int_equal(expect[4].total, 2);
+    assert_int_equal(expect[5].total, 20);
+    assert_int_equal(expect[6].total, 20);
+    assert_int_equal(expect[7].total, 2);
+    assert_int_equal(expect[8].total, 4);
+    assert_int_equal(expect[9].total, 0);
+    assert_int_equal(expect[10].total, 300);
+    assert_int_equal(expect[11].total, 300);
+    assert_int_equal(expect[12].total, 300);
+    assert_int_equal(expect[13].total, 300);
+    assert_int_equal(expect[14].total, 1000);   // only outbound has a remotep
+    // 10.0.0.1: conn, rx, tx, duration; fe80::1: conn, rx; 10.0.0.2: error;
+    // unconnected: rx
+    assert_int_equal(g_send_metric_count, 8);
+
+    // Reset forgets it all
+    netAggReset(net_agg);
+    g_send_metric_count = 0;
+    netAggSendReport(net_agg, bogus_mtc_addr);
+    assert_int_equal(g_send_metric_count, 0);
+
+    netAggDestroy(&net_agg);
+}
+
+static void
+netAggSendReportIsTopTalkers(void **state)
+{
+    net_agg_t *net_agg = netAggCreate(2);
+
+    // Many more clients than are reported; client i sends i bytes
+    struct sockaddr_storage local = inet4("10.0.0.9", 5000);
+    int i;
+    for (i = 1; i <= 1000; i++) {
+        char ip[32];
+        snprintf(ip, sizeof(ip), "10.1.%d.%d", i / 256, i % 256);
+        struct sockaddr_storage client = inet4(ip, 50000);
+        net_agg_counts_t counts = {.rx = 1, .rxBytes = i};
+        netAggAddCounts(net_agg, &local, &client, SOCK_DGRAM, TRUE, &counts);
+    }
+
+    expect_t expect[] = {
+        {"net.remote.rx",               "remoteip",  "10.1.3.232",  0},      // 1000
+        {"net.remote.rx",               "remoteip",  "10.1.3.231",  0},      // 999
+        {NULL, NULL, NULL, 0}
+    };
+    g_expect = expect;
+    g_send_metric_count = 0;
+    netAggSendReport(net_agg, bogus_mtc_addr);
+    g_expect = NULL;
+    assert_int_equal(g_send_metric_count, 2);
+    assert_int_equal(expect[0].total, 1000);
+    assert_int_equal(expect[1].total, 999);
+
+    netAggDestroy(&net_agg);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(netAggCreateReturnsNonNull),
+        cmocka_unit_test(netAggForNullDoesNotCrash),
+        cmocka_unit_test(netAggAddCountsHappyPath),
+        cmocka_unit_test(netAggSendReportIsTopTalkers),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -1,5 +1,7 @@
 #define _GNU_SOURCE
+#include <pthread.h>
 
+#include "dbg.h"
 #include "fn.h"
 #include "os.h"
 #include "scopestdlib.h"
@@ -39,6 +41,203 @@ osWritePermFailure(void **state) {
     scope_close(fd);
 }
 
+static void
+osInitTimerCalibrates(void **state) {
+    assert_int_equal(osInitTimer(&g_time), 0);
+    assert_true(g_time.mult != 0);
+
+    struct timespec req = {.tv_sec = 0, .tv_nsec = 20000000};
+    uint64_t start = getTime();
+    scope_nanosleep(&req, NULL);
+    uint64_t elapsed = getDuration(start);
+
+    // Generous upper bound for a loaded machine
+    assert_true(elapsed >= 19000000);
+    assert_true(elapsed < 500000000);
+}
+
+static void
+osTimerDurationIgnoresSkew(void **state) {
+    assert_int_equal(osInitTimer(&g_time), 0);
+    uint64_t now = getTime();
+    assert_int_equal(getDurationNow(now, now + 100), 0);
+    assert_int_equal(getDurationNow(now, now), 0);
+}
+
+static void
+osTimerFallbackIsNs(void **state) {
+    platform_time_t saved = g_time;
+    g_time.gptimer_avail = FALSE;
+    g_time.mult = 1;
+    g_time.shift = 0;
+
+    uint64_t start = getTime();
+    assert_int_equal(getDurationNow(start + 1500, start), 1500);
+
+    g_time = saved;
+}
+
+static void
+osGetPageProtFromTheMapsTable(void **state) {
+    size_t len = 3 * 4096;
+    char *addr = scope_mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    assert_ptr_not_equal(addr, MAP_FAILED);
+    assert_int_equal(scope_mprotect(addr + 4096, 4096, PROT_READ), 0);
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        // from the file the first time, from the table the second
+        if (i) assert_true(osMapsLoad());
+        assert_int_equal(osGetPageProt((uint64_t)addr), PROT_READ | PROT_WRITE);
+        assert_int_equal(osGetPageProt((uint64_t)addr + 4096 + 8), PROT_READ);
+        assert_int_equal(osGetPageProt((uint64_t)addr + 2 * 4096), PROT_READ | PROT_WRITE);
+        assert_int_equal(osGetPageProt((uint64_t)&osGetPageProtFromTheMapsTable) & PROT_EXEC, PROT_EXEC);
+        assert_int_equal(osGetPageProt(0), -1);
+        assert_int_equal(osGetPageProt(UINT64_MAX - 1), -1);
+    }
+
+    // Loads nest; the table is kept until the last release
+    assert_true(osMapsLoad());
+    osMapsRelease();
+    scope_munmap(addr, len);
+    assert_int_equal(osGetPageProt((uint64_t)addr), PROT_READ | PROT_WRITE);
+    osMapsRelease();
+    assert_int_equal(osGetPageProt((uint64_t)addr), -1);
+
+    // an extra release is harmless
+    osMapsRelease();
+}
+
+// The number of entries in a /proc directory that aren't directories
+static int
+countEntries(const char *path, bool dirs) {
+    int count = 0;
+    DIR *dirp = opendir(path);
+    assert_non_null(dirp);
+    struct dirent *entry;
+    while ((entry = readdir(dirp)) != NULL) {
+        if (dirs ? (entry->d_name[0] != '.') : (entry->d_type != DT_DIR)) count++;
+    }
+    closedir(dirp);
+    return count;
+}
+
+// A value from /proc/self/status, in kB
+static int
+statusValue(const char *name) {
+    char line[256];
+    int value = -1;
+    size_t len = strlen(name);
+    FILE *fs = fopen("/proc/self/status", "r");
+    assert_non_null(fs);
+    while (fgets(line, sizeof(line), fs)) {
+        if (!strncmp(line, name, len) && (line[len] == ':')) {
+            value = atoi(line + len + 1);
+            break;
+        }
+    }
+    fclose(fs);
+    return value;
+}
+
+static void *
+waitForIt(void *arg) {
+    pthread_mutex_lock(arg);
+    pthread_mutex_unlock(arg);
+    return NULL;
+}
+
+static void
+osGetProcMetricsMatchProc(void **state) {
+    pid_t pid = getpid();
+
+    // As the entries in /proc/<pid>/task and /proc/<pid>/fd count them;
+    // and VmSize, give or take what reading it allocates
+    assert_int_equal(osGetNumThreads(pid), countEntries("/proc/self/task", TRUE));
+    assert_int_equal(osGetNumChildProcs(pid), countEntries("/proc/self/task", TRUE) - 1);
+    assert_true(abs(osGetProcMemory(pid) - statusValue("VmSize")) < 1024);
+    assert_int_equal(osGetNumFds(pid), countEntries("/proc/self/fd", FALSE) - 1);
+
+    // All from one read
+    proc_stat_t stat;
+    assert_true(osGetProcStat(pid, &stat));
+    assert_int_equal(stat.threads, countEntries("/proc/self/task", TRUE));
+    assert_true(labs(stat.rss - statusValue("VmRSS")) < 1024);
+
+    // A thread and a descriptor more are seen the next time they're asked for
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t thread;
+    pthread_mutex_lock(&lock);
+    assert_int_equal(pthread_create(&thread, NULL, waitForIt, &lock), 0);
+    int fd = dup(0);
+    assert_int_not_equal(fd, -1);
+
+    assert_int_equal(osGetNumThreads(pid), countEntries("/proc/self/task", TRUE));
+    assert_int_equal(osGetNumChildProcs(pid), countEntries("/proc/self/task", TRUE) - 1);
+    assert_true(abs(osGetProcMemory(pid) - statusValue("VmSize")) < 1024);
+    assert_int_equal(osGetNumFds(pid), countEntries("/proc/self/fd", FALSE) - 1);
+
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    close(fd);
+
+    assert_int_equal(osGetNumThreads(-1), -1);
+    assert_int_equal(osGetNumFds(-1), -1);
+    assert_int_equal(dbgCountMatchingLines("os/linux/os.c"), 2);
+    dbgInit();
+}
+
+static void
+osGetProcResourcesMatchProc(void **state) {
+    pid_t pid = getpid();
+
+    assert_true(abs(osGetProcRss(pid) - statusValue("VmRSS")) < 1024);
+
+    // Touching new pages faults them in
+    proc_rusage_t before, after;
+    assert_true(osGetProcRusage(RUSAGE_SELF, &before));
+    size_t len = 256 * 4096;
+    char *mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert_ptr_not_equal(mem, MAP_FAILED);
+    memset(mem, 'x', len);
+    assert_true(osGetProcRusage(RUSAGE_SELF, &after));
+    assert_true(after.minorFaults - before.minorFaults >= 256);
+    assert_true(after.volCtxSwitch >= before.volCtxSwitch);
+    assert_true(after.involCtxSwitch >= before.involCtxSwitch);
+    munmap(mem, len);
+
+    // This thread's are a part of the process's
+    proc_rusage_t thread;
+    assert_true(osGetProcRusage(RUSAGE_THREAD, &thread));
+    assert_true(thread.minorFaults >= 256);
+    assert_true(thread.minorFaults <= after.minorFaults);
+
+    long long rd, wr;
+    assert_true(osGetProcIo(pid, &rd, &wr));
+    assert_true((rd >= 0) && (wr >= 0));
+
+    // Nothing is left open to be counted in proc.fd
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    assert_int_equal(osFindFd(pid, path), -1);
+
+    // Totals of the cgroup only go up, if there's a v2 hierarchy to read
+    cgroup_stats_t first, second;
+    if (osGetCgroupStats(pid, &first)) {
+        assert_true(osGetCgroupStats(pid, &second));
+        assert_false(second.moved);
+        assert_true(second.cpuPressure >= first.cpuPressure);
+        assert_true(second.memPressure >= first.memPressure);
+        assert_true(second.ioPressure >= first.ioPressure);
+        assert_true(second.cpuThrottled >= first.cpuThrottled);
+    }
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    assert_int_equal(osFindFd(pid, path), -1);
+
+    assert_false(osGetProcIo(-1, &rd, &wr));
+    assert_false(osGetCgroupStats(-1, &first));
+}
+
 int
 main(int argc, char* argv[]) {
     printf("running %s\n", argv[0]);
@@ -49,6 +248,12 @@ main(int argc, char* argv[]) {
         cmocka_unit_test(osTestTimerStopNotInit),
         cmocka_unit_test(osWritePermSuccess),
         cmocka_unit_test(osWritePermFailure),
+        cmocka_unit_test(osInitTimerCalibrates),
+        cmocka_unit_test(osTimerDurationIgnoresSkew),
+        cmocka_unit_test(osTimerFallbackIsNs),
+        cmocka_unit_test(osGetPageProtFromTheMapsTable),
+        cmocka_unit_test(osGetProcMetricsMatchProc),
+        cmocka_unit_test(osGetProcResourcesMatchProc),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
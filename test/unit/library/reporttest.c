@@ -1,4 +1,6 @@
 #define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -6,6 +8,7 @@
 #include "cfg.h"
 #include "dbg.h"
 #include "fn.h"
+#include "gocontext.h"
 #include "plattime.h"
 #include "report.h"
 #include "runtimecfg.h"
@@ -18,6 +21,7 @@
 event_t evtBuf[BUFSIZE] = {{0}};
 int evtBufNext = 0;
 event_t mtcBuf[BUFSIZE] = {{0}};
+char mtcFields[BUFSIZE][256] = {{0}};
 int mtcBufNext = 0;
 
 // These signatures satisfy --wrap=cmdSendEvent in the Makefile
@@ -45,6 +49,21 @@ int __wrap_cmdSendMetric(mtc_t* mtc, event_t* metric)
 int cmdSendMetric(mtc_t* mtc, event_t* metric)
 #endif // __APPLE__
 {
+    // Store its fields as ",name:value,name:value,"; they're the caller's
+    char *fields = mtcFields[mtcBufNext];
+    size_t len = snprintf(fields, sizeof(mtcFields[0]), ",");
+    event_field_t *field;
+    for (field = metric->fields; field && (field->value_type != FMT_END); field++) {
+        if (len >= sizeof(mtcFields[0])) break;
+        if (field->value_type == FMT_STR) {
+            len += snprintf(fields + len, sizeof(mtcFields[0]) - len, "%s:%s,",
+                            field->name, field->value.str);
+        } else {
+            len += snprintf(fields + len, sizeof(mtcFields[0]) - len, "%s:%lld,",
+                            field->name, field->value.num);
+        }
+    }
+
     // Store metric for later inspection
     memcpy(&mtcBuf[mtcBufNext++], metric, sizeof(*metric));
     if (mtcBufNext >= BUFSIZE) fail();
@@ -75,6 +94,22 @@ metricCalls(const char* str)
     return returnVal;
 }
 
+// The total of the metrics named str with a field, "name:value"
+int
+metricValuesWith(const char *str, const char *field)
+{
+    doEvent();
+    char match[128];
+    snprintf(match, sizeof(match), ",%s,", field);
+    int i, returnVal = 0;
+    for (i=0; i < mtcBufNext; i++) {
+        if (!strcmp(mtcBuf[i].name, str) && strstr(mtcFields[i], match)) {
+            returnVal += mtcBuf[i].value.integer;
+        }
+    }
+    return returnVal;
+}
+
 // we no longer clear counters on rd/wr, only on close
 // the last entry is the total
 int
@@ -125,6 +160,7 @@ clearTestData(void)
     memset(&evtBuf, 0, sizeof(evtBuf));
     evtBufNext = 0;
     memset(&mtcBuf, 0, sizeof(mtcBuf));
+    memset(&mtcFields, 0, sizeof(mtcFields));
     mtcBufNext = 0;
 }
 
@@ -184,6 +220,10 @@ nothingCrashesBeforeAnyInit(void** state)
     doProcStartMetric();
     doErrorMetric(NET_ERR_CONN, PERIODIC, "A", "B", NULL);
     doProcMetric(PROC_CPU);
+    doProcMetric(PROC_STAT);
+    doProcMetric(PROC_RUSAGE);
+    doProcMetric(PROC_IO);
+    doProcMetric(PROC_CGROUP);
     doStatMetric("statFunc", "/the/path/to/something", NULL);
     doTotal(TOT_READ);
     doTotalDuration(TOT_DNS_DURATION);
@@ -206,15 +246,15 @@ nothingCrashesBeforeAnyInit(void** state)
     doWrite(17, 876, 1, NULL, 0, "writeFunc", BUF, 0);
     doSeek(18, 1, "seekymcseekface");
 #ifdef __linux__
-    doStatPath("/pathy/path", 0, "statymcstatface");
-    doStatFd(19, 0, "toomuchstat4u");
+    doStatPath("/pathy/path", 0, 0, "statymcstatface");
+    doStatFd(19, 0, 0, "toomuchstat4u");
 #endif // __linux__
     doDupFile(20, 21, "dup");
     doDupSock(22, 23);
     doDup(24, 0, "dupFunc", 1);
     doDup2(25, 26, 0, "dup2Func");
     doClose(26, "closeFunc");
-    doOpen(27, "/the/file/path", FD, "openFunc");
+    doOpen(27, 0, "/the/file/path", FD, "openFunc");
     doSendFile(28, 29, 23548, 0, "sendFileFunc");
     doCloseAndReportFailures(30, 1, "closeFunc");
     doCloseAllStreams();
@@ -237,7 +277,7 @@ doReadFileNoSummarization(void** state)
 {
     clearTestData();
     setVerbosity(9);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 1);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -282,7 +322,7 @@ doReadFileSummarizedOpenCloseNotSummarized(void** state)
 {
     clearTestData();
     setVerbosity(6);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 1);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -328,7 +368,7 @@ doReadFileFullSummarization(void** state)
 {
     clearTestData();
     setVerbosity(5);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 0);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -379,7 +419,7 @@ doWriteFileNoSummarization(void** state)
 
     clearTestData();
     setVerbosity(9);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 1);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -426,7 +466,7 @@ doWriteFileSummarizedOpenCloseNotSummarized(void** state)
 
     clearTestData();
     setVerbosity(6);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 1);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -474,7 +514,7 @@ doWriteFileFullSummarization(void** state)
 
     clearTestData();
     setVerbosity(5);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 0);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -717,6 +757,78 @@ doRecvFullSummarization(void** state)
     if(addr_list) freeaddrinfo(addr_list);
 }
 
+static void
+doRecvSendBatched(void** state)
+{
+    struct addrinfo* addr_list = NULL;
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (getaddrinfo("localhost", "13456", &hints, &addr_list) || !addr_list) {
+        fail();
+    }
+
+    clearTestData();
+    setVerbosity(9);
+    setNetBatched(TRUE);
+    addSock(15, SOCK_STREAM, 0);
+    doSetConnection(15, addr_list->ai_addr, addr_list->ai_addrlen, LOCAL);
+    doAccept(15, 16, addr_list->ai_addr, &addr_list->ai_addrlen, "acceptFunc");
+
+    // Batched, nothing is output per call
+    clearTestData();
+    doRecv(16, 13, NULL, 13, BUF);
+    doRecv(16, 13, NULL, 13, BUF);
+    doSend(16, 7, NULL, 7, BUF);
+    assert_int_equal(metricCalls("net.rx"), 0);
+    assert_int_equal(eventCalls("net.rx"), 0);
+    assert_int_equal(eventCalls("net.tx"), 0);
+
+    // The period's calls are output once, together
+    reportFD(16, PERIODIC);
+    assert_int_equal(metricCalls("net.rx"), 1);
+    assert_int_equal(metricValues("net.rx"), 2*13);
+    assert_int_equal(eventCalls("net.rx"), 1);
+    assert_int_equal(eventRdWrValues("net.rx"), 2*13);
+    assert_int_equal(eventCalls("net.tx"), 1);
+    assert_int_equal(eventRdWrValues("net.tx"), 7);
+
+    // A quiet period outputs nothing
+    clearTestData();
+    reportFD(16, PERIODIC);
+    assert_int_equal(eventCalls("net.rx"), 0);
+    assert_int_equal(metricCalls("net.rx"), 0);
+
+    // What's left is output when the socket is closed
+    doRecv(16, 13, NULL, 13, BUF);
+    assert_int_equal(eventCalls("net.rx"), 0);
+    doClose(16, "closeFunc");
+    assert_int_equal(eventCalls("net.rx"), 1);
+    assert_int_equal(metricCalls("net.rx"), 1);
+    assert_int_equal(metricValues("net.rx"), 13);
+
+    // Summarized, only the event is output once a period
+    setVerbosity(6);
+    doAccept(15, 17, addr_list->ai_addr, &addr_list->ai_addrlen, "acceptFunc");
+    clearTestData();
+    doRecv(17, 13, NULL, 13, BUF);
+    doRecv(17, 13, NULL, 13, BUF);
+    assert_int_equal(eventCalls("net.rx"), 0);
+    reportFD(17, PERIODIC);
+    assert_int_equal(eventCalls("net.rx"), 1);
+    assert_int_equal(eventRdWrValues("net.rx"), 2*13);
+    assert_int_equal(metricCalls("net.rx"), 0);
+    clearTestData();
+    reportFD(17, PERIODIC);
+    assert_int_equal(eventCalls("net.rx"), 0);
+
+    setNetBatched(FALSE);
+    doClose(17, "closeFunc");
+    doClose(15, "closeFunc");
+    freeaddrinfo(addr_list);
+}
+
 static void
 doSendNoSummarization(void** state)
 {
@@ -926,7 +1038,7 @@ doSeekNoSummarization(void** state)
     clearTestData();
     setVerbosity(8);
 
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 1);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -967,7 +1079,7 @@ doSeekSummarization(void** state)
     clearTestData();
     setVerbosity(7);
 
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
     assert_int_equal(metricCalls("fs.open"), 1);
     assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -1017,8 +1129,8 @@ doStatPathNoSummarization(void** state)
 
     // Without stat summarization, every doStat is output
     clearTestData();
-    doStatPath("/the/path", 0, "statFunc");
-    doStatPath("/the/path", 0, "statFunc");
+    doStatPath("/the/path", 0, 0, "statFunc");
+    doStatPath("/the/path", 0, 0, "statFunc");
     assert_int_equal(metricCalls("fs.stat"), 2);
     assert_int_equal(metricValues("fs.stat"), 2);
     assert_int_equal(eventCalls("fs.stat"), 2);
@@ -1044,8 +1156,8 @@ doStatPathSummarization(void** state)
 
     // Without stat summarization, every doStat is output
     clearTestData();
-    doStatPath("/the/path", 0, "statFunc");
-    doStatPath("/the/path", 0, "statFunc");
+    doStatPath("/the/path", 0, 0, "statFunc");
+    doStatPath("/the/path", 0, 0, "statFunc");
     assert_int_equal(metricCalls("fs.stat"), 0);
     assert_int_equal(metricValues("fs.stat"), 0);
     assert_int_equal(eventCalls("fs.stat"), 2);
@@ -1064,7 +1176,7 @@ doStatFdNoSummarization(void** state)
 {
      clearTestData();
      setVerbosity(7);
-     doOpen(16, "/the/file/path", FD, "openFunc");
+     doOpen(16, 0, "/the/file/path", FD, "openFunc");
      assert_int_equal(metricCalls("fs.open"), 1);
      assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -1075,8 +1187,8 @@ doStatFdNoSummarization(void** state)
 
      // Without stat summarization, every doStatFd is output
      clearTestData();
-     doStatFd(16, 0, "statFunc");
-     doStatFd(16, 0, "statFunc");
+     doStatFd(16, 0, 0, "statFunc");
+     doStatFd(16, 0, 0, "statFunc");
      assert_int_equal(metricCalls("fs.stat"), 2);
      assert_int_equal(metricValues("fs.stat"), 2);
      assert_int_equal(eventCalls("fs.stat"), 2);
@@ -1104,7 +1216,7 @@ doStatFdSummarization(void** state)
 {
      clearTestData();
      setVerbosity(6);
-     doOpen(16, "/the/file/path", FD, "openFunc");
+     doOpen(16, 0, "/the/file/path", FD, "openFunc");
      assert_int_equal(metricCalls("fs.open"), 1);
      assert_int_equal(eventCalls("fs.open"), 1);
 
@@ -1115,8 +1227,8 @@ doStatFdSummarization(void** state)
 
      // With stat summarization, doStatFd is is not output
      clearTestData();
-     doStatFd(16, 0, "statFunc");
-     doStatFd(16, 0, "statFunc");
+     doStatFd(16, 0, 0, "statFunc");
+     doStatFd(16, 0, 0, "statFunc");
      assert_int_equal(metricCalls("fs.stat"), 0);
      assert_int_equal(metricValues("fs.stat"), 0);
      assert_int_equal(eventCalls("fs.stat"), 2);
@@ -1322,7 +1434,7 @@ doFSConnectionErrorNoSummarization(void** state)
 {
     clearTestData();
     setVerbosity(5);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
 
     // Zeros should not be reported on any interface
     clearTestData();
@@ -1352,7 +1464,7 @@ doFSConnectionErrorSummarization(void** state)
 {
     clearTestData();
     setVerbosity(4);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
 
     // Zeros should not be reported on any interface
     clearTestData();
@@ -1442,7 +1554,7 @@ doFSReadWriteErrorNoSummarization(void** state)
 {
     clearTestData();
     setVerbosity(5);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
 
     // Zeros should not be reported on any interface
     clearTestData();
@@ -1472,7 +1584,7 @@ doFSReadWriteErrorSummarization(void** state)
 {
     clearTestData();
     setVerbosity(4);
-    doOpen(16, "/the/file/path", FD, "openFunc");
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
 
     // Zeros should not be reported on any interface
     clearTestData();
@@ -1571,8 +1683,8 @@ doStatErrNoSummarization(void** state)
     assert_int_equal(eventCalls(NULL), 0);
 
     // Should create "stat" fs.error and report it immediately
-    doStatPath("/pathy/path", -1, "statymcstatface");
-    doStatPath("/pathy/path", -1, "statymcstatface");
+    doStatPath("/pathy/path", 0, -1, "statymcstatface");
+    doStatPath("/pathy/path", 0, -1, "statymcstatface");
     assert_int_equal(metricCalls("fs.error"), 2);
     assert_int_equal(metricValues("fs.error"), 2);
     assert_int_equal(eventCalls("fs.error"), 2);
@@ -1598,8 +1710,8 @@ doStatErrSummarization(void** state)
     assert_int_equal(eventCalls(NULL), 0);
 
     // Should create "stat" fs.error but not report it
-    doStatPath("/pathy/path", -1, "statymcstatface");
-    doStatPath("/pathy/path", -1, "statymcstatface");
+    doStatPath("/pathy/path", 0, -1, "statymcstatface");
+    doStatPath("/pathy/path", 0, -1, "statymcstatface");
     assert_int_equal(metricCalls("fs.error"), 0);
     assert_int_equal(eventCalls("fs.error"), 2);
     assert_int_equal(eventValues("fs.error"), 2);
@@ -1667,6 +1779,282 @@ doDNSErrSummarization(void** state)
     assert_int_equal(eventCalls(NULL), 0);
 }
 
+static void
+doFSPathCloseIsPostedOnlyWithCounts(void** state)
+{
+    config_t *cfg = cfgCreateDefault();
+    cfgMtcWatchTopSet(cfg, 5, CFG_MTC_FS);
+    setReportingFsPaths(cfg);
+    setVerbosity(4);
+
+    // Only what metrics need is posted
+    evt_fmt_t *evt = ctlEvtGet(g_ctl);
+    unsigned fsEvents = evtFormatSourceEnabled(evt, CFG_SRC_FS);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, FALSE);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_FS, FALSE);
+    clearTestData();
+
+    // The close takes the open to its path
+    doOpen(20, 0, "/tmp/fspath/a", FD, "openFunc");
+    doClose(20, "closeFunc");
+    doEvent();
+    doFSAgg();
+    assert_int_equal(metricCalls("fs.path.open"), 1);
+
+    // Once the period has taken it, the close has nothing to post
+    clearTestData();
+    doOpen(20, 0, "/tmp/fspath/a", FD, "openFunc");
+    reportFD(20, PERIODIC);
+    doClose(20, "closeFunc");
+    assert_int_equal(ctlGetEvent(g_ctl), (uint64_t)-1);
+    doFSAgg();
+    assert_int_equal(metricCalls("fs.path.open"), 1);
+
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, TRUE);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_FS, fsEvents);
+    cfgMtcWatchTopSet(cfg, 0, CFG_MTC_FS);
+    setReportingFsPaths(cfg);
+    setVerbosity(4);
+    cfgDestroy(&cfg);
+    clearTestData();
+}
+
+static struct sockaddr_in
+inet4(const char *ip, int port)
+{
+    struct sockaddr_in sin = {0};
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &sin.sin_addr);
+    return sin;
+}
+
+// Reporting by remote endpoint, with only what metrics need posted
+static config_t *
+netRemoteStart(unsigned *netEvents)
+{
+    config_t *cfg = cfgCreateDefault();
+    cfgMtcWatchTopSet(cfg, 5, CFG_MTC_NET);
+    setReportingNetTop(cfg);
+    setVerbosity(4);
+
+    evt_fmt_t *evt = ctlEvtGet(g_ctl);
+    *netEvents = evtFormatSourceEnabled(evt, CFG_SRC_NET);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, FALSE);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_NET, FALSE);
+    clearTestData();
+    return cfg;
+}
+
+static void
+netRemoteStop(config_t **cfg, unsigned netEvents)
+{
+    evt_fmt_t *evt = ctlEvtGet(g_ctl);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, TRUE);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_NET, netEvents);
+    cfgMtcWatchTopSet(*cfg, 0, CFG_MTC_NET);
+    setReportingNetTop(*cfg);
+    setVerbosity(4);
+    cfgDestroy(cfg);
+    clearTestData();
+}
+
+static void
+doNetRemoteConnectionIsCountedOnce(void** state)
+{
+    unsigned netEvents;
+    config_t *cfg = netRemoteStart(&netEvents);
+
+    struct sockaddr_in local = inet4("10.0.0.9", 40000);
+    struct sockaddr_in server = inet4("10.0.0.1", 443);
+    addSock(30, SOCK_STREAM, AF_INET);
+    doSetConnection(30, (struct sockaddr *)&local, sizeof(local), LOCAL);
+    doSetConnection(30, (struct sockaddr *)&server, sizeof(server), REMOTE);
+    doRemoteConnect(30, (struct sockaddr *)&server, sizeof(server), 4000000, TRUE);
+
+    // The period takes the connection and what was sent; the close only
+    // what was received after it
+    doSend(30, 100, NULL, 100, BUF);
+    reportFD(30, PERIODIC);
+    doRecv(30, 50, NULL, 50, BUF);
+    doClose(30, "closeFunc");
+    doEvent();
+    doNetAgg();
+    assert_int_equal(metricCalls("net.remote.conn"), 1);
+    assert_int_equal(metricValuesWith("net.remote.conn", "remotep:443"), 1);
+    assert_int_equal(metricValuesWith("net.remote.conn", "direction:out"), 1);
+    assert_int_equal(metricValues("net.remote.tx"), 100);
+    assert_int_equal(metricValues("net.remote.rx"), 50);
+    assert_int_equal(metricValues("net.remote.connect.duration"), 4000);
+
+    netRemoteStop(&cfg, netEvents);
+}
+
+static void
+doNetRemoteAcceptIsInboundAndDupIsNotCounted(void** state)
+{
+    unsigned netEvents;
+    config_t *cfg = netRemoteStart(&netEvents);
+
+    struct sockaddr_in listener = inet4("0.0.0.0", 8080);
+    struct sockaddr_in client = inet4("10.0.0.5", 50001);
+    socklen_t len = sizeof(client);
+    addSock(31, SOCK_STREAM, AF_INET);
+    doSetConnection(31, (struct sockaddr *)&listener, sizeof(listener), LOCAL);
+    doAccept(31, 32, (struct sockaddr *)&client, &len, "acceptFunc");
+    doRecv(32, 10, NULL, 10, BUF);
+
+    // Another descriptor for the same connection
+    doDupSock(32, 33);
+    doRecv(33, 20, NULL, 20, BUF);
+
+    // A second connection from the client, from another port
+    client = inet4("10.0.0.5", 50002);
+    doAccept(31, 34, (struct sockaddr *)&client, &len, "acceptFunc");
+
+    doClose(33, "closeFunc");
+    doClose(32, "closeFunc");
+    doClose(34, "closeFunc");
+    doClose(31, "closeFunc");
+    doEvent();
+    doNetAgg();
+    assert_int_equal(metricCalls("net.remote.conn"), 1);
+    assert_int_equal(metricValuesWith("net.remote.conn", "localp:8080"), 2);
+    assert_int_equal(metricValuesWith("net.remote.conn", "direction:in"), 2);
+    assert_int_equal(metricValuesWith("net.remote.conn", "remoteip:10.0.0.5"), 2);
+    assert_int_equal(metricValuesWith("net.remote.rx", "localp:8080"), 30);
+
+    netRemoteStop(&cfg, netEvents);
+}
+
+static void
+doNetRemoteFailedConnectIsCountedAgainstTarget(void** state)
+{
+    unsigned netEvents;
+    config_t *cfg = netRemoteStart(&netEvents);
+
+    // One that failed, and one that didn't block and was closed before
+    // it connected
+    struct sockaddr_in down = inet4("10.0.0.2", 5432);
+    addSock(35, SOCK_STREAM, AF_INET);
+    doRemoteConnect(35, (struct sockaddr *)&down, sizeof(down), 0, FALSE);
+    doClose(35, "closeFunc");
+    addSock(36, SOCK_STREAM, AF_INET);
+    doRemoteConnectStart(36, (struct sockaddr *)&down, sizeof(down), getTime());
+    doClose(36, "closeFunc");
+
+    // One that didn't block and connected; it's timed to its first send
+    struct sockaddr_in server = inet4("10.0.0.1", 443);
+    addSock(37, SOCK_STREAM, AF_INET);
+    doRemoteConnectStart(37, (struct sockaddr *)&server, sizeof(server), getTime());
+    doSetConnection(37, (struct sockaddr *)&server, sizeof(server), REMOTE);
+    doSend(37, 10, NULL, 10, BUF);
+    doClose(37, "closeFunc");
+
+    doEvent();
+    doNetAgg();
+    assert_int_equal(metricCalls("net.remote.error"), 1);
+    assert_int_equal(metricValuesWith("net.remote.error", "remoteip:10.0.0.2"), 2);
+    assert_int_equal(metricValuesWith("net.remote.error", "remotep:5432"), 2);
+    assert_int_equal(metricValuesWith("net.remote.conn", "remoteip:10.0.0.2"), 0);
+    assert_int_equal(metricValuesWith("net.remote.conn", "remoteip:10.0.0.1"), 1);
+    assert_int_equal(metricCalls("net.remote.connect.duration"), 1);
+    assert_int_equal(metricValuesWith("net.remote.tx", "remotep:443"), 10);
+
+    netRemoteStop(&cfg, netEvents);
+}
+
+static void
+doNetRemoteCloseIsPosted(void** state)
+{
+    unsigned netEvents;
+    config_t *cfg = netRemoteStart(&netEvents);
+
+    // With nothing sent or received, the close is posted for the endpoint
+    struct sockaddr_in local = inet4("10.0.0.9", 40000);
+    struct sockaddr_in server = inet4("10.0.0.1", 443);
+    addSock(38, SOCK_STREAM, AF_INET);
+    doSetConnection(38, (struct sockaddr *)&local, sizeof(local), LOCAL);
+    doSetConnection(38, (struct sockaddr *)&server, sizeof(server), REMOTE);
+    doClose(38, "closeFunc");
+    doEvent();
+    doNetAgg();
+    assert_int_equal(metricValuesWith("net.remote.conn", "remoteip:10.0.0.1"), 1);
+
+    // and only then
+    clearTestData();
+    cfgMtcWatchTopSet(cfg, 0, CFG_MTC_NET);
+    setReportingNetTop(cfg);
+    setVerbosity(4);
+    addSock(38, SOCK_STREAM, AF_INET);
+    doSetConnection(38, (struct sockaddr *)&local, sizeof(local), LOCAL);
+    doSetConnection(38, (struct sockaddr *)&server, sizeof(server), REMOTE);
+    doClose(38, "closeFunc");
+    assert_int_equal(ctlGetEvent(g_ctl), (uint64_t)-1);
+
+    netRemoteStop(&cfg, netEvents);
+}
+
+static void
+doLatencyMetricOnlyWhenWatched(void** state)
+{
+    // Takes what earlier tests recorded
+    doLatencyMetric();
+    clearTestData();
+    setVerbosity(5);
+
+    // Two 5 ms lookups; 5 ms is under the 8192 us bucket
+    doUpdateState(DNS_DURATION, -1, 5000000, NULL, "www.example.com");
+    doUpdateState(DNS_DURATION, -1, 5000000, NULL, "www.example.com");
+    clearTestData();
+    doLatencyMetric();
+    assert_int_equal(metricCalls("dns.latency.count"), 1);
+    assert_int_equal(metricValues("dns.latency.count"), 2);
+    assert_int_equal(metricCalls("dns.latency.bucket"), 2);
+    assert_int_equal(metricValues("dns.latency.bucket"), 4);
+
+    // Nothing is recorded while metrics are off
+    clearTestData();
+    mtcEnabledSet(g_mtc, FALSE);
+    assert_false(latencyEnabled(HISTO_DNS));
+    assert_int_equal(latencyStartTime(HISTO_OPEN), 0);
+    doUpdateState(DNS_DURATION, -1, 5000000, NULL, "www.example.com");
+    mtcEnabledSet(g_mtc, TRUE);
+    assert_true(latencyEnabled(HISTO_DNS));
+    doLatencyMetric();
+    assert_int_equal(metricCalls("dns.latency.count"), 0);
+    assert_int_equal(metricCalls("dns.latency.bucket"), 0);
+}
+
+static void
+goFdFilterFollowsTrackedDescriptors(void** state)
+{
+    clearTestData();
+    setVerbosity(9);
+
+    // stdio always passes
+    assert_true(g_go_fd_filter[0] && g_go_fd_filter[1] && g_go_fd_filter[2]);
+
+    // However a descriptor comes to be tracked, libc or Go, it passes
+    assert_false(g_go_fd_filter[16]);
+    doOpen(16, 0, "/the/file/path", FD, "openFunc");
+    assert_true(g_go_fd_filter[16]);
+    addSock(17, SOCK_STREAM, AF_INET);
+    assert_true(g_go_fd_filter[17]);
+    doDupSock(17, 18);
+    assert_true(g_go_fd_filter[18]);
+    doAccept(17, 19, NULL, NULL, "acceptFunc");
+    assert_true(g_go_fd_filter[19]);
+
+    // and stops passing once it's closed
+    int fd;
+    for (fd = 16; fd <= 19; fd++) {
+        doClose(fd, "closeFunc");
+        assert_false(g_go_fd_filter[fd]);
+    }
+    clearTestData();
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -1691,6 +2079,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(doRecvNoSummarization),
         cmocka_unit_test(doRecvSummarizedOpenCloseNotSummarized),
         cmocka_unit_test(doRecvFullSummarization),
+        cmocka_unit_test(doRecvSendBatched),
         cmocka_unit_test(doSendNoSummarization),
         cmocka_unit_test(doSendSummarizedOpenCloseNotSummarized),
         cmocka_unit_test(doSendFullSummarization),
@@ -1718,6 +2107,13 @@ main(int argc, char* argv[])
 #endif // __linux__
         cmocka_unit_test(doDNSErrNoSummarization),
         cmocka_unit_test(doDNSErrSummarization),
+        cmocka_unit_test(doFSPathCloseIsPostedOnlyWithCounts),
+        cmocka_unit_test(doNetRemoteConnectionIsCountedOnce),
+        cmocka_unit_test(doNetRemoteAcceptIsInboundAndDupIsNotCounted),
+        cmocka_unit_test(doNetRemoteFailedConnectIsCountedAgainstTarget),
+        cmocka_unit_test(doNetRemoteCloseIsPosted),
+        cmocka_unit_test(doLatencyMetricOnlyWhenWatched),
+        cmocka_unit_test(goFdFilterFollowsTrackedDescriptors),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     int test_errors = cmocka_run_group_tests(tests, countTestSetup, countTestTeardown);
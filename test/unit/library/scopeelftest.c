@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <link.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "os.h"
+#include "scopeelf.h"
+#include "scopestdlib.h"
+#include "test.h"
+
+#define NUM_HOOKS 300
+
+static char g_names[NUM_HOOKS][16];
+static got_list_t g_hooks[NUM_HOOKS + 3];
+
+static pid_t (*g_getppid)(void) = NULL;
+
+static pid_t
+hookedGetppid(void)
+{
+    return 12345;
+}
+
+static void
+gotIndexFindsEveryHook(void **state)
+{
+    int i;
+    for (i = 0; i < NUM_HOOKS; i++) {
+        snprintf(g_names[i], sizeof(g_names[i]), "func%d", i);
+        g_hooks[i].symbol = g_names[i];
+    }
+    // listed twice, like gethostbyname_r in the real list
+    g_hooks[NUM_HOOKS].symbol = "func7";
+    g_hooks[NUM_HOOKS + 1].symbol = "func8";
+    g_hooks[NUM_HOOKS + 2].symbol = NULL;
+
+    got_index_t *index = gotIndexCreate(g_hooks);
+    assert_non_null(index);
+
+    for (i = 0; i < NUM_HOOKS; i++) {
+        assert_ptr_equal(gotIndexFind(index, g_names[i]), &g_hooks[i]);
+    }
+    assert_null(gotIndexFind(index, "func"));
+    assert_null(gotIndexFind(index, "func300"));
+    assert_null(gotIndexFind(index, ""));
+    assert_null(gotIndexFind(index, NULL));
+
+    gotIndexDestroy(&index);
+    assert_null(index);
+}
+
+static void
+gotIndexForNullDoesNotCrash(void **state)
+{
+    got_list_t empty[] = {{NULL, NULL, NULL}};
+    assert_null(gotIndexCreate(NULL));
+    assert_null(gotIndexCreate(empty));
+    assert_null(gotIndexFind(NULL, "read"));
+    gotIndexDestroy(NULL);
+    assert_int_equal(doGotchaAll(NULL, NULL, NULL, NULL, NULL, 0, TRUE, NULL, NULL), 0);
+}
+
+static bool
+onlyGetppid(got_list_t *hook, void *data)
+{
+    (*(int *)data)++;
+    return !scope_strcmp(hook->symbol, "getppid");
+}
+
+static void
+doGotchaAllPatchesThisExecutable(void **state)
+{
+    struct link_map *lm;
+    Elf64_Sym *sym = NULL;
+    Elf64_Rela *rel = NULL;
+    char *str = NULL;
+    int rsz = 0;
+
+    g_getppid = dlsym(RTLD_NEXT, "getppid");
+    assert_non_null(g_getppid);
+    got_list_t hooks[] = {
+        {"getppid", hookedGetppid, &g_getppid},
+        {"getpid", hookedGetppid, NULL},
+        {"not_a_real_function", hookedGetppid, NULL},
+        {NULL, NULL, NULL}
+    };
+    got_index_t *index = gotIndexCreate(hooks);
+    assert_non_null(index);
+
+    void *handle = dlopen(NULL, RTLD_NOW);
+    assert_non_null(handle);
+    assert_int_not_equal(dlinfo(handle, RTLD_DI_LINKMAP, (void *)&lm), -1);
+    assert_int_not_equal(getElfEntries(lm, &rel, &sym, &str, &rsz), -1);
+
+    pid_t parent = getppid();
+    assert_int_not_equal(parent, 12345);
+
+    // getpid is found too, but the filter only lets getppid through
+    int asked = 0;
+    assert_true(osMapsLoad());
+    assert_int_equal(doGotchaAll(lm, index, rel, sym, str, rsz, TRUE, onlyGetppid, &asked), 1);
+    osMapsRelease();
+    assert_int_equal(asked, 2);
+    assert_int_equal(getppid(), 12345);
+    assert_int_not_equal(getpid(), 12345);
+
+    // again is a no-op
+    assert_int_equal(doGotchaAll(lm, index, rel, sym, str, rsz, TRUE, onlyGetppid, &asked), 0);
+
+    // and detaching puts back the original
+    assert_int_equal(doGotchaAll(lm, index, rel, sym, str, rsz, FALSE, onlyGetppid, &asked), 1);
+    assert_int_equal(getppid(), parent);
+
+    dlclose(handle);
+    gotIndexDestroy(&index);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(gotIndexFindsEveryHook),
+        cmocka_unit_test(gotIndexForNullDoesNotCrash),
+        cmocka_unit_test(doGotchaAllPatchesThisExecutable),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
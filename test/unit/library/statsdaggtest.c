@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scopestdlib.h"
+#include "statsdagg.h"
+#include "test.h"
+
+#define MAX_REPORTED 32
+
+typedef struct {
+    char name[64];
+    char type[4];
+    char dims[64];
+    bool isint;
+    long long intval;
+    double fltval;
+} reported_t;
+
+static reported_t g_reported[MAX_REPORTED];
+static int g_num_reported = 0;
+
+static void
+captureReport(const captured_metric_t *metric)
+{
+    if (g_num_reported >= MAX_REPORTED) fail();
+    reported_t *out = &g_reported[g_num_reported++];
+    scope_memset(out, 0, sizeof(*out));
+    scope_strncpy(out->name, (char *)metric->name, sizeof(out->name) - 1);
+    scope_strncpy(out->type, (char *)metric->type, sizeof(out->type) - 1);
+    if (metric->dims) {
+        scope_strncpy(out->dims, (char *)metric->dims, sizeof(out->dims) - 1);
+    }
+    out->isint = metric->isint;
+    out->intval = metric->intval;
+    out->fltval = metric->fltval;
+}
+
+static reported_t *
+findReported(const char *name)
+{
+    int i;
+    for (i = 0; i < g_num_reported; i++) {
+        if (!scope_strcmp(g_reported[i].name, name)) return &g_reported[i];
+    }
+    return NULL;
+}
+
+static void
+sendReport(statsd_agg_t *agg)
+{
+    g_num_reported = 0;
+    statsdAggSendReport(agg, captureReport);
+}
+
+static captured_metric_t
+intMetric(const char *name, const char *type, const char *dims, long long value)
+{
+    captured_metric_t metric = {
+        .name = (unsigned char *)name,
+        .type = (unsigned char *)type,
+        .dims = (unsigned char *)dims,
+        .isint = TRUE,
+        .intval = value,
+        .rate = 1.0,
+    };
+    return metric;
+}
+
+static void
+statsdAggCreateAndDestroy(void **state)
+{
+    statsd_agg_t *agg = statsdAggCreate(0);
+    assert_non_null(agg);
+    assert_int_equal(statsdAggSeriesCount(agg), 0);
+    statsdAggDestroy(&agg);
+    assert_null(agg);
+
+    statsdAggDestroy(&agg);
+    statsdAggDestroy(NULL);
+    statsdAggReset(NULL);
+    statsdAggSendReport(NULL, captureReport);
+    assert_false(statsdAggAddMetric(NULL, NULL));
+}
+
+static void
+statsdAggSumsCountersWithSortedDims(void **state)
+{
+    statsd_agg_t *agg = statsdAggCreate(16);
+
+    captured_metric_t m1 = intMetric("req", "c", "#b:2,a:1", 3);
+    captured_metric_t m2 = intMetric("req", "c", "#a:1,b:2", 4);
+    captured_metric_t m3 = intMetric("req", "c", NULL, 1);
+    assert_true(statsdAggAddMetric(agg, &m1));
+    assert_true(statsdAggAddMetric(agg, &m2));
+    assert_true(statsdAggAddMetric(agg, &m3));
+    assert_int_equal(statsdAggSeriesCount(agg), 2);
+
+    // Sampled counters are scaled up
+    captured_metric_t m4 = intMetric("req", "c", NULL, 1);
+    m4.rate = 0.25;
+    assert_true(statsdAggAddMetric(agg, &m4));
+
+    sendReport(agg);
+    assert_int_equal(g_num_reported, 2);
+    int i;
+    for (i = 0; i < g_num_reported; i++) {
+        assert_string_equal(g_reported[i].name, "req");
+        assert_true(g_reported[i].isint);
+        if (g_reported[i].dims[0]) {
+            assert_string_equal(g_reported[i].dims, "#a:1,b:2");
+            assert_int_equal(g_reported[i].intval, 7);
+        } else {
+            assert_int_equal(g_reported[i].intval, 5);
+        }
+    }
+
+    // Reset starts the next period empty
+    statsdAggReset(agg);
+    assert_int_equal(statsdAggSeriesCount(agg), 0);
+    sendReport(agg);
+    assert_int_equal(g_num_reported, 0);
+
+    statsdAggDestroy(&agg);
+}
+
+static void
+statsdAggKeepsLastGauge(void **state)
+{
+    statsd_agg_t *agg = statsdAggCreate(16);
+
+    captured_metric_t m1 = intMetric("temp", "g", NULL, 10);
+    captured_metric_t m2 = intMetric("temp", "g", NULL, 0);
+    m2.isint = FALSE;
+    m2.fltval = 12.5;
+    assert_true(statsdAggAddMetric(agg, &m1));
+    assert_true(statsdAggAddMetric(agg, &m2));
+
+    sendReport(agg);
+    assert_int_equal(g_num_reported, 1);
+    assert_false(g_reported[0].isint);
+    assert_true(g_reported[0].fltval == 12.5);
+
+    // Sets aren't aggregated
+    captured_metric_t m3 = intMetric("users", "s", NULL, 1);
+    assert_false(statsdAggAddMetric(agg, &m3));
+
+    statsdAggDestroy(&agg);
+}
+
+static void
+assertWithin(double actual, double expected, double tolerance)
+{
+    double diff = (actual > expected) ? actual - expected : expected - actual;
+    if (diff > expected * tolerance) {
+        fail_msg("%f is not within %f of %f", actual, tolerance, expected);
+    }
+}
+
+static void
+statsdAggSketchesTimers(void **state)
+{
+    statsd_agg_t *agg = statsdAggCreate(16);
+
+    int i;
+    for (i = 1; i <= 1000; i++) {
+        captured_metric_t m = intMetric("lat", "ms", "#op:get", i);
+        assert_true(statsdAggAddMetric(agg, &m));
+    }
+
+    sendReport(agg);
+    assert_int_equal(g_num_reported, 7);
+
+    reported_t *r = findReported("lat.count");
+    assert_non_null(r);
+    assert_string_equal(r->type, "c");
+    assert_string_equal(r->dims, "#op:get");
+    assert_int_equal(r->intval, 1000);
+
+    assert_non_null(r = findReported("lat.min"));
+    assert_string_equal(r->type, "g");
+    assert_true(r->fltval == 1.0);
+    assert_non_null(r = findReported("lat.max"));
+    assert_true(r->fltval == 1000.0);
+    assert_non_null(r = findReported("lat.avg"));
+    assert_true(r->fltval == 500.5);
+    assert_non_null(r = findReported("lat.median"));
+    assertWithin(r->fltval, 500.0, 0.04);
+    assert_non_null(r = findReported("lat.95percentile"));
+    assertWithin(r->fltval, 950.0, 0.04);
+    assert_non_null(r = findReported("lat.99percentile"));
+    assertWithin(r->fltval, 990.0, 0.04);
+
+    statsdAggDestroy(&agg);
+}
+
+static void
+statsdAggSketchKeepsHighQuantilesOverWideRanges(void **state)
+{
+    statsd_agg_t *agg = statsdAggCreate(16);
+
+    // Ten orders of magnitude; more than the sketch has buckets for
+    long long value;
+    int n = 0;
+    for (value = 1; value <= 10000000000LL; value *= 10) {
+        captured_metric_t m = intMetric("size", "h", NULL, value);
+        int i;
+        for (i = 0; i < 10; i++, n++) assert_true(statsdAggAddMetric(agg, &m));
+    }
+
+    // Timer samples taken at a rate stand for more samples
+    captured_metric_t m = intMetric("size", "h", NULL, 0);
+    m.rate = 0.1;
+    assert_true(statsdAggAddMetric(agg, &m));
+
+    sendReport(agg);
+    reported_t *r = findReported("size.count");
+    assert_non_null(r);
+    assert_int_equal(r->intval, n + 10);
+    assert_non_null(r = findReported("size.99percentile"));
+    assertWithin(r->fltval, 10000000000.0, 0.04);
+    assert_non_null(r = findReported("size.min"));
+    assert_true(r->fltval == 0.0);
+
+    statsdAggDestroy(&agg);
+}
+
+static void
+statsdAggCapsCardinality(void **state)
+{
+    statsd_agg_t *agg = statsdAggCreate(4);
+
+    char name[16];
+    int i;
+    for (i = 0; i < 6; i++) {
+        snprintf(name, sizeof(name), "m%d", i);
+        captured_metric_t m = intMetric(name, "c", NULL, 1);
+        assert_true(statsdAggAddMetric(agg, &m));
+        assert_true(statsdAggAddMetric(agg, &m));
+    }
+    assert_int_equal(statsdAggSeriesCount(agg), 4);
+
+    sendReport(agg);
+    assert_int_equal(g_num_reported, 5);
+    reported_t *r = findReported(STATSD_AGG_OVERFLOW);
+    assert_non_null(r);
+    assert_int_equal(r->intval, 4);
+    assert_non_null(r = findReported("m3"));
+    assert_int_equal(r->intval, 2);
+    assert_null(findReported("m4"));
+
+    statsdAggDestroy(&agg);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(statsdAggCreateAndDestroy),
+        cmocka_unit_test(statsdAggSumsCountersWithSortedDims),
+        cmocka_unit_test(statsdAggKeepsLastGauge),
+        cmocka_unit_test(statsdAggSketchesTimers),
+        cmocka_unit_test(statsdAggSketchKeepsHighQuantilesOverWideRanges),
+        cmocka_unit_test(statsdAggCapsCardinality),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
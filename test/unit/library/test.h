@@ -36,6 +36,17 @@ int writeFile(const char* path, const char* text);
 int deleteFile(const char* path);
 long fileEndPosition(const char* path);
 
+// Totals of the metrics sent by metric name and a field to match. The
+// cmdSendMetric in test.c adds each metric sent to them, and counts it.
+typedef struct {
+    const char *name;
+    const char *field;
+    const char *value;    // string value of field, or NULL for any
+    long long total;
+} expect_t;
+extern expect_t *g_expect;
+extern int g_send_metric_count;
+
 
 
 #endif //__TEST_H__
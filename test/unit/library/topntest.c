@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "topn.h"
+#include "test.h"
+
+static void
+topnCreateReturnsNonNull(void **state)
+{
+    topn_t *topn = topnCreate(8, sizeof(uint64_t));
+    assert_non_null(topn);
+    assert_int_equal(topnCount(topn), 0);
+    topnDestroy(&topn);
+    assert_null(topn);
+
+    // a value isn't needed
+    topn = topnCreate(8, 0);
+    assert_non_null(topn);
+    topnDestroy(&topn);
+}
+
+static void
+topnForNullDoesNotCrash(void **state)
+{
+    topn_entry_t entry[4];
+
+    assert_null(topnCreate(0, sizeof(uint64_t)));
+    assert_int_equal(dbgCountMatchingLines("src/topn.c"), 1);
+    dbgInit();
+
+    topnDestroy(NULL);
+    assert_null(topnAdd(NULL, "key", 1));
+    assert_int_equal(topnGet(NULL, entry, 4), 0);
+    topnReset(NULL);
+    assert_int_equal(topnCount(NULL), 0);
+    assert_int_equal(topnEvicted(NULL), 0);
+
+    topn_t *topn = topnCreate(4, sizeof(uint64_t));
+    assert_null(topnAdd(topn, NULL, 1));
+    assert_int_equal(topnGet(topn, NULL, 4), 0);
+    assert_int_equal(topnGet(topn, entry, 0), 0);
+    topnDestroy(&topn);
+}
+
+static void
+topnAddCountsEachKeyOnce(void **state)
+{
+    topn_t *topn = topnCreate(8, sizeof(uint64_t));
+
+    uint64_t *a = topnAdd(topn, "a", 1);
+    assert_non_null(a);
+    assert_int_equal(*a, 0);
+    *a += 10;
+
+    uint64_t *b = topnAdd(topn, "b", 5);
+    *b += 50;
+
+    // The same key gets the same value
+    assert_ptr_equal(topnAdd(topn, "a", 2), a);
+    assert_int_equal(*a, 10);
+    assert_int_equal(topnCount(topn), 2);
+
+    topn_entry_t entry[8];
+    assert_int_equal(topnGet(topn, entry, 8), 2);
+    assert_string_equal(entry[0].key, "b");
+    assert_int_equal(entry[0].weight, 5);
+    assert_int_equal(entry[0].error, 0);
+    assert_int_equal(*(uint64_t *)entry[0].value, 50);
+    assert_string_equal(entry[1].key, "a");
+    assert_int_equal(entry[1].weight, 3);
+    assert_int_equal(*(uint64_t *)entry[1].value, 10);
+
+    topnDestroy(&topn);
+}
+
+static void
+topnGetIsHeaviestFirst(void **state)
+{
+    topn_t *topn = topnCreate(64, 0);
+
+    // key i is added with weight (i * 7) % 50, so all weights differ
+    int i;
+    for (i = 0; i < 50; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "k%d", i);
+        topnAdd(topn, key, (i * 7) % 50 + 1);
+    }
+
+    topn_entry_t entry[10];
+    assert_int_equal(topnGet(topn, entry, 10), 10);
+    for (i = 0; i < 10; i++) {
+        assert_int_equal(entry[i].weight, 50 - i);
+    }
+
+    // Asking for more than there are gets them all
+    topn_entry_t all[64];
+    assert_int_equal(topnGet(topn, all, 64), 50);
+    assert_int_equal(all[0].weight, 50);
+    assert_int_equal(all[49].weight, 1);
+
+    topnDestroy(&topn);
+}
+
+static void
+topnHeavyKeysSurviveManyLightOnes(void **state)
+{
+    topn_t *topn = topnCreate(16, sizeof(uint64_t));
+
+    // A few heavy keys among many more light ones than there is room for
+    int i;
+    for (i = 0; i < 10000; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "/tmp/light/%d", i);
+        topnAdd(topn, key, 1);
+        if (!(i % 10)) {
+            uint64_t *count = topnAdd(topn, "/heavy/one", 3);
+            (*count)++;
+            topnAdd(topn, "/heavy/two", 2);
+        }
+    }
+
+    // The table never grows
+    assert_int_equal(topnCount(topn), 16);
+    assert_true(topnEvicted(topn) > 9000);
+
+    topn_entry_t entry[2];
+    assert_int_equal(topnGet(topn, entry, 2), 2);
+    assert_string_equal(entry[0].key, "/heavy/one");
+    assert_string_equal(entry[1].key, "/heavy/two");
+
+    // Its own weight is within the error of what's reported
+    assert_true(entry[0].weight >= 3000);
+    assert_true(entry[0].weight - entry[0].error <= 3000);
+    assert_true(entry[1].weight >= 2000);
+    assert_true(entry[1].weight - entry[1].error <= 2000);
+
+    // A key that's never taken over has all of its value
+    if (!entry[0].error) {
+        assert_int_equal(*(uint64_t *)entry[0].value, 1000);
+    }
+
+    topnDestroy(&topn);
+}
+
+static void
+topnTakenOverEntryStartsFromZero(void **state)
+{
+    topn_t *topn = topnCreate(2, sizeof(uint64_t));
+
+    uint64_t *val = topnAdd(topn, "a", 1);
+    *val = 100;
+    val = topnAdd(topn, "b", 5);
+    *val = 500;
+
+    // c takes over a, the lightest, and its weight
+    val = topnAdd(topn, "c", 1);
+    assert_non_null(val);
+    assert_int_equal(*val, 0);
+    assert_int_equal(topnEvicted(topn), 1);
+
+    topn_entry_t entry[2];
+    assert_int_equal(topnGet(topn, entry, 2), 2);
+    assert_string_equal(entry[0].key, "b");
+    assert_string_equal(entry[1].key, "c");
+    assert_int_equal(entry[1].weight, 2);
+    assert_int_equal(entry[1].error, 1);
+
+    // a was forgotten, and takes over c when it's back
+    val = topnAdd(topn, "a", 1);
+    assert_int_equal(*val, 0);
+    assert_int_equal(topnGet(topn, entry, 2), 2);
+    assert_string_equal(entry[1].key, "a");
+    assert_int_equal(entry[1].weight, 3);
+    assert_int_equal(entry[1].error, 2);
+
+    topnDestroy(&topn);
+}
+
+static void
+topnResetEmptiesTheTable(void **state)
+{
+    topn_t *topn = topnCreate(4, sizeof(uint64_t));
+
+    int i;
+    for (i = 0; i < 10; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "k%d", i);
+        topnAdd(topn, key, 1);
+    }
+    assert_int_equal(topnCount(topn), 4);
+    assert_int_equal(topnEvicted(topn), 6);
+
+    topnReset(topn);
+    assert_int_equal(topnCount(topn), 0);
+    assert_int_equal(topnEvicted(topn), 0);
+
+    topn_entry_t entry[4];
+    assert_int_equal(topnGet(topn, entry, 4), 0);
+
+    // and is as good as new
+    uint64_t *val = topnAdd(topn, "k9", 1);
+    assert_int_equal(*val, 0);
+    assert_int_equal(topnGet(topn, entry, 4), 1);
+    assert_string_equal(entry[0].key, "k9");
+    assert_int_equal(entry[0].weight, 1);
+
+    topnDestroy(&topn);
+}
+
+int
+main(int argc, char *argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(topnCreateReturnsNonNull),
+        cmocka_unit_test(topnForNullDoesNotCrash),
+        cmocka_unit_test(topnAddCountsEachKeyOnce),
+        cmocka_unit_test(topnGetIsHeaviestFirst),
+        cmocka_unit_test(topnHeavyKeysSurviveManyLightOnes),
+        cmocka_unit_test(topnTakenOverEntryStartsFromZero),
+        cmocka_unit_test(topnResetEmptiesTheTable),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
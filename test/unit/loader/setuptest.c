@@ -8,7 +8,9 @@
 #include <string.h>
 #include <sys/stat.h>
 
+#include "rulescompile.h"
 #include "setup.h"
+#include "../rulesidx.h"
 #include "test.h"
 
 /*
@@ -144,6 +146,43 @@ removeScopeCfgFile2Changes(void **state) {
     }
 }
 
+/*
+ * Assertions:
+ * The index is for the rules file it was compiled from
+ * It says whether the rules file is valid yaml, with rules
+ */
+static void
+rulesCompileIndex(void **state) {
+    struct stat st = {.st_dev = 1, .st_ino = 2, .st_size = 3};
+    void *idx = NULL;
+    size_t size = 0;
+
+    const char *rules = "allow:\n- procname: redis\ndeny:\n- procname: git\n- arg: _MatchAll_\n";
+    assert_true(rulesCompile(rules, strlen(rules), &st, &idx, &size));
+    rules_idx_hdr_t *hdr = idx;
+    assert_int_equal(hdr->magic, RULES_IDX_MAGIC);
+    assert_int_equal(hdr->version, RULES_IDX_VERSION);
+    assert_int_equal(hdr->size, size);
+    assert_int_equal(hdr->ino, 2);
+    assert_int_equal(hdr->flags, RULES_IDX_PARSED | RULES_IDX_VALID | RULES_IDX_DENY_ALL);
+    assert_int_equal(hdr->allowCount, 1);
+    assert_int_equal(hdr->denySlots, 4);
+    free(idx);
+
+    rules = "source:\n  unixSocketPath: /run/appscope.sock\n";
+    assert_true(rulesCompile(rules, strlen(rules), &st, &idx, &size));
+    hdr = idx;
+    assert_int_equal(hdr->flags, RULES_IDX_PARSED);
+    assert_string_equal((char *)idx + hdr->strOff + hdr->unixPath, "/run/appscope.sock");
+    free(idx);
+
+    rules = "allow: [redis\n";
+    assert_true(rulesCompile(rules, strlen(rules), &st, &idx, &size));
+    hdr = idx;
+    assert_int_equal(hdr->flags, 0);
+    free(idx);
+}
+
 int
 main(int argc, char* argv[]) {
     printf("running %s\n", argv[0]);
@@ -152,6 +191,7 @@ main(int argc, char* argv[]) {
         cmocka_unit_test(removeScopeCfgFile0Changes),
         cmocka_unit_test(removeScopeCfgFile1Change),
         cmocka_unit_test(removeScopeCfgFile2Changes),
+        cmocka_unit_test(rulesCompileIndex),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
 }
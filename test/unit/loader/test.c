@@ -7,6 +7,41 @@
 unsigned long g_libscopesz;
 unsigned long g_scopedynsz;
 
+/*
+* The rules compiler uses libyaml, whose allocations are renamed to
+* scopelibc_* and wrapped when tests are built with the address
+* sanitizer (see test/unit/library/test.c). They go to the standard
+* library's allocator here too.
+*/
+#if defined(__has_feature)
+# if __has_feature(address_sanitizer)
+#  define __SANITIZE_ADDRESS__ 1
+# endif
+#endif
+
+#ifdef __SANITIZE_ADDRESS__
+#include <stdlib.h>
+void * __wrap_scopelibc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void __wrap_scopelibc_free(void * ptr)
+{
+    return free(ptr);
+}
+
+void * __wrap_scopelibc_calloc(size_t nelem, size_t size)
+{
+    return calloc(nelem, size);
+}
+
+void * __wrap_scopelibc_realloc(void * ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+#endif
+
 int
 groupSetup(void** state)
 {